@@ -24,6 +24,122 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/training-graph-compiler.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+/// Holds one TrainingGraphCompiler per concurrently running task, so that
+/// each compiler (with its lexicon-side TableComposeCache) is re-used across
+/// the utterances, but is never used by two threads at once.  The compilers
+/// are created on demand, each with its own copy of the lexicon.
+class TrainingGraphCompilerPool {
+ public:
+  TrainingGraphCompilerPool(const TransitionModel &trans_model,
+                            const ContextDependency &ctx_dep,
+                            fst::VectorFst<fst::StdArc> *lex_fst,  // takes ownership
+                            const std::vector<int32> &disambig_syms,
+                            const TrainingGraphCompilerOptions &opts):
+      trans_model_(trans_model), ctx_dep_(ctx_dep), lex_fst_(lex_fst),
+      disambig_syms_(disambig_syms), opts_(opts) { }
+
+  ~TrainingGraphCompilerPool() {
+    KALDI_ASSERT(free_.size() == compilers_.size());
+    DeletePointers(&compilers_);
+    delete lex_fst_;
+  }
+
+  /// Returns a compiler which is not used by other threads,
+  TrainingGraphCompiler *Get() {
+    mutex_.Lock();
+    if (!free_.empty()) {
+      TrainingGraphCompiler *gc = free_.back();
+      free_.pop_back();
+      mutex_.Unlock();
+      return gc;
+    }
+    mutex_.Unlock();
+    // the new compiler takes ownership of the copy of the lexicon,
+    TrainingGraphCompiler *gc = new TrainingGraphCompiler(
+        trans_model_, ctx_dep_, new fst::VectorFst<fst::StdArc>(*lex_fst_),
+        disambig_syms_, opts_);
+    mutex_.Lock();
+    compilers_.push_back(gc);
+    mutex_.Unlock();
+    return gc;
+  }
+
+  /// Gives the compiler back to the pool,
+  void Release(TrainingGraphCompiler *gc) {
+    mutex_.Lock();
+    free_.push_back(gc);
+    mutex_.Unlock();
+  }
+
+  int32 NumCompilers() const { return compilers_.size(); }
+
+ private:
+  const TransitionModel &trans_model_;
+  const ContextDependency &ctx_dep_;
+  const fst::VectorFst<fst::StdArc> *lex_fst_;
+  std::vector<int32> disambig_syms_;
+  TrainingGraphCompilerOptions opts_;
+  Mutex mutex_;
+  std::vector<TrainingGraphCompiler*> compilers_;  // all the compilers
+  std::vector<TrainingGraphCompiler*> free_;  // compilers not in use
+};
+
+
+/// Compiles the graph of one utterance, the graph is written by the
+/// destructor (TaskSequencer calls the destructors in the input order).
+class CompileGraphClass {
+ public:
+  CompileGraphClass(TrainingGraphCompilerPool *pool,
+                    const std::string &key,
+                    fst::VectorFst<fst::StdArc> *grammar,  // takes ownership
+                    BaseFloat transcript_beam,
+                    TableWriter<fst::VectorFstHolder> *fst_writer,
+                    int32 *num_succeed, int32 *num_fail):
+      pool_(pool), key_(key), grammar_(grammar),
+      transcript_beam_(transcript_beam), fst_writer_(fst_writer),
+      num_succeed_(num_succeed), num_fail_(num_fail) { }
+
+  void operator () () {
+    if (transcript_beam_ > 0.0) {
+      // remove the unlikely paths of the probabilistic transcript,
+      fst::Prune(grammar_, fst::TropicalWeight(transcript_beam_));
+    }
+    if (grammar_->Start() == fst::kNoStateId) return;  // empty grammar
+    TrainingGraphCompiler *gc = pool_->Get();
+    if (!gc->CompileGraph(*grammar_, &decode_fst_)) {
+      decode_fst_.DeleteStates();  // Just make it empty.
+    }
+    pool_->Release(gc);
+  }
+
+  ~CompileGraphClass() {
+    if (decode_fst_.Start() != fst::kNoStateId) {
+      (*num_succeed_)++;
+      fst_writer_->Write(key_, decode_fst_);
+    } else {
+      KALDI_WARN << "Empty decoding graph for utterance "
+                 << key_;
+      (*num_fail_)++;
+    }
+    delete grammar_;
+  }
+
+ private:
+  TrainingGraphCompilerPool *pool_;
+  std::string key_;
+  fst::VectorFst<fst::StdArc> *grammar_;
+  BaseFloat transcript_beam_;
+  TableWriter<fst::VectorFstHolder> *fst_writer_;
+  int32 *num_succeed_, *num_fail_;
+  fst::VectorFst<fst::StdArc> decode_fst_;
+};
+
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -43,6 +159,8 @@ int main(int argc, char *argv[]) {
         "of disambiguation symbols.\n"
         "Warning: you probably want to set the --transition-scale and --self-loop-scale\n"
         "options; the defaults (zero) are probably not appropriate.\n"
+        "With --num-threads > 1 the graphs are compiled in parallel (the output\n"
+        "order is preserved).\n"
         "Usage:   compile-train-graphs-fsts [options] <tree-in> <model-in> <lexicon-fst-in> "
         " <graphs-rspecifier> <graphs-wspecifier>\n"
         "e.g.: \n"
@@ -56,13 +174,19 @@ int main(int argc, char *argv[]) {
     // transition probs in the alignment phase (since they change each time)
     gopts.self_loop_scale = 0.0;  // Ditto for self-loop probs.
     std::string disambig_rxfilename;
+    BaseFloat transcript_beam = 0.0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     gopts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Register("batch-size", &batch_size,
                 "Number of FSTs to compile at a time (more -> faster but uses "
                 "more memory.  E.g. 500");
     po.Register("read-disambig-syms", &disambig_rxfilename, "File containing "
                 "list of disambiguation symbols in phone symbol table");
+    po.Register("transcript-beam", &transcript_beam, "If >0, prune each "
+                "utterance grammar (probabilistic transcript) with this beam "
+                "before the composition");
     
     po.Read(argc, argv);
 
@@ -103,41 +227,36 @@ int main(int argc, char *argv[]) {
                  << "typically necessary when compiling graphs from FSTs (i.e. "
                  << "supply L_disambig.fst and the list of disambig syms with\n"
                  << "--read-disambig-syms)";
-    TrainingGraphCompiler gc(trans_model, ctx_dep, lex_fst, disambig_syms, gopts);
+    TrainingGraphCompilerPool gc_pool(trans_model, ctx_dep, lex_fst,
+                                      disambig_syms, gopts);
 
-    lex_fst = NULL;  // we gave ownership to gc.
+    lex_fst = NULL;  // we gave ownership to gc_pool.
 
     //SequentialTableReader<fst::VectorFstHolder> fst_reader(fsts_rspecifier);
     SequentialTokenVectorReader fst_reader(fsts_rspecifier);
     TableWriter<fst::VectorFstHolder> fst_writer(fsts_wspecifier);
     
-    int num_succeed = 0, num_fail = 0;
+    int32 num_succeed = 0, num_fail = 0;
 
     if (batch_size == 1) {  // We treat batch_size of 1 as a special case in order
       // to test more parts of the code.
+      TaskSequencer<CompileGraphClass> sequencer(sequencer_config);
       for (; !fst_reader.Done(); fst_reader.Next()) {
         std::string key = fst_reader.Key();
         //const VectorFst<StdArc> &grammar = fst_reader.Value(); // weighted
         const std::vector<std::string> &fst_path = fst_reader.Value(); // weighted
 
-        VectorFst<StdArc> &grammar = *fst::ReadFstKaldi(fst_path[0]); 
-        KALDI_LOG << fst_path[0] << "\n";
-
         // grammar for this utterance.
-        VectorFst<StdArc> decode_fst;
+        VectorFst<StdArc> *grammar = fst::ReadFstKaldi(fst_path[0]);
+        KALDI_LOG << fst_path[0] << "\n";
 
-        if (!gc.CompileGraph(grammar, &decode_fst)) {
-          decode_fst.DeleteStates();  // Just make it empty.
-        }
-        if (decode_fst.Start() != fst::kNoStateId) {
-          num_succeed++;
-          fst_writer.Write(key, decode_fst);
-        } else {
-          KALDI_WARN << "Empty decoding graph for utterance "
-                     << key;
-          num_fail++;
-        }
+        sequencer.Run(new CompileGraphClass(&gc_pool, key, grammar,
+                                            transcript_beam, &fst_writer,
+                                            &num_succeed, &num_fail));
+        // takes ownership of "grammar", the task is deleted when done.
       }
+      sequencer.Wait();
+      KALDI_LOG << "Used " << gc_pool.NumCompilers() << " graph compilers.";
     } else {
       /*
       std::vector<std::string> keys;
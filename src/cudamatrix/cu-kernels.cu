@@ -1115,6 +1115,13 @@ static void _pvec_sum(Real* v, Real* g, int dim, int size) {
 
 
 
+template<typename Real>
+__global__
+static void _vec_equal_element_mask(Real *v, const int32_cuda *a, const int32_cuda *b, int dim) {
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < dim) v[i] = (a[i] == b[i] ? 1.0 : 0.0);
+}
+
 template<typename Real>
 __global__
 static void _vec_apply_floor(Real *v, Real floor_val, float *count, int dim) {
@@ -1911,6 +1918,17 @@ static void _diff_xent(const int32_cuda* vec_tgt, Real* mat_net_out, Real* vec_l
 }
 
 
+template<typename Real>
+__global__
+static void _add_to_elements(Real alpha, Real* mat, const int32_cuda* elements, MatrixDim d) {
+  int32_cuda i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < d.rows) {
+    int32_cuda j = elements[i];
+    if (j >= 0) mat[i*d.stride + j] += alpha;
+  }
+}
+
+
 
 /***********************************************************************
  * ANSI-C wrappers of CUDA kernels
@@ -2185,6 +2203,10 @@ void cudaF_vec_apply_floor(int Gr, int Bl, float* v, float floor_val, float *cou
   _vec_apply_floor<<<Gr,Bl>>>(v,floor_val,count,dim);
 }
 
+void cudaF_vec_equal_element_mask(int Gr, int Bl, float* v, const int32_cuda* a, const int32_cuda* b, int dim) {
+  _vec_equal_element_mask<<<Gr,Bl>>>(v,a,b,dim);
+}
+
 void cudaF_vec_apply_exp(int Gr, int Bl, float* v, int dim) {
   _vec_apply_exp<<<Gr,Bl>>>(v,dim);
 }
@@ -2303,6 +2325,10 @@ void cudaF_diff_xent(dim3 Gr, dim3 Bl, const int32_cuda* vec_tgt, float* mat_net
   _diff_xent<<<Gr,Bl>>>(vec_tgt,mat_net_out,vec_log_post,d);
 }
 
+void cudaF_add_to_elements(int Gr, int Bl, float alpha, float* mat, const int32_cuda* elements, MatrixDim d) {
+  _add_to_elements<<<Gr,Bl>>>(alpha,mat,elements,d);
+}
+
 void cudaF_copy_rows_from_vec(dim3 Gr, dim3 Bl, float *mat_out, MatrixDim d_out, const float *v_in) {
   _copy_rows_from_vec<<<Gr,Bl>>>(mat_out, d_out, v_in);
 }
@@ -2597,6 +2623,10 @@ void cudaD_vec_apply_floor(int Gr, int Bl, double* v, double floor_val, float *c
   _vec_apply_floor<<<Gr,Bl>>>(v,floor_val,count,dim);
 }
 
+void cudaD_vec_equal_element_mask(int Gr, int Bl, double* v, const int32_cuda* a, const int32_cuda* b, int dim) {
+  _vec_equal_element_mask<<<Gr,Bl>>>(v,a,b,dim);
+}
+
 void cudaD_vec_apply_exp(int Gr, int Bl, double* v, int dim) {
   _vec_apply_exp<<<Gr,Bl>>>(v,dim);
 }
@@ -2713,6 +2743,10 @@ void cudaD_diff_xent(dim3 Gr, dim3 Bl, const int32_cuda* vec_tgt, double* mat_ne
   _diff_xent<<<Gr,Bl>>>(vec_tgt,mat_net_out,vec_log_post,d);
 }
 
+void cudaD_add_to_elements(int Gr, int Bl, double alpha, double* mat, const int32_cuda* elements, MatrixDim d) {
+  _add_to_elements<<<Gr,Bl>>>(alpha,mat,elements,d);
+}
+
 void cudaD_copy_rows_from_vec(dim3 Gr, dim3 Bl, double *mat_out, MatrixDim d_out, const double *v_in) {
   _copy_rows_from_vec<<<Gr,Bl>>>(mat_out, d_out, v_in);
 }
@@ -1634,6 +1634,29 @@ static void UnitTestCuDiffXent() {
   AssertEqual(Hlogpost,Hlogpost2);
 }
 
+template<typename Real> 
+static void UnitTestCuMatrixAddToElements() {
+  int32 X=100, Y=111;
+  Matrix<Real> Hi(X,Y);
+  Hi.SetRandn();
+  CuMatrix<Real> Di(Hi);
+  // target vector, some rows skipped,
+  std::vector<int32> Helem(X);
+  for(int32 i=0; i<X; i++) {
+    Helem[i] = (i % 7 == 0 ? -1 : Rand()%Y);
+  }
+  CuArray<int32> Delem(Helem);
+  Real alpha = 0.5;
+  //gpu
+  Di.AddToElements(alpha, Delem);
+  //cpu
+  for(MatrixIndexT r=0; r<Hi.NumRows(); r++) {
+    if (Helem[r] >= 0) Hi(r, Helem[r]) += alpha;
+  }
+  Matrix<Real> Hi2(Di);
+  AssertEqual(Hi,Hi2);
+}
+
 template<typename Real> void UnitTestCheck() {
   Matrix<Real> Hi(100,111);
   Hi.SetRandn();
@@ -2078,6 +2101,7 @@ template<typename Real> void CudaMatrixUnitTest() {
   UnitTestCuSoftmax<Real>();
   UnitTestCuLogSoftmax<Real>();
   UnitTestCuDiffXent<Real>();
+  UnitTestCuMatrixAddToElements<Real>();
   UnitTestCheck<Real>();
   UnitTestSwapCu2Cu<Real>();
   UnitTestSwapCu2M<Real>();
@@ -1215,11 +1215,7 @@ void CuMatrixBase<Real>::ApplySoftMaxPerRow(const CuMatrixBase<Real> &src) {
   } else
   #endif
   {
-    MatrixBase<Real> &mat(this->Mat());
-    mat.CopyFromMat(src.Mat());
-    for(MatrixIndexT r = 0; r < mat.NumRows(); r++) {
-      mat.Row(r).ApplySoftMax();
-    }
+    Mat().SoftMaxPerRow(src.Mat());
   }
 }
 
@@ -1239,11 +1235,7 @@ void CuMatrixBase<Real>::ApplyLogSoftMaxPerRow(const CuMatrixBase<Real> &src) {
   } else
 #endif
   {
-    MatrixBase<Real> &mat(this->Mat());
-    mat.CopyFromMat(src.Mat());
-    for(MatrixIndexT r = 0; r < mat.NumRows(); r++) {
-      mat.Row(r).ApplyLogSoftMax();
-    }
+    Mat().LogSoftMaxPerRow(src.Mat());
   }
 }
 
@@ -1406,6 +1398,32 @@ void CuMatrixBase<Real>::DiffXent(const CuArray<int32> &tgt,
 }
 
 
+template<typename Real>
+void CuMatrixBase<Real>::AddToElements(Real alpha, const CuArray<int32> &elements) {
+  KALDI_ASSERT(elements.Dim() == num_rows_);
+#if HAVE_CUDA == 1 
+  if (CuDevice::Instantiate().Enabled()) {
+    Timer tim;
+
+    int dimBlock(CU1DBLOCK);
+    int dimGrid(n_blocks(num_rows_, CU1DBLOCK));
+    cuda_add_to_elements(dimGrid, dimBlock, alpha, data_, elements.Data(), Dim());
+    CU_SAFE_CALL(cudaGetLastError());
+
+    CuDevice::Instantiate().AccuProfile(__func__, tim.Elapsed());
+  } else
+#endif
+  {
+    MatrixBase<Real> &this_mat = Mat();
+    const int32 *row_to_col = elements.Data();
+    for (int32 r = 0; r < num_rows_; r++) {
+      KALDI_ASSERT(row_to_col[r] >= -1 && row_to_col[r] < num_cols_);
+      if (row_to_col[r] >= 0) this_mat(r, row_to_col[r]) += alpha;
+    }
+  }
+}
+
+
 template<typename Real>
 void CuMatrixBase<Real>::Cholesky(CuMatrixBase<Real> *inv_cholesky) {
   KALDI_ASSERT(this->NumRows() == this->NumCols());
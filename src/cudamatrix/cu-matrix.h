@@ -224,6 +224,10 @@ class CuMatrixBase {
   void DiffXent(const CuArray<int32> &tgt,
                 CuVector<Real> *log_post_tgt);  
 
+  /// For each row r, adds alpha to the element (r, elements[r]),
+  /// rows with elements[r] == -1 are skipped (all on GPU, no host copies).
+  void AddToElements(Real alpha, const CuArray<int32> &elements);
+
   /// This function does sets *this to the Cholesky factor of *this (i.e.  the C
   /// satisfying *this = C C^T), and sets "inv_cholesky" (if supplied) to its
   /// inverse.  *this is treated as a symmetric matrix but only the lower triangle
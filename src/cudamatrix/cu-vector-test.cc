@@ -293,6 +293,24 @@ template<typename Real> void CuVectorUnitTestSum() {
   }
 }
 
+template<typename Real> void CuVectorUnitTestSetEqualElementMask() {
+  for (int32 i = 0; i < 4; i++) {
+    int32 dim = 100 + Rand() % 400;
+    std::vector<int32> a(dim), b(dim);
+    Vector<Real> mask_ref(dim);
+    for (int32 j = 0; j < dim; j++) {
+      a[j] = Rand() % 5;
+      b[j] = Rand() % 5;
+      mask_ref(j) = (a[j] == b[j] ? 1.0 : 0.0);
+    }
+    CuArray<int32> cu_a(a), cu_b(b);
+    CuVector<Real> mask(dim);
+    mask.SetEqualElementMask(cu_a, cu_b);
+    Vector<Real> mask2(mask);
+    AssertEqual(mask_ref, mask2);
+  }
+}
+
 template<typename Real> void CuVectorUnitTestScale() {
   for (int32 i = 0; i < 4; i++) {
     int32 dim = 100 + 400 % Rand();
@@ -673,6 +691,7 @@ template<typename Real> void CuVectorUnitTest() {
   CuVectorUnitTestApproxEqual<Real>();
   CuVectorUnitTestScale<Real>();
   CuVectorUnitTestSum<Real>();
+  CuVectorUnitTestSetEqualElementMask<Real>();
   CuVectorUnitTestInvertElements<Real>();
   CuVectorUnitTestAddRowSumMat<Real>();
   CuVectorUnitTestAddColSumMat<Real>();
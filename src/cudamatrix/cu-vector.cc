@@ -320,6 +320,29 @@ MatrixIndexT CuVectorBase<Real>::ApplyFloor(Real floor_val) {
 
 }
 
+template<typename Real>
+void CuVectorBase<Real>::SetEqualElementMask(const CuArray<int32> &a,
+                                             const CuArray<int32> &b) {
+  KALDI_ASSERT(a.Dim() == dim_ && b.Dim() == dim_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    if (dim_ == 0) return;
+    Timer tim;
+    int dimBlock(CU1DBLOCK);
+    int dimGrid(n_blocks(dim_, CU1DBLOCK));
+    cuda_vec_equal_element_mask(dimGrid, dimBlock, data_, a.Data(), b.Data(), dim_);
+    CU_SAFE_CALL(cudaGetLastError());
+    CuDevice::Instantiate().AccuProfile("CuVectorBase::SetEqualElementMask", tim.Elapsed());
+  } else
+#endif
+  {
+    const int32 *a_data = a.Data(), *b_data = b.Data();
+    for (MatrixIndexT i = 0; i < dim_; i++) {
+      data_[i] = (a_data[i] == b_data[i] ? 1.0 : 0.0);
+    }
+  }
+}
+
 template<typename Real>
 void CuVectorBase<Real>::ApplyCeiling(Real ceiling_val) {
 #if HAVE_CUDA == 1
@@ -122,6 +122,8 @@ class CuVectorBase {
   void ApplyExp();
   void ApplyLog();
   MatrixIndexT ApplyFloor(Real floor_val);
+  /// Sets (*this)(i) = (a[i] == b[i] ? 1.0 : 0.0), e.g. to count matching argmax ids,
+  void SetEqualElementMask(const CuArray<int32> &a, const CuArray<int32> &b);
   void ApplyCeiling(Real ceiling_val);
   void ApplyPow(Real power);
   Real Sum() const;
@@ -0,0 +1,143 @@
+// feat/feature-pipeline-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+
+#include "feat/feature-pipeline.h"
+#include "feat/feature-functions.h"
+#include "transform/cmvn.h"
+
+namespace kaldi {
+
+// Compares the pipeline with the functions called by the programs, on
+// archives of random features, CMVN stats and transforms.
+void UnitTestFeaturePipeline() {
+  int32 num_utts = 5, dim = 2 + Rand() % 10;
+  std::vector<std::string> utts;
+  std::vector<Matrix<BaseFloat> > feats(num_utts);
+  {
+    BaseFloatMatrixWriter feats_writer("ark:tmpf.feats");
+    DoubleMatrixWriter cmvn_writer("ark:tmpf.cmvn");
+    BaseFloatMatrixWriter trans_writer("ark:tmpf.trans");
+    for (int32 i = 0; i < num_utts; i++) {
+      std::ostringstream os;
+      os << "utt" << i;
+      utts.push_back(os.str());
+      feats[i].Resize(10 + Rand() % 20, dim);
+      feats[i].SetRandn();
+      feats_writer.Write(utts[i], feats[i]);
+      if (i == 2) continue;  // no stats: skipped.
+      Matrix<double> stats;
+      InitCmvnStats(dim, &stats);
+      AccCmvnStats(feats[i], NULL, &stats);
+      cmvn_writer.Write(utts[i], stats);
+      Matrix<BaseFloat> trans(dim * 3 * 3, dim * 3 * 3 + 1);
+      trans.SetRandn();
+      trans_writer.Write(utts[i], trans);
+    }
+  }
+  std::string spec = "pipeline:ark:tmpf.feats | apply-cmvn --norm-vars=true "
+      "ark:tmpf.cmvn | add-deltas --delta-order=2 | splice-feats "
+      "--left-context=1 --right-context=1 | transform-feats ark:tmpf.trans";
+  KALDI_ASSERT(IsFeaturePipelineSpec(spec));
+  KALDI_ASSERT(!IsFeaturePipelineSpec("ark:tmpf.feats"));
+
+  RandomAccessDoubleMatrixReader cmvn_reader("ark:tmpf.cmvn");
+  RandomAccessBaseFloatMatrixReader trans_reader("ark:tmpf.trans");
+  SequentialFeatureReader reader(spec);
+  int32 i = 0;
+  for (; !reader.Done(); reader.Next(), i++) {
+    if (i == 2) i++;
+    KALDI_ASSERT(reader.Key() == utts[i]);
+    Matrix<BaseFloat> ref(feats[i]), deltas, spliced;
+    ApplyCmvn(cmvn_reader.Value(utts[i]), true, &ref);
+    DeltaFeaturesOptions delta_opts;
+    ComputeDeltas(delta_opts, ref, &deltas);
+    SpliceFrames(deltas, 1, 1, &spliced);
+    const Matrix<BaseFloat> &trans = trans_reader.Value(utts[i]);
+    ref.Resize(spliced.NumRows(), trans.NumRows());
+    ref.AddMatMat(1.0, spliced, kNoTrans,
+                  SubMatrix<BaseFloat>(trans, 0, trans.NumRows(),
+                                       0, spliced.NumCols()),
+                  kTrans, 0.0);
+    Vector<BaseFloat> offset(trans.NumRows());
+    offset.CopyColFromMat(trans, spliced.NumCols());
+    ref.AddVecToRows(1.0, offset);
+    AssertEqual(ref, reader.Value());
+  }
+  KALDI_ASSERT(i == num_utts);
+  KALDI_ASSERT(reader.Close());
+
+  // with no stages, it reads the rspecifier.
+  SequentialFeatureReader plain_reader("pipeline:ark:tmpf.feats");
+  for (i = 0; !plain_reader.Done(); plain_reader.Next(), i++)
+    AssertEqual(feats[i], plain_reader.Value());
+  KALDI_ASSERT(i == num_utts);
+
+  // a command as the input rspecifier, (its '|' is not a stage separator)
+  SequentialFeatureReader cmd_reader("pipeline:ark:cat tmpf.feats | | add-deltas");
+  for (i = 0; !cmd_reader.Done(); cmd_reader.Next(), i++) {
+    Matrix<BaseFloat> deltas;
+    ComputeDeltas(DeltaFeaturesOptions(), feats[i], &deltas);
+    AssertEqual(deltas, cmd_reader.Value());
+  }
+  KALDI_ASSERT(i == num_utts);
+
+  std::remove("tmpf.feats");
+  std::remove("tmpf.cmvn");
+  std::remove("tmpf.trans");
+}
+
+// The invalid specs are rejected, (not silently read in a different way).
+void UnitTestFeaturePipelineErrors() {
+  {
+    BaseFloatMatrixWriter feats_writer("ark:tmpf.feats");
+    Matrix<BaseFloat> feats(10, 3);
+    feats_writer.Write("utt0", feats);
+    Matrix<BaseFloat> trans(3, 3);
+    trans.SetUnit();
+    WriteKaldiObject(trans, "tmpf.mat", false);
+  }
+  const char *specs[] = {
+    "pipeline:ark:tmpf.feats | add-delta",  // misspelled stage,
+    "pipeline:ark:tmpf.feats | add-deltas | compute-cmvn-stats",  // not a stage,
+    "pipeline:ark:tmpf.feats | add-deltas |",  // empty stage,
+    "pipeline:ark:tmpf.feats | transform-feats --utt2spk=ark:tmpf.u2s tmpf.mat"
+  };
+  for (size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); i++) {
+    bool threw = false;
+    try {
+      SequentialFeatureReader reader(specs[i]);
+    } catch (...) {
+      threw = true;
+    }
+    KALDI_ASSERT(threw);
+  }
+  std::remove("tmpf.feats");
+  std::remove("tmpf.mat");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++)
+    UnitTestFeaturePipeline();
+  UnitTestFeaturePipelineErrors();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,442 @@
+// feat/feature-pipeline.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "feat/feature-pipeline.h"
+#include "feat/feature-functions.h"
+#include "transform/cmvn.h"
+#include "util/simple-options.h"
+
+namespace kaldi {
+
+namespace {
+
+const char *kPipelinePrefix = "pipeline:";
+
+bool IsStageName(const std::string &name) {
+  return (name == "apply-cmvn" || name == "add-deltas" ||
+          name == "splice-feats" || name == "transform-feats");
+}
+
+// Returns the first word after position 'pos' of 'spec' ("" if none).
+std::string WordAfter(const std::string &spec, size_t pos) {
+  size_t begin = spec.find_first_not_of(" \t", pos + 1);
+  if (begin == std::string::npos) return "";
+  size_t end = spec.find_first_of(" \t|", begin);
+  return spec.substr(begin, end == std::string::npos ? end : end - begin);
+}
+
+// Splits the spec (without "pipeline:") into the input rspecifier and the
+// stages.  The stages are separated by '|' followed by the name of a stage,
+// other '|' characters belong to the input rspecifier (e.g. "ark:cmd |"),
+// which then has to end with '|'; so an unknown word after a '|' (e.g. a
+// misspelled stage) is an error, it is not appended to the rspecifier.
+void SplitPipelineSpec(const std::string &spec, std::string *rspecifier,
+                       std::vector<std::string> *stages) {
+  std::vector<size_t> bars;
+  for (size_t pos = spec.find('|'); pos != std::string::npos;
+       pos = spec.find('|', pos + 1)) {
+    std::string name = WordAfter(spec, pos);
+    if (IsStageName(name))
+      bars.push_back(pos);
+    else if (!bars.empty())
+      KALDI_ERR << "Unknown stage '" << name << "' in the feature pipeline "
+                << spec << " (the stages are apply-cmvn, add-deltas, "
+                << "splice-feats, transform-feats)";
+  }
+  bars.push_back(spec.size());
+  *rspecifier = spec.substr(0, bars[0]);
+  Trim(rspecifier);
+  size_t last_bar = rspecifier->rfind('|');
+  if (last_bar != std::string::npos && last_bar + 1 != rspecifier->size())
+    KALDI_ERR << "Unknown stage '" << WordAfter(*rspecifier, last_bar)
+              << "' in the feature pipeline " << spec << " (the stages are "
+              << "apply-cmvn, add-deltas, splice-feats, transform-feats; "
+              << "a command as the input rspecifier ends with '|')";
+  stages->clear();
+  for (size_t i = 0; i + 1 < bars.size(); i++) {
+    stages->push_back(spec.substr(bars[i] + 1, bars[i + 1] - bars[i] - 1));
+    Trim(&stages->back());
+  }
+}
+
+// Sets the registered options from the "--name=value" arguments of a stage,
+// (a bool option may be given as "--name"), and outputs the other arguments.
+void ParseStageArgs(const std::string &stage,
+                    const std::vector<std::string> &args,
+                    SimpleOptions *opts,
+                    std::vector<std::string> *positional) {
+  for (size_t i = 0; i < args.size(); i++) {
+    const std::string &arg = args[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      positional->push_back(arg);
+      continue;
+    }
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(2, (eq == std::string::npos ?
+                                     std::string::npos : eq - 2)),
+        value = (eq == std::string::npos ? "true" : arg.substr(eq + 1));
+    for (size_t j = 0; j < key.size(); j++)
+      if (key[j] == '_') key[j] = '-';
+    SimpleOptions::OptionType type;
+    bool ok = opts->GetOptionType(key, &type);
+    if (ok) {
+      switch (type) {
+        case SimpleOptions::kBool:
+          ok = (value == "true" || value == "false") &&
+              opts->SetOption(key, (value == "true"));
+          break;
+        case SimpleOptions::kInt32: {
+          int32 i;
+          ok = ConvertStringToInteger(value, &i) && opts->SetOption(key, i);
+          break;
+        }
+        case SimpleOptions::kUint32: {
+          uint32 u;
+          ok = ConvertStringToInteger(value, &u) && opts->SetOption(key, u);
+          break;
+        }
+        case SimpleOptions::kFloat: {
+          float f;
+          ok = ConvertStringToReal(value, &f) && opts->SetOption(key, f);
+          break;
+        }
+        case SimpleOptions::kDouble: {
+          double d;
+          ok = ConvertStringToReal(value, &d) && opts->SetOption(key, d);
+          break;
+        }
+        case SimpleOptions::kString:
+          ok = opts->SetOption(key, value);
+          break;
+      }
+    }
+    if (!ok)
+      KALDI_ERR << "Invalid option " << arg << " of the feature-pipeline stage "
+                << stage;
+  }
+}
+
+
+// "apply-cmvn", as featbin/apply-cmvn.cc.
+class CmvnStage: public FeaturePipelineStage {
+ public:
+  explicit CmvnStage(const std::vector<std::string> &args):
+      norm_vars_(false), norm_means_(true), reverse_(false) {
+    SimpleOptions opts;
+    std::string utt2spk_rspecifier, skip_dims_str;
+    opts.Register("utt2spk", &utt2spk_rspecifier,
+                  "rspecifier for utterance to speaker map");
+    opts.Register("norm-vars", &norm_vars_, "If true, normalize variances.");
+    opts.Register("norm-means", &norm_means_, "If false, no mean normalization.");
+    opts.Register("skip-dims", &skip_dims_str, "Dimensions for which to skip "
+                  "normalization: colon-separated list of integers");
+    opts.Register("reverse", &reverse_, "If true, apply CMVN in a reverse sense");
+    std::vector<std::string> positional;
+    ParseStageArgs("apply-cmvn", args, &opts, &positional);
+    if (positional.size() != 1)
+      KALDI_ERR << "apply-cmvn stage expects one argument, "
+                << "(<cmvn-stats-rspecifier>|<cmvn-stats-rxfilename>)";
+    if (norm_vars_ && !norm_means_)
+      KALDI_ERR << "You cannot normalize the variance but not the mean.";
+    if (!SplitStringToIntegers(skip_dims_str, ":", false, &skip_dims_))
+      KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
+                << "integers)";
+    global_ = (ClassifyRspecifier(positional[0], NULL, NULL) == kNoRspecifier);
+    if (global_) {
+      if (utt2spk_rspecifier != "")
+        KALDI_ERR << "--utt2spk option not compatible with rxfilename as input "
+                  << "(did you forget ark:?)";
+      ReadKaldiObject(positional[0], &global_stats_);
+      if (!skip_dims_.empty())
+        FakeStatsForSomeDims(skip_dims_, &global_stats_);
+    } else if (!cmvn_reader_.Open(positional[0], utt2spk_rspecifier)) {
+      KALDI_ERR << "Problem opening CMVN stats with rspecifier "
+                << positional[0] << " and utt2spk rspecifier "
+                << utt2spk_rspecifier;
+    }
+  }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats,
+                     Matrix<BaseFloat> *buffer) {
+    if (!norm_means_) return true;
+    const Matrix<double> *stats = &global_stats_;
+    if (!global_) {
+      if (!cmvn_reader_.HasKey(utt)) {
+        KALDI_WARN << "No normalization statistics available for key "
+                   << utt << ", producing no output for this utterance";
+        return false;
+      }
+      stats = &cmvn_reader_.Value(utt);
+      if (!skip_dims_.empty()) {
+        stats_ = *stats;
+        FakeStatsForSomeDims(skip_dims_, &stats_);
+        stats = &stats_;
+      }
+    }
+    if (reverse_) ApplyCmvnReverse(*stats, norm_vars_, feats);
+    else ApplyCmvn(*stats, norm_vars_, feats);
+    return true;
+  }
+
+ private:
+  bool norm_vars_, norm_means_, reverse_;
+  std::vector<int32> skip_dims_;
+  bool global_;
+  Matrix<double> global_stats_;
+  RandomAccessDoubleMatrixReaderMapped cmvn_reader_;
+  Matrix<double> stats_;  // (per-utterance stats with the skipped dims)
+};
+
+
+// "add-deltas", as featbin/add-deltas.cc.
+class DeltaStage: public FeaturePipelineStage {
+ public:
+  explicit DeltaStage(const std::vector<std::string> &args): truncate_(0) {
+    SimpleOptions opts;
+    opts.Register("truncate", &truncate_,
+                  "If nonzero, first truncate features to this dimension.");
+    delta_opts_.Register(&opts);
+    std::vector<std::string> positional;
+    ParseStageArgs("add-deltas", args, &opts, &positional);
+    if (!positional.empty())
+      KALDI_ERR << "add-deltas stage has no arguments, got " << positional[0];
+  }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats,
+                     Matrix<BaseFloat> *buffer) {
+    if (feats->NumRows() == 0) {
+      KALDI_WARN << "Empty feature matrix for key " << utt;
+      return false;
+    }
+    if (truncate_ != 0) {
+      if (truncate_ > feats->NumCols())
+        KALDI_ERR << "Cannot truncate features as dimension " << feats->NumCols()
+                  << " is smaller than truncation dimension.";
+      SubMatrix<BaseFloat> feats_sub(*feats, 0, feats->NumRows(), 0, truncate_);
+      ComputeDeltas(delta_opts_, feats_sub, buffer);
+    } else {
+      ComputeDeltas(delta_opts_, *feats, buffer);
+    }
+    feats->Swap(buffer);
+    return true;
+  }
+
+ private:
+  DeltaFeaturesOptions delta_opts_;
+  int32 truncate_;
+};
+
+
+// "splice-feats", as featbin/splice-feats.cc.
+class SpliceStage: public FeaturePipelineStage {
+ public:
+  explicit SpliceStage(const std::vector<std::string> &args):
+      left_context_(4), right_context_(4) {
+    SimpleOptions opts;
+    opts.Register("left-context", &left_context_,
+                  "Number of frames of left context");
+    opts.Register("right-context", &right_context_,
+                  "Number of frames of right context");
+    std::vector<std::string> positional;
+    ParseStageArgs("splice-feats", args, &opts, &positional);
+    if (!positional.empty())
+      KALDI_ERR << "splice-feats stage has no arguments, got " << positional[0];
+  }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats,
+                     Matrix<BaseFloat> *buffer) {
+    SpliceFrames(*feats, left_context_, right_context_, buffer);
+    feats->Swap(buffer);
+    return true;
+  }
+
+ private:
+  int32 left_context_, right_context_;
+};
+
+
+// "transform-feats", as featbin/transform-feats.cc (without the logdet
+// statistics).
+class TransformStage: public FeaturePipelineStage {
+ public:
+  explicit TransformStage(const std::vector<std::string> &args) {
+    SimpleOptions opts;
+    std::string utt2spk_rspecifier;
+    opts.Register("utt2spk", &utt2spk_rspecifier,
+                  "rspecifier for utterance to speaker map");
+    std::vector<std::string> positional;
+    ParseStageArgs("transform-feats", args, &opts, &positional);
+    if (positional.size() != 1)
+      KALDI_ERR << "transform-feats stage expects one argument, "
+                << "(<transform-rspecifier>|<transform-rxfilename>)";
+    global_ = (ClassifyRspecifier(positional[0], NULL, NULL) == kNoRspecifier);
+    if (global_) {
+      if (utt2spk_rspecifier != "")
+        KALDI_ERR << "--utt2spk option not compatible with rxfilename as input "
+                  << "(did you forget ark:?)";
+      ReadKaldiObject(positional[0], &global_transform_);
+    } else if (!transform_reader_.Open(positional[0], utt2spk_rspecifier)) {
+      KALDI_ERR << "Problem opening transforms with rspecifier "
+                << positional[0] << " and utt2spk rspecifier "
+                << utt2spk_rspecifier;
+    }
+  }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats,
+                     Matrix<BaseFloat> *buffer) {
+    if (!global_ && !transform_reader_.HasKey(utt)) {
+      KALDI_WARN << "No fMLLR transform available for utterance "
+                 << utt << ", producing no output for this utterance";
+      return false;
+    }
+    const Matrix<BaseFloat> &trans =
+        (global_ ? global_transform_ : transform_reader_.Value(utt));
+    int32 transform_rows = trans.NumRows(),
+        transform_cols = trans.NumCols(),
+        feat_dim = feats->NumCols();
+    buffer->Resize(feats->NumRows(), transform_rows, kUndefined);
+    if (transform_cols == feat_dim) {
+      buffer->AddMatMat(1.0, *feats, kNoTrans, trans, kTrans, 0.0);
+    } else if (transform_cols == feat_dim + 1) {
+      // append the implicit 1.0 to the input features.
+      SubMatrix<BaseFloat> linear_part(trans, 0, transform_rows, 0, feat_dim);
+      buffer->AddMatMat(1.0, *feats, kNoTrans, linear_part, kTrans, 0.0);
+      Vector<BaseFloat> offset(transform_rows);
+      offset.CopyColFromMat(trans, feat_dim);
+      buffer->AddVecToRows(1.0, offset);
+    } else {
+      KALDI_WARN << "Transform matrix for utterance " << utt << " has bad dimension "
+                 << transform_rows << "x" << transform_cols << " versus feat dim "
+                 << feat_dim;
+      return false;
+    }
+    feats->Swap(buffer);
+    return true;
+  }
+
+ private:
+  bool global_;
+  Matrix<BaseFloat> global_transform_;
+  RandomAccessBaseFloatMatrixReaderMapped transform_reader_;
+};
+
+}  // namespace
+
+
+bool IsFeaturePipelineSpec(const std::string &spec) {
+  return (spec.compare(0, strlen(kPipelinePrefix), kPipelinePrefix) == 0);
+}
+
+
+SequentialFeatureReader::SequentialFeatureReader(const std::string &spec):
+    num_done_(0), num_err_(0), have_value_(false) {
+  if (spec != "" && !Open(spec))
+    KALDI_ERR << "Error opening SequentialFeatureReader object "
+              << " (spec is: " << spec << ")";
+}
+
+
+bool SequentialFeatureReader::Open(const std::string &spec) {
+  if (IsOpen() && !Close())
+    KALDI_ERR << "Could not close previously open object.";
+  std::string rspecifier = spec;
+  if (IsFeaturePipelineSpec(spec)) {
+    std::vector<std::string> stages;
+    SplitPipelineSpec(spec.substr(strlen(kPipelinePrefix)), &rspecifier,
+                      &stages);
+    for (size_t i = 0; i < stages.size(); i++) {
+      std::vector<std::string> args;
+      SplitStringToVector(stages[i], " \t", true, &args);
+      std::string name = args[0];
+      args.erase(args.begin());
+      if (name == "apply-cmvn") stages_.push_back(new CmvnStage(args));
+      else if (name == "add-deltas") stages_.push_back(new DeltaStage(args));
+      else if (name == "splice-feats") stages_.push_back(new SpliceStage(args));
+      else stages_.push_back(new TransformStage(args));
+    }
+    KALDI_VLOG(1) << "Feature pipeline with " << stages_.size()
+                  << " stages, reading " << rspecifier;
+  }
+  if (!reader_.Open(rspecifier)) {
+    DeleteStages();
+    return false;
+  }
+  ProcessUtterance();
+  return true;
+}
+
+
+void SequentialFeatureReader::ProcessUtterance() {
+  have_value_ = false;
+  if (stages_.empty()) return;
+  for (; !reader_.Done(); reader_.Next()) {
+    std::string utt = reader_.Key();
+    feats_ = reader_.Value();
+    size_t i = 0;
+    while (i < stages_.size() && stages_[i]->Apply(utt, &feats_, &buffer_))
+      i++;
+    if (i == stages_.size()) {
+      have_value_ = true;
+      num_done_++;
+      return;
+    }
+    num_err_++;
+  }
+}
+
+
+bool SequentialFeatureReader::Done() {
+  return reader_.Done();
+}
+
+
+std::string SequentialFeatureReader::Key() {
+  return reader_.Key();
+}
+
+
+const Matrix<BaseFloat> &SequentialFeatureReader::Value() {
+  if (stages_.empty()) return reader_.Value();
+  KALDI_ASSERT(have_value_);
+  return feats_;
+}
+
+
+void SequentialFeatureReader::Next() {
+  reader_.Next();
+  ProcessUtterance();
+}
+
+
+bool SequentialFeatureReader::Close() {
+  if (!stages_.empty())
+    KALDI_LOG << "Feature pipeline processed " << num_done_
+              << " utterances, skipped " << num_err_;
+  DeleteStages();
+  num_done_ = num_err_ = 0;
+  have_value_ = false;
+  return reader_.Close();
+}
+
+
+void SequentialFeatureReader::DeleteStages() {
+  for (size_t i = 0; i < stages_.size(); i++)
+    delete stages_[i];
+  stages_.clear();
+}
+
+}  // namespace kaldi
@@ -0,0 +1,133 @@
+// feat/feature-pipeline.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_FEAT_FEATURE_PIPELINE_H_
+#define KALDI_FEAT_FEATURE_PIPELINE_H_
+
+#include <string>
+#include <vector>
+
+#include "matrix/matrix-lib.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+/// @addtogroup  feat FeatureExtraction
+/// @{
+
+// Documentation for the feature-pipeline spec.
+//
+// The recipes read the features through a chain of programs, as in
+//  "ark,s,cs:apply-cmvn --utt2spk=ark:utt2spk scp:cmvn.scp scp:feats.scp ark:- |
+//   add-deltas ark:- ark:- |"
+// which costs a process per stage and the serialization of the features
+// between them, for each epoch of the training.  A feature-pipeline spec
+// describes the same chain, run in-process by SequentialFeatureReader:
+//
+//  "pipeline:scp:feats.scp | apply-cmvn --utt2spk=ark:utt2spk scp:cmvn.scp | add-deltas"
+//
+// i.e. "pipeline:" followed by the rspecifier of the input features, and the
+// stages separated by '|'.  A stage is the name of the program followed by
+// its options and its arguments without the feature rspecifier/wspecifier.
+// The options and arguments of the stages are separated by whitespace (so
+// they cannot contain spaces), the input rspecifier can be anything, e.g. a
+// command ending with '|'.  A word after '|' which is not a stage name (nor
+// a part of such a command) is an error.  The stages are:
+//
+//   apply-cmvn [--norm-means] [--norm-vars] [--reverse] [--skip-dims]
+//              [--utt2spk] (<cmvn-stats-rspecifier>|<cmvn-stats-rxfilename>)
+//   add-deltas [--delta-order] [--delta-window] [--truncate]
+//   splice-feats [--left-context] [--right-context]
+//   transform-feats [--utt2spk] (<transform-rspecifier>|<transform-rxfilename>)
+//
+// with the same meaning and defaults as in the programs.  An utterance the
+// programs would skip (e.g. no CMVN stats or transform for it) is skipped
+// with a warning.
+
+
+/// Returns true if 'spec' is a feature-pipeline spec (starts with "pipeline:").
+bool IsFeaturePipelineSpec(const std::string &spec);
+
+
+/// One stage of a feature pipeline, it processes the features of an
+/// utterance; see the implementations in feature-pipeline.cc.
+class FeaturePipelineStage {
+ public:
+  /// Processes the features of utterance 'utt'.  The stages that don't work
+  /// in place write into 'buffer' and swap it with 'feats', so the pipeline
+  /// reuses its two matrices.  Returns false (with a warning) if the
+  /// utterance must be skipped.
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats,
+                     Matrix<BaseFloat> *buffer) = 0;
+  virtual ~FeaturePipelineStage() { }
+};
+
+
+/// SequentialFeatureReader reads features like SequentialBaseFloatMatrixReader,
+/// from an rspecifier or from a feature-pipeline spec (see above), in which
+/// case it applies the stages of the pipeline to each utterance.
+class SequentialFeatureReader {
+ public:
+  SequentialFeatureReader(): num_done_(0), num_err_(0), have_value_(false) { }
+
+  /// This constructor is equivalent to default constructor + "open", but
+  /// throws on error.
+  explicit SequentialFeatureReader(const std::string &spec);
+
+  /// Opens an rspecifier or a feature-pipeline spec; returns false on error.
+  bool Open(const std::string &spec);
+
+  bool IsOpen() const { return reader_.IsOpen(); }
+
+  /// True when there are no more utterances.
+  bool Done();
+  std::string Key();
+  /// The features of the current utterance, after the stages.
+  const Matrix<BaseFloat> &Value();
+  void Next();
+  /// Frees the current utterance if it is the one held by the underlying
+  /// reader; the buffers of the pipeline are kept for the next utterance.
+  void FreeCurrent() { if (stages_.empty()) reader_.FreeCurrent(); }
+
+  bool Close();
+
+  ~SequentialFeatureReader() { DeleteStages(); }
+
+ private:
+  /// Applies the stages to the current utterance of 'reader_', and to the
+  /// next ones if a stage rejects it, until an utterance passes (or the end).
+  void ProcessUtterance();
+  void DeleteStages();
+
+  SequentialBaseFloatMatrixReader reader_;
+  std::vector<FeaturePipelineStage*> stages_;
+  int32 num_done_, num_err_;
+
+  // the current utterance, (if there are stages),
+  bool have_value_;
+  Matrix<BaseFloat> feats_;
+  Matrix<BaseFloat> buffer_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialFeatureReader);
+};
+
+
+/// @} End of "addtogroup feat"
+}  // namespace kaldi
+
+
+#endif  // KALDI_FEAT_FEATURE_PIPELINE_H_
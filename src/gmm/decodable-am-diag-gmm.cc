@@ -42,7 +42,7 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
     previous_frame_ = frame;
   }
 
-  const DiagGmm &pdf = acoustic_model_.GetPdf(state);
+  const DiagGmm &pdf = GetPdf(state);
   const VectorBase<BaseFloat> &data = feature_matrix_.Row(frame);
 
   // check if everything is in order
@@ -26,6 +26,7 @@
 
 #include "base/kaldi-common.h"
 #include "gmm/am-diag-gmm.h"
+#include "gmm/mle-am-diag-gmm.h"
 #include "hmm/transition-model.h"
 #include "itf/decodable-itf.h"
 #include "transform/regression-tree.h"
@@ -75,6 +76,10 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
  protected:
   void ResetLogLikeCache();
   virtual BaseFloat LogLikelihoodZeroBased(int32 frame, int32 state_index);
+  /// The pdf used for the likelihoods, (overridden for adapted models)
+  virtual const DiagGmm &GetPdf(int32 pdf_index) const {
+    return acoustic_model_.GetPdf(pdf_index);
+  }
 
   const AmDiagGmm &acoustic_model_;
   const Matrix<BaseFloat> &feature_matrix_;
@@ -159,6 +164,30 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmScaled);
 };
 
+/// DecodableAmDiagGmmScaled for a MAP-adapted model stored as an overlay
+/// over the speaker-independent model (see MapAmDiagGmmOverlay); takes
+/// ownership of "feats".
+class DecodableMapAmDiagGmmScaled: public DecodableAmDiagGmmScaled {
+ public:
+  DecodableMapAmDiagGmmScaled(const MapAmDiagGmmOverlay &am,
+                              const TransitionModel &tm,
+                              BaseFloat scale,
+                              BaseFloat log_sum_exp_prune,
+                              Matrix<BaseFloat> *feats):
+      DecodableAmDiagGmmScaled(am.SpeakerIndependentModel(), tm, scale,
+                               log_sum_exp_prune, feats),
+      map_model_(am) {}
+
+ protected:
+  virtual const DiagGmm &GetPdf(int32 pdf_index) const {
+    return map_model_.GetPdf(pdf_index);
+  }
+
+ private:
+  const MapAmDiagGmmOverlay &map_model_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMapAmDiagGmmScaled);
+};
+
 }  // namespace kaldi
 
 #endif  // KALDI_GMM_DECODABLE_AM_DIAG_GMM_H_
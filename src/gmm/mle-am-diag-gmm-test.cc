@@ -91,6 +91,40 @@ void TestAmDiagGmmAccsIO(const AmDiagGmm &am_gmm,
   unlink("tmpfb");
 }
 
+// Tests that the sparse MAP overlay equals the MAP update of a full copy,
+// only some of the pdfs get stats.
+void TestMapAmDiagGmmOverlay(const AmDiagGmm &am_gmm,
+                             const Matrix<BaseFloat> &feats) {
+  kaldi::GmmFlagsType flags = kaldi::kGmmMeans | kaldi::kGmmWeights;
+  int32 num_used = 1 + RandInt(0, am_gmm.NumPdfs()/2);
+  AccumAmDiagGmm accs;
+  accs.Init(am_gmm, flags);
+  MapAmDiagGmmOverlay overlay(am_gmm, flags);
+  for (int32 i = 0; i < feats.NumRows(); i++) {
+    int32 state = RandInt(0, num_used-1);
+    BaseFloat weight = RandUniform();
+    BaseFloat loglike = accs.AccumulateForGmm(am_gmm, feats.Row(i), state, weight),
+        loglike_overlay = overlay.AccumulateForGmm(feats.Row(i), state, weight);
+    AssertEqual(loglike, loglike_overlay, 1e-5);
+  }
+  MapDiagGmmOptions config;
+  AmDiagGmm am_gmm_map;
+  am_gmm_map.CopyFromAmDiagGmm(am_gmm);
+  BaseFloat obj, count, obj_overlay, count_overlay;
+  MapAmDiagGmmUpdate(config, accs, flags, &am_gmm_map, &obj, &count);
+  overlay.Update(config, &obj_overlay, &count_overlay);
+  AssertEqual(obj, obj_overlay, 1e-4);
+  AssertEqual(count, count_overlay, 1e-4);
+  KALDI_ASSERT(overlay.NumAdaptedPdfs() <= num_used);
+
+  for (int32 i = 0; i < 10; i++) {
+    int32 pdf = RandInt(0, am_gmm.NumPdfs()-1),
+        frame = RandInt(0, feats.NumRows()-1);
+    AssertEqual(am_gmm_map.LogLikelihood(pdf, feats.Row(frame)),
+                overlay.GetPdf(pdf).LogLikelihood(feats.Row(frame)), 1e-4);
+  }
+}
+
 void UnitTestMleAmDiagGmm() {
   int32 dim = 1 + kaldi::RandInt(0, 9),  // random dimension of the gmm
       num_pdfs = 5 + kaldi::RandInt(0, 9);  // random number of states
@@ -126,6 +160,7 @@ void UnitTestMleAmDiagGmm() {
     }
   }
   TestAmDiagGmmAccsIO(am_gmm, feats);
+  TestMapAmDiagGmmOverlay(am_gmm, feats);
 }
 
 
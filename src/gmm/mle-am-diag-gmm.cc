@@ -286,4 +286,52 @@ void AccumAmDiagGmm::Add(BaseFloat scale, const AccumAmDiagGmm &other) {
     gmm_accumulators_[i]->Add(scale, *(other.gmm_accumulators_[i]));
 }
 
+
+MapAmDiagGmmOverlay::MapAmDiagGmmOverlay(const AmDiagGmm &am_gmm,
+                                         GmmFlagsType flags)
+    : am_gmm_(am_gmm), flags_(flags),
+      accs_(am_gmm.NumPdfs(), NULL), pdfs_(am_gmm.NumPdfs(), NULL) { }
+
+MapAmDiagGmmOverlay::~MapAmDiagGmmOverlay() {
+  DeletePointers(&accs_);
+  DeletePointers(&pdfs_);
+}
+
+BaseFloat MapAmDiagGmmOverlay::AccumulateForGmm(
+    const VectorBase<BaseFloat> &data, int32 pdf_index, BaseFloat weight) {
+  KALDI_ASSERT(static_cast<size_t>(pdf_index) < accs_.size());
+  if (accs_[pdf_index] == NULL)
+    accs_[pdf_index] = new AccumDiagGmm(am_gmm_.GetPdf(pdf_index), flags_);
+  return accs_[pdf_index]->AccumulateFromDiag(am_gmm_.GetPdf(pdf_index),
+                                              data, weight);
+}
+
+void MapAmDiagGmmOverlay::Update(const MapDiagGmmOptions &config,
+                                 BaseFloat *obj_change_out,
+                                 BaseFloat *count_out) {
+  if (obj_change_out != NULL) *obj_change_out = 0.0;
+  if (count_out != NULL) *count_out = 0.0;
+  BaseFloat tmp_obj_change, tmp_count;
+  BaseFloat *p_obj = (obj_change_out != NULL) ? &tmp_obj_change : NULL,
+      *p_count   = (count_out != NULL) ? &tmp_count : NULL;
+
+  for (size_t i = 0; i < accs_.size(); i++) {
+    if (accs_[i] == NULL) continue;
+    if (pdfs_[i] == NULL) pdfs_[i] = new DiagGmm(am_gmm_.GetPdf(i));
+    MapDiagGmmUpdate(config, *accs_[i], flags_, pdfs_[i], p_obj, p_count);
+    delete accs_[i];
+    accs_[i] = NULL;
+
+    if (obj_change_out != NULL) *obj_change_out += tmp_obj_change;
+    if (count_out != NULL) *count_out += tmp_count;
+  }
+}
+
+int32 MapAmDiagGmmOverlay::NumAdaptedPdfs() const {
+  int32 ans = 0;
+  for (size_t i = 0; i < pdfs_.size(); i++)
+    if (pdfs_[i] != NULL) ans++;
+  return ans;
+}
+
 }  // namespace kaldi
@@ -124,6 +124,47 @@ void MapAmDiagGmmUpdate(const MapDiagGmmOptions &config,
                         BaseFloat *obj_change_out,
                         BaseFloat *count_out);
 
+/// MAP-adapted acoustic model stored as a sparse overlay over a shared
+/// speaker-independent AmDiagGmm.  MAP leaves unchanged the pdfs that got
+/// no occupancy, so only the pdfs that received stats are copied and
+/// re-estimated, the others are read from the speaker-independent model.
+/// The result is the same as MapAmDiagGmmUpdate() applied to a full copy.
+class MapAmDiagGmmOverlay {
+ public:
+  /// 'am_gmm' must outlive this object,
+  MapAmDiagGmmOverlay(const AmDiagGmm &am_gmm, GmmFlagsType flags);
+  ~MapAmDiagGmmOverlay();
+
+  /// Accumulate the MAP stats of a single pdf (the stats are allocated on
+  /// demand); returns the log-likelihood of the speaker-independent pdf.
+  BaseFloat AccumulateForGmm(const VectorBase<BaseFloat> &data,
+                             int32 pdf_index, BaseFloat weight);
+
+  /// MAP update of the pdfs that have stats, frees the stats.
+  void Update(const MapDiagGmmOptions &config,
+              BaseFloat *obj_change_out,
+              BaseFloat *count_out);
+
+  /// The adapted pdf, or the speaker-independent one if it was not adapted,
+  const DiagGmm &GetPdf(int32 pdf_index) const {
+    KALDI_ASSERT(static_cast<size_t>(pdf_index) < pdfs_.size());
+    return (pdfs_[pdf_index] != NULL ? *pdfs_[pdf_index]
+                                     : am_gmm_.GetPdf(pdf_index));
+  }
+
+  const AmDiagGmm &SpeakerIndependentModel() const { return am_gmm_; }
+  int32 NumPdfs() const { return pdfs_.size(); }
+  int32 NumAdaptedPdfs() const;
+
+ private:
+  const AmDiagGmm &am_gmm_;
+  GmmFlagsType flags_;
+  std::vector<AccumDiagGmm*> accs_;  ///< NULL for pdfs without stats
+  std::vector<DiagGmm*> pdfs_;       ///< NULL for pdfs shared with am_gmm_
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MapAmDiagGmmOverlay);
+};
+
 // These typedefs are needed to write GMMs to and from pipes, for MAP
 // adaptation and decoding.  Note: this doesn't handle the transition
 // model, you have to read that in separately.
@@ -0,0 +1,412 @@
+// gmmbin/gmm-adapt-map-latgen-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "gmm/am-diag-gmm.h"
+#include "gmm/mle-am-diag-gmm.h"
+#include "hmm/transition-model.h"
+#include "hmm/posterior.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "gmm/decodable-am-diag-gmm.h"
+#include "base/timer.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+/// Utterance of a speaker, the pointers are owned by MapAdaptDecodeClass,
+struct MapAdaptUtterance {
+  std::string utt;
+  Matrix<BaseFloat> *feats;
+  Posterior *posterior;  // NULL = not used for the MAP stats
+  fst::VectorFst<fst::StdArc> *fst;  // NULL = the shared decoding graph
+  MapAdaptUtterance(): feats(NULL), posterior(NULL), fst(NULL) { }
+};
+
+
+/// MAP adaptation for one speaker (or utterance), followed by the decoding
+/// of its utterances with the adapted model.  The adapted model is a sparse
+/// overlay over the shared speaker-independent model, it is never copied
+/// or written.  The outputs are written by the destructor (TaskSequencer
+/// calls the destructors sequentially, in order).
+class MapAdaptDecodeClass {
+ public:
+  MapAdaptDecodeClass(const AmDiagGmm &am_gmm,
+                      const TransitionModel &trans_model,
+                      const MapDiagGmmOptions &map_config,
+                      GmmFlagsType update_flags,
+                      const LatticeFasterDecoderConfig &decoder_config,
+                      const fst::Fst<fst::StdArc> *decode_fst,
+                      const fst::SymbolTable *word_syms,
+                      BaseFloat acoustic_scale,
+                      BaseFloat log_sum_exp_prune,
+                      bool allow_partial,
+                      const std::string &spk,
+                      const std::vector<MapAdaptUtterance> &utts,
+                      Int32VectorWriter *alignments_writer,
+                      Int32VectorWriter *words_writer,
+                      CompactLatticeWriter *compact_lattice_writer,
+                      LatticeWriter *lattice_writer,
+                      double *map_like_sum, double *map_frame_sum,
+                      double *map_objf_change_sum,
+                      double *like_sum, int64 *frame_sum,
+                      int32 *num_done, int32 *num_err):
+      am_gmm_(am_gmm), trans_model_(trans_model), map_config_(map_config),
+      update_flags_(update_flags), decoder_config_(decoder_config),
+      decode_fst_(decode_fst), word_syms_(word_syms),
+      acoustic_scale_(acoustic_scale), log_sum_exp_prune_(log_sum_exp_prune),
+      allow_partial_(allow_partial), spk_(spk), utts_(utts),
+      alignments_writer_(alignments_writer), words_writer_(words_writer),
+      compact_lattice_writer_(compact_lattice_writer),
+      lattice_writer_(lattice_writer),
+      map_like_sum_(map_like_sum), map_frame_sum_(map_frame_sum),
+      map_objf_change_sum_(map_objf_change_sum),
+      like_sum_(like_sum), frame_sum_(frame_sum),
+      num_done_(num_done), num_err_(num_err),
+      map_model_(NULL), map_like_(0.0), map_frames_(0.0),
+      map_objf_change_(0.0), map_count_(0.0) { }
+
+  void operator () () {
+    map_model_ = new MapAmDiagGmmOverlay(am_gmm_, update_flags_);
+    // accumulate the MAP stats,
+    for (size_t u = 0; u < utts_.size(); u++) {
+      if (utts_[u].posterior == NULL) continue;
+      const Matrix<BaseFloat> &feats = *utts_[u].feats;
+      Posterior pdf_posterior;
+      ConvertPosteriorToPdfs(trans_model_, *utts_[u].posterior, &pdf_posterior);
+      for (size_t i = 0; i < pdf_posterior.size(); i++) {
+        for (size_t j = 0; j < pdf_posterior[i].size(); j++) {
+          int32 pdf_id = pdf_posterior[i][j].first;
+          BaseFloat weight = pdf_posterior[i][j].second;
+          map_like_ += weight * map_model_->AccumulateForGmm(feats.Row(i),
+                                                             pdf_id, weight);
+          map_frames_ += weight;
+        }
+      }
+    }
+    // MAP estimation, (only the pdfs with stats are adapted)
+    map_model_->Update(map_config_, &map_objf_change_, &map_count_);
+
+    // decode with the adapted model,
+    bool determinize = decoder_config_.determinize_lattice;
+    for (size_t u = 0; u < utts_.size(); u++) {
+      LatticeFasterDecoder *decoder = (utts_[u].fst != NULL ?
+          new LatticeFasterDecoder(decoder_config_, utts_[u].fst) :
+          new LatticeFasterDecoder(*decode_fst_, decoder_config_));
+      utts_[u].fst = NULL;  // owned by the decoder,
+      DecodableMapAmDiagGmmScaled *gmm_decodable =
+          new DecodableMapAmDiagGmmScaled(*map_model_, trans_model_,
+                                          acoustic_scale_, log_sum_exp_prune_,
+                                          utts_[u].feats);
+      utts_[u].feats = NULL;  // owned by the decodable,
+      DecodeUtteranceLatticeFasterClass *task =
+          new DecodeUtteranceLatticeFasterClass(
+              decoder, gmm_decodable,  // takes ownership of these two.
+              trans_model_, word_syms_, utts_[u].utt, acoustic_scale_,
+              determinize, allow_partial_, alignments_writer_, words_writer_,
+              compact_lattice_writer_, lattice_writer_,
+              like_sum_, frame_sum_, num_done_, num_err_, NULL);
+      (*task)();
+      decode_tasks_.push_back(task);
+    }
+  }
+
+  ~MapAdaptDecodeClass() {
+    if (map_model_ != NULL) {
+      KALDI_VLOG(1) << "For speaker " << spk_ << ", objective function change "
+                    << "from MAP was " << (map_objf_change_ / map_count_)
+                    << " over " << map_count_ << " frames, adapted "
+                    << map_model_->NumAdaptedPdfs() << " of "
+                    << map_model_->NumPdfs() << " pdfs.";
+    }
+    *map_like_sum_ += map_like_;
+    *map_frame_sum_ += map_frames_;
+    *map_objf_change_sum_ += map_objf_change_;
+    DeletePointers(&decode_tasks_);  // writes the outputs,
+    delete map_model_;
+    for (size_t u = 0; u < utts_.size(); u++) {
+      delete utts_[u].feats;
+      delete utts_[u].posterior;
+      delete utts_[u].fst;
+    }
+  }
+
+ private:
+  const AmDiagGmm &am_gmm_;
+  const TransitionModel &trans_model_;
+  const MapDiagGmmOptions &map_config_;
+  GmmFlagsType update_flags_;
+  const LatticeFasterDecoderConfig &decoder_config_;
+  const fst::Fst<fst::StdArc> *decode_fst_;
+  const fst::SymbolTable *word_syms_;
+  BaseFloat acoustic_scale_;
+  BaseFloat log_sum_exp_prune_;
+  bool allow_partial_;
+  std::string spk_;
+  std::vector<MapAdaptUtterance> utts_;
+  Int32VectorWriter *alignments_writer_;
+  Int32VectorWriter *words_writer_;
+  CompactLatticeWriter *compact_lattice_writer_;
+  LatticeWriter *lattice_writer_;
+  double *map_like_sum_, *map_frame_sum_, *map_objf_change_sum_;
+  double *like_sum_;
+  int64 *frame_sum_;
+  int32 *num_done_, *num_err_;
+
+  MapAmDiagGmmOverlay *map_model_;
+  std::vector<DecodeUtteranceLatticeFasterClass*> decode_tasks_;
+  double map_like_, map_frames_;
+  BaseFloat map_objf_change_, map_count_;
+};
+
+
+/// Prepares the data of one utterance, 'fst_reader' is NULL if there is
+/// a single decoding graph; returns false if the utterance can't be decoded.
+bool GetMapAdaptUtterance(const std::string &utt,
+                          const Matrix<BaseFloat> &feats,
+                          RandomAccessPosteriorReader *posteriors_reader,
+                          RandomAccessTableReader<fst::VectorFstHolder> *fst_reader,
+                          int32 *num_err, int32 *num_no_post,
+                          MapAdaptUtterance *ans) {
+  if (feats.NumRows() == 0) {
+    KALDI_WARN << "Zero-length utterance: " << utt;
+    (*num_err)++;
+    return false;
+  }
+  if (fst_reader != NULL && !fst_reader->HasKey(utt)) {
+    KALDI_WARN << "Utterance " << utt << " has no corresponding FST, "
+               << "skipping this utterance.";
+    (*num_err)++;
+    return false;
+  }
+  ans->utt = utt;
+  ans->posterior = NULL;
+  if (!posteriors_reader->HasKey(utt)) {
+    KALDI_WARN << "Did not find posteriors for utterance " << utt
+               << ", not using it for the adaptation.";
+    (*num_no_post)++;
+  } else if (posteriors_reader->Value(utt).size() != feats.NumRows()) {
+    KALDI_WARN << "Posteriors has wrong size "
+               << posteriors_reader->Value(utt).size() << " vs. "
+               << feats.NumRows() << ", not using utterance " << utt
+               << " for the adaptation.";
+    (*num_no_post)++;
+  } else {
+    ans->posterior = new Posterior(posteriors_reader->Value(utt));
+  }
+  ans->feats = new Matrix<BaseFloat>(feats);
+  ans->fst = (fst_reader != NULL ?
+              new fst::VectorFst<fst::StdArc>(fst_reader->Value(utt)) : NULL);
+  return true;
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "MAP-adapt the GMM-based model per-utterance (default) or per-speaker\n"
+        "(--spk2utt option) and decode with the adapted model, in one pass.\n"
+        "Does the job of gmm-adapt-map piped into gmm-latgen-map, but the adapted\n"
+        "models are never written: only the adapted pdfs are kept in memory, on top\n"
+        "of the shared speaker-independent model.  Uses multiple threads (one task\n"
+        "per speaker).  Utterances without posteriors are decoded, but not used\n"
+        "for the adaptation.\n"
+        "\n"
+        "Usage: gmm-adapt-map-latgen-parallel [options] <model-in> "
+        "<fst-in|fsts-rspecifier> <features-rspecifier> <posteriors-rspecifier> "
+        "<lattice-wspecifier> [ <words-wspecifier> [ <alignments-wspecifier> ] ]\n"
+        "e.g.: gmm-adapt-map-latgen-parallel --num-threads=8 --spk2utt=ark:spk2utt \\\n"
+        "  final.mdl HCLG.fst scp:feats.scp ark:1st_pass.post ark:lat.ark\n";
+
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = true;
+    BaseFloat acoustic_scale = 0.1;
+    BaseFloat log_sum_exp_prune = 0.0;
+    std::string spk2utt_rspecifier, word_syms_filename;
+    std::string update_flags_str = "mw";
+    MapDiagGmmOptions map_config;
+    LatticeFasterDecoderConfig decoder_config;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    po.Register("spk2utt", &spk2utt_rspecifier, "rspecifier for speaker to "
+                "utterance-list map");
+    po.Register("update-flags", &update_flags_str, "Which GMM parameters will be "
+                "updated: subset of mvw.");
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("log-sum-exp-prune", &log_sum_exp_prune,
+                "If >0, pruning parameter to minimize exp()'s.  Suggest 3 to 5; "
+                "larger is more exact.");
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "Produce output even when final state was not reached");
+    map_config.Register(&po);
+    decoder_config.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        posteriors_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    GmmFlagsType update_flags = StringToGmmFlags(update_flags_str);
+
+    TransitionModel trans_model;
+    AmDiagGmm am_gmm;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_gmm.Read(ki.Stream(), binary);
+    }
+
+    bool determinize = decoder_config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                  << word_syms_filename;
+
+    VectorFst<StdArc> *decode_fst = NULL;  // only used if there is a single
+                                           // decoding graph.
+    RandomAccessTableReader<fst::VectorFstHolder> fst_reader,
+        *fst_reader_ptr = NULL;  // used if there are different FSTs for
+                                 // different utterances.
+    if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
+      decode_fst = fst::ReadFstKaldi(fst_in_str);
+    } else if (fst_reader.Open(fst_in_str)) {
+      fst_reader_ptr = &fst_reader;
+    } else {
+      KALDI_ERR << "Could not open table of FSTs " << fst_in_str;
+    }
+
+    RandomAccessPosteriorReader posteriors_reader(posteriors_rspecifier);
+
+    double tot_like = 0.0, map_like = 0.0, map_frames = 0.0,
+        map_objf_change = 0.0;
+    kaldi::int64 frame_count = 0;
+    int32 num_done = 0, num_err = 0, num_no_post = 0;
+
+    {
+      TaskSequencer<MapAdaptDecodeClass> sequencer(sequencer_config);
+      if (spk2utt_rspecifier != "") {  // per-speaker adaptation
+        SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
+        RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
+        for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
+          std::string spk = spk2utt_reader.Key();
+          const std::vector<std::string> &uttlist = spk2utt_reader.Value();
+          std::vector<MapAdaptUtterance> utts;
+          for (size_t i = 0; i < uttlist.size(); i++) {
+            const std::string &utt = uttlist[i];
+            if (!feature_reader.HasKey(utt)) {
+              KALDI_WARN << "Did not find features for utterance " << utt;
+              num_err++;
+              continue;
+            }
+            MapAdaptUtterance u;
+            if (GetMapAdaptUtterance(utt, feature_reader.Value(utt),
+                                     &posteriors_reader, fst_reader_ptr,
+                                     &num_err, &num_no_post, &u))
+              utts.push_back(u);
+          }
+          if (utts.empty()) continue;
+          sequencer.Run(new MapAdaptDecodeClass(
+              am_gmm, trans_model, map_config, update_flags, decoder_config,
+              decode_fst, word_syms, acoustic_scale, log_sum_exp_prune,
+              allow_partial, spk, utts, &alignment_writer, &words_writer,
+              &compact_lattice_writer, &lattice_writer, &map_like, &map_frames,
+              &map_objf_change, &tot_like, &frame_count, &num_done, &num_err));
+        }
+      } else {  // per-utterance adaptation
+        SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+        for (; !feature_reader.Done(); feature_reader.Next()) {
+          std::string utt = feature_reader.Key();
+          std::vector<MapAdaptUtterance> utts(1);
+          bool ok = GetMapAdaptUtterance(utt, feature_reader.Value(),
+                                         &posteriors_reader, fst_reader_ptr,
+                                         &num_err, &num_no_post, &utts[0]);
+          feature_reader.FreeCurrent();
+          if (!ok) continue;
+          sequencer.Run(new MapAdaptDecodeClass(
+              am_gmm, trans_model, map_config, update_flags, decoder_config,
+              decode_fst, word_syms, acoustic_scale, log_sum_exp_prune,
+              allow_partial, utt, utts, &alignment_writer, &words_writer,
+              &compact_lattice_writer, &lattice_writer, &map_like, &map_frames,
+              &map_objf_change, &tot_like, &frame_count, &num_done, &num_err));
+        }
+      }
+      sequencer.Wait();
+    }
+
+    if (decode_fst != NULL) delete decode_fst;
+
+    KALDI_LOG << "MAP: acoustic likelihood was " << (map_like / map_frames)
+              << " and change in likelihood per frame was "
+              << (map_objf_change / map_frames) << " over " << map_frames
+              << " frames; " << num_no_post << " utterances had no posteriors.";
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Decoded with " << sequencer_config.num_threads << " threads.";
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor per thread assuming 100 frames/sec is "
+              << (sequencer_config.num_threads * elapsed * 100.0 / frame_count);
+    KALDI_LOG << "Done " << num_done << " utterances, failed for "
+              << num_err;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+    if (word_syms) delete word_syms;
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -50,12 +50,57 @@ void TestVectorToPosteriorEntry() {
   KALDI_ASSERT(ans >= max_val);
 }
 
+void TestCompactPosterior() {
+  // multi-task posteriors, (large ids and many entries in some frames),
+  std::vector<int32> task_offset;
+  task_offset.push_back(0);
+  task_offset.push_back(100);
+  task_offset.push_back(100000);
+  int32 num_frames = rand() % 20;
+  Posterior post(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    int32 n = (rand() % 10 == 0 ? 300 : rand() % 3);
+    for (int32 i = 0; i < n; i++) {
+      post[t].push_back(std::make_pair(rand() % (rand() % 2 == 0 ? 100 : 100000),
+                                       RandUniform()));
+    }
+  }
+  for (int32 weight_bits = 8; weight_bits <= 16; weight_bits += 8) {
+    CompactPosterior cpost(post, weight_bits, &task_offset);
+    KALDI_ASSERT(cpost.NumFrames() == num_frames && cpost.HasTasks());
+    for (int32 binary = 0; binary <= 1; binary++) {
+      std::ostringstream os;
+      cpost.Write(os, (binary == 1));
+      CompactPosterior cpost2;
+      std::istringstream is(os.str());
+      cpost2.Read(is, (binary == 1));
+      Posterior post2;
+      cpost2.ToPosterior(&post2);
+      KALDI_ASSERT(post2.size() == post.size());
+      for (int32 t = 0; t < num_frames; t++) {
+        KALDI_ASSERT(post2[t].size() == post[t].size());
+        for (size_t i = 0; i < post[t].size(); i++) {
+          KALDI_ASSERT(post2[t][i].first == post[t][i].first);
+          KALDI_ASSERT(fabs(post2[t][i].second - post[t][i].second) <=
+                       0.5 / cpost.MaxQuantizedWeight() + 1.0e-06);
+        }
+        int32 task = (post[t].empty() ? 0 : (post[t][0].first < 100 ? 0 : 1));
+        KALDI_ASSERT(cpost2.FrameTask(t) == task);
+      }
+    }
+  }
+  CompactPosterior cpost(post);
+  cpost.Truncate(num_frames / 2);
+  KALDI_ASSERT(cpost.NumFrames() == num_frames / 2 && !cpost.HasTasks());
+}
+
 }
 
 int main() {
   // repeat the test ten times
   for (int i = 0; i < 10; i++) {
     kaldi::TestVectorToPosteriorEntry();
+    kaldi::TestCompactPosterior();
   }
   std::cout << "Test OK.\n";
 }
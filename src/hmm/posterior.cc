@@ -21,6 +21,7 @@
 // limitations under the License.
 
 #include <vector>
+#include <algorithm>
 #include "hmm/posterior.h"
 #include "util/kaldi-table.h"
 #include "util/stl-utils.h"
@@ -468,4 +469,202 @@ BaseFloat VectorToPosteriorEntry(
 }
 
 
+
+CompactPosterior::CompactPosterior(const Posterior &post, int32 weight_bits,
+                                   const std::vector<int32> *task_offset):
+    weight_bits_(weight_bits) {
+  if (weight_bits_ != 8 && weight_bits_ != 16)
+    KALDI_ERR << "CompactPosterior: weight_bits must be 8 or 16, got "
+              << weight_bits_;
+  BaseFloat max_q = MaxQuantizedWeight();
+  frame_offset_.reserve(post.size() + 1);
+  frame_offset_.push_back(0);
+  for (size_t t = 0; t < post.size(); t++) {
+    for (size_t i = 0; i < post[t].size(); i++) {
+      int32 id = post[t][i].first;
+      BaseFloat weight = post[t][i].second;
+      if (id < 0)
+        KALDI_ERR << "CompactPosterior: negative index " << id;
+      if (!(weight >= 0.0 && weight <= 1.0))
+        KALDI_ERR << "CompactPosterior: weight " << weight << " is out of "
+                  << "the range [0, 1], use the Posterior format.";
+      ids_.push_back(id);
+      weights_.push_back(static_cast<uint16>(weight * max_q + 0.5));
+    }
+    frame_offset_.push_back(ids_.size());
+  }
+  if (task_offset != NULL) {
+    KALDI_ASSERT(task_offset->size() >= 2 && task_offset->size() <= 257);
+    frame_task_.resize(post.size(), 0);
+    for (size_t t = 0; t < post.size(); t++) {
+      if (post[t].empty()) continue;
+      int32 task = std::upper_bound(task_offset->begin(), task_offset->end(),
+                                    post[t][0].first) - task_offset->begin() - 1;
+      if (task < 0 || task + 1 >= static_cast<int32>(task_offset->size()))
+        KALDI_ERR << "CompactPosterior: index " << post[t][0].first
+                  << " out of the task ranges (0.." << task_offset->back() - 1
+                  << ")";
+      frame_task_[t] = task;
+    }
+  }
+}
+
+void CompactPosterior::ToPosterior(Posterior *post) const {
+  post->resize(NumFrames());
+  for (int32 t = 0; t < NumFrames(); t++) {
+    std::vector<std::pair<int32, BaseFloat> > &frame = (*post)[t];
+    frame.resize(FrameEnd(t) - FrameBegin(t));
+    for (int32 i = FrameBegin(t); i < FrameEnd(t); i++) {
+      frame[i - FrameBegin(t)] = std::make_pair(Id(i), Weight(i));
+    }
+  }
+}
+
+void CompactPosterior::Truncate(int32 num_frames) {
+  KALDI_ASSERT(num_frames >= 0 && num_frames <= NumFrames());
+  frame_offset_.resize(num_frames + 1);
+  ids_.resize(frame_offset_.back());
+  weights_.resize(frame_offset_.back());
+  if (!frame_task_.empty()) frame_task_.resize(num_frames);
+}
+
+// Writes the elements of 'v' as raw integers of 'num_bytes' bytes,
+template<typename I>
+static void WriteNarrowIntegers(std::ostream &os, int32 num_bytes,
+                                const std::vector<I> &v) {
+  if (num_bytes == sizeof(I)) {
+    if (!v.empty())
+      os.write(reinterpret_cast<const char*>(&v[0]), v.size() * sizeof(I));
+    return;
+  }
+  for (size_t i = 0; i < v.size(); i++) {
+    if (num_bytes == 1) {
+      uint8 x = v[i]; os.write(reinterpret_cast<const char*>(&x), 1);
+    } else if (num_bytes == 2) {
+      uint16 x = v[i]; os.write(reinterpret_cast<const char*>(&x), 2);
+    } else {
+      KALDI_ASSERT(num_bytes == 4);
+      int32 x = v[i]; os.write(reinterpret_cast<const char*>(&x), 4);
+    }
+  }
+}
+
+template<typename I>
+static void ReadNarrowIntegers(std::istream &is, int32 num_bytes,
+                               std::vector<I> *v) {
+  if (num_bytes == sizeof(I)) {
+    if (!v->empty())
+      is.read(reinterpret_cast<char*>(&(*v)[0]), v->size() * sizeof(I));
+  } else {
+    for (size_t i = 0; i < v->size(); i++) {
+      if (num_bytes == 1) {
+        uint8 x; is.read(reinterpret_cast<char*>(&x), 1); (*v)[i] = x;
+      } else if (num_bytes == 2) {
+        uint16 x; is.read(reinterpret_cast<char*>(&x), 2); (*v)[i] = x;
+      } else {
+        KALDI_ASSERT(num_bytes == 4);
+        int32 x; is.read(reinterpret_cast<char*>(&x), 4); (*v)[i] = x;
+      }
+    }
+  }
+  if (is.fail())
+    KALDI_ERR << "Error reading CompactPosterior";
+}
+
+void CompactPosterior::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<CompactPosterior>");
+  WriteBasicType(os, binary, weight_bits_);
+  WriteBasicType(os, binary, NumFrames());
+  WriteBasicType(os, binary, NumEntries());
+  WriteBasicType(os, binary, HasTasks());
+  if (binary) {
+    // the narrowest types that fit the data,
+    std::vector<int32> counts(NumFrames());
+    int32 max_count = 0, max_id = 0;
+    for (int32 t = 0; t < NumFrames(); t++) {
+      counts[t] = FrameEnd(t) - FrameBegin(t);
+      max_count = std::max(max_count, counts[t]);
+    }
+    for (size_t i = 0; i < ids_.size(); i++)
+      max_id = std::max(max_id, ids_[i]);
+    int32 count_bytes = (max_count <= 255 ? 1 : 4),
+        id_bytes = (max_id <= 65535 ? 2 : 4);
+    WriteBasicType(os, binary, count_bytes);
+    WriteBasicType(os, binary, id_bytes);
+    WriteNarrowIntegers(os, count_bytes, counts);
+    WriteNarrowIntegers(os, id_bytes, ids_);
+    WriteNarrowIntegers(os, weight_bits_ / 8, weights_);
+    WriteNarrowIntegers(os, 1, frame_task_);
+  } else {
+    // format is [ 1235 255 12 0 ] [ 34 255 ] ..., with task-tags 0 [ ... ] 1 [ ... ]
+    for (int32 t = 0; t < NumFrames(); t++) {
+      if (HasTasks()) os << FrameTask(t) << ' ';
+      os << "[ ";
+      for (int32 i = FrameBegin(t); i < FrameEnd(t); i++)
+        os << Id(i) << ' ' << QuantizedWeight(i) << ' ';
+      os << "] ";
+    }
+  }
+  WriteToken(os, binary, "</CompactPosterior>");
+  if (!binary) os << '\n';
+}
+
+void CompactPosterior::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<CompactPosterior>");
+  int32 num_frames, num_entries;
+  bool has_tasks;
+  ReadBasicType(is, binary, &weight_bits_);
+  ReadBasicType(is, binary, &num_frames);
+  ReadBasicType(is, binary, &num_entries);
+  ReadBasicType(is, binary, &has_tasks);
+  if ((weight_bits_ != 8 && weight_bits_ != 16) || num_frames < 0 ||
+      num_entries < 0)
+    KALDI_ERR << "Reading CompactPosterior: invalid header";
+  frame_offset_.resize(num_frames + 1);
+  ids_.resize(num_entries);
+  weights_.resize(num_entries);
+  frame_task_.resize(has_tasks ? num_frames : 0);
+  frame_offset_[0] = 0;
+  if (binary) {
+    int32 count_bytes, id_bytes;
+    ReadBasicType(is, binary, &count_bytes);
+    ReadBasicType(is, binary, &id_bytes);
+    std::vector<int32> counts(num_frames);
+    ReadNarrowIntegers(is, count_bytes, &counts);
+    for (int32 t = 0; t < num_frames; t++)
+      frame_offset_[t+1] = frame_offset_[t] + counts[t];
+    if (frame_offset_.back() != num_entries)
+      KALDI_ERR << "Reading CompactPosterior: inconsistent entry counts";
+    ReadNarrowIntegers(is, id_bytes, &ids_);
+    ReadNarrowIntegers(is, weight_bits_ / 8, &weights_);
+    ReadNarrowIntegers(is, 1, &frame_task_);
+  } else {
+    int32 n = 0;
+    for (int32 t = 0; t < num_frames; t++) {
+      if (has_tasks) {
+        int32 task;
+        ReadBasicType(is, binary, &task);
+        frame_task_[t] = task;
+      }
+      ExpectToken(is, binary, "[");
+      std::string tok;
+      while (true) {
+        ReadToken(is, binary, &tok);
+        if (tok == "]") break;
+        int32 id, weight;
+        if (n >= num_entries || !ConvertStringToInteger(tok, &id))
+          KALDI_ERR << "Reading CompactPosterior: bad entry " << tok;
+        ReadBasicType(is, binary, &weight);
+        ids_[n] = id;
+        weights_[n] = weight;
+        n++;
+      }
+      frame_offset_[t+1] = n;
+    }
+    if (n != num_entries)
+      KALDI_ERR << "Reading CompactPosterior: inconsistent entry counts";
+  }
+  ExpectToken(is, binary, "</CompactPosterior>");
+}
+
 } // End namespace kaldi
@@ -123,6 +123,67 @@ typedef SequentialTableReader<GaussPostHolder> SequentialGaussPostReader;
 typedef RandomAccessTableReader<GaussPostHolder> RandomAccessGaussPostReader;
 
 
+/// CompactPosterior is a memory- and disk-efficient form of Posterior for the
+/// NN-training targets, whose weights are probabilities in [0, 1]. The entries
+/// are stored in flat (CSR) arrays and the weights are quantized to 8 or 16
+/// bits. Optionally each frame carries a task-tag (multi-task targets, the
+/// task is the index-range of the first target of the frame, see paste-post).
+/// The on-disk format uses the narrowest integer types that fit the data,
+/// so 1-hot targets take about 5 bytes per frame instead of 15.
+class CompactPosterior {
+ public:
+  CompactPosterior(): weight_bits_(16) { frame_offset_.push_back(0); }
+
+  /// Quantizes 'post' to 'weight_bits' (8 or 16) bits. If 'task_offset' is
+  /// not NULL (num_tasks+1 starting points of the target index-ranges),
+  /// the frames get task-tags (frames without targets are of task 0).
+  CompactPosterior(const Posterior &post, int32 weight_bits = 16,
+                   const std::vector<int32> *task_offset = NULL);
+
+  /// Returns the de-quantized posterior,
+  void ToPosterior(Posterior *post) const;
+
+  int32 NumFrames() const { return frame_offset_.size() - 1; }
+  int32 NumEntries() const { return ids_.size(); }
+  int32 WeightBits() const { return weight_bits_; }
+  bool HasTasks() const { return !frame_task_.empty(); }
+
+  /// The entries of frame 't' are the indices FrameBegin(t) .. FrameEnd(t)-1,
+  int32 FrameBegin(int32 t) const { return frame_offset_[t]; }
+  int32 FrameEnd(int32 t) const { return frame_offset_[t+1]; }
+  int32 Id(int32 i) const { return ids_[i]; }
+  /// Quantized weight, the weight is QuantizedWeight(i) / MaxQuantizedWeight(),
+  uint16 QuantizedWeight(int32 i) const { return weights_[i]; }
+  BaseFloat Weight(int32 i) const {
+    return weights_[i] / static_cast<BaseFloat>(MaxQuantizedWeight());
+  }
+  int32 MaxQuantizedWeight() const { return (1 << weight_bits_) - 1; }
+  /// Task-tag of frame 't', (-1 if the frames are not tagged),
+  int32 FrameTask(int32 t) const {
+    return (frame_task_.empty() ? -1 : frame_task_[t]);
+  }
+
+  /// Keeps the first 'num_frames' frames,
+  void Truncate(int32 num_frames);
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  int32 weight_bits_;
+  std::vector<int32> frame_offset_;  ///< NumFrames()+1 offsets into the entries
+  std::vector<int32> ids_;
+  std::vector<uint16> weights_;      ///< quantized to 'weight_bits_' bits
+  std::vector<uint8> frame_task_;    ///< task-tags (empty = not tagged)
+};
+
+typedef TableWriter<KaldiObjectHolder<CompactPosterior> > CompactPosteriorWriter;
+typedef SequentialTableReader<KaldiObjectHolder<CompactPosterior> >
+    SequentialCompactPosteriorReader;
+typedef RandomAccessTableReader<KaldiObjectHolder<CompactPosterior> >
+    RandomAccessCompactPosteriorReader;
+
+
 /// Scales the BaseFloat (weight) element in the posterior entries.
 void ScalePosterior(BaseFloat scale, Posterior *post);
 
@@ -0,0 +1,260 @@
+// latbin/lattice-to-frame-weights.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "hmm/posterior.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+/// Options of the conversion of the best-path posteriors to frame weights,
+/// (the same as in thresh-vector and reverse-weights)
+struct FrameWeightsOptions {
+  std::string posterior_type;
+  bool reverse;
+  BaseFloat threshold;
+  BaseFloat lower_cap;
+  BaseFloat upper_cap;
+  bool disable_upper_cap;
+
+  FrameWeightsOptions(): posterior_type("pdf"), reverse(false),
+                         threshold(-1.0), lower_cap(0.0), upper_cap(1.0),
+                         disable_upper_cap(true) { }
+
+  void Register(OptionsItf *po) {
+    po->Register("posterior-type", &posterior_type, "Level at which the "
+                 "best path is matched with the posteriors: pdf|phone|transition");
+    po->Register("reverse", &reverse, "If true, use 1.0-weight (as reverse-weights)");
+    po->Register("threshold", &threshold, "Threshold below which the weights "
+                 "are set to --lower-cap (as thresh-vector); <0 = no thresholding");
+    po->Register("lower-cap", &lower_cap, "Value to which we set weights below threshold");
+    po->Register("upper-cap", &upper_cap, "Value to which we set weights above threshold");
+    po->Register("disable-upper-cap", &disable_upper_cap, "Disable upper "
+                 "capping, keep the weights above threshold");
+  }
+};
+
+
+/// Computes the frame weights of one lattice: the posterior (from a single
+/// forward-backward pass) of the best path at each frame.
+class LatticeToFrameWeightsTask {
+ public:
+  // Initializer takes ownership of "clat".
+  LatticeToFrameWeightsTask(const TransitionModel &trans_model,
+                            const FrameWeightsOptions &opts,
+                            const std::string &key,
+                            CompactLattice *clat,
+                            BaseFloatVectorWriter *weights_writer,
+                            PosteriorWriter *posterior_writer,
+                            double *tot_like, double *tot_weight,
+                            int64 *tot_frames, int32 *num_done,
+                            int32 *num_fail):
+      trans_model_(trans_model), opts_(opts), key_(key), clat_(clat),
+      weights_writer_(weights_writer), posterior_writer_(posterior_writer),
+      tot_like_(tot_like), tot_weight_(tot_weight), tot_frames_(tot_frames),
+      num_done_(num_done), num_fail_(num_fail), success_(false), like_(0.0) { }
+
+  void operator () () {
+    // Best path, (as lattice-best-path)
+    CompactLattice clat_best_path;
+    CompactLatticeShortestPath(*clat_, &clat_best_path);
+    Lattice best_path;
+    ConvertLattice(clat_best_path, &best_path);
+    if (best_path.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Best-path failed for key " << key_;
+      return;
+    }
+    std::vector<int32> alignment, words;
+    LatticeWeight weight;
+    GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+
+    // Posteriors, (as lattice-to-post)
+    Lattice lat;
+    ConvertLattice(*clat_, &lat);
+    delete clat_;  // not needed anymore,
+    clat_ = NULL;
+    if (!(lat.Properties(fst::kFstProperties, false) & fst::kTopSorted)) {
+      if (fst::TopSort(&lat) == false) {
+        KALDI_WARN << "Cycles detected in lattice " << key_;
+        return;
+      }
+    }
+    Posterior post;
+    like_ = LatticeForwardBackward(lat, &post);
+    if (post.size() != alignment.size()) {
+      KALDI_WARN << "Length mismatch of best path and posteriors for key "
+                 << key_ << ", " << alignment.size() << " vs. " << post.size();
+      return;
+    }
+
+    // Posteriors and best path at the chosen level,
+    if (opts_.posterior_type == "pdf") {
+      ConvertPosteriorToPdfs(trans_model_, post, &post_);
+      for (size_t t = 0; t < alignment.size(); t++)
+        alignment[t] = trans_model_.TransitionIdToPdf(alignment[t]);
+    } else if (opts_.posterior_type == "phone") {
+      ConvertPosteriorToPhones(trans_model_, post, &post_);
+      for (size_t t = 0; t < alignment.size(); t++)
+        alignment[t] = trans_model_.TransitionIdToPhone(alignment[t]);
+    } else {
+      post_.swap(post);
+    }
+
+    // The posterior on the best path, (as get-post-on-ali)
+    weights_.Resize(alignment.size());
+    for (size_t t = 0; t < alignment.size(); t++) {
+      for (size_t j = 0; j < post_[t].size(); j++) {
+        if (post_[t][j].first == alignment[t]) {
+          weights_(t) = post_[t][j].second;
+          break;
+        }
+      }
+    }
+    if (opts_.reverse) {  // (as reverse-weights)
+      weights_.Scale(-1.0);
+      weights_.Add(1.0);
+    }
+    if (opts_.threshold >= 0.0) {  // (as thresh-vector)
+      weights_.LowerThreshold(opts_.threshold, opts_.lower_cap);
+      if (!opts_.disable_upper_cap)
+        weights_.UpperThreshold(opts_.threshold, opts_.upper_cap);
+    }
+    success_ = true;
+  }
+
+  ~LatticeToFrameWeightsTask() {
+    delete clat_;
+    if (!success_) {
+      (*num_fail_)++;
+      return;
+    }
+    weights_writer_->Write(key_, weights_);
+    if (posterior_writer_->IsOpen())
+      posterior_writer_->Write(key_, post_);
+    *tot_like_ += like_;
+    *tot_weight_ += weights_.Sum();
+    *tot_frames_ += weights_.Dim();
+    (*num_done_)++;
+  }
+
+ private:
+  const TransitionModel &trans_model_;
+  const FrameWeightsOptions &opts_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice, owned locally.
+  BaseFloatVectorWriter *weights_writer_;
+  PosteriorWriter *posterior_writer_;
+  double *tot_like_, *tot_weight_;
+  int64 *tot_frames_;
+  int32 *num_done_, *num_fail_;
+
+  bool success_;
+  double like_;
+  Posterior post_;  // The output posteriors,
+  Vector<BaseFloat> weights_;  // The output frame weights.
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Compute per-frame weights for semi-supervised training from lattices:\n"
+        "the weight of a frame is the lattice posterior of the best path at that\n"
+        "frame.  Does the job of the pipeline\n"
+        " lattice-best-path | ali-to-pdf, lattice-to-post | post-to-pdf-post,\n"
+        " get-post-on-ali | reverse-weights | thresh-vector\n"
+        "in one pass, with a single forward-backward per lattice.  The weights\n"
+        "are for the --frame-weights option of nnet-train-frmshuff; the optional\n"
+        "posteriors (pdf-level by default) can be used as soft training targets.\n"
+        "\n"
+        "Usage: lattice-to-frame-weights [options] <model-in> <lattice-rspecifier> "
+        "<weights-wspecifier> [<posteriors-wspecifier>]\n"
+        " e.g.: lattice-to-frame-weights --acoustic-scale=0.1 --threshold=0.7 \\\n"
+        "   final.mdl 'ark:gunzip -c lat.1.gz|' ark:frame_weights.ark ark:post.ark\n";
+
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 1.0, lm_scale = 1.0;
+    FrameWeightsOptions opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("lm-scale", &lm_scale,
+                "Scaling factor for \"graph costs\" (including LM costs)");
+    opts.Register(&po);
+    sequencer_config.Register(&po);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 3 || po.NumArgs() > 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (opts.posterior_type != "pdf" && opts.posterior_type != "phone" &&
+        opts.posterior_type != "transition")
+      KALDI_ERR << "Invalid --posterior-type " << opts.posterior_type;
+
+    std::string model_rxfilename = po.GetArg(1),
+        lats_rspecifier = po.GetArg(2),
+        weights_wspecifier = po.GetArg(3),
+        posteriors_wspecifier = po.GetOptArg(4);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_rxfilename, &trans_model);
+
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    BaseFloatVectorWriter weights_writer(weights_wspecifier);
+    PosteriorWriter posterior_writer(posteriors_wspecifier);
+
+    double tot_like = 0.0, tot_weight = 0.0;
+    int64 tot_frames = 0;
+    int32 num_done = 0, num_fail = 0;
+    {
+      TaskSequencer<LatticeToFrameWeightsTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        if (acoustic_scale != 1.0 || lm_scale != 1.0)
+          fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), clat);
+        sequencer.Run(new LatticeToFrameWeightsTask(
+            trans_model, opts, key, clat,  // takes ownership of "clat".
+            &weights_writer, &posterior_writer, &tot_like, &tot_weight,
+            &tot_frames, &num_done, &num_fail));
+      }
+      sequencer.Wait();
+    }
+
+    KALDI_LOG << "Overall average log-like/frame is "
+              << (tot_like / tot_frames) << ", average frame weight is "
+              << (tot_weight / tot_frames) << " over " << tot_frames
+              << " frames.";
+    KALDI_LOG << "Done " << num_done << " lattices, failed for " << num_fail;
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
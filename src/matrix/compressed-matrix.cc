@@ -372,6 +372,22 @@ inline float CompressedMatrix::CharToFloat(
   }
 }
 
+// static
+void CompressedMatrix::ComputeColumnTable(const GlobalHeader &global_header,
+                                          const PerColHeader &header,
+                                          float *table) {
+  float p0 = Uint16ToFloat(global_header, header.percentile_0),
+      p25 = Uint16ToFloat(global_header, header.percentile_25),
+      p75 = Uint16ToFloat(global_header, header.percentile_75),
+      p100 = Uint16ToFloat(global_header, header.percentile_100);
+  // (the same arithmetic as CharToFloat(), so the values are identical).
+  for (int32 i = 0; i <= 64; i++)
+    table[i] = p0 + (p25 - p0) * i * (1/64.0);
+  for (int32 i = 65; i <= 192; i++)
+    table[i] = p25 + (p75 - p25) * (i - 64) * (1/128.0);
+  for (int32 i = 193; i < 256; i++)
+    table[i] = p75 + (p100 - p75) * (i - 192) * (1/63.0);
+}
 
 template<typename Real>  // static
 void CompressedMatrix::CompressColumn(
@@ -497,7 +513,17 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat) const {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     unsigned char *byte_data = reinterpret_cast<unsigned char*>(per_col_header +
                                                                 h->num_cols);
+    Real *mat_data = mat->Data();
+    MatrixIndexT stride = mat->Stride();
     for (int32 i = 0; i < num_cols; i++, per_col_header++) {
+      if (num_rows >= kMinRowsForTable) {
+        float table[256];
+        ComputeColumnTable(*h, *per_col_header, table);
+        Real *col_data = mat_data + i;
+        for (int32 j = 0; j < num_rows; j++, byte_data++, col_data += stride)
+          *col_data = table[*byte_data];
+        continue;
+      }
       float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
           p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
           p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
@@ -608,8 +634,8 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
   KALDI_PARANOID_ASSERT(col_offset < this->NumCols());
   KALDI_PARANOID_ASSERT(row_offset >= 0);
   KALDI_PARANOID_ASSERT(col_offset >= 0);
-  KALDI_ASSERT(row_offset+dest->NumRows() < this->NumRows());
-  KALDI_ASSERT(col_offset+dest->NumCols() < this->NumCols());
+  KALDI_ASSERT(row_offset+dest->NumRows() <= this->NumRows());
+  KALDI_ASSERT(col_offset+dest->NumCols() <= this->NumCols());
   // everything is OK
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
   int32 num_rows = h->num_rows, num_cols = h->num_cols,
@@ -632,6 +658,15 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
          i < tgt_cols;
          i++, per_col_header++, start_of_subcol+=num_rows) {
       byte_data = start_of_subcol;
+      if (tgt_rows >= kMinRowsForTable) {
+        float table[256];
+        ComputeColumnTable(*h, *per_col_header, table);
+        Real *col_data = dest->Data() + i;
+        MatrixIndexT stride = dest->Stride();
+        for (int32 j = 0; j < tgt_rows; j++, byte_data++, col_data += stride)
+          *col_data = table[*byte_data];
+        continue;
+      }
       float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
           p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
           p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
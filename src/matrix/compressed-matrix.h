@@ -160,6 +160,17 @@ class CompressedMatrix {
   static inline float CharToFloat(float p0, float p25,
                                   float p75, float p100,
                                   unsigned char value);
+
+  // Fills table[0..255] with the values of the 256 byte codes of the column
+  // with header 'header', so a long column decodes with one table lookup per
+  // element instead of the branches of CharToFloat().
+  static void ComputeColumnTable(const GlobalHeader &global_header,
+                                 const PerColHeader &header,
+                                 float *table);
+
+  // Columns with fewer rows than this are decoded with CharToFloat(), for
+  // which the table is not worth computing.
+  static const int32 kMinRowsForTable = 64;
   
   void Destroy();
   
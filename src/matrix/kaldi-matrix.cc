@@ -22,6 +22,7 @@
 
 #include "matrix/kaldi-matrix.h"
 #include "matrix/sp-matrix.h"
+#include "matrix/simd-math.h"
 #include "matrix/jama-svd.h"
 #include "matrix/jama-eig.h"
 #include "matrix/compressed-matrix.h"
@@ -1269,7 +1270,8 @@ void Matrix<Real>::Read(std::istream & is, bool binary, bool add) {
       // This code enable us to read CompressedMatrix as a regular matrix.
       CompressedMatrix compressed_mat;
       compressed_mat.Read(is, binary); // at this point, add == false.
-      this->Resize(compressed_mat.NumRows(), compressed_mat.NumCols());
+      this->Resize(compressed_mat.NumRows(), compressed_mat.NumCols(),
+                   kUndefined);  // (all of it is written by CopyToMat()).
       compressed_mat.CopyToMat(this);
       return;
     }
@@ -2455,6 +2457,43 @@ Real MatrixBase<Real>::ApplySoftMax() {
   return max + Log(sum);
 }
 
+template<typename Real>
+void MatrixBase<Real>::SoftMaxPerRow(const MatrixBase<Real> &src) {
+  KALDI_ASSERT(SameDim(*this, src));
+  for (MatrixIndexT r = 0; r < num_rows_; r++) {
+    SubVector<Real> row(*this, r);
+    row.CopyFromVec(src.Row(r));
+    row.ApplySoftMax();
+  }
+}
+
+template<typename Real>
+void MatrixBase<Real>::LogSoftMaxPerRow(const MatrixBase<Real> &src) {
+  KALDI_ASSERT(SameDim(*this, src));
+  for (MatrixIndexT r = 0; r < num_rows_; r++) {
+    SubVector<Real> row(*this, r);
+    row.CopyFromVec(src.Row(r));
+    row.ApplyLogSoftMax();
+  }
+}
+
+#ifdef KALDI_SIMD_MATH
+// the copy is fused with the soft-max,
+template<>
+void MatrixBase<float>::SoftMaxPerRow(const MatrixBase<float> &src) {
+  KALDI_ASSERT(SameDim(*this, src));
+  for (MatrixIndexT r = 0; r < num_rows_; r++)
+    SimdSoftMax(src.RowData(r), this->RowData(r), num_cols_);
+}
+
+template<>
+void MatrixBase<float>::LogSoftMaxPerRow(const MatrixBase<float> &src) {
+  KALDI_ASSERT(SameDim(*this, src));
+  for (MatrixIndexT r = 0; r < num_rows_; r++)
+    SimdLogSoftMax(src.RowData(r), this->RowData(r), num_cols_);
+}
+#endif
+
 template<typename Real>
 void MatrixBase<Real>::Tanh(const MatrixBase<Real> &src) {
   KALDI_ASSERT(SameDim(*this, src));
@@ -2593,6 +2632,26 @@ void MatrixBase<Real>::DiffTanh(const MatrixBase<Real> &value,
   }
 }
 
+#ifdef KALDI_SIMD_MATH
+template<>
+void MatrixBase<float>::DiffSigmoid(const MatrixBase<float> &value,
+                                    const MatrixBase<float> &diff) {
+  KALDI_ASSERT(SameDim(*this, value) && SameDim(*this, diff));
+  for (MatrixIndexT r = 0; r < num_rows_; r++)
+    SimdDiffSigmoid(value.RowData(r), diff.RowData(r), this->RowData(r),
+                    num_cols_);
+}
+
+template<>
+void MatrixBase<float>::DiffTanh(const MatrixBase<float> &value,
+                                 const MatrixBase<float> &diff) {
+  KALDI_ASSERT(SameDim(*this, value) && SameDim(*this, diff));
+  for (MatrixIndexT r = 0; r < num_rows_; r++)
+    SimdDiffTanh(value.RowData(r), diff.RowData(r), this->RowData(r),
+                 num_cols_);
+}
+#endif
+
 
 template<typename Real>
 template<typename OtherReal>
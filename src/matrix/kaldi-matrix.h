@@ -415,6 +415,13 @@ class MatrixBase {
   /// Apply soft-max to the collection of all elements of the
   /// matrix and return normalizer (log sum of exponentials).
   Real ApplySoftMax();
+
+  /// Set each row to the soft-max of the corresponding row of "src"
+  /// (same as copying and calling ApplySoftMax() on each row).
+  void SoftMaxPerRow(const MatrixBase<Real> &src);
+
+  /// Set each row to the log-soft-max of the corresponding row of "src".
+  void LogSoftMaxPerRow(const MatrixBase<Real> &src);
   
   /// Set each element to the sigmoid of the corresponding element of "src".
   void Sigmoid(const MatrixBase<Real> &src);
@@ -28,6 +28,7 @@
 #include "matrix/kaldi-vector.h"
 #include "matrix/kaldi-matrix.h"
 #include "matrix/sp-matrix.h"
+#include "matrix/simd-math.h"
 
 namespace kaldi {
 
@@ -793,6 +794,20 @@ void VectorBase<Real>::ApplyExp() {
   }
 }
 
+#ifdef KALDI_SIMD_MATH
+template<>
+void VectorBase<float>::ApplyLog() {
+  if (dim_ > 0 && this->Min() < 0.0)
+    KALDI_ERR << "Trying to take log of a negative number.";
+  SimdLog(data_, data_, dim_);
+}
+
+template<>
+void VectorBase<float>::ApplyExp() {
+  SimdExp(data_, data_, dim_);
+}
+#endif
+
 template<typename Real>
 void VectorBase<Real>::ApplyAbs() {
   for (MatrixIndexT i = 0; i < dim_; i++) { data_[i] = std::abs(data_[i]); }
@@ -881,6 +896,18 @@ Real VectorBase<Real>::ApplyLogSoftMax() {
   return max + sum;
 }
 
+#ifdef KALDI_SIMD_MATH
+template<>
+float VectorBase<float>::ApplySoftMax() {
+  return SimdSoftMax(data_, data_, dim_);
+}
+
+template<>
+float VectorBase<float>::ApplyLogSoftMax() {
+  return SimdLogSoftMax(data_, data_, dim_);
+}
+#endif
+
 #ifdef HAVE_MKL
 template<>
 void VectorBase<float>::Tanh(const VectorBase<float> &src) {
@@ -908,6 +935,13 @@ void VectorBase<Real>::Tanh(const VectorBase<Real> &src) {
     data_[i] = x;
   }
 }
+#ifdef KALDI_SIMD_MATH
+template<>
+void VectorBase<float>::Tanh(const VectorBase<float> &src) {
+  KALDI_ASSERT(dim_ == src.dim_);
+  SimdTanh(src.data_, data_, dim_);
+}
+#endif
 #endif
 
 #ifdef HAVE_MKL
@@ -946,6 +980,13 @@ void VectorBase<Real>::Sigmoid(const VectorBase<Real> &src) {
     data_[i] = x;
   }
 }
+#ifdef KALDI_SIMD_MATH
+template<>
+void VectorBase<float>::Sigmoid(const VectorBase<float> &src) {
+  KALDI_ASSERT(dim_ == src.dim_);
+  SimdSigmoid(src.data_, data_, dim_);
+}
+#endif
 #endif
 
 
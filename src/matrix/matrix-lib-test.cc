@@ -23,6 +23,7 @@
 // limitations under the License.
 
 #include "matrix/matrix-lib.h"
+#include "matrix/simd-math.h"
 #include <numeric>
 #include <time.h> // This is only needed for UnitTestSvdSpeed, you can
 // comment it (and that function) out if it causes problems.
@@ -2344,6 +2345,100 @@ template<typename Real> static void  UnitTestSigmoid() {
   }
 }
 
+#ifdef KALDI_SIMD_MATH
+static double MaxAbsDiff(const MatrixBase<float> &A, const MatrixBase<double> &B) {
+  Matrix<double> D(A);
+  D.AddMat(-1.0, B);
+  return std::max(D.Max(), -D.Min());
+}
+
+// The float kernels against the double-precision loops.
+static void UnitTestSimdMath() {
+  for (int32 sse2 = 0; sse2 < 2; sse2++) {
+    SimdMathForceSse2(sse2 == 1);
+    KALDI_LOG << "Testing the " << SimdMathInstructionSet() << " kernels";
+    for (MatrixIndexT i = 0; i < 40; i++) {
+      MatrixIndexT dimM = 1 + Rand() % 5, dimN = 1 + Rand() % 40;
+      Matrix<float> M(dimM, dimN), P(dimM, dimN), R(dimM, dimN);
+      M.SetRandn();
+      M.Scale(i < 20 ? 3.0 : 30.0);
+      M.ApplyCeiling(80.0);  // (exp() overflow is tested below)
+      P.SetRandn();
+      Matrix<double> Md(M), Pd(P), Nd(dimM, dimN);
+
+      Matrix<float> N(M);  // exp,
+      N.ApplyExp();
+      Nd.CopyFromMat(Md);
+      Nd.ApplyExp();
+      for (MatrixIndexT r = 0; r < dimM; r++)
+        for (MatrixIndexT c = 0; c < dimN; c++)
+          KALDI_ASSERT(std::abs(N(r, c) - Nd(r, c)) <= 1.0e-06 * Nd(r, c) ||
+                       (Md(r, c) < -87.0 && N(r, c) < 1.0e-37));
+      Nd.CopyFromMat(N);  // log,
+      Nd.ApplyLog();
+      N.ApplyLog();
+      for (MatrixIndexT r = 0; r < dimM; r++)
+        for (MatrixIndexT c = 0; c < dimN; c++)
+          if (N(r, c) > -87.0)
+            KALDI_ASSERT(std::abs(N(r, c) - Nd(r, c)) <=
+                         1.0e-06 * std::max(1.0, std::abs(Nd(r, c))));
+
+      N.Sigmoid(M);  // sigmoid,
+      Nd.Sigmoid(Md);
+      KALDI_ASSERT(MaxAbsDiff(N, Nd) <= 2.0e-07);
+      R.DiffSigmoid(N, P);
+      Nd.DiffSigmoid(Matrix<double>(N), Pd);
+      KALDI_ASSERT(MaxAbsDiff(R, Nd) <= 1.0e-06);
+
+      N.Tanh(M);  // tanh,
+      Nd.Tanh(Md);
+      KALDI_ASSERT(MaxAbsDiff(N, Nd) <= 2.0e-07);
+      R.DiffTanh(N, P);
+      Nd.DiffTanh(Matrix<double>(N), Pd);
+      KALDI_ASSERT(MaxAbsDiff(R, Nd) <= 1.0e-06);
+
+      N.SoftMaxPerRow(M);  // soft-max,
+      for (MatrixIndexT r = 0; r < dimM; r++) {
+        Vector<double> row(Md.Row(r));
+        double log_norm = row.ApplySoftMax();
+        SubVector<float> v(N, r);
+        v.CopyFromVec(M.Row(r));
+        KALDI_ASSERT(ApproxEqual(v.ApplySoftMax(), log_norm, 1.0e-06));
+        for (MatrixIndexT c = 0; c < dimN; c++)
+          KALDI_ASSERT(std::abs(N(r, c) - row(c)) <= 1.0e-06);
+      }
+      N.LogSoftMaxPerRow(M);  // log-soft-max,
+      for (MatrixIndexT r = 0; r < dimM; r++) {
+        Vector<double> row(Md.Row(r));
+        double log_norm = row.ApplyLogSoftMax();
+        for (MatrixIndexT c = 0; c < dimN; c++)  // (float rounding of x - norm)
+          KALDI_ASSERT(std::abs(N(r, c) - row(c)) <= 1.0e-06 *
+                       (1.0 + std::abs(Md(r, c)) + std::abs(log_norm)));
+      }
+    }
+    // the limits,
+    Vector<float> v(6), w(6);
+    v(0) = -1000.0; v(1) = 1000.0; v(2) = 0.0; v(3) = 1.0e-30;
+    v(4) = std::numeric_limits<float>::quiet_NaN(); v(5) = 88.5;
+    w.CopyFromVec(v);
+    SimdExp(w.Data(), w.Data(), w.Dim());
+    KALDI_ASSERT(w(0) == 0.0 && w(1) == std::numeric_limits<float>::infinity() &&
+                 w(2) == 1.0 && w(3) == 1.0 && KALDI_ISNAN(w(4)) &&
+                 ApproxEqual(w(5), expf(88.5), 1.0e-05));
+    w.Sigmoid(v);
+    KALDI_ASSERT(w(0) == 0.0 && w(1) == 1.0 && w(2) == 0.5 && KALDI_ISNAN(w(4)));
+    w.Tanh(v);
+    KALDI_ASSERT(w(0) == -1.0 && w(1) == 1.0 && w(2) == 0.0 &&
+                 w(3) == 1.0e-30f && KALDI_ISNAN(w(4)));
+    SimdLog(v.Data(), w.Data(), v.Dim());
+    KALDI_ASSERT(KALDI_ISNAN(w(0)) && ApproxEqual(w(1), logf(1000.0), 1.0e-06) &&
+                 w(2) == -std::numeric_limits<float>::infinity() &&
+                 ApproxEqual(w(3), logf(1.0e-30), 1.0e-06) && KALDI_ISNAN(w(4)));
+  }
+  SimdMathForceSse2(false);
+}
+#endif
+
 template<typename Real> static void  UnitTestSoftHinge() {
   for (MatrixIndexT i = 0; i < 10; i++) {
     MatrixIndexT dimM = 5 + Rand() % 10, dimN = 5 + Rand() % 10;
@@ -4005,6 +4100,31 @@ static void UnitTestSvdSpeed() {
   }
 }
 
+// Long columns are decoded through a table (see ComputeColumnTable()), this
+// checks it gives the same values as the per-element decoding.
+template<typename Real> static void UnitTestCompressedMatrixLong() {
+  for (MatrixIndexT n = 0; n < 20; n++) {
+    MatrixIndexT num_rows = 64 + Rand() % 200, num_cols = 1 + Rand() % 20;
+    Matrix<Real> M(num_rows, num_cols);
+    InitRand(&M);
+    CompressedMatrix cmat(M);
+    Matrix<Real> M2(num_rows, num_cols, kUndefined);
+    cmat.CopyToMat(&M2);
+    Vector<Real> col(num_rows);
+    for (MatrixIndexT c = 0; c < num_cols; c++) {
+      cmat.CopyColToVec(c, &col);
+      for (MatrixIndexT r = 0; r < num_rows; r++)
+        KALDI_ASSERT(M2(r, c) == col(r));
+    }
+    MatrixIndexT row_offset = Rand() % 10, col_offset = Rand() % num_cols;
+    Matrix<Real> Msub(num_rows - row_offset, num_cols - col_offset);
+    cmat.CopyToMat(row_offset, col_offset, &Msub);
+    for (MatrixIndexT r = 0; r < Msub.NumRows(); r++)
+      for (MatrixIndexT c = 0; c < Msub.NumCols(); c++)
+        KALDI_ASSERT(Msub(r, c) == M2(r + row_offset, c + col_offset));
+  }
+}
+
 template<typename Real> static void UnitTestCompressedMatrix() {
   // This is the basic test.
 
@@ -4334,6 +4454,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestLinearCgd<Real>();
   // UnitTestSvdBad<Real>(); // test bug in Jama SVD code.
   UnitTestCompressedMatrix<Real>();
+  UnitTestCompressedMatrixLong<Real>();
   UnitTestExtractCompressedMatrix<Real>();
   UnitTestResize<Real>();
   UnitTestMatrixExponentialBackprop();
@@ -4478,6 +4599,9 @@ int main() {
   bool full_test = false;
   kaldi::MatrixUnitTest<float>(full_test);
   kaldi::MatrixUnitTest<double>(full_test);
+#ifdef KALDI_SIMD_MATH
+  kaldi::UnitTestSimdMath();
+#endif
   KALDI_LOG << "Tests succeeded.";
 
 }
@@ -0,0 +1,127 @@
+// matrix/simd-math-avx2.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// The AVX2+FMA kernels of simd-math.h, called from simd-math.cc only if the
+// CPU supports them.  The whole file is compiled for AVX2 by the pragma
+// below, the kaldi headers are included before it so that no inline function
+// shared with other files gets an AVX2 copy.
+
+#include "matrix/simd-math.h"
+
+#ifdef KALDI_SIMD_MATH_AVX2
+
+#pragma GCC target("avx2,fma")
+#include <immintrin.h>
+#include "matrix/simd-math-inl.h"
+
+namespace kaldi {
+
+namespace {
+
+struct Avx2 {
+  typedef __m256 Vec;
+  typedef __m256i IVec;
+  static const int kWidth = 8;
+
+  static inline Vec Load(const float *p) { return _mm256_loadu_ps(p); }
+  static inline void Store(float *p, Vec v) { _mm256_storeu_ps(p, v); }
+  static inline Vec Set1(float f) { return _mm256_set1_ps(f); }
+  static inline Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+  static inline Vec Sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+  static inline Vec Mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+  static inline Vec Div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+  static inline Vec MulAdd(Vec a, Vec b, Vec c) {  // a * b + c
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  // (b if either is nan)
+  static inline Vec Min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+  static inline Vec Max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+  static inline Vec And(Vec a, Vec b) { return _mm256_and_ps(a, b); }
+  static inline Vec AndNot(Vec a, Vec b) { return _mm256_andnot_ps(a, b); }
+  static inline Vec Or(Vec a, Vec b) { return _mm256_or_ps(a, b); }
+  static inline Vec CmpLt(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline Vec CmpGt(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static inline Vec CmpEq(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  static inline Vec CmpNotGe(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_NGE_UQ); }
+  // mask ? b : a
+  static inline Vec Select(Vec mask, Vec a, Vec b) {
+    return _mm256_blendv_ps(a, b, mask);
+  }
+  static inline IVec ToInt(Vec a) { return _mm256_cvttps_epi32(a); }
+  static inline Vec ToFloat(IVec a) { return _mm256_cvtepi32_ps(a); }
+  static inline Vec AsFloat(IVec a) { return _mm256_castsi256_ps(a); }
+  static inline IVec AsInt(Vec a) { return _mm256_castps_si256(a); }
+  static inline IVec Set1Int(int i) { return _mm256_set1_epi32(i); }
+  static inline IVec AddInt(IVec a, IVec b) { return _mm256_add_epi32(a, b); }
+  static inline IVec SubInt(IVec a, IVec b) { return _mm256_sub_epi32(a, b); }
+  static inline IVec ShiftLeftInt(IVec a, int n) { return _mm256_slli_epi32(a, n); }
+  static inline IVec ShiftRightInt(IVec a, int n) { return _mm256_srli_epi32(a, n); }
+  static inline float HorizontalSum(Vec a) {
+    __m128 b = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    b = _mm_add_ps(b, _mm_movehl_ps(b, b));
+    b = _mm_add_ss(b, _mm_shuffle_ps(b, b, 1));
+    return _mm_cvtss_f32(b);
+  }
+  static inline float HorizontalMax(Vec a) {
+    __m128 b = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    b = _mm_max_ps(b, _mm_movehl_ps(b, b));
+    b = _mm_max_ss(b, _mm_shuffle_ps(b, b, 1));
+    return _mm_cvtss_f32(b);
+  }
+};
+
+}  // namespace
+
+namespace simd_math_avx2 {
+
+void Exp(const float *x, float *y, int n) {
+  simd_math::Map<Avx2, simd_math::ExpOp<Avx2> >(x, y, n);
+}
+
+void Log(const float *x, float *y, int n) {
+  simd_math::Map<Avx2, simd_math::LogOp<Avx2> >(x, y, n);
+}
+
+void Sigmoid(const float *x, float *y, int n) {
+  simd_math::Map<Avx2, simd_math::SigmoidOp<Avx2> >(x, y, n);
+}
+
+void Tanh(const float *x, float *y, int n) {
+  simd_math::Map<Avx2, simd_math::TanhOp<Avx2> >(x, y, n);
+}
+
+float SoftMax(const float *x, float *y, int n) {
+  return simd_math::SoftMax<Avx2>(x, y, n);
+}
+
+float LogSoftMax(const float *x, float *y, int n) {
+  return simd_math::LogSoftMax<Avx2>(x, y, n);
+}
+
+void DiffSigmoid(const float *value, const float *diff, float *y, int n) {
+  simd_math::DiffSigmoid<Avx2>(value, diff, y, n);
+}
+
+void DiffTanh(const float *value, const float *diff, float *y, int n) {
+  simd_math::DiffTanh<Avx2>(value, diff, y, n);
+}
+
+}  // namespace simd_math_avx2
+
+}  // namespace kaldi
+
+#endif  // KALDI_SIMD_MATH_AVX2
@@ -0,0 +1,255 @@
+// matrix/simd-math-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SIMD_MATH_INL_H_
+#define KALDI_MATRIX_SIMD_MATH_INL_H_
+
+// The kernels of simd-math.h, written once for a class V wrapping the
+// instruction set (the Sse2 class in simd-math.cc, Avx2 in simd-math-avx2.cc).
+// V has the vector types Vec and IVec (float and int32 lanes), kWidth and
+// the element-wise operations; V is local to the .cc file, so each instruction
+// set gets its own copy of the kernels.  Do not include this elsewhere.
+//
+// exp() and log() are the Cephes single-precision algorithms (range
+// reduction and minimax polynomials), tanh() uses the Cephes polynomial
+// for |x| < 0.625.
+
+namespace kaldi {
+namespace simd_math {
+
+template<class V>
+inline typename V::Vec ExpVec(typename V::Vec x) {
+  typedef typename V::Vec Vec;
+  Vec overflow = V::CmpGt(x, V::Set1(88.72283905f)),  // log(FLT_MAX)
+      underflow = V::CmpLt(x, V::Set1(-87.33654475f));  // log(FLT_MIN)
+  // (the constant first, so that nan propagates),
+  x = V::Min(V::Set1(88.72283905f), x);
+  x = V::Max(V::Set1(-87.33654475f), x);
+  // exp(x) = 2^n exp(r), n = floor(x / log(2) + 0.5), |r| <= log(2) / 2,
+  Vec fx = V::MulAdd(x, V::Set1(1.44269504088896341f), V::Set1(0.5f));
+  Vec tmp = V::ToFloat(V::ToInt(fx));  // truncation, to floor:
+  fx = V::Sub(tmp, V::And(V::CmpGt(tmp, fx), V::Set1(1.0f)));
+  fx = V::Min(V::Set1(127.0f), V::Max(V::Set1(-126.0f), fx));
+  x = V::Sub(x, V::Mul(fx, V::Set1(0.693359375f)));
+  x = V::Sub(x, V::Mul(fx, V::Set1(-2.12194440e-4f)));
+  Vec z = V::Mul(x, x),
+      y = V::Set1(1.9875691500e-4f);
+  y = V::MulAdd(y, x, V::Set1(1.3981999507e-3f));
+  y = V::MulAdd(y, x, V::Set1(8.3334519073e-3f));
+  y = V::MulAdd(y, x, V::Set1(4.1665795894e-2f));
+  y = V::MulAdd(y, x, V::Set1(1.6666665459e-1f));
+  y = V::MulAdd(y, x, V::Set1(5.0000001201e-1f));
+  y = V::MulAdd(y, z, V::Add(x, V::Set1(1.0f)));
+  // 2^n from the exponent bits,
+  typename V::IVec n = V::AddInt(V::ToInt(fx), V::Set1Int(127));
+  y = V::Mul(y, V::AsFloat(V::ShiftLeftInt(n, 23)));
+  y = V::Select(overflow, y, V::AsFloat(V::Set1Int(0x7f800000)));
+  return V::AndNot(underflow, y);
+}
+
+template<class V>
+inline typename V::Vec LogVec(typename V::Vec x) {
+  typedef typename V::Vec Vec;
+  Vec inf = V::AsFloat(V::Set1Int(0x7f800000)),
+      invalid = V::CmpNotGe(x, V::Set1(0.0f)),  // negative or nan,
+      zero = V::CmpEq(x, V::Set1(0.0f)),
+      infinite = V::CmpEq(x, inf);
+  x = V::Max(V::Set1(1.17549435e-38f), x);  // FLT_MIN, no denormals,
+  // x = m 2^e, 0.5 <= m < 1,
+  typename V::IVec e_int = V::SubInt(V::ShiftRightInt(V::AsInt(x), 23),
+                                     V::Set1Int(0x7f));
+  x = V::And(x, V::AsFloat(V::Set1Int(~0x7f800000)));
+  x = V::Or(x, V::Set1(0.5f));
+  Vec e = V::Add(V::ToFloat(e_int), V::Set1(1.0f));
+  // if m < sqrt(0.5): e = e - 1, x = 2m - 1; else x = m - 1,
+  Vec mask = V::CmpLt(x, V::Set1(0.707106781186547524f)),
+      tmp = V::And(x, mask);
+  x = V::Sub(x, V::Set1(1.0f));
+  e = V::Sub(e, V::And(V::Set1(1.0f), mask));
+  x = V::Add(x, tmp);
+  Vec z = V::Mul(x, x),
+      y = V::Set1(7.0376836292e-2f);
+  y = V::MulAdd(y, x, V::Set1(-1.1514610310e-1f));
+  y = V::MulAdd(y, x, V::Set1(1.1676998740e-1f));
+  y = V::MulAdd(y, x, V::Set1(-1.2420140846e-1f));
+  y = V::MulAdd(y, x, V::Set1(1.4249322787e-1f));
+  y = V::MulAdd(y, x, V::Set1(-1.6668057665e-1f));
+  y = V::MulAdd(y, x, V::Set1(2.0000714765e-1f));
+  y = V::MulAdd(y, x, V::Set1(-2.4999993993e-1f));
+  y = V::MulAdd(y, x, V::Set1(3.3333331174e-1f));
+  y = V::Mul(V::Mul(y, x), z);
+  y = V::MulAdd(e, V::Set1(-2.12194440e-4f), y);
+  y = V::Sub(y, V::Mul(z, V::Set1(0.5f)));
+  x = V::Add(x, y);
+  x = V::MulAdd(e, V::Set1(0.693359375f), x);
+  x = V::Select(zero, x, V::Sub(V::Set1(0.0f), inf));
+  x = V::Select(infinite, x, inf);
+  return V::Or(x, invalid);  // nan (all bits set),
+}
+
+template<class V>
+inline typename V::Vec SigmoidVec(typename V::Vec x) {
+  // 1 / (1 + exp(-x)), exp() overflows to inf for x < -88, (y = 0)
+  return V::Div(V::Set1(1.0f),
+                V::Add(V::Set1(1.0f), ExpVec<V>(V::Sub(V::Set1(0.0f), x))));
+}
+
+template<class V>
+inline typename V::Vec TanhVec(typename V::Vec x) {
+  typedef typename V::Vec Vec;
+  Vec sign_bit = V::AsFloat(V::Set1Int(0x80000000)),
+      sign = V::And(x, sign_bit),
+      abs_x = V::AndNot(sign_bit, x);
+  // |x| >= 0.625: 1 - 2 / (exp(2|x|) + 1), with the sign of x,
+  Vec large = V::Sub(V::Set1(1.0f), V::Div(V::Set1(2.0f),
+      V::Add(ExpVec<V>(V::Add(abs_x, abs_x)), V::Set1(1.0f))));
+  large = V::Or(large, sign);
+  // |x| < 0.625: x + x^3 P(x^2),
+  Vec z = V::Mul(x, x),
+      small = V::Set1(-5.70498872745e-3f);
+  small = V::MulAdd(small, z, V::Set1(2.06390887954e-2f));
+  small = V::MulAdd(small, z, V::Set1(-5.37397155531e-2f));
+  small = V::MulAdd(small, z, V::Set1(1.33314422036e-1f));
+  small = V::MulAdd(small, z, V::Set1(-3.33332819422e-1f));
+  small = V::MulAdd(V::Mul(small, z), x, x);
+  return V::Select(V::CmpLt(abs_x, V::Set1(0.625f)), large, small);
+}
+
+template<class V> struct ExpOp {
+  static inline typename V::Vec Apply(typename V::Vec x) { return ExpVec<V>(x); }
+};
+template<class V> struct LogOp {
+  static inline typename V::Vec Apply(typename V::Vec x) { return LogVec<V>(x); }
+};
+template<class V> struct SigmoidOp {
+  static inline typename V::Vec Apply(typename V::Vec x) { return SigmoidVec<V>(x); }
+};
+template<class V> struct TanhOp {
+  static inline typename V::Vec Apply(typename V::Vec x) { return TanhVec<V>(x); }
+};
+
+/// y = Op(x), the last partial vector goes through a zero-padded buffer.
+template<class V, class Op>
+inline void Map(const float *x, float *y, int n) {
+  int i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth)
+    V::Store(y + i, Op::Apply(V::Load(x + i)));
+  if (i < n) {
+    float buf[V::kWidth];
+    for (int j = 0; j < V::kWidth; j++) buf[j] = (i + j < n ? x[i + j] : 0.0f);
+    V::Store(buf, Op::Apply(V::Load(buf)));
+    for (int j = 0; i + j < n; j++) y[i + j] = buf[j];
+  }
+}
+
+template<class V>
+inline float Max(const float *x, int n) {
+  typename V::Vec max = V::Set1(x[0]);  // n > 0,
+  int i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth)
+    max = V::Max(max, V::Load(x + i));
+  float ans = V::HorizontalMax(max);
+  for (; i < n; i++) ans = (x[i] > ans ? x[i] : ans);
+  return ans;
+}
+
+/// Returns sum(exp(x - shift)), stores exp(x - shift) in y if not NULL.
+template<class V>
+inline float ExpSum(const float *x, float shift, float *y, int n) {
+  typedef typename V::Vec Vec;
+  Vec sum = V::Set1(0.0f), s = V::Set1(shift);
+  int i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth) {
+    Vec e = ExpVec<V>(V::Sub(V::Load(x + i), s));
+    if (y != NULL) V::Store(y + i, e);
+    sum = V::Add(sum, e);
+  }
+  float ans = V::HorizontalSum(sum);
+  if (i < n) {
+    float buf[V::kWidth];
+    for (int j = 0; j < V::kWidth; j++) buf[j] = (i + j < n ? x[i + j] : 0.0f);
+    V::Store(buf, ExpVec<V>(V::Sub(V::Load(buf), s)));
+    for (int j = 0; i + j < n; j++) {
+      if (y != NULL) y[i + j] = buf[j];
+      ans += buf[j];
+    }
+  }
+  return ans;
+}
+
+/// y = x * alpha + beta
+template<class V>
+inline void ScaleAdd(const float *x, float alpha, float beta, float *y, int n) {
+  typename V::Vec a = V::Set1(alpha), b = V::Set1(beta);
+  int i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth)
+    V::Store(y + i, V::MulAdd(V::Load(x + i), a, b));
+  for (; i < n; i++) y[i] = x[i] * alpha + beta;
+}
+
+template<class V>
+inline float Log(float x) {
+  float buf[V::kWidth];
+  V::Store(buf, LogVec<V>(V::Set1(x)));
+  return buf[0];
+}
+
+template<class V>
+inline float SoftMax(const float *x, float *y, int n) {
+  if (n == 0) return 0.0f;
+  float max = Max<V>(x, n),
+      sum = ExpSum<V>(x, max, y, n);
+  ScaleAdd<V>(y, 1.0f / sum, 0.0f, y, n);
+  return max + Log<V>(sum);
+}
+
+template<class V>
+inline float LogSoftMax(const float *x, float *y, int n) {
+  if (n == 0) return 0.0f;
+  float max = Max<V>(x, n),
+      log_norm = max + Log<V>(ExpSum<V>(x, max, NULL, n));
+  ScaleAdd<V>(x, 1.0f, -log_norm, y, n);
+  return log_norm;
+}
+
+template<class V>
+inline void DiffSigmoid(const float *value, const float *diff, float *y,
+                        int n) {
+  typename V::Vec one = V::Set1(1.0f);
+  int i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth) {
+    typename V::Vec v = V::Load(value + i);
+    V::Store(y + i, V::Mul(V::Mul(V::Load(diff + i), v), V::Sub(one, v)));
+  }
+  for (; i < n; i++) y[i] = diff[i] * value[i] * (1.0f - value[i]);
+}
+
+template<class V>
+inline void DiffTanh(const float *value, const float *diff, float *y, int n) {
+  typename V::Vec one = V::Set1(1.0f);
+  int i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth) {
+    typename V::Vec v = V::Load(value + i);
+    V::Store(y + i, V::Mul(V::Load(diff + i), V::Sub(one, V::Mul(v, v))));
+  }
+  for (; i < n; i++) y[i] = diff[i] * (1.0f - value[i] * value[i]);
+}
+
+}  // namespace simd_math
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SIMD_MATH_INL_H_
@@ -0,0 +1,197 @@
+// matrix/simd-math.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/simd-math.h"
+
+#ifdef KALDI_SIMD_MATH
+
+#include <emmintrin.h>
+#include "matrix/simd-math-inl.h"
+
+namespace kaldi {
+
+#ifdef KALDI_SIMD_MATH_AVX2
+// The AVX2+FMA kernels, in simd-math-avx2.cc.
+namespace simd_math_avx2 {
+void Exp(const float *x, float *y, int n);
+void Log(const float *x, float *y, int n);
+void Sigmoid(const float *x, float *y, int n);
+void Tanh(const float *x, float *y, int n);
+float SoftMax(const float *x, float *y, int n);
+float LogSoftMax(const float *x, float *y, int n);
+void DiffSigmoid(const float *value, const float *diff, float *y, int n);
+void DiffTanh(const float *value, const float *diff, float *y, int n);
+}  // namespace simd_math_avx2
+#endif
+
+namespace {
+
+struct Sse2 {
+  typedef __m128 Vec;
+  typedef __m128i IVec;
+  static const int kWidth = 4;
+
+  static inline Vec Load(const float *p) { return _mm_loadu_ps(p); }
+  static inline void Store(float *p, Vec v) { _mm_storeu_ps(p, v); }
+  static inline Vec Set1(float f) { return _mm_set1_ps(f); }
+  static inline Vec Add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+  static inline Vec Sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+  static inline Vec Mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+  static inline Vec Div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+  static inline Vec MulAdd(Vec a, Vec b, Vec c) {  // a * b + c
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  // (b if either is nan)
+  static inline Vec Min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+  static inline Vec Max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+  static inline Vec And(Vec a, Vec b) { return _mm_and_ps(a, b); }
+  static inline Vec AndNot(Vec a, Vec b) { return _mm_andnot_ps(a, b); }
+  static inline Vec Or(Vec a, Vec b) { return _mm_or_ps(a, b); }
+  static inline Vec CmpLt(Vec a, Vec b) { return _mm_cmplt_ps(a, b); }
+  static inline Vec CmpGt(Vec a, Vec b) { return _mm_cmpgt_ps(a, b); }
+  static inline Vec CmpEq(Vec a, Vec b) { return _mm_cmpeq_ps(a, b); }
+  static inline Vec CmpNotGe(Vec a, Vec b) { return _mm_cmpnge_ps(a, b); }
+  // mask ? b : a
+  static inline Vec Select(Vec mask, Vec a, Vec b) {
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+  }
+  static inline IVec ToInt(Vec a) { return _mm_cvttps_epi32(a); }
+  static inline Vec ToFloat(IVec a) { return _mm_cvtepi32_ps(a); }
+  static inline Vec AsFloat(IVec a) { return _mm_castsi128_ps(a); }
+  static inline IVec AsInt(Vec a) { return _mm_castps_si128(a); }
+  static inline IVec Set1Int(int i) { return _mm_set1_epi32(i); }
+  static inline IVec AddInt(IVec a, IVec b) { return _mm_add_epi32(a, b); }
+  static inline IVec SubInt(IVec a, IVec b) { return _mm_sub_epi32(a, b); }
+  static inline IVec ShiftLeftInt(IVec a, int n) { return _mm_slli_epi32(a, n); }
+  static inline IVec ShiftRightInt(IVec a, int n) { return _mm_srli_epi32(a, n); }
+  static inline float HorizontalSum(Vec a) {
+    a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+    return _mm_cvtss_f32(a);
+  }
+  static inline float HorizontalMax(Vec a) {
+    a = _mm_max_ps(a, _mm_movehl_ps(a, a));
+    a = _mm_max_ss(a, _mm_shuffle_ps(a, a, 1));
+    return _mm_cvtss_f32(a);
+  }
+};
+
+bool force_sse2 = false;
+
+inline bool UseAvx2() {
+#ifdef KALDI_SIMD_MATH_AVX2
+  static const bool has_avx2 = (__builtin_cpu_init(),
+                                __builtin_cpu_supports("avx2") &&
+                                __builtin_cpu_supports("fma"));
+  return has_avx2 && !force_sse2;
+#else
+  return false;
+#endif
+}
+
+}  // namespace
+
+
+const char *SimdMathInstructionSet() {
+  return (UseAvx2() ? "avx2" : "sse2");
+}
+
+void SimdMathForceSse2(bool force) { force_sse2 = force; }
+
+void SimdExp(const float *x, float *y, MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    simd_math_avx2::Exp(x, y, n);
+    return;
+  }
+#endif
+  simd_math::Map<Sse2, simd_math::ExpOp<Sse2> >(x, y, n);
+}
+
+void SimdLog(const float *x, float *y, MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    simd_math_avx2::Log(x, y, n);
+    return;
+  }
+#endif
+  simd_math::Map<Sse2, simd_math::LogOp<Sse2> >(x, y, n);
+}
+
+void SimdSigmoid(const float *x, float *y, MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    simd_math_avx2::Sigmoid(x, y, n);
+    return;
+  }
+#endif
+  simd_math::Map<Sse2, simd_math::SigmoidOp<Sse2> >(x, y, n);
+}
+
+void SimdTanh(const float *x, float *y, MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    simd_math_avx2::Tanh(x, y, n);
+    return;
+  }
+#endif
+  simd_math::Map<Sse2, simd_math::TanhOp<Sse2> >(x, y, n);
+}
+
+float SimdSoftMax(const float *x, float *y, MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    return simd_math_avx2::SoftMax(x, y, n);
+  }
+#endif
+  return simd_math::SoftMax<Sse2>(x, y, n);
+}
+
+float SimdLogSoftMax(const float *x, float *y, MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    return simd_math_avx2::LogSoftMax(x, y, n);
+  }
+#endif
+  return simd_math::LogSoftMax<Sse2>(x, y, n);
+}
+
+void SimdDiffSigmoid(const float *value, const float *diff, float *y,
+                     MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    simd_math_avx2::DiffSigmoid(value, diff, y, n);
+    return;
+  }
+#endif
+  simd_math::DiffSigmoid<Sse2>(value, diff, y, n);
+}
+
+void SimdDiffTanh(const float *value, const float *diff, float *y,
+                  MatrixIndexT n) {
+#ifdef KALDI_SIMD_MATH_AVX2
+  if (UseAvx2()) {
+    simd_math_avx2::DiffTanh(value, diff, y, n);
+    return;
+  }
+#endif
+  simd_math::DiffTanh<Sse2>(value, diff, y, n);
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_SIMD_MATH
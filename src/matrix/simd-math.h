@@ -0,0 +1,82 @@
+// matrix/simd-math.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SIMD_MATH_H_
+#define KALDI_MATRIX_SIMD_MATH_H_
+
+#include "matrix/matrix-common.h"
+
+// Vectorized single-precision exp/log and the nonlinearities built on them,
+// used by the float versions of VectorBase::Sigmoid(), Tanh(), ApplyExp(),
+// ApplyLog(), ApplySoftMax() ... (the CPU path of the CuMatrix functions).
+// SSE2 is the baseline, the AVX2+FMA kernels are selected at run-time if the
+// CPU supports them.  Define KALDI_NO_SIMD_MATH to use the libm loops.
+#if defined(__SSE2__) && !defined(KALDI_NO_SIMD_MATH)
+#define KALDI_SIMD_MATH 1
+#if defined(__GNUC__) && !defined(__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define KALDI_SIMD_MATH_AVX2 1
+#endif
+#endif
+
+namespace kaldi {
+
+#ifdef KALDI_SIMD_MATH
+
+/// The instruction set of the kernels: "avx2" or "sse2".
+const char *SimdMathInstructionSet();
+
+/// If true, the SSE2 kernels are used even if the CPU has AVX2
+/// (for testing; not thread-safe, call it before the computation).
+void SimdMathForceSse2(bool force);
+
+// The kernels below work on arrays of length n, 'x' and 'y' may be
+// the same array.  The accuracy is a few ulps (see UnitTestSimdMath()),
+// exp() saturates to 0 below log(FLT_MIN) and log() treats the
+// denormals as FLT_MIN.
+
+/// y = exp(x)
+void SimdExp(const float *x, float *y, MatrixIndexT n);
+
+/// y = log(x), (-inf for 0, nan for negative x)
+void SimdLog(const float *x, float *y, MatrixIndexT n);
+
+/// y = 1 / (1 + exp(-x))
+void SimdSigmoid(const float *x, float *y, MatrixIndexT n);
+
+/// y = tanh(x)
+void SimdTanh(const float *x, float *y, MatrixIndexT n);
+
+/// y = softmax(x), returns the log-normalizer (max + log sum exp(x - max)).
+float SimdSoftMax(const float *x, float *y, MatrixIndexT n);
+
+/// y = x - log sum exp(x), returns the log-normalizer.
+float SimdLogSoftMax(const float *x, float *y, MatrixIndexT n);
+
+/// y = diff * value * (1 - value), (backprop of the sigmoid)
+void SimdDiffSigmoid(const float *value, const float *diff, float *y,
+                     MatrixIndexT n);
+
+/// y = diff * (1 - value^2), (backprop of the tanh)
+void SimdDiffTanh(const float *value, const float *diff, float *y,
+                  MatrixIndexT n);
+
+#endif  // KALDI_SIMD_MATH
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SIMD_MATH_H_
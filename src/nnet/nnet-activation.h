@@ -114,7 +114,30 @@ class BlockSoftmax : public Component {
     WriteIntegerVector(os, binary, block_dims);
   }
 
+  /// Set row-ranges of a task-grouped mini-batch, the rows of block 'bl'
+  /// are [ row_offset[bl], row_offset[bl+1] ). With non-empty 'row_offset',
+  /// the softmax is evaluated only on the rows of each block (the rest
+  /// of the output stays zero). Empty vector restores the dense mode.
+  void SetBlockRowOffset(const std::vector<int32> &row_offset) {
+    KALDI_ASSERT(row_offset.empty() || row_offset.size() == block_dims.size()+1);
+    block_row_offset = row_offset;
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
+    if (!block_row_offset.empty()) {
+      // sparse mode, softmax only on the rows of each block:
+      KALDI_ASSERT(block_row_offset.back() == in.NumRows());
+      for (int32 bl = 0; bl < block_dims.size(); bl++) {
+        int32 num_rows = block_row_offset[bl+1] - block_row_offset[bl];
+        if (num_rows == 0) continue;
+        CuSubMatrix<BaseFloat> in_bl = in.Range(block_row_offset[bl], num_rows,
+                                                block_offset[bl], block_dims[bl]);
+        CuSubMatrix<BaseFloat> out_bl = out->Range(block_row_offset[bl], num_rows,
+                                                   block_offset[bl], block_dims[bl]);
+        out_bl.ApplySoftMaxPerRow(in_bl);
+      }
+      return;
+    }
     // perform softmax per block:
     for (int32 bl = 0; bl < block_dims.size(); bl++) {
       CuSubMatrix<BaseFloat> in_bl = in.ColRange(block_offset[bl], block_dims[bl]);
@@ -126,6 +149,18 @@ class BlockSoftmax : public Component {
 
   void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in, const CuMatrixBase<BaseFloat> &out,
                         const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff) {
+    if (!block_row_offset.empty()) {
+      // sparse mode, copy only the in-block derivatives,
+      // ('in_diff' was zeroed in Component::Backpropagate)
+      KALDI_ASSERT(block_row_offset.back() == out_diff.NumRows());
+      for (int32 bl = 0; bl < block_dims.size(); bl++) {
+        int32 num_rows = block_row_offset[bl+1] - block_row_offset[bl];
+        if (num_rows == 0) continue;
+        in_diff->Range(block_row_offset[bl], num_rows, block_offset[bl], block_dims[bl]).
+          CopyFromMat(out_diff.Range(block_row_offset[bl], num_rows, block_offset[bl], block_dims[bl]));
+      }
+      return;
+    }
     // copy the error derivative:
     // (assuming we already got softmax-cross-entropy derivative in out_diff)
     in_diff->CopyFromMat(out_diff);
@@ -157,6 +192,7 @@ class BlockSoftmax : public Component {
 
   std::vector<int32> block_dims;
   std::vector<int32> block_offset;
+  std::vector<int32> block_row_offset; ///< row-ranges of blocks (empty = dense mode)
 };
 
 
@@ -249,6 +285,15 @@ class Dropout : public Component {
     WriteBasicType(os, binary, dropout_retention_);
   }
 
+  bool IsFeedforwardThreadSafe() const {
+    return (dropout_retention_ == 1.0);  // no mask is drawn,
+  }
+
+  void FeedforwardFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const {
+    KALDI_ASSERT(dropout_retention_ == 1.0);
+    out->CopyFromMat(in);
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     out->CopyFromMat(in);
     // switch off 50% of the inputs...
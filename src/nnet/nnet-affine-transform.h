@@ -128,6 +128,13 @@ class AffineTransform : public UpdatableComponent {
     wei_copy->Range(0,linearity_num_elem).CopyRowsFromMat(Matrix<BaseFloat>(linearity_));
     wei_copy->Range(linearity_num_elem, bias_.Dim()).CopyFromVec(Vector<BaseFloat>(bias_));
   }
+
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    int32 linearity_num_elem = linearity_.NumRows() * linearity_.NumCols(); 
+    linearity_.CopyRowsFromVec(params.Range(0, linearity_num_elem));
+    bias_.CopyFromVec(params.Range(linearity_num_elem, bias_.Dim()));
+  }
   
   std::string Info() const {
     return std::string("\n  linearity") + MomentStatistics(linearity_) +
@@ -147,6 +154,23 @@ class AffineTransform : public UpdatableComponent {
   // "in dim" = i/p dim of this component = feat dim for first layer or out dim of the previous component
   // "out dim" = o/p dim of this component
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
+    if (!out_block_row_offset_.empty()) {
+      // sparse mode, evaluate only the in-block rows of each output block,
+      // (the rest of 'out' stays zero, it was reset in Component::Propagate)
+      KALDI_ASSERT(out_block_row_offset_.back() == in.NumRows());
+      for (int32 bl = 0; bl+1 < out_block_offset_.size(); bl++) {
+        int32 row_beg = out_block_row_offset_[bl],
+          num_rows = out_block_row_offset_[bl+1] - row_beg,
+          col_beg = out_block_offset_[bl],
+          num_cols = out_block_offset_[bl+1] - col_beg;
+        if (num_rows == 0) continue;
+        CuSubMatrix<BaseFloat> out_bl(out->Range(row_beg, num_rows, col_beg, num_cols));
+        out_bl.AddVecToRows(1.0, bias_.Range(col_beg, num_cols), 0.0);
+        out_bl.AddMatMat(1.0, in.RowRange(row_beg, num_rows), kNoTrans,
+                         linearity_.RowRange(col_beg, num_cols), kTrans, 1.0);
+      }
+      return;
+    }
     // precopy bias
     out->AddVecToRows(1.0, bias_, 0.0);
     // multiply by weights^t
@@ -161,6 +185,20 @@ class AffineTransform : public UpdatableComponent {
   // "in dim" = i/p dim of this component
   void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in, const CuMatrixBase<BaseFloat> &out,
                         const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff) {
+    if (!out_block_row_offset_.empty()) {
+      // sparse mode, only the in-block part of 'out_diff' is non-zero,
+      for (int32 bl = 0; bl+1 < out_block_offset_.size(); bl++) {
+        int32 row_beg = out_block_row_offset_[bl],
+          num_rows = out_block_row_offset_[bl+1] - row_beg,
+          col_beg = out_block_offset_[bl],
+          num_cols = out_block_offset_[bl+1] - col_beg;
+        if (num_rows == 0) continue;
+        in_diff->RowRange(row_beg, num_rows).AddMatMat(1.0, 
+            out_diff.Range(row_beg, num_rows, col_beg, num_cols), kNoTrans,
+            linearity_.RowRange(col_beg, num_cols), kNoTrans, 0.0);
+      }
+      return;
+    }
     // multiply error derivative by weights
     in_diff->AddMatMat(1.0, out_diff, kNoTrans, linearity_, kNoTrans, 0.0);
   }
@@ -176,8 +214,25 @@ class AffineTransform : public UpdatableComponent {
     // we will also need the number of frames in the mini-batch
     const int32 num_frames = input.NumRows();
     // compute gradient (incl. momentum)
-    linearity_corr_.AddMatMat(1.0, diff, kTrans, input, kNoTrans, mmt);
-    bias_corr_.AddRowSumMat(1.0, diff, mmt);
+    if (!out_block_row_offset_.empty()) {
+      // sparse mode, gradient of each block from the rows of the block,
+      linearity_corr_.Scale(mmt);
+      bias_corr_.Scale(mmt);
+      for (int32 bl = 0; bl+1 < out_block_offset_.size(); bl++) {
+        int32 row_beg = out_block_row_offset_[bl],
+          num_rows = out_block_row_offset_[bl+1] - row_beg,
+          col_beg = out_block_offset_[bl],
+          num_cols = out_block_offset_[bl+1] - col_beg;
+        if (num_rows == 0) continue;
+        CuSubMatrix<BaseFloat> diff_bl(diff.Range(row_beg, num_rows, col_beg, num_cols));
+        linearity_corr_.RowRange(col_beg, num_cols).AddMatMat(1.0, diff_bl, kTrans,
+            input.RowRange(row_beg, num_rows), kNoTrans, 1.0);
+        bias_corr_.Range(col_beg, num_cols).AddRowSumMat(1.0, diff_bl, 1.0);
+      }
+    } else {
+      linearity_corr_.AddMatMat(1.0, diff, kTrans, input, kNoTrans, mmt);
+      bias_corr_.AddRowSumMat(1.0, diff, mmt);
+    }
     // l2 regularization
     if (l2 != 0.0) {
       linearity_.AddMat(-lr*l2*num_frames, linearity_);
@@ -187,8 +242,14 @@ class AffineTransform : public UpdatableComponent {
       cu::RegularizeL1(&linearity_, &linearity_corr_, lr*l1*num_frames, lr);
     }
     // update
-    linearity_.AddMat(-lr, linearity_corr_);
-    bias_.AddVec(-lr_bias, bias_corr_);
+    if (out_learn_rate_scale_.Dim() == 0) {
+      linearity_.AddMat(-lr, linearity_corr_);
+      bias_.AddVec(-lr_bias, bias_corr_);
+    } else {
+      // per-output learning rates, (the rows of the tasks of multi-task output)
+      linearity_.AddDiagVecMat(-lr, out_learn_rate_scale_, linearity_corr_, kNoTrans, 1.0);
+      bias_.AddVecVec(-lr_bias, out_learn_rate_scale_, bias_corr_, 1.0);
+    }
     // max-norm
     if (max_norm_ > 0.0) {
       CuMatrix<BaseFloat> lin_sqr(linearity_);
@@ -224,6 +285,26 @@ class AffineTransform : public UpdatableComponent {
     linearity_.CopyFromMat(linearity);
   }
 
+  /// Set the output blocks (column offsets of e.g. BlockSoftmax) and
+  /// their row-ranges in a task-grouped mini-batch, then only the in-block
+  /// part of the output is computed. Empty vectors restore the dense mode.
+  void SetOutputBlocks(const std::vector<int32> &block_offset,
+                       const std::vector<int32> &block_row_offset) {
+    KALDI_ASSERT(block_offset.size() == block_row_offset.size());
+    KALDI_ASSERT(block_offset.empty() || block_offset.back() == OutputDim());
+    out_block_offset_ = block_offset;
+    out_block_row_offset_ = block_row_offset;
+  }
+
+  /// Set the learning-rate multipliers of the outputs (rows of the linearity),
+  /// e.g. per-task in the multi-task output layer, empty vector = all 1.0.
+  /// The multipliers are not stored in the model.
+  void SetOutputLearnRateScale(const VectorBase<BaseFloat> &scale) {
+    KALDI_ASSERT(scale.Dim() == 0 || scale.Dim() == OutputDim());
+    out_learn_rate_scale_.Resize(scale.Dim());
+    out_learn_rate_scale_.CopyFromVec(scale);
+  }
+
   const CuVectorBase<BaseFloat>& GetBiasCorr() const {
     return bias_corr_;
   }
@@ -243,6 +324,10 @@ class AffineTransform : public UpdatableComponent {
   BaseFloat learn_rate_coef_;
   BaseFloat bias_learn_rate_coef_;
   BaseFloat max_norm_;
+
+  std::vector<int32> out_block_offset_; ///< column offsets of output blocks (sparse mode)
+  std::vector<int32> out_block_row_offset_; ///< row offsets of output blocks (sparse mode)
+  CuVector<BaseFloat> out_learn_rate_scale_; ///< per-output learning-rate multipliers (empty = none)
 };
 
 } // namespace nnet1
@@ -318,6 +318,55 @@ class BLstmProjectedStreams : public UpdatableComponent {
     return;
   }
 
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    int32 offset = 0, len;
+
+    len = f_w_gifo_x_.NumRows() * f_w_gifo_x_.NumCols();
+    f_w_gifo_x_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = f_w_gifo_r_.NumRows() * f_w_gifo_r_.NumCols();
+    f_w_gifo_r_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = f_bias_.Dim();
+    f_bias_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = f_peephole_i_c_.Dim();
+    f_peephole_i_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = f_peephole_f_c_.Dim();
+    f_peephole_f_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = f_peephole_o_c_.Dim();
+    f_peephole_o_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = f_w_r_m_.NumRows() * f_w_r_m_.NumCols();
+    f_w_r_m_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_w_gifo_x_.NumRows() * b_w_gifo_x_.NumCols();
+    b_w_gifo_x_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_w_gifo_r_.NumRows() * b_w_gifo_r_.NumCols();
+    b_w_gifo_r_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_bias_.Dim();
+    b_bias_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_peephole_i_c_.Dim();
+    b_peephole_i_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_peephole_f_c_.Dim();
+    b_peephole_f_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_peephole_o_c_.Dim();
+    b_peephole_o_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = b_w_r_m_.NumRows() * b_w_r_m_.NumCols();
+    b_w_r_m_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    KALDI_ASSERT(offset == NumParams());
+  }
+
 
   std::string Info() const {
     return std::string("  ")  +
@@ -465,6 +514,10 @@ class BLstmProjectedStreams : public UpdatableComponent {
   }
 
 
+  bool IsFeedforwardThreadSafe() const {
+    return false;  // the recurrent state and the buffers are kept in the component,
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     int DEBUG = 0;
 
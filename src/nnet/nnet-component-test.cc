@@ -25,7 +25,11 @@
 #include "nnet/nnet-max-pooling-component.h"
 #include "nnet/nnet-max-pooling-2d-component.h"
 #include "nnet/nnet-average-pooling-2d-component.h"
+#include "nnet/nnet-parallel-component.h"
+#include "nnet/nnet-affine-transform.h"
 #include "nnet/nnet-loss.h"
+#include "nnet/nnet-utils.h"
+#include "nnet/nnet-train-parallel.h"
 #include "util/common-utils.h"
 
 #include <sstream>
@@ -573,6 +577,72 @@ namespace nnet1 {
 
   }
 
+  void UnitTestBlockSoftmaxSparse() {
+    // network : affine transform + block-softmax with 2 blocks,
+    Nnet nnet_dense;
+    nnet_dense.AppendComponent(Component::Init("<AffineTransform> <InputDim> 5 <OutputDim> 6 <BiasMean> 0.0 <BiasRange> 1.0 <ParamStddev> 0.5"));
+    nnet_dense.AppendComponent(Component::Init("<BlockSoftmax> <InputDim> 6 <OutputDim> 6 <BlockDims> 3:3"));
+    NnetTrainOptions opts;
+    opts.learn_rate = 0.1;
+    opts.momentum = 0.5;
+    nnet_dense.SetTrainOptions(opts);
+    Nnet nnet_sparse(nnet_dense);
+
+    // input grouped by tasks, rows 0..2 : task 1, rows 3..4 : task 2,
+    CuMatrix<BaseFloat> mat_in;
+    ReadCuMatrixFromString("[ -1.2 0.4 1.1 -0.5 0.3 ; \
+                               0.7 -2.1 0.2 0.9 -0.4 ; \
+                               1.5 0.6 -0.3 -1.8 1.0 ; \
+                              -0.2 1.3 0.8 0.1 -1.1 ; \
+                               0.9 -0.7 -1.4 0.6 0.5 ]", &mat_in);
+    Posterior post(mat_in.NumRows());
+    post[0].push_back(std::make_pair(0, 1.0));
+    post[1].push_back(std::make_pair(2, 1.0));
+    post[2].push_back(std::make_pair(1, 1.0));
+    post[3].push_back(std::make_pair(5, 1.0));
+    post[4].push_back(std::make_pair(3, 1.0));
+    Vector<BaseFloat> frm_weights(mat_in.NumRows());
+    frm_weights.Set(1.0);
+
+    std::vector<int32> block_offset, frame_order, row_offset;
+    block_offset.push_back(0); block_offset.push_back(3); block_offset.push_back(6);
+    KALDI_ASSERT(GroupPosteriorByBlock(post, block_offset, &frame_order, &row_offset));
+    KALDI_ASSERT(row_offset[1] == 3 && row_offset[2] == 5);
+    nnet_sparse.SetBlockSoftmaxRowOffset(row_offset);
+
+    // two iterations, to check also the momentum,
+    for (int32 iter = 0; iter < 2; iter++) {
+      CuMatrix<BaseFloat> out_dense, out_sparse, diff_dense, diff_sparse,
+        in_diff_dense, in_diff_sparse;
+      nnet_dense.Propagate(mat_in, &out_dense);
+      nnet_sparse.Propagate(mat_in, &out_sparse);
+      // the in-block outputs match, the rest of sparse output is zero,
+      for (int32 r = 0; r < mat_in.NumRows(); r++) {
+        int32 bl = (r < row_offset[1] ? 0 : 1);
+        for (int32 c = 0; c < 6; c++) {
+          BaseFloat ref = (c >= block_offset[bl] && c < block_offset[bl+1] ?
+                           out_dense(r, c) : 0.0);
+          AssertEqual(out_sparse(r, c), ref);
+        }
+      }
+      MultiTaskLoss loss_dense, loss_sparse;
+      loss_dense.InitFromString("multitask,xent,3,1.0,xent,3,1.0");
+      loss_sparse.InitFromString("multitask,xent,3,1.0,xent,3,1.0");
+      loss_dense.Eval(frm_weights, out_dense, post, &diff_dense);
+      loss_sparse.Eval(frm_weights, out_sparse, post, &diff_sparse);
+      AssertEqual(diff_dense, diff_sparse);
+      AssertEqual(loss_dense.AvgLoss(), loss_sparse.AvgLoss());
+      // backprop + update,
+      nnet_dense.Backpropagate(diff_dense, &in_diff_dense);
+      nnet_sparse.Backpropagate(diff_sparse, &in_diff_sparse);
+      AssertEqual(in_diff_dense, in_diff_sparse);
+    }
+    Vector<BaseFloat> params_dense, params_sparse;
+    nnet_dense.GetParams(&params_dense);
+    nnet_sparse.GetParams(&params_sparse);
+    AssertEqual(params_dense, params_sparse);
+  }
+
   void UnitTestTargetInterpolation() {
 
 	  MultiTaskLoss multitask;
@@ -658,6 +728,207 @@ namespace nnet1 {
 #endif
   }
 
+  void UnitTestNnetSetParams() {
+    Nnet nnet;
+    nnet.AppendComponent(Component::Init("<AddShift> <InputDim> 5 <OutputDim> 5 <InitParam> 0.1"));
+    nnet.AppendComponent(Component::Init("<AffineTransform> <InputDim> 5 <OutputDim> 4 <BiasMean> 0.0 <BiasRange> 1.0 <ParamStddev> 0.5"));
+    nnet.AppendComponent(Component::Init("<Rescale> <InputDim> 4 <OutputDim> 4 <InitParam> 2.0"));
+    nnet.AppendComponent(Component::Init("<LinearTransform> <InputDim> 4 <OutputDim> 3 <ParamStddev> 0.5"));
+    // set random parameters, get them back,
+    Vector<BaseFloat> params(nnet.NumParams()), params2;
+    params.SetRandn();
+    nnet.SetParams(params);
+    nnet.GetParams(&params2);
+    AssertEqual(params, params2);
+  }
+
+  void UnitTestParallelComponentBranches() {
+    // 2 nested networks, each reads 5 columns of the input,
+    Component* c = Component::Init("<ParallelComponent> <InputDim> 10 <OutputDim> 6 <NestedNnetProto> xent_debug.proto xent_debug.proto </NestedNnetProto> ");
+    ParallelComponent* pc = dynamic_cast<ParallelComponent*>(c);
+    Nnet nnet1(pc->GetNestedNnet(0)), nnet2(pc->GetNestedNnet(1));
+    CuMatrix<BaseFloat> in(8, 10), out, out_diff(8, 6), in_diff;
+    in.SetRandn();
+    out_diff.SetRandn();
+    c->Propagate(in, &out);
+    c->Backpropagate(in, out, out_diff, &in_diff);
+    // reference, the nested networks one after another,
+    CuMatrix<BaseFloat> out1, out2, in_diff1, in_diff2;
+    nnet1.Propagate(in.ColRange(0, 5), &out1);
+    nnet2.Propagate(in.ColRange(5, 5), &out2);
+    nnet1.Backpropagate(out_diff.ColRange(0, 3), &in_diff1);
+    nnet2.Backpropagate(out_diff.ColRange(3, 3), &in_diff2);
+    AssertEqual(Matrix<BaseFloat>(out.ColRange(0, 3)), Matrix<BaseFloat>(out1));
+    AssertEqual(Matrix<BaseFloat>(out.ColRange(3, 3)), Matrix<BaseFloat>(out2));
+    AssertEqual(Matrix<BaseFloat>(in_diff.ColRange(0, 5)), Matrix<BaseFloat>(in_diff1));
+    AssertEqual(Matrix<BaseFloat>(in_diff.ColRange(5, 5)), Matrix<BaseFloat>(in_diff2));
+    // the nested networks were updated in the same way,
+    Vector<BaseFloat> params, params_ref1, params_ref2;
+    pc->GetParams(&params);
+    nnet1.GetParams(&params_ref1);
+    nnet2.GetParams(&params_ref2);
+    Vector<BaseFloat> params1(params.Range(0, params_ref1.Dim())),
+      params2(params.Range(params_ref1.Dim(), params_ref2.Dim()));
+    AssertEqual(params1, params_ref1);
+    AssertEqual(params2, params_ref2);
+    // the 2nd pass re-uses the thread pool, a copy runs in the calling thread,
+    ParallelComponent* pc_seq = dynamic_cast<ParallelComponent*>(c->Copy());
+    pc_seq->SetNumThreads(1);
+    CuMatrix<BaseFloat> out_seq, in_diff_seq;
+    c->Propagate(in, &out);
+    c->Backpropagate(in, out, out_diff, &in_diff);
+    pc_seq->Propagate(in, &out_seq);
+    pc_seq->Backpropagate(in, out_seq, out_diff, &in_diff_seq);
+    AssertEqual(Matrix<BaseFloat>(out), Matrix<BaseFloat>(out_seq));
+    AssertEqual(Matrix<BaseFloat>(in_diff), Matrix<BaseFloat>(in_diff_seq));
+    delete pc_seq;
+    delete c;
+  }
+
+  void UnitTestNnetSelectTask() {
+    Nnet nnet;
+    nnet.AppendComponent(Component::Init("<AffineTransform> <InputDim> 5 <OutputDim> 7 <BiasMean> 0.0 <BiasRange> 1.0 <ParamStddev> 0.5"));
+    nnet.AppendComponent(Component::Init("<BlockSoftmax> <InputDim> 7 <OutputDim> 7 <BlockDims> 3:4"));
+    CuMatrix<BaseFloat> in(6, 5), out, out_task;
+    in.SetRandn();
+    nnet.Feedforward(in, &out);
+    // the 2nd block is evaluated alone,
+    Nnet nnet_task(nnet);
+    nnet_task.SelectTask(2);
+    KALDI_ASSERT(nnet_task.OutputDim() == 4);
+    KALDI_ASSERT(nnet_task.GetComponent(1).GetType() == Component::kSoftmax);
+    nnet_task.Feedforward(in, &out_task);
+    AssertEqual(Matrix<BaseFloat>(out.ColRange(3, 4)), Matrix<BaseFloat>(out_task));
+  }
+
+  void UnitTestMultiTaskWeighting() {
+    // 4 frames of task 1 (ids 0..2), 1 frame of task 2 (ids 3..5),
+    CuMatrix<BaseFloat> nnet_out(5, 6);
+    nnet_out.Set(1.0 / 3.0);
+    Posterior post(5);
+    for (int32 f = 0; f < 4; f++) post[f].push_back(std::make_pair(f % 3, 1.0));
+    post[4].push_back(std::make_pair(4, 1.0));
+    Vector<BaseFloat> frm_weights(5);
+    frm_weights.Set(1.0);
+    CuMatrix<BaseFloat> diff_fixed, diff_frames;
+    MultiTaskLoss loss_fixed, loss_frames;
+    loss_fixed.InitFromString("multitask,xent,3,1.0,xent,3,0.5");
+    loss_frames.InitFromString("multitask,xent,3,1.0,xent,3,0.5");
+    loss_frames.SetTaskWeighting("frames");
+    loss_fixed.Eval(frm_weights, nnet_out, post, &diff_fixed);
+    loss_frames.Eval(frm_weights, nnet_out, post, &diff_frames);
+    // both tasks get half of the 5 frames : task 1 x 5/8, task 2 x 5/2,
+    Matrix<BaseFloat> ref(diff_fixed);
+    ref.ColRange(0, 3).Scale(5.0 / 8.0);
+    ref.ColRange(3, 3).Scale(5.0 / 2.0);
+    AssertEqual(ref, Matrix<BaseFloat>(diff_frames));
+  }
+
+  void UnitTestTaskLearnRateScale() {
+    Nnet nnet;
+    nnet.AppendComponent(Component::Init("<AffineTransform> <InputDim> 4 <OutputDim> 6 <BiasMean> 0.0 <BiasRange> 1.0 <ParamStddev> 0.5"));
+    nnet.AppendComponent(Component::Init("<BlockSoftmax> <InputDim> 6 <OutputDim> 6 <BlockDims> 2:4"));
+    NnetTrainOptions opts;
+    opts.learn_rate = 0.1;
+    nnet.SetTrainOptions(opts);
+    Nnet nnet_ref(nnet);
+    // the rows of task 2 are not updated, the rows of task 1 as without scaling,
+    std::vector<int32> task_offset(3, 0);
+    task_offset[1] = 2; task_offset[2] = 6;
+    std::vector<BaseFloat> scale(2, 1.0);
+    scale[1] = 0.0;
+    nnet.SetTaskLearnRateScale(task_offset, scale);
+    CuMatrix<BaseFloat> in(5, 4), out, out_diff(5, 6), in_diff;
+    in.SetRandn();
+    out_diff.SetRandn();
+    Matrix<BaseFloat> linearity_init(dynamic_cast<const AffineTransform&>(nnet.GetComponent(0)).GetLinearity());
+    nnet.Propagate(in, &out);
+    nnet.Backpropagate(out_diff, &in_diff);
+    nnet_ref.Propagate(in, &out);
+    nnet_ref.Backpropagate(out_diff, &in_diff);
+    Matrix<BaseFloat> linearity(dynamic_cast<const AffineTransform&>(nnet.GetComponent(0)).GetLinearity()),
+      linearity_ref(dynamic_cast<const AffineTransform&>(nnet_ref.GetComponent(0)).GetLinearity());
+    AssertEqual(Matrix<BaseFloat>(linearity.RowRange(0, 2)), Matrix<BaseFloat>(linearity_ref.RowRange(0, 2)));
+    AssertEqual(Matrix<BaseFloat>(linearity.RowRange(2, 4)), Matrix<BaseFloat>(linearity_init.RowRange(2, 4)));
+  }
+
+  void UnitTestNnetFeedforwardShared() {
+    Nnet nnet;
+    nnet.AppendComponent(Component::Init("<Splice> <InputDim> 5 <OutputDim> 15 <BuildVector> -1:1 </BuildVector> "));
+    nnet.AppendComponent(Component::Init("<AffineTransform> <InputDim> 15 <OutputDim> 10 <BiasMean> 0.0 <BiasRange> 1.0 <ParamStddev> 0.5"));
+    nnet.AppendComponent(Component::Init("<Sigmoid> <InputDim> 10 <OutputDim> 10"));
+    nnet.AppendComponent(Component::Init("<Dropout> <InputDim> 10 <OutputDim> 10"));
+    nnet.AppendComponent(Component::Init("<ParallelComponent> <InputDim> 10 <OutputDim> 6 <NestedNnetProto> xent_debug.proto xent_debug.proto </NestedNnetProto> "));
+    // the dropout draws a mask in the forward pass,
+    KALDI_ASSERT(!nnet.IsFeedforwardThreadSafe());
+    nnet.SetDropoutRetention(1.0);
+    KALDI_ASSERT(nnet.IsFeedforwardThreadSafe());
+    // const forward pass with external buffers matches the forward pass,
+    CuMatrix<BaseFloat> in(9, 5), out, out_shared;
+    in.SetRandn();
+    nnet.Feedforward(in, &out);
+    std::vector<CuMatrix<BaseFloat> > buffers;
+    const Nnet &nnet_const = nnet;
+    nnet_const.Feedforward(in, &out_shared, &buffers);
+    AssertEqual(Matrix<BaseFloat>(out), Matrix<BaseFloat>(out_shared));
+  }
+
+  void UnitTestNnetParallelTrainer() {
+    Nnet nnet;
+    nnet.AppendComponent(Component::Init("<AffineTransform> <InputDim> 5 <OutputDim> 6 <BiasMean> 0.0 <BiasRange> 1.0 <ParamStddev> 0.5"));
+    nnet.AppendComponent(Component::Init("<Softmax> <InputDim> 6 <OutputDim> 6"));
+    NnetTrainOptions opts;
+    opts.learn_rate = 0.1;
+    nnet.SetTrainOptions(opts);
+    Nnet nnet_ref(nnet);
+    // two mini-batches, the 2nd one is a re-ordered view into a shared buffer,
+    std::vector<NnetMinibatch> mb(2);
+    CuMatrix<BaseFloat> buffer(8, 5);
+    buffer.SetRandn();
+    std::vector<CuMatrix<BaseFloat> > feats(mb.size());
+    for (int32 i = 0; i < mb.size(); i++) {
+      mb[i].targets.resize(4);
+      for (int32 t = 0; t < 4; t++) {
+        mb[i].targets[t].push_back(std::make_pair(RandInt(0, 5), 1.0));
+      }
+      mb[i].weights.Resize(4);
+      mb[i].weights.Set(1.0);
+    }
+    mb[0].feats.Resize(4, 5);
+    mb[0].feats.SetRandn();
+    feats[0] = mb[0].feats;
+    mb[1].feats_buffer = &buffer;
+    mb[1].feats_offset = 4;
+    for (int32 t = 0; t < 4; t++) mb[1].frame_order.push_back(3 - t);
+    feats[1].Resize(4, 5);
+    feats[1].CopyRows(buffer.RowRange(4, 4), mb[1].frame_order);
+    // reference: average of both updates, computed from the same initial model,
+    Vector<BaseFloat> params_ref(nnet.NumParams()), params;
+    for (int32 i = 0; i < mb.size(); i++) {
+      Nnet nnet_aux(nnet_ref);
+      Xent xent;
+      CuMatrix<BaseFloat> out, diff;
+      nnet_aux.Propagate(feats[i], &out);
+      xent.Eval(mb[i].weights, out, mb[i].targets, &diff);
+      AssertEqual(xent.LastLoss(), xent.AvgLoss()); // the only Eval(),
+      nnet_aux.Backpropagate(diff, NULL);
+      nnet_aux.GetParams(&params);
+      params_ref.AddVec(0.5, params);
+    }
+    // 2 threads, each trains one mini-batch, the updates get averaged,
+    Xent xent;
+    NnetParallelOptions popts;
+    popts.num_threads = 2;
+    popts.sync_minibatches = 1;
+    NnetParallelTrainer trainer(popts, false, false, &nnet, &xent);
+    trainer.Train(mb);
+    nnet.GetParams(&params);
+    // the loss statistics of the threads are in the shared loss,
+    KALDI_ASSERT(xent.Report().find("AvgLoss") != std::string::npos);
+    KALDI_ASSERT(xent.AvgLoss() > 0.0);
+    AssertEqual(params, params_ref);
+  }
+
 } // namespace nnet1
 } // namespace kaldi
 
@@ -685,7 +956,15 @@ int main() {
     // UnitTestParallelComponent_WithMSE();
     // UnitTestParallelComponent_WithMSE(2);
     // UnitTestBlockSoftmaxComponent();
+    UnitTestParallelComponentBranches();
+    UnitTestBlockSoftmaxSparse();
     UnitTestTargetInterpolation();
+    UnitTestNnetSetParams();
+    UnitTestNnetSelectTask();
+    UnitTestNnetFeedforwardShared();
+    UnitTestMultiTaskWeighting();
+    UnitTestTaskLearnRateScale();
+    if (loop == 0) UnitTestNnetParallelTrainer(); // CPU only,
     // end of unit-tests,
     if (loop == 0)
         KALDI_LOG << "Tests without GPU use succeeded.";
@@ -120,6 +120,17 @@ class Component {
  
   /// Perform forward pass propagation Input->Output
   void Propagate(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out); 
+  /// Perform forward pass propagation into pre-allocated 'out' (e.g. a sub-matrix)
+  void PropagateInto(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out);
+  /// Perform forward pass for inference, the component is not changed,
+  /// so a shared component can be used from several threads
+  /// (requires IsFeedforwardThreadSafe())
+  void Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out) const;
+  /// Check if the forward pass leaves the component unchanged (no buffers,
+  /// no lazy initialization), so Feedforward() can run concurrently
+  virtual bool IsFeedforwardThreadSafe() const {
+    return true;
+  }
   /// Perform backward pass propagation, out_diff -> in_diff
   /// '&in' and '&out' will sometimes be unused... 
   void Backpropagate(const CuMatrixBase<BaseFloat> &in,
@@ -144,6 +155,13 @@ class Component {
   /// Forward pass transformation (to be implemented by descending class...)
   virtual void PropagateFnc(const CuMatrixBase<BaseFloat> &in,
                             CuMatrixBase<BaseFloat> *out) = 0;
+  /// Forward pass for inference, the default is PropagateFnc() of the
+  /// components which don't change in the forward pass
+  virtual void FeedforwardFnc(const CuMatrixBase<BaseFloat> &in,
+                              CuMatrixBase<BaseFloat> *out) const {
+    KALDI_ASSERT(IsFeedforwardThreadSafe());
+    const_cast<Component*>(this)->PropagateFnc(in, out);
+  }
   /// Backward pass transformation (to be implemented by descending class...)
   virtual void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in,
                                 const CuMatrixBase<BaseFloat> &out,
@@ -192,6 +210,8 @@ class UpdatableComponent : public Component {
   /// Number of trainable parameters
   virtual int32 NumParams() const = 0;
   virtual void GetParams(Vector<BaseFloat> *params) const = 0;
+  /// Set the trainable parameters from a supervector (same layout as GetParams)
+  virtual void SetParams(const VectorBase<BaseFloat> &params) = 0;
 
   /// Compute gradient and update parameters
   virtual void Update(const CuMatrixBase<BaseFloat> &input,
@@ -228,6 +248,38 @@ inline void Component::Propagate(const CuMatrixBase<BaseFloat> &in,
 }
 
 
+inline void Component::PropagateInto(const CuMatrixBase<BaseFloat> &in,
+                                     CuMatrixBase<BaseFloat> *out) {
+  // Check the dims
+  if (input_dim_ != in.NumCols()) {
+    KALDI_ERR << "Non-matching dims! " << TypeToMarker(GetType()) 
+              << " input-dim : " << input_dim_ << " data : " << in.NumCols();
+  }
+  KALDI_ASSERT(out->NumRows() == in.NumRows() && out->NumCols() == output_dim_);
+  out->SetZero(); // reset, (as in Propagate())
+  // Call the propagation implementation of the component
+  PropagateFnc(in, out);
+}
+
+
+inline void Component::Feedforward(const CuMatrixBase<BaseFloat> &in,
+                                   CuMatrix<BaseFloat> *out) const {
+  // Check the dims
+  if (input_dim_ != in.NumCols()) {
+    KALDI_ERR << "Non-matching dims! " << TypeToMarker(GetType()) 
+              << " input-dim : " << input_dim_ << " data : " << in.NumCols();
+  }
+  if (!IsFeedforwardThreadSafe()) {
+    KALDI_ERR << TypeToMarker(GetType()) << " changes in the forward pass, "
+              << "it cannot be shared by several threads";
+  }
+  // Allocate target buffer
+  out->Resize(in.NumRows(), output_dim_, kSetZero); // reset
+  // Call the inference implementation of the component
+  FeedforwardFnc(in, out);
+}
+
+
 inline void Component::Backpropagate(const CuMatrixBase<BaseFloat> &in,
                                      const CuMatrixBase<BaseFloat> &out,
                                      const CuMatrixBase<BaseFloat> &out_diff,
@@ -236,6 +236,13 @@ class Convolutional2DComponent : public UpdatableComponent {
     wei_copy->Range(filters_num_elem, bias_.Dim()).CopyFromVec(Vector<BaseFloat>(bias_));
   }
 
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    int32 filters_num_elem = filters_.NumRows() * filters_.NumCols();
+    filters_.CopyRowsFromVec(params.Range(0, filters_num_elem));
+    bias_.CopyFromVec(params.Range(filters_num_elem, bias_.Dim()));
+  }
+
   std::string Info() const {
     return std::string("\n  filters") + MomentStatistics(filters_) +
            "\n  bias" + MomentStatistics(bias_);
@@ -247,6 +254,10 @@ class Convolutional2DComponent : public UpdatableComponent {
            ", lr-coef " + ToString(bias_learn_rate_coef_);
   }
 
+  bool IsFeedforwardThreadSafe() const {
+    return false;  // the patches are kept for the backward pass,
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     // useful dims
     int32 num_input_fmaps = input_dim_ / (fmap_x_len_ * fmap_y_len_);
@@ -0,0 +1,458 @@
+// nnet/nnet-data-prefetch.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet/nnet-data-prefetch.h"
+#include "base/timer.h"
+#include "cudamatrix/cu-device.h"
+#include "lat/lattice-functions.h"
+#include "nnet/nnet-utils.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace kaldi {
+namespace nnet1 {
+
+
+bool CompressedFeatsHolder::Read(std::istream &is) {
+  Clear();
+  bool binary;
+  if (!InitKaldiInputStream(is, &binary)) {
+    KALDI_WARN << "Reading Table object, failed reading binary header";
+    return false;
+  }
+  // the compressed matrix starts by "CM" token, (binary only)
+  if (!binary || Peek(is, binary) != 'C') {
+    KALDI_WARN << "The features are not compressed, use --compressed-feats only "
+               << "with features written by 'copy-feats --compress=true'";
+    return false;
+  }
+  try {
+    t_.Read(is, binary);
+    return true;
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Exception caught reading compressed features: " << e.what();
+    Clear();
+    return false;
+  }
+}
+
+
+NnetDataPrefetcher::NnetDataPrefetcher(const NnetDataPrefetchOptions &opts,
+                                       const std::string &feature_rspecifier,
+                                       const std::string &targets_rspecifier,
+                                       const std::string &weights_rspecifier,
+                                       Nnet *feature_transform)
+  : opts_(opts), apply_transform_in_reader_(false),
+    lattice_targets_(opts.lattice_targets_model != ""),
+    have_weights_(weights_rspecifier != ""), feature_transform_(feature_transform),
+    num_done_(0), num_no_tgt_mat_(0), num_other_error_(0),
+    num_frames_(0.0), num_target_entries_(0.0),
+    empty_semaphore_(std::max<int32>(opts.prefetch_utts, 1)),
+    reader_done_(false), reader_failed_(false), stop_(false), thread_(NULL),
+    producer_stall_(0.0), consumer_stall_(0.0),
+    utt_(NULL), done_(false) {
+  if (lattice_targets_ && opts_.compact_targets) {
+    KALDI_ERR << "Cannot use --lattice-targets-model with --compact-targets";
+  }
+  if (opts_.compressed_feats) {
+    if (IsFeaturePipelineSpec(feature_rspecifier))
+      KALDI_ERR << "Cannot use --compressed-feats with a feature-pipeline spec";
+    if (!compressed_feature_reader_.Open(feature_rspecifier))
+      KALDI_ERR << "Error opening the compressed features " << feature_rspecifier;
+  } else if (!feature_reader_.Open(feature_rspecifier)) {
+    KALDI_ERR << "Error opening the features " << feature_rspecifier;
+  }
+  if (lattice_targets_) {
+    // the lattices are read by random access, an archive which is not
+    // sorted would be kept in memory until the end,
+    RspecifierOptions ropts;
+    if (ClassifyRspecifier(targets_rspecifier, NULL, &ropts) == kArchiveRspecifier &&
+        !(ropts.sorted && ropts.called_sorted)) {
+      KALDI_ERR << "The lattice archive " << targets_rspecifier << " would be "
+                << "cached in memory, use 'ark,s,cs:' with a sorted archive "
+                << "and sorted features, or an 'scp:' list";
+    }
+    ReadKaldiObject(opts_.lattice_targets_model, &trans_model_);
+    lattice_reader_.Open(targets_rspecifier);
+  } else if (opts_.compact_targets) {
+    compact_targets_reader_.Open(targets_rspecifier);
+  } else {
+    targets_reader_.Open(targets_rspecifier);
+  }
+  if (have_weights_) {
+    weights_reader_.Open(weights_rspecifier);
+  }
+  if (opts_.prefetch_utts > 0) {
+    // the CUDA calls stay in the training thread,
+    apply_transform_in_reader_ = true;
+#if HAVE_CUDA == 1
+    if (CuDevice::Instantiate().Enabled()) {
+      apply_transform_in_reader_ = false;
+    }
+#endif
+    thread_ = new MultiThreader<ReaderThread>(1, ReaderThread(this));
+  }
+}
+
+
+NnetDataPrefetcher::~NnetDataPrefetcher() {
+  if (thread_ != NULL) {
+    // ask the reading thread to stop, and drain the queue, so it is not blocked,
+    queue_mutex_.Lock();
+    stop_ = true;
+    queue_mutex_.Unlock();
+    NnetUtterance *utt;
+    while ((utt = PopUtterance()) != NULL) delete utt;
+    delete thread_; // joins the thread,
+  }
+  delete utt_;
+}
+
+
+bool NnetDataPrefetcher::LatticeTargets(const std::string &key,
+                                        Posterior *targets) {
+  // (as lattice-to-post | post-to-pdf-post)
+  Lattice lat;
+  ConvertLattice(lattice_reader_.Value(key), &lat);
+  if (opts_.lattice_acoustic_scale != 1.0 || opts_.lattice_lm_scale != 1.0) {
+    fst::ScaleLattice(fst::LatticeScale(opts_.lattice_lm_scale,
+                                        opts_.lattice_acoustic_scale), &lat);
+  }
+  if (!(lat.Properties(fst::kFstProperties, false) & fst::kTopSorted)) {
+    if (fst::TopSort(&lat) == false) {
+      KALDI_WARN << key << ", cycles detected in lattice";
+      return false;
+    }
+  }
+  Posterior post;
+  LatticeForwardBackward(lat, &post);
+  ConvertPosteriorToPdfs(trans_model_, post, targets);
+  // prune the small posteriors, keeps the buffers of the randomizer small,
+  if (opts_.posterior_floor > 0.0) {
+    for (size_t t = 0; t < targets->size(); t++) {
+      std::vector<std::pair<int32, BaseFloat> > &frame = (*targets)[t];
+      if (frame.empty()) continue;
+      size_t best = 0;
+      for (size_t i = 1; i < frame.size(); i++) {
+        if (frame[i].second > frame[best].second) best = i;
+      }
+      std::swap(frame[0], frame[best]); // the best pdf always stays,
+      size_t num_kept = 1;
+      BaseFloat sum = frame[0].second;
+      for (size_t i = 1; i < frame.size(); i++) {
+        if (frame[i].second >= opts_.posterior_floor) {
+          frame[num_kept++] = frame[i];
+          sum += frame[i].second;
+        }
+      }
+      frame.resize(num_kept);
+      for (size_t i = 0; i < frame.size(); i++) {
+        frame[i].second /= sum;
+      }
+      std::sort(frame.begin(), frame.end());
+    }
+  }
+  // move the pdf-ids into the range of the task, (multitask training)
+  if (opts_.lattice_targets_offset != 0) {
+    for (size_t t = 0; t < targets->size(); t++) {
+      for (size_t i = 0; i < (*targets)[t].size(); i++) {
+        (*targets)[t][i].first += opts_.lattice_targets_offset;
+      }
+    }
+  }
+  return true;
+}
+
+
+bool NnetDataPrefetcher::FeaturesDone() {
+  if (!opts_.compressed_feats) return feature_reader_.Done();
+  if (!compressed_feature_reader_.IsOpen()) return true; // (closed below)
+  if (!compressed_feature_reader_.Done()) return false;
+  // a failed read (e.g. features which are not compressed) is not the end of data,
+  if (!compressed_feature_reader_.Close()) {
+    KALDI_ERR << "Error reading the features with --compressed-feats";
+  }
+  return true;
+}
+
+
+std::string NnetDataPrefetcher::FeaturesKey() {
+  return (opts_.compressed_feats ? compressed_feature_reader_.Key() :
+          feature_reader_.Key());
+}
+
+
+void NnetDataPrefetcher::FeaturesNext() {
+  if (opts_.compressed_feats) compressed_feature_reader_.Next();
+  else feature_reader_.Next();
+}
+
+
+bool NnetDataPrefetcher::ReadUtterance(NnetUtterance *utt) {
+  for ( ; !FeaturesDone(); FeaturesNext()) {
+    std::string key = FeaturesKey();
+    KALDI_VLOG(3) << "Reading " << key;
+    // check that we have targets
+    if (lattice_targets_ ? !lattice_reader_.HasKey(key) :
+        opts_.compact_targets ? !compact_targets_reader_.HasKey(key) :
+        !targets_reader_.HasKey(key)) {
+      KALDI_WARN << key << ", missing targets";
+      num_no_tgt_mat_++;
+      continue;
+    }
+    // check we have per-frame weights
+    if (have_weights_ && !weights_reader_.HasKey(key)) {
+      KALDI_WARN << key << ", missing per-frame weights";
+      num_other_error_++;
+      continue;
+    }
+    // get feature / target pair
+    utt->key = key;
+    if (opts_.compressed_feats) {
+      utt->compressed_feats = compressed_feature_reader_.Value();
+    } else {
+      utt->feats = feature_reader_.Value();
+    }
+    int32 num_feat_frames = (opts_.compressed_feats ?
+                             utt->compressed_feats.NumRows() : utt->feats.NumRows());
+    utt->feats_transformed = false;
+    if (lattice_targets_) {
+      if (!LatticeTargets(key, &utt->targets)) {
+        num_other_error_++;
+        continue;
+      }
+    } else if (opts_.compact_targets) {
+      utt->compact_targets = compact_targets_reader_.Value(key);
+    } else {
+      utt->targets = targets_reader_.Value(key);
+    }
+    int32 num_target_frames = (opts_.compact_targets ?
+                               utt->compact_targets.NumFrames() : utt->targets.size());
+    // get per-frame weights
+    if (have_weights_) {
+      utt->weights = weights_reader_.Value(key);
+    } else { // all per-frame weights are 1.0
+      utt->weights.Resize(num_feat_frames);
+      utt->weights.Set(1.0);
+    }
+    // correct small length mismatch ... or drop sentence
+    {
+      // add lengths to vector
+      std::vector<int32> length;
+      length.push_back(num_feat_frames);
+      length.push_back(num_target_frames);
+      length.push_back(utt->weights.Dim());
+      // find min, max
+      int32 min = *std::min_element(length.begin(), length.end());
+      int32 max = *std::max_element(length.begin(), length.end());
+      // fix or drop ?
+      if (max - min < opts_.length_tolerance) {
+        if (num_feat_frames != min) {
+          if (opts_.compressed_feats) {
+            if (min == 0) {
+              utt->compressed_feats = CompressedMatrix();
+            } else {
+              CompressedMatrix truncated(utt->compressed_feats, 0, min,
+                                         0, utt->compressed_feats.NumCols());
+              utt->compressed_feats.Swap(&truncated);
+            }
+          } else {
+            utt->feats.Resize(min, utt->feats.NumCols(), kCopyData);
+          }
+        }
+        if (num_target_frames != min) {
+          if (opts_.compact_targets) utt->compact_targets.Truncate(min);
+          else utt->targets.resize(min);
+        }
+        if (utt->weights.Dim() != min) utt->weights.Resize(min, kCopyData);
+      } else {
+        KALDI_WARN << key << ", length mismatch of targets " << num_target_frames
+                   << " and features " << num_feat_frames;
+        num_other_error_++;
+        continue;
+      }
+    }
+    // optionally apply the feature transform (no GPU in this thread),
+    if (apply_transform_in_reader_) {
+      CuMatrix<BaseFloat> feats_transf;
+      if (opts_.compressed_feats) {
+        CuMatrix<BaseFloat> feats_in;
+        CompressedMatrixToCuMatrix(utt->compressed_feats, &feats_in);
+        utt->compressed_feats = CompressedMatrix();  // (not needed anymore)
+        feature_transform_->Feedforward(feats_in, &feats_transf);
+      } else {
+        feature_transform_->Feedforward(CuMatrix<BaseFloat>(utt->feats), &feats_transf);
+      }
+      utt->feats.Resize(feats_transf.NumRows(), feats_transf.NumCols(), kUndefined);
+      feats_transf.CopyToMat(&utt->feats);
+      utt->feats_transformed = true;
+    }
+    num_done_++;
+    if (opts_.compact_targets) {
+      num_frames_ += utt->compact_targets.NumFrames();
+      num_target_entries_ += utt->compact_targets.NumEntries();
+    } else {
+      num_frames_ += utt->targets.size();
+      for (size_t t = 0; t < utt->targets.size(); t++) {
+        num_target_entries_ += utt->targets[t].size();
+      }
+    }
+    FeaturesNext();
+    return true;
+  }
+  return false;
+}
+
+
+void NnetDataPrefetcher::ReaderLoop() {
+  while (true) {
+    queue_mutex_.Lock();
+    bool stop = stop_;
+    queue_mutex_.Unlock();
+    NnetUtterance *utt = new NnetUtterance();
+    bool ok = false;
+    try {
+      ok = (!stop && ReadUtterance(utt));
+    } catch (const std::exception &e) {
+      // an exception must not leave the thread (std::terminate),
+      // it is re-thrown by Done() in the training thread,
+      queue_mutex_.Lock();
+      reader_error_ = e.what();
+      reader_failed_ = true;
+      queue_mutex_.Unlock();
+    }
+    if (!ok) {
+      delete utt;
+      break;
+    }
+    // wait for a free slot,
+    if (!empty_semaphore_.TryWait()) {
+      Timer tim;
+      empty_semaphore_.Wait();
+      producer_stall_ += tim.Elapsed();
+    }
+    queue_mutex_.Lock();
+    queue_.push_back(utt);
+    queue_mutex_.Unlock();
+    full_semaphore_.Signal();
+  }
+  // mark the end of data,
+  queue_mutex_.Lock();
+  reader_done_ = true;
+  queue_mutex_.Unlock();
+  full_semaphore_.Signal();
+}
+
+
+NnetUtterance* NnetDataPrefetcher::PopUtterance() {
+  // wait for an utterance (or the end of data),
+  if (!full_semaphore_.TryWait()) {
+    Timer tim;
+    full_semaphore_.Wait();
+    consumer_stall_ += tim.Elapsed();
+  }
+  NnetUtterance *utt = NULL;
+  queue_mutex_.Lock();
+  if (!queue_.empty()) {
+    utt = queue_.front();
+    queue_.pop_front();
+  } else {
+    KALDI_ASSERT(reader_done_);
+  }
+  queue_mutex_.Unlock();
+  if (utt != NULL) {
+    empty_semaphore_.Signal();
+  } else {
+    full_semaphore_.Signal(); // the next call will not block,
+  }
+  return utt;
+}
+
+
+bool NnetDataPrefetcher::Done() {
+  if (utt_ == NULL && !done_) {
+    if (thread_ != NULL) {
+      utt_ = PopUtterance();
+      if (utt_ == NULL) {
+        // the error of the reading thread, (after the utterances read before it)
+        queue_mutex_.Lock();
+        bool failed = reader_failed_;
+        queue_mutex_.Unlock();
+        if (failed) throw std::runtime_error(reader_error_);
+      }
+    } else {
+      utt_ = new NnetUtterance();
+      if (!ReadUtterance(utt_)) {
+        delete utt_;
+        utt_ = NULL;
+      }
+    }
+    done_ = (utt_ == NULL);
+  }
+  return done_;
+}
+
+
+const std::string& NnetDataPrefetcher::Key() {
+  KALDI_ASSERT(!Done());
+  return utt_->key;
+}
+
+
+const CuMatrixBase<BaseFloat>& NnetDataPrefetcher::Feats() {
+  KALDI_ASSERT(!Done());
+  if (utt_->feats_transformed) {
+    feats_transf_ = utt_->feats;
+  } else if (opts_.compressed_feats) {
+    CompressedMatrixToCuMatrix(utt_->compressed_feats, &feats_in_);
+    feature_transform_->Feedforward(feats_in_, &feats_transf_);
+  } else {
+    feature_transform_->Feedforward(CuMatrix<BaseFloat>(utt_->feats), &feats_transf_);
+  }
+  return feats_transf_;
+}
+
+
+const Posterior& NnetDataPrefetcher::Targets() {
+  KALDI_ASSERT(!Done());
+  return utt_->targets;
+}
+
+
+const CompactPosterior& NnetDataPrefetcher::CompactTargets() {
+  KALDI_ASSERT(!Done());
+  KALDI_ASSERT(opts_.compact_targets);
+  return utt_->compact_targets;
+}
+
+
+const Vector<BaseFloat>& NnetDataPrefetcher::Weights() {
+  KALDI_ASSERT(!Done());
+  return utt_->weights;
+}
+
+
+void NnetDataPrefetcher::Next() {
+  KALDI_ASSERT(!Done());
+  delete utt_;
+  utt_ = NULL;
+}
+
+
+} // namespace nnet1
+} // namespace kaldi
@@ -0,0 +1,230 @@
+// nnet/nnet-data-prefetch.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_NNET_NNET_DATA_PREFETCH_H_
+#define KALDI_NNET_NNET_DATA_PREFETCH_H_
+
+#include <deque>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "util/common-utils.h"
+#include "feat/feature-pipeline.h"
+#include "hmm/posterior.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "thread/kaldi-thread.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-semaphore.h"
+#include "cudamatrix/cu-matrix.h"
+#include "nnet/nnet-nnet.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// Configuration of the background reading of the training data.
+struct NnetDataPrefetchOptions {
+  int32 prefetch_utts; // Capacity of the queue (in utterances), 0 = no thread
+  int32 length_tolerance; // Allowed length difference of features/targets
+  std::string lattice_targets_model; // Targets are lattices, (transition model)
+  BaseFloat lattice_acoustic_scale;
+  BaseFloat lattice_lm_scale;
+  BaseFloat posterior_floor; // Pruning of the lattice posteriors
+  int32 lattice_targets_offset; // Added to the lattice pdf-ids, (set by the program, e.g. the task offset)
+  bool compact_targets; // Targets are CompactPosterior
+  bool compressed_feats; // Features are CompressedMatrix
+
+  NnetDataPrefetchOptions()
+   : prefetch_utts(0), length_tolerance(5),
+     lattice_acoustic_scale(1.0), lattice_lm_scale(1.0), posterior_floor(0.0),
+     lattice_targets_offset(0),
+     compact_targets(false), compressed_feats(false)
+  { }
+
+  void Register(OptionsItf *po) {
+    po->Register("prefetch-utts", &prefetch_utts, "Read, check and transform the utterances in a background thread, size of the queue between the reading thread and the training (in utterances, 0 = read in the training thread).");
+    po->Register("length-tolerance", &length_tolerance, "Allowed length difference of features/targets (frames)");
+    po->Register("lattice-targets-model", &lattice_targets_model, "Transition model (e.g. final.mdl), if set the <targets-rspecifier> is read as lattices, the targets are the pdf-posteriors computed from the lattices on the fly (as lattice-to-post | post-to-pdf-post). The lattices are read by random access, an archive must be 'ark,s,cs:' (sorted like the features), or use 'scp:'.");
+    po->Register("lattice-acoustic-scale", &lattice_acoustic_scale, "Scaling factor for acoustic likelihoods in the lattice targets");
+    po->Register("lattice-lm-scale", &lattice_lm_scale, "Scaling factor for graph/LM costs in the lattice targets");
+    po->Register("compact-targets", &compact_targets, "The <targets-rspecifier> has compact (quantized) posteriors, written by 'paste-post --compact-bits', these are kept compact in the randomizer.");
+    po->Register("compressed-feats", &compressed_feats, "The <feature-rspecifier> has compressed features, written by 'copy-feats --compress=true', these are kept compressed in the prefetch queue and decompressed straight into the input of the feature transform (features which are not compressed are an error).");
+    po->Register("posterior-floor", &posterior_floor, "Drop the pdf-posteriors of the lattice targets below this value, the remaining ones are re-normalized (0.0 = no pruning)");
+  }
+};
+
+
+/// Utterance prepared for the training,
+struct NnetUtterance {
+  std::string key;
+  Matrix<BaseFloat> feats;  ///< features (transformed, if 'feats_transformed')
+  bool feats_transformed;
+  CompressedMatrix compressed_feats;  ///< (with 'compressed_feats' option, before the transform)
+  Posterior targets;
+  CompactPosterior compact_targets;  ///< (with 'compact_targets' option)
+  Vector<BaseFloat> weights;
+  NnetUtterance() : feats_transformed(false) { }
+};
+
+
+/// Holder of the features with 'compressed_feats' option, it reads only the
+/// matrices stored compressed (e.g. by 'copy-feats --compress=true'), as
+/// KaldiObjectHolder<CompressedMatrix> would silently (and lossily) compress
+/// the other matrices on reading; the read of such matrix fails with a warning.
+class CompressedFeatsHolder {
+ public:
+  typedef CompressedMatrix T;
+
+  CompressedFeatsHolder() { }
+
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    return KaldiObjectHolder<T>::Write(os, binary, t);
+  }
+  void Clear() { CompressedMatrix empty; t_.Swap(&empty); }
+  bool Read(std::istream &is);
+  static bool IsReadInBinary() { return true; }
+  const T &Value() const { return t_; }
+
+ private:
+  T t_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(CompressedFeatsHolder);
+};
+
+
+/**
+ * Reads the training data for the frame-level training (features, targets,
+ * optional frame-weights), drops the utterances with missing targets or
+ * weights, corrects small length mismatch and applies the feature transform.
+ *
+ * With 'prefetch_utts > 0' all this runs in a background thread, which
+ * fills a bounded queue, while the training consumes the previous data.
+ * The feature transform runs in the background thread only when the GPU
+ * is not used (the CUDA calls stay in the training thread).
+ *
+ * The interface resembles SequentialTableReader : Done(), Key(), Value(), Next().
+ */
+class NnetDataPrefetcher {
+ public:
+  NnetDataPrefetcher(const NnetDataPrefetchOptions &opts,
+                     const std::string &feature_rspecifier,
+                     const std::string &targets_rspecifier,
+                     const std::string &weights_rspecifier,
+                     Nnet *feature_transform);
+  /// Stops the reading thread (if the data were not read to the end),
+  ~NnetDataPrefetcher();
+
+  /// True when there are no more utterances (blocks until the next one is ready),
+  /// an error of the reading thread is re-thrown here,
+  bool Done();
+  /// Key of the current utterance,
+  const std::string& Key();
+  /// Features of the current utterance, the feature transform is applied,
+  const CuMatrixBase<BaseFloat>& Feats();
+  /// Targets of the current utterance,
+  const Posterior& Targets();
+  /// Compact targets of the current utterance, (with 'compact_targets' option)
+  const CompactPosterior& CompactTargets();
+  /// Per-frame weights of the current utterance,
+  const Vector<BaseFloat>& Weights();
+  /// Move to the next utterance,
+  void Next();
+
+  /// Statistics of the reading, (valid after Done() returned true),
+  int32 NumDone() const { return num_done_; }
+  int32 NumNoTgtMat() const { return num_no_tgt_mat_; }
+  int32 NumOtherError() const { return num_other_error_; }
+  /// Number of pdfs of the transition model, (for the lattice targets),
+  int32 NumLatticePdfs() const { return trans_model_.NumPdfs(); }
+  /// Average number of target entries per frame, (for the lattice targets),
+  double AvgTargetsPerFrame() const {
+    return (num_frames_ > 0 ? num_target_entries_ / num_frames_ : 0.0);
+  }
+
+  /// Time the reading thread waited for a free slot in the queue (seconds),
+  double ProducerStallTime() const { return producer_stall_; }
+  /// Time the training waited for the data (seconds),
+  double ConsumerStallTime() const { return consumer_stall_; }
+
+ private:
+  /// The loop of the reading thread,
+  class ReaderThread : public MultiThreadable {
+   public:
+    ReaderThread(NnetDataPrefetcher *prefetcher) : prefetcher_(prefetcher) { }
+    void operator() () { prefetcher_->ReaderLoop(); }
+   private:
+    NnetDataPrefetcher *prefetcher_;
+  };
+
+  /// Reads next valid utterance, returns false at the end of data,
+  bool ReadUtterance(NnetUtterance *utt);
+  /// Sequential access to the features, from the reader used by the options,
+  bool FeaturesDone();
+  std::string FeaturesKey();
+  void FeaturesNext();
+  /// Pdf-posteriors from the lattice of 'key', returns false on failure,
+  bool LatticeTargets(const std::string &key, Posterior *targets);
+  /// Runs in the reading thread, fills the queue,
+  void ReaderLoop();
+  /// Gets the next utterance from the queue (NULL at the end of data),
+  NnetUtterance* PopUtterance();
+
+  NnetDataPrefetchOptions opts_;
+  bool apply_transform_in_reader_;
+
+  SequentialFeatureReader feature_reader_;  ///< (rspecifier or feature pipeline)
+  SequentialTableReader<CompressedFeatsHolder> compressed_feature_reader_; ///< with 'compressed_feats'
+  RandomAccessPosteriorReader targets_reader_;
+  RandomAccessCompactLatticeReader lattice_reader_; ///< with 'lattice_targets_'
+  RandomAccessCompactPosteriorReader compact_targets_reader_;
+  bool lattice_targets_;
+  TransitionModel trans_model_;
+  RandomAccessBaseFloatVectorReader weights_reader_;
+  bool have_weights_;
+  Nnet *feature_transform_;
+
+  int32 num_done_, num_no_tgt_mat_, num_other_error_;
+  double num_frames_, num_target_entries_;
+
+  // the queue between the reading thread and the training,
+  std::deque<NnetUtterance*> queue_;
+  Mutex queue_mutex_;
+  Semaphore full_semaphore_;  ///< number of utterances in the queue
+  Semaphore empty_semaphore_; ///< number of free slots in the queue
+  bool reader_done_; ///< set by the reading thread (under 'queue_mutex_')
+  bool reader_failed_; ///< exception in the reading thread (under 'queue_mutex_')
+  std::string reader_error_; ///< its message, re-thrown by Done()
+  bool stop_; ///< asks the reading thread to stop (under 'queue_mutex_')
+  MultiThreader<ReaderThread> *thread_;
+
+  double producer_stall_;
+  double consumer_stall_;
+
+  // the current utterance,
+  NnetUtterance *utt_;
+  bool done_;
+  CuMatrix<BaseFloat> feats_in_;  ///< decompressed features, (with 'compressed_feats')
+  CuMatrix<BaseFloat> feats_transf_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetDataPrefetcher);
+};
+
+
+} // namespace nnet1
+} // namespace kaldi
+
+#endif
@@ -0,0 +1,131 @@
+// nnet/nnet-decodable.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet/nnet-decodable.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+DecodableNnetOutputLayer::DecodableNnetOutputLayer(
+    const AffineTransform &affine, const PdfPrior *pdf_prior):
+    linearity_(affine.GetLinearity()), bias_(affine.GetBias()) {
+  if (pdf_prior != NULL) {
+    // the log-priors subtracted from a zero row,
+    CuMatrix<BaseFloat> log_prior(1, NumPdfs());
+    pdf_prior->SubtractOnLogpost(&log_prior);
+    bias_.AddVec(1.0, Vector<BaseFloat>(log_prior.Row(0)));
+  }
+}
+
+
+DecodableNnetScaledMapped::DecodableNnetScaledMapped(
+    const TransitionModel &trans_model, const Nnet &nnet,
+    const PdfPrior *pdf_prior, const DecodableNnetOptions &opts,
+    const Matrix<BaseFloat> *feats,
+    const DecodableNnetOutputLayer *output_layer):
+    trans_model_(trans_model), nnet_(nnet), pdf_prior_(pdf_prior),
+    opts_(opts), feats_(feats), left_context_(0), right_context_(0),
+    chunk_frames_(opts.chunk_frames), chunk_begin_(0),
+    output_layer_(output_layer), num_evaluated_(0) {
+  int32 num_outputs = nnet.OutputDim();
+  if (output_layer != NULL) {
+    KALDI_ASSERT(opts.no_softmax);
+    if (output_layer->InputDim() != nnet.OutputDim())
+      KALDI_ERR << "DecodableNnetScaledMapped: mismatch, nnet has "
+                << nnet.OutputDim() << " outputs but output layer has "
+                << output_layer->InputDim() << " inputs.";
+    num_outputs = output_layer->NumPdfs();
+    pdf_cache_.Resize(num_outputs, kUndefined);
+    pdf_frame_.resize(num_outputs, -1);
+  }
+  if (num_outputs != trans_model.NumPdfs())
+    KALDI_ERR << "DecodableNnetScaledMapped: mismatch, nnet has "
+              << num_outputs << " outputs but transition-model has "
+              << trans_model.NumPdfs() << " pdf-ids.";
+  int32 num_splice = 0;
+  if (!nnet.GetFrameContext(&left_context_, &right_context_, &num_splice) ||
+      num_splice > 1) {
+    chunk_frames_ = 0;  // whole utterance, as nnet-forward,
+  }
+  if (chunk_frames_ <= 0) {
+    left_context_ = right_context_ = 0;
+  }
+}
+
+
+DecodableNnetScaledMapped::~DecodableNnetScaledMapped() {
+  if (output_layer_ != NULL && feats_->NumRows() > 0) {
+    KALDI_VLOG(2) << "Evaluated " << (static_cast<double>(num_evaluated_) / feats_->NumRows())
+                  << " of " << output_layer_->NumPdfs() << " pdfs per frame";
+  }
+  delete feats_;
+}
+
+
+void DecodableNnetScaledMapped::ComputeChunk(int32 frame) {
+  int32 num_frames = feats_->NumRows();
+  KALDI_ASSERT(frame >= 0 && frame < num_frames);
+  int32 chunk_begin = 0, chunk_end = num_frames;
+  if (chunk_frames_ > 0) {
+    chunk_begin = (frame / chunk_frames_) * chunk_frames_;
+    chunk_end = std::min(chunk_begin + chunk_frames_, num_frames);
+  }
+  // the input frames with context, the utterance edges are replicated,
+  int32 num_rows = left_context_ + (chunk_end - chunk_begin) + right_context_;
+  Matrix<BaseFloat> in_host(num_rows, feats_->NumCols(), kUndefined);
+  for (int32 r = 0; r < num_rows; r++) {
+    int32 t = chunk_begin - left_context_ + r;
+    t = std::max(0, std::min(t, num_frames - 1));
+    in_host.CopyRowFromVec(feats_->Row(t), r);
+  }
+  CuMatrix<BaseFloat> in(in_host), out;
+
+  // fwd-pass, (const, with our buffers)
+  nnet_.Feedforward(in, &out, &buffers_);
+
+  CuSubMatrix<BaseFloat> out_chunk(out.RowRange(left_context_, chunk_end - chunk_begin));
+  if (output_layer_ != NULL) {
+    // the hidden activations, the output layer is evaluated lazily,
+    loglikes_.Resize(out_chunk.NumRows(), out_chunk.NumCols(), kUndefined);
+    out_chunk.CopyToMat(&loglikes_);
+    chunk_begin_ = chunk_begin;
+    if (!KALDI_ISFINITE(loglikes_.Sum())) { // check there's no nan/inf,
+      KALDI_ERR << "NaN or inf found in the hidden activations, frames "
+                << chunk_begin << " .. " << chunk_end;
+    }
+    return;
+  }
+  // convert posteriors to log-posteriors,
+  if (!opts_.no_softmax) {
+    out_chunk.Add(1e-20); // avoid log(0),
+    out_chunk.ApplyLog();
+  }
+  // subtract log-priors from log-posteriors or pre-softmax,
+  if (pdf_prior_ != NULL) {
+    pdf_prior_->SubtractOnLogpost(&out_chunk);
+  }
+  loglikes_.Resize(out_chunk.NumRows(), out_chunk.NumCols(), kUndefined);
+  out_chunk.CopyToMat(&loglikes_);
+  chunk_begin_ = chunk_begin;
+  if (!KALDI_ISFINITE(loglikes_.Sum())) { // check there's no nan/inf,
+    KALDI_ERR << "NaN or inf found in nn-output, frames " << chunk_begin
+              << " .. " << chunk_end;
+  }
+}
+
+}  // namespace nnet1
+}  // namespace kaldi
@@ -0,0 +1,171 @@
+// nnet/nnet-decodable.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET_NNET_DECODABLE_H_
+#define KALDI_NNET_NNET_DECODABLE_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/decodable-itf.h"
+#include "itf/options-itf.h"
+#include "hmm/transition-model.h"
+#include "cudamatrix/cu-matrix.h"
+#include "nnet/nnet-nnet.h"
+#include "nnet/nnet-pdf-prior.h"
+#include "nnet/nnet-affine-transform.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+struct DecodableNnetOptions {
+  BaseFloat acoustic_scale;
+  bool no_softmax;
+  int32 chunk_frames;
+  bool lazy_output_layer;
+
+  DecodableNnetOptions(): acoustic_scale(0.1), no_softmax(true),
+                          chunk_frames(512), lazy_output_layer(false) { }
+
+  void Register(OptionsItf *po) {
+    po->Register("acoustic-scale", &acoustic_scale,
+                 "Scaling factor for acoustic likelihoods");
+    po->Register("no-softmax", &no_softmax, "No softmax on MLP output (or "
+                 "remove it if found), the pre-softmax activations are used "
+                 "as log-likelihoods (if false, log of the softmax output)");
+    po->Register("chunk-frames", &chunk_frames, "The nnet output is computed "
+                 "in chunks of N frames when the decoder reaches them "
+                 "(0 = whole utterance at once)");
+    po->Register("lazy-output-layer", &lazy_output_layer, "Evaluate the output "
+                 "<AffineTransform> only for the pdfs requested by the decoder "
+                 "(requires --no-softmax=true, large output layers)");
+  }
+};
+
+
+/// The output <AffineTransform> on the CPU with the log-priors subtracted
+/// from the bias, it is evaluated row by row for the pdfs requested by the
+/// decoder (the pre-softmax activations don't need the softmax normalizer).
+/// Shared read-only by the decodables.
+class DecodableNnetOutputLayer {
+ public:
+  DecodableNnetOutputLayer(const AffineTransform &affine,
+                           const PdfPrior *pdf_prior);
+
+  int32 InputDim() const { return linearity_.NumCols(); }
+  int32 NumPdfs() const { return linearity_.NumRows(); }
+
+  /// The pseudo log-likelihood of 'pdf' for the hidden activations,
+  BaseFloat LogLikelihood(const VectorBase<BaseFloat> &hidden, int32 pdf) const {
+    return bias_(pdf) + VecVec(linearity_.Row(pdf), hidden);
+  }
+
+ private:
+  Matrix<BaseFloat> linearity_;
+  Vector<BaseFloat> bias_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetOutputLayer);
+};
+
+
+/// The pseudo log-likelihoods of a nnet1 hybrid model: log-posteriors
+/// (or pre-softmax activations) minus the log-priors of the pdfs.
+/// The network is evaluated lazily, chunk by chunk, when the decoder
+/// asks for the frames. The network is shared (const forward pass), the
+/// decodable keeps its own buffers, so several decoders can run in parallel
+/// with a single copy of the network (see Nnet::IsFeedforwardThreadSafe()).
+/// With 'output_layer' the network gives the hidden activations, the output
+/// layer is evaluated lazily for the pdfs of the active tokens, (per-frame
+/// cache).
+class DecodableNnetScaledMapped: public DecodableInterface {
+ public:
+  /// 'nnet' is the feature transform and the network (with the softmax
+  /// removed if opts.no_softmax), 'pdf_prior' can be NULL (no priors),
+  /// takes ownership of 'feats'. If 'output_layer' is not NULL, 'nnet' is
+  /// without the output layer, the priors are in 'output_layer'.
+  DecodableNnetScaledMapped(const TransitionModel &trans_model,
+                            const Nnet &nnet,
+                            const PdfPrior *pdf_prior,
+                            const DecodableNnetOptions &opts,
+                            const Matrix<BaseFloat> *feats,
+                            const DecodableNnetOutputLayer *output_layer = NULL);
+
+  virtual int32 NumFramesReady() const { return feats_->NumRows(); }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    KALDI_ASSERT(frame < NumFramesReady());
+    return (frame == NumFramesReady() - 1);
+  }
+
+  // Note, frames are numbered from zero.
+  virtual BaseFloat LogLikelihood(int32 frame, int32 tid) {
+    if (frame < chunk_begin_ || frame >= chunk_begin_ + loglikes_.NumRows()) {
+      ComputeChunk(frame);
+    }
+    int32 pdf = trans_model_.TransitionIdToPdf(tid);
+    if (output_layer_ == NULL) {
+      return opts_.acoustic_scale * loglikes_(frame - chunk_begin_, pdf);
+    }
+    if (pdf_frame_[pdf] != frame) {  // not in the cache,
+      pdf_cache_(pdf) = output_layer_->LogLikelihood(
+          loglikes_.Row(frame - chunk_begin_), pdf);
+      if (!KALDI_ISFINITE(pdf_cache_(pdf))) { // check there's no nan/inf,
+        KALDI_ERR << "NaN or inf found in nn-output, frame " << frame
+                  << ", pdf " << pdf;
+      }
+      pdf_frame_[pdf] = frame;
+      num_evaluated_++;
+    }
+    return opts_.acoustic_scale * pdf_cache_(pdf);
+  }
+
+  // Indices are one-based!  This is for compatibility with OpenFst.
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  virtual ~DecodableNnetScaledMapped();
+
+ private:
+  /// Forwards the chunk containing 'frame' through the network,
+  void ComputeChunk(int32 frame);
+
+  const TransitionModel &trans_model_;  // for tid to pdf mapping
+  const Nnet &nnet_;
+  const PdfPrior *pdf_prior_;
+  const DecodableNnetOptions &opts_;
+  const Matrix<BaseFloat> *feats_;
+
+  /// The frame-context of the chunks, the chunks are used only for
+  /// networks with a single <Splice>, (the padding at the utterance edges
+  /// gives the same output as the whole utterance)
+  int32 left_context_, right_context_, chunk_frames_;
+
+  int32 chunk_begin_;  ///< first frame of the chunk in 'loglikes_',
+  Matrix<BaseFloat> loglikes_;  ///< (the hidden activations with 'output_layer_')
+  std::vector<CuMatrix<BaseFloat> > buffers_;  ///< forward pass buffers
+
+  const DecodableNnetOutputLayer *output_layer_;
+  Vector<BaseFloat> pdf_cache_;  ///< the pdfs of the frame 'pdf_frame_[pdf]',
+  std::vector<int32> pdf_frame_;
+  int64 num_evaluated_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetScaledMapped);
+};
+
+}  // namespace nnet1
+}  // namespace kaldi
+
+#endif  // KALDI_NNET_NNET_DECODABLE_H_
@@ -43,6 +43,10 @@ class KlHmm : public Component {
     return kKlHmm;
   }
 
+  bool IsFeedforwardThreadSafe() const {
+    return false;  // the inverted stats are computed lazily in the first forward pass,
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     if (kl_inv_q_.NumRows() == 0) {
       // Copy the CudaMatrix to a Matrix
@@ -24,6 +24,7 @@
 
 #include <sstream>
 #include <iterator>
+#include <algorithm>
 
 namespace kaldi {
 namespace nnet1 {
@@ -34,26 +35,21 @@ namespace nnet1 {
 /**
  * Helper function of Xent::Eval,
  * calculates number of matching elemente in 'v1', 'v2' weighted by 'weights'.
+ * The comparison is done in GPU (0/1 mask in the 'mask' buffer),
+ * only the weighted sum of the mask is copied to host.
  */
-template <typename T>
-inline void CountCorrectFramesWeighted(const CuArray<T> &v1, 
-                                       const CuArray<T> &v2, 
-                                       const VectorBase<BaseFloat> &weights, 
+inline void CountCorrectFramesWeighted(const CuArray<int32> &v1, 
+                                       const CuArray<int32> &v2, 
+                                       const CuVectorBase<BaseFloat> &weights, 
+                                       CuVector<BaseFloat> *mask,
                                        double *correct) {
   KALDI_ASSERT(v1.Dim() == v2.Dim());
   KALDI_ASSERT(v1.Dim() == weights.Dim());
-  int32 dim = v1.Dim();
-  // Get GPU data to host,
-  std::vector<T> v1_h(dim), v2_h(dim);
-  v1.CopyToVec(&v1_h);
-  v2.CopyToVec(&v2_h);
+  // mask(i) = 1.0 for the matching elements,
+  mask->Resize(v1.Dim(), kUndefined);
+  mask->SetEqualElementMask(v1, v2);
   // Get correct frame count (weighted),
-  double corr = 0.0;
-  for (int32 i=0; i<dim; i++) {
-   corr += weights(i) * (v1_h[i] == v2_h[i] ? 1.0 : 0.0);
-  }
-  // Return,
-  (*correct) = corr;
+  (*correct) = VecVec(*mask, weights);
 }
 
 
@@ -61,6 +57,17 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
                 const CuMatrixBase<BaseFloat> &net_out, 
                 const CuMatrixBase<BaseFloat> &target, 
                 CuMatrix<BaseFloat> *diff) {
+  // get frame_weights to GPU,
+  frame_weights_ = frame_weights;
+  // call the other eval function,
+  Eval(frame_weights_, net_out, target, diff);
+}
+
+
+void Xent::Eval(const CuVectorBase<BaseFloat> &frame_weights,
+                const CuMatrixBase<BaseFloat> &net_out, 
+                const CuMatrixBase<BaseFloat> &target, 
+                CuMatrix<BaseFloat> *diff) {
   // check inputs,
   KALDI_ASSERT(net_out.NumCols() == target.NumCols());
   KALDI_ASSERT(net_out.NumRows() == target.NumRows());
@@ -73,9 +80,6 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
   double num_frames = frame_weights.Sum();
   KALDI_ASSERT(num_frames >= 0.0);
 
-  // get frame_weights to GPU,
-  frame_weights_ = frame_weights;
-
 #if 0
   CuVector<BaseFloat> col_sum(net_out.NumRows());
   col_sum.AddColSumMat(1.0, net_out, 0.0);
@@ -89,7 +93,8 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
     double correct;
     net_out.FindRowMaxId(&max_id_out_); // find max in nn-output
     target.FindRowMaxId(&max_id_tgt_); // find max in targets
-    CountCorrectFramesWeighted(max_id_out_, max_id_tgt_, frame_weights, &correct);
+    CountCorrectFramesWeighted(max_id_out_, max_id_tgt_, frame_weights,
+                               &correct_mask_, &correct);
     
     CuMatrix<BaseFloat> target_interp(target, kNoTrans);
 
@@ -100,18 +105,8 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
   	    // soft interpolation: wt*t_k + (1 - wt)*y_k
         target_interp.AddMat(1 - tgt_interp_wt_, net_out, kNoTrans);
   	  } else if (tgt_interp_mode_.compare("hard") == 0) {
-  		// hard interpolation: wt*t_k + (1 - wt)*1_{max y_k}
-  		Matrix<BaseFloat> net_out_hard(net_out.NumRows(), net_out.NumCols(), kSetZero);
-  		// net_out.CopyToMat(&net_out_hard, kNoTrans);
-  		// net_out_hard.SetZero();
-  		std::vector<int32> max_id_out(net_out.NumRows());
-  		max_id_out_.CopyToVec(&max_id_out);
-  		// Set the "hard" matrix s.t. M(i, max_id_out(i)) = 1 and all other elements set to 0
-  		for(int32 ri=0; ri<net_out_hard.NumRows(); ri++) {
-  		  net_out_hard(ri, max_id_out[ri]) = 1.0;
-  		}
-  		CuMatrix<BaseFloat> net_out_hard_cu(net_out_hard, kNoTrans);
-  		target_interp.AddMat(1 - tgt_interp_wt_, net_out_hard_cu, kNoTrans);
+  		// hard interpolation: wt*t_k + (1 - wt)*1_{max y_k}, (argmax stays in GPU)
+  		target_interp.AddToElements(1 - tgt_interp_wt_, max_id_out_);
   	  }
   	}
 
@@ -119,7 +114,7 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
   *diff = net_out;
   //diff->AddMat(-1.0, target); // diff <-- (-1.0)*target + diff
   diff->AddMat(-1.0, target_interp);
-  diff->MulRowsVec(frame_weights_); // weighting,
+  diff->MulRowsVec(frame_weights); // weighting,
 
   // calculate cross_entropy (in GPU),
   xentropy_aux_ = net_out; // y
@@ -127,7 +122,7 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
   xentropy_aux_.ApplyLog(); // log(y)
   //xentropy_aux_.MulElements(target); // t*log(y)
   xentropy_aux_.MulElements(target_interp); // t*log(y)
-  xentropy_aux_.MulRowsVec(frame_weights_); // w*t*log(y) 
+  xentropy_aux_.MulRowsVec(frame_weights); // w*t*log(y) 
   double cross_entropy = -xentropy_aux_.Sum();
   
   // caluculate entropy (in GPU),
@@ -135,7 +130,7 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
   entropy_aux_.Add(1e-20); // avoid log(0)
   entropy_aux_.ApplyLog(); // log(t)
   entropy_aux_.MulElements(target); // t*log(t)
-  entropy_aux_.MulRowsVec(frame_weights_); // w*t*log(t) 
+  entropy_aux_.MulRowsVec(frame_weights); // w*t*log(t) 
   double entropy = -entropy_aux_.Sum();
 
   KALDI_ASSERT(KALDI_ISFINITE(cross_entropy));
@@ -145,29 +140,54 @@ void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
   entropy_ += entropy;
   correct_ += correct;
   frames_ += num_frames;
+  last_loss_ = cross_entropy - entropy;
+  last_frames_ = num_frames;
 
   // progressive loss reporting
-  {
-    static const int32 progress_step = 3600*100; // 1h
-    frames_progress_ += num_frames;
-    loss_progress_ += cross_entropy;
-    entropy_progress_ += entropy;
-    if (frames_progress_ > progress_step) {
-      KALDI_VLOG(1) << "ProgressLoss[last " 
-                    << static_cast<int>(frames_progress_/100/3600) << "h of " 
-                    << static_cast<int>(frames_/100/3600) << "h]: " 
-                    << (loss_progress_-entropy_progress_)/frames_progress_ << " (Xent)";
-      // store
-      loss_vec_.push_back((loss_progress_-entropy_progress_)/frames_progress_);
-      // reset
-      frames_progress_ = 0;
-      loss_progress_ = 0.0;
-      entropy_progress_ = 0.0;
-    }
+  frames_progress_ += num_frames;
+  loss_progress_ += cross_entropy;
+  entropy_progress_ += entropy;
+  ReportProgress();
+}
+
+
+void Xent::ReportProgress() {
+  static const int32 progress_step = 3600*100; // 1h
+  if (frames_progress_ > progress_step) {
+    KALDI_VLOG(1) << "ProgressLoss[last " 
+                  << static_cast<int>(frames_progress_/100/3600) << "h of " 
+                  << static_cast<int>(frames_/100/3600) << "h]: " 
+                  << (loss_progress_-entropy_progress_)/frames_progress_ << " (Xent)";
+    // store
+    loss_vec_.push_back((loss_progress_-entropy_progress_)/frames_progress_);
+    // reset
+    frames_progress_ = 0;
+    loss_progress_ = 0.0;
+    entropy_progress_ = 0.0;
   }
 }
 
 
+LossItf* Xent::NewThreadCopy() const {
+  Xent *ans = new Xent();
+  ans->Set_Target_Interp(tgt_interp_mode_, tgt_interp_wt_);
+  return ans;
+}
+
+
+void Xent::AddStats(const LossItf &other) {
+  const Xent &xent = dynamic_cast<const Xent&>(other);
+  frames_ += xent.frames_;
+  correct_ += xent.correct_;
+  loss_ += xent.loss_;
+  entropy_ += xent.entropy_;
+  frames_progress_ += xent.frames_progress_;
+  loss_progress_ += xent.loss_progress_;
+  entropy_progress_ += xent.entropy_progress_;
+  ReportProgress();
+}
+
+
 void Xent::Eval(const VectorBase<BaseFloat> &frame_weights,
                 const CuMatrixBase<BaseFloat> &net_out, 
                 const Posterior &post, 
@@ -315,7 +335,8 @@ void XentRegMCE::Eval(const VectorBase<BaseFloat> &frame_weights,
   double correct;
   net_out.FindRowMaxId(&max_id_out_); // find max in nn-output
   target.FindRowMaxId(&max_id_tgt_); // find max in targets
-  CountCorrectFramesWeighted(max_id_out_, max_id_tgt_, frame_weights, &correct);
+  CountCorrectFramesWeighted(max_id_out_, max_id_tgt_, frame_weights_,
+                             &correct_mask_, &correct);
 
   // calculate cross_entropy (in GPU),
   double cross_entropy = -1000; // init with -ve value (invalid)
@@ -440,6 +461,17 @@ void Mse::Eval(const VectorBase<BaseFloat> &frame_weights,
                const CuMatrixBase<BaseFloat>& net_out, 
                const CuMatrixBase<BaseFloat>& target, 
                CuMatrix<BaseFloat>* diff) {
+  // get frame_weights to GPU,
+  frame_weights_ = frame_weights;
+  // call the other eval function,
+  Eval(frame_weights_, net_out, target, diff);
+}
+
+
+void Mse::Eval(const CuVectorBase<BaseFloat> &frame_weights,
+               const CuMatrixBase<BaseFloat>& net_out, 
+               const CuMatrixBase<BaseFloat>& target, 
+               CuMatrix<BaseFloat>* diff) {
   // check inputs,
   KALDI_ASSERT(net_out.NumCols() == target.NumCols());
   KALDI_ASSERT(net_out.NumRows() == target.NumRows());
@@ -452,18 +484,15 @@ void Mse::Eval(const VectorBase<BaseFloat> &frame_weights,
   int32 num_frames = frame_weights.Sum();
   KALDI_ASSERT(num_frames >= 0.0);
 
-  // get frame_weights to GPU,
-  frame_weights_ = frame_weights;
-
   //compute derivative w.r.t. neural nerwork outputs
   *diff = net_out; // y
   diff->AddMat(-1.0,target); // (y - t)
-  diff->MulRowsVec(frame_weights_); // weighting,
+  diff->MulRowsVec(frame_weights); // weighting,
 
   // Compute MeanSquareError loss of mini-batch
   diff_pow_2_ = *diff;
   diff_pow_2_.MulElements(diff_pow_2_); // (y - t)^2
-  diff_pow_2_.MulRowsVec(frame_weights_); // w*(y - t)^2
+  diff_pow_2_.MulRowsVec(frame_weights); // w*(y - t)^2
   double mean_square_error = 0.5 * diff_pow_2_.Sum(); // sum the matrix,
 
   KALDI_ASSERT(KALDI_ISFINITE(mean_square_error));
@@ -471,27 +500,43 @@ void Mse::Eval(const VectorBase<BaseFloat> &frame_weights,
   // accumulate
   loss_ += mean_square_error;
   frames_ += num_frames;
+  last_loss_ = mean_square_error;
+  last_frames_ = num_frames;
 
   // progressive loss reporting
-  {
-    static const int32 progress_step = 3600*100; // 1h
-    frames_progress_ += num_frames;
-    loss_progress_ += mean_square_error;
-    if (frames_progress_ > progress_step) {
-      KALDI_VLOG(1) << "ProgressLoss[last " 
-                    << static_cast<int>(frames_progress_/100/3600) << "h of " 
-                    << static_cast<int>(frames_/100/3600) << "h]: " 
-                    << loss_progress_/frames_progress_ << " (Mse)";
-      // store
-      loss_vec_.push_back(loss_progress_/frames_progress_);
-      // reset
-      frames_progress_ = 0;
-      loss_progress_ = 0.0;
-    }
+  frames_progress_ += num_frames;
+  loss_progress_ += mean_square_error;
+  ReportProgress();
+}
+
+
+void Mse::ReportProgress() {
+  static const int32 progress_step = 3600*100; // 1h
+  if (frames_progress_ > progress_step) {
+    KALDI_VLOG(1) << "ProgressLoss[last " 
+                  << static_cast<int>(frames_progress_/100/3600) << "h of " 
+                  << static_cast<int>(frames_/100/3600) << "h]: " 
+                  << loss_progress_/frames_progress_ << " (Mse)";
+    // store
+    loss_vec_.push_back(loss_progress_/frames_progress_);
+    // reset
+    frames_progress_ = 0;
+    loss_progress_ = 0.0;
   }
 }
 
 
+void Mse::AddStats(const LossItf &other) {
+  const Mse &mse = dynamic_cast<const Mse&>(other);
+  frames_ += mse.frames_;
+  loss_ += mse.loss_;
+  frames_progress_ += mse.frames_progress_;
+  loss_progress_ += mse.loss_progress_;
+  if (diff_pow_2_.NumCols() == 0) diff_pow_2_ = mse.diff_pow_2_; // (dim for the report)
+  ReportProgress();
+}
+
+
 void Mse::Eval(const VectorBase<BaseFloat> &frame_weights,
                const CuMatrixBase<BaseFloat>& net_out, 
                const Posterior& post, 
@@ -571,6 +616,59 @@ void MultiTaskLoss::InitFromString(const std::string& s) {
   KALDI_ASSERT(loss_vec_.size() == loss_weights_.size());
 }
 
+LossItf* MultiTaskLoss::NewThreadCopy() const {
+  MultiTaskLoss *ans = new MultiTaskLoss();
+  for (int32 l = 0; l < loss_vec_.size(); l++) {
+    ans->loss_vec_.push_back(loss_vec_[l]->NewThreadCopy());
+  }
+  ans->loss_dim_ = loss_dim_;
+  ans->loss_weights_ = loss_weights_;
+  ans->loss_dim_offset_ = loss_dim_offset_;
+  ans->Set_Target_Interp(tgt_interp_mode_, tgt_interp_wt_);
+  ans->SetTaskWeighting(task_weighting_, task_weighting_smooth_);
+  ans->task_loss_avg_ = task_loss_avg_; // continue the running averages,
+  return ans;
+}
+
+void MultiTaskLoss::AddStats(const LossItf &other) {
+  const MultiTaskLoss &mtl = dynamic_cast<const MultiTaskLoss&>(other);
+  KALDI_ASSERT(mtl.loss_vec_.size() == loss_vec_.size());
+  for (int32 l = 0; l < loss_vec_.size(); l++) {
+    loss_vec_[l]->AddStats(*mtl.loss_vec_[l]);
+  }
+  if (mtl.num_minibatches_ > 0) {
+    if (task_weights_sum_.Dim() == 0) {
+      task_weights_sum_.Resize(mtl.task_weights_sum_.Dim());
+    }
+    task_weights_sum_.AddVec(1.0, mtl.task_weights_sum_);
+    num_minibatches_ += mtl.num_minibatches_;
+  }
+}
+
+void MultiTaskLoss::MergeThreadCopies(const std::vector<LossItf*> &copies) {
+  if (task_weighting_ != "loss" && task_weighting_ != "frames-loss") return;
+  // average of the running averages, (zero is 'not initialized yet')
+  int32 num_losses = loss_vec_.size();
+  Vector<double> loss_avg(num_losses), count(num_losses);
+  for (int32 t = 0; t < copies.size(); t++) {
+    const MultiTaskLoss &mtl = dynamic_cast<const MultiTaskLoss&>(*copies[t]);
+    for (int32 l = 0; l < mtl.task_loss_avg_.Dim(); l++) {
+      if (mtl.task_loss_avg_(l) > 0.0) {
+        loss_avg(l) += mtl.task_loss_avg_(l);
+        count(l) += 1.0;
+      }
+    }
+  }
+  if (task_loss_avg_.Dim() != num_losses) task_loss_avg_.Resize(num_losses);
+  for (int32 l = 0; l < num_losses; l++) {
+    if (count(l) > 0.0) task_loss_avg_(l) = loss_avg(l) / count(l);
+  }
+  // the threads continue from the merged state,
+  for (int32 t = 0; t < copies.size(); t++) {
+    dynamic_cast<MultiTaskLoss&>(*copies[t]).task_loss_avg_ = task_loss_avg_;
+  }
+}
+
 void MultiTaskLoss::Eval(const VectorBase<BaseFloat> &frame_weights, 
             const CuMatrixBase<BaseFloat>& net_out, 
             const Posterior& post,
@@ -586,51 +684,60 @@ void MultiTaskLoss::Eval(const VectorBase<BaseFloat> &frame_weights,
   // allocate diff matrix,
   diff->Resize(num_frames, num_output);
   
-  /// One vector of frame_weights per loss-function,
+  /// One row of frame_weights per loss-function,
   /// The original frame weights are multiplied with
   /// a mask of `defined targets' according to the 'Posterior'.
-  std::vector<Vector<BaseFloat> > frmwei_have_tgt;
-  for (int32 l = 0; l < loss_vec_.size(); l++) {
-    // copy original weights,
-    frmwei_have_tgt.push_back(Vector<BaseFloat>(frame_weights));
-    // We need to mask-out the frames for which the 'posterior' is not defined (= is empty):
-    int32 loss_beg = loss_dim_offset_[l];   // first column of loss target,
-    int32 loss_end = loss_dim_offset_[l+1]; // (last+1) column of loss target,
-    for (int32 f = 0; f < num_frames; f++) {
-      bool tgt_defined = false;
-      for (int32 p = 0; p < post[f].size(); p++) {
-        if (post[f][p].first >= loss_beg && post[f][p].first < loss_end) {
-          tgt_defined = true;
-          break;
-        }
-      }
-      if (!tgt_defined) {
-          frmwei_have_tgt[l](f) = 0.0; // set zero_weight for the frame with no targets!
-        }
-      }
+  /// The mask is built in a single pass over the 'Posterior',
+  /// uploaded once, and the weighting is done in GPU.
+  int32 num_losses = loss_vec_.size();
+  frmwei_have_tgt_host_.Resize(num_losses, num_frames, kSetZero);
+  for (int32 f = 0; f < num_frames; f++) {
+    for (int32 p = 0; p < post[f].size(); p++) {
+      int32 id = post[f][p].first;
+      // find the loss-function of the target 'id',
+      int32 l = std::upper_bound(loss_dim_offset_.begin(), loss_dim_offset_.end(), id)
+                - loss_dim_offset_.begin() - 1;
+      KALDI_ASSERT(l >= 0 && l < num_losses);
+      frmwei_have_tgt_host_(l, f) = 1.0; // the frame has target for loss 'l',
+    }
+  }
+  frmwei_have_tgt_ = frmwei_have_tgt_host_;
+  frame_weights_ = frame_weights;
+  frmwei_have_tgt_.MulColsVec(frame_weights_); // set zero_weight for the frames with no targets!
+
+  // per-task (weighted) frames of the mini-batch,
+  // (needed only by the adaptive weighting, we skip the download with 'none')
+  Vector<BaseFloat> task_frames, task_loss(num_losses);
+  if (task_weighting_ != "none") {
+    CuVector<BaseFloat> task_frames_gpu(num_losses);
+    task_frames_gpu.AddColSumMat(1.0, frmwei_have_tgt_, 0.0);
+    task_frames.Resize(num_losses, kUndefined);
+    task_frames_gpu.CopyToVec(&task_frames);
   }
 
   // call the vector of loss functions,
-  CuMatrix<BaseFloat> diff_aux;
-  for (int32 l = 0; l < loss_vec_.size(); l++) {
+  std::vector<CuMatrix<BaseFloat> > diff_aux(num_losses);
+  for (int32 l = 0; l < num_losses; l++) {
     if (tgt_interp_mode_.compare("none") != 0 && l == 0) {
       loss_vec_[l]->Set_Target_Interp(tgt_interp_mode_, tgt_interp_wt_);
-      loss_vec_[l]->Eval(frmwei_have_tgt[l],
-        net_out.ColRange(loss_dim_offset_[l], loss_dim_[l]),
-        tgt_mat_.ColRange(loss_dim_offset_[l], loss_dim_[l]),
-        &diff_aux);
-	} else {
-	  loss_vec_[l]->Set_Target_Interp("none", 1.0);
-	  loss_vec_[l]->Eval(frmwei_have_tgt[l],
-	    net_out.ColRange(loss_dim_offset_[l], loss_dim_[l]),
-	    tgt_mat_.ColRange(loss_dim_offset_[l], loss_dim_[l]),
-		&diff_aux);
-	}
+    } else {
+      loss_vec_[l]->Set_Target_Interp("none", 1.0);
+    }
+    loss_vec_[l]->Eval(frmwei_have_tgt_.Row(l),
+      net_out.ColRange(loss_dim_offset_[l], loss_dim_[l]),
+      tgt_mat_.ColRange(loss_dim_offset_[l], loss_dim_[l]),
+      &diff_aux[l]);
+    // the per-frame loss of the mini-batch,
+    task_loss(l) = loss_vec_[l]->LastLoss();
+  }
 
+  UpdateTaskWeights(task_frames, task_loss);
+
+  for (int32 l = 0; l < num_losses; l++) {
     // Scale the gradients,
-    diff_aux.Scale(loss_weights_[l]);
+    diff_aux[l].Scale(task_weights_(l));
     // Copy to diff,
-    diff->ColRange(loss_dim_offset_[l], loss_dim_[l]).CopyFromMat(diff_aux);
+    diff->ColRange(loss_dim_offset_[l], loss_dim_[l]).CopyFromMat(diff_aux[l]);
   }
 
   /* 
@@ -654,6 +761,73 @@ void MultiTaskLoss::Eval(const VectorBase<BaseFloat> &frame_weights,
   } */
 }
 
+void MultiTaskLoss::SetTaskWeighting(const std::string &mode, BaseFloat smooth) {
+  if (mode != "none" && mode != "frames" && mode != "loss" && mode != "frames-loss") {
+    KALDI_ERR << "Unknown task weighting : " << mode << ", use none|frames|loss|frames-loss";
+  }
+  KALDI_ASSERT(smooth >= 0.0 && smooth < 1.0);
+  task_weighting_ = mode;
+  task_weighting_smooth_ = smooth;
+}
+
+void MultiTaskLoss::UpdateTaskWeights(const Vector<BaseFloat> &task_frames,
+                                      const Vector<BaseFloat> &task_loss) {
+  int32 num_losses = loss_vec_.size();
+  // (a thread copy already has the running averages)
+  if (task_weights_.Dim() != num_losses) task_weights_.Resize(num_losses);
+  if (task_weights_sum_.Dim() != num_losses) task_weights_sum_.Resize(num_losses);
+  if (task_loss_avg_.Dim() != num_losses) task_loss_avg_.Resize(num_losses);
+  // the fixed weights,
+  for (int32 l = 0; l < num_losses; l++) {
+    task_weights_(l) = loss_weights_[l];
+  }
+  if (task_weighting_ == "none") return;
+  // the tasks present in the mini-batch,
+  int32 num_active = 0;
+  BaseFloat tot_frames = task_frames.Sum();
+  for (int32 l = 0; l < num_losses; l++) {
+    if (task_frames(l) > 0.0) num_active++;
+  }
+  if (num_active == 0) return;
+
+  if (task_weighting_ == "frames" || task_weighting_ == "frames-loss") {
+    // equal share of the total weight for each of the active tasks,
+    for (int32 l = 0; l < num_losses; l++) {
+      if (task_frames(l) > 0.0) {
+        task_weights_(l) *= tot_frames / (num_active * task_frames(l));
+      }
+    }
+  }
+  if (task_weighting_ == "loss" || task_weighting_ == "frames-loss") {
+    // running average of per-frame loss, (initialized by the first value)
+    for (int32 l = 0; l < num_losses; l++) {
+      if (task_frames(l) == 0.0) continue;
+      if (task_loss_avg_(l) == 0.0) {
+        task_loss_avg_(l) = task_loss(l);
+      } else {
+        task_loss_avg_(l) = task_weighting_smooth_ * task_loss_avg_(l) +
+                            (1.0 - task_weighting_smooth_) * task_loss(l);
+      }
+    }
+    // scale by (mean loss / task loss), (the losses are floored)
+    double mean_loss = 0.0;
+    int32 num_avg = 0;
+    for (int32 l = 0; l < num_losses; l++) {
+      if (task_loss_avg_(l) > 0.0) { mean_loss += task_loss_avg_(l); num_avg++; }
+    }
+    if (num_avg > 0) {
+      mean_loss /= num_avg;
+      for (int32 l = 0; l < num_losses; l++) {
+        if (task_loss_avg_(l) > 0.0) {
+          task_weights_(l) *= mean_loss / std::max(task_loss_avg_(l), 1e-03 * mean_loss);
+        }
+      }
+    }
+  }
+  task_weights_sum_.AddVec(1.0, task_weights_);
+  num_minibatches_++;
+}
+
 std::string MultiTaskLoss::Report() {
   // calculate overall loss (weighted),
   BaseFloat overall_loss = AvgLoss();
@@ -676,6 +850,13 @@ std::string MultiTaskLoss::Report() {
       << "AvgLoss: " << overall_loss << " (MultiTaskLoss), "
       << "weights " << loss_weights_ << ", "
       << "values " << loss_values << std::endl;
+  // adaptive weights,
+  if (task_weighting_ != "none" && num_minibatches_ > 0) {
+    Vector<BaseFloat> avg_weights(task_weights_sum_);
+    avg_weights.Scale(1.0 / num_minibatches_);
+    oss << "Task weighting '" << task_weighting_ << "', average weights " 
+        << avg_weights << std::endl;
+  }
 
   return oss.str();
 }
@@ -42,6 +42,12 @@ class LossItf {
             const CuMatrixBase<BaseFloat> &target,
             CuMatrix<BaseFloat> *diff) = 0;
 
+  /// Evaluate cross entropy using target-matrix, frame-weights already in GPU,
+  virtual void Eval(const CuVectorBase<BaseFloat> &frame_weights, 
+            const CuMatrixBase<BaseFloat> &net_out, 
+            const CuMatrixBase<BaseFloat> &target,
+            CuMatrix<BaseFloat> *diff) = 0;
+
   /// Evaluate cross entropy using target-posteriors (supports soft labels),
   virtual void Eval(const VectorBase<BaseFloat> &frame_weights, 
             const CuMatrixBase<BaseFloat> &net_out, 
@@ -54,15 +60,39 @@ class LossItf {
   /// Get loss value (frame average),
   virtual BaseFloat AvgLoss() = 0;
 
+  /// Get loss value of the last Eval() call (frame average, 0.0 with no frames),
+  virtual BaseFloat LastLoss() const {
+    KALDI_ERR << "LastLoss() not implemented for this loss";
+    return 0.0;
+  }
+
   /// Set target interpolation mode and weight
   virtual void Set_Target_Interp(const std::string tgt_interp_mode,
 		    const float tgt_interp_wt) = 0;
+
+  /// New loss with the same configuration and no statistics, for a training
+  /// thread (see NnetParallelTrainer),
+  virtual LossItf* NewThreadCopy() const {
+    KALDI_ERR << "NewThreadCopy() not implemented for this loss";
+    return NULL;
+  }
+
+  /// Adds the statistics of a thread copy (from NewThreadCopy()),
+  virtual void AddStats(const LossItf &other) {
+    KALDI_ERR << "AddStats() not implemented for this loss";
+  }
+
+  /// Merges the adaptive state of the thread copies (if any) into this loss,
+  /// and sets the copies to the merged state, (called between the rounds
+  /// of the multi-threaded training)
+  virtual void MergeThreadCopies(const std::vector<LossItf*> &copies) { }
 };
 
 
 class Xent : public LossItf {
  public:
   Xent() : frames_(0.0), correct_(0.0), loss_(0.0), entropy_(0.0),
+           last_frames_(0.0), last_loss_(0.0),
            tgt_interp_mode_("none"), tgt_interp_wt_(1.0),
            frames_progress_(0.0), loss_progress_(0.0), entropy_progress_(0.0) { }
   ~Xent() { }
@@ -73,6 +103,12 @@ class Xent : public LossItf {
             const CuMatrixBase<BaseFloat> &target,
             CuMatrix<BaseFloat> *diff);
 
+  /// Evaluate cross entropy using target-matrix, frame-weights already in GPU,
+  void Eval(const CuVectorBase<BaseFloat> &frame_weights, 
+            const CuMatrixBase<BaseFloat> &net_out, 
+            const CuMatrixBase<BaseFloat> &target,
+            CuMatrix<BaseFloat> *diff);
+
   /// Evaluate cross entropy using target-posteriors (supports soft labels),
   void Eval(const VectorBase<BaseFloat> &frame_weights, 
             const CuMatrixBase<BaseFloat> &net_out, 
@@ -88,6 +124,11 @@ class Xent : public LossItf {
     return (loss_ - entropy_) / frames_;
   }
 
+  BaseFloat LastLoss() const {
+    if (last_frames_ == 0) return 0.0;
+    return last_loss_ / last_frames_;
+  }
+
   /// Set target interpolation mode and weight
   void Set_Target_Interp(const std::string tgt_interp_mode="none", const float tgt_interp_wt=1.0) {
 	  tgt_interp_mode_ = tgt_interp_mode;
@@ -98,11 +139,19 @@ class Xent : public LossItf {
 	  }
   }
 
+  LossItf* NewThreadCopy() const;
+  void AddStats(const LossItf &other);
+
  private: 
+  /// Logs the loss of the last hour of data, (when there is a full hour)
+  void ReportProgress();
+
   double frames_;
   double correct_;
   double loss_;
   double entropy_;
+  double last_frames_; ///< frames of the last Eval(),
+  double last_loss_; ///< loss of the last Eval(), (minus the target entropy)
   std::string tgt_interp_mode_;
   float tgt_interp_wt_;
 
@@ -123,6 +172,7 @@ class Xent : public LossItf {
   // frame classification buffers, 
   CuArray<int32> max_id_out_;
   CuArray<int32> max_id_tgt_;
+  CuVector<BaseFloat> correct_mask_;
 };
 
 class XentRegMCE {
@@ -176,11 +226,12 @@ class XentRegMCE {
   // frame classification buffers,
   CuArray<int32> max_id_out_;
   CuArray<int32> max_id_tgt_;
+  CuVector<BaseFloat> correct_mask_;
 };
 
 class Mse : public LossItf {
  public:
-  Mse() : frames_(0.0), loss_(0.0), 
+  Mse() : frames_(0.0), loss_(0.0), last_frames_(0.0), last_loss_(0.0),
           frames_progress_(0.0), loss_progress_(0.0) { }
   ~Mse() { }
 
@@ -190,6 +241,12 @@ class Mse : public LossItf {
             const CuMatrixBase<BaseFloat>& target,
             CuMatrix<BaseFloat>* diff);
 
+  /// Evaluate mean square error using target-matrix, frame-weights already in GPU,
+  void Eval(const CuVectorBase<BaseFloat> &frame_weights, 
+            const CuMatrixBase<BaseFloat>& net_out, 
+            const CuMatrixBase<BaseFloat>& target,
+            CuMatrix<BaseFloat>* diff);
+
   /// Evaluate mean square error using target-posteior,
   void Eval(const VectorBase<BaseFloat> &frame_weights, 
             const CuMatrixBase<BaseFloat>& net_out, 
@@ -205,12 +262,25 @@ class Mse : public LossItf {
     return loss_ / frames_;
   }
 
+  BaseFloat LastLoss() const {
+    if (last_frames_ == 0) return 0.0;
+    return last_loss_ / last_frames_;
+  }
+
   /// Set target interpolation mode and weight: No interpolation for MSE
   void Set_Target_Interp(const std::string tgt_interp_mode="none", const float tgt_interp_wt=1.0) {};
 
+  LossItf* NewThreadCopy() const { return new Mse(); }
+  void AddStats(const LossItf &other);
+
  private:
+  /// Logs the loss of the last hour of data, (when there is a full hour)
+  void ReportProgress();
+
   double frames_;
   double loss_;
+  double last_frames_; ///< frames of the last Eval(),
+  double last_loss_; ///< loss of the last Eval(),
   
   double frames_progress_;
   double loss_progress_;
@@ -224,7 +294,9 @@ class Mse : public LossItf {
 
 class MultiTaskLoss : public LossItf {
  public:
-  MultiTaskLoss() : tgt_interp_mode_("none"), tgt_interp_wt_(1.0) { }
+  MultiTaskLoss() : tgt_interp_mode_("none"), tgt_interp_wt_(1.0),
+                    task_weighting_("none"), task_weighting_smooth_(0.9),
+                    num_minibatches_(0) { }
   ~MultiTaskLoss() {
     while (loss_vec_.size() > 0) {
       delete loss_vec_.back();
@@ -247,6 +319,13 @@ class MultiTaskLoss : public LossItf {
     KALDI_ERR << "This is not supposed to be called!";
   }
 
+  void Eval(const CuVectorBase<BaseFloat> &frame_weights, 
+            const CuMatrixBase<BaseFloat>& net_out, 
+            const CuMatrixBase<BaseFloat>& target,
+            CuMatrix<BaseFloat>* diff) {
+    KALDI_ERR << "This is not supposed to be called!";
+  }
+
   /// Evaluate mean square error using target-posteior,
   void Eval(const VectorBase<BaseFloat> &frame_weights, 
             const CuMatrixBase<BaseFloat>& net_out, 
@@ -259,6 +338,15 @@ class MultiTaskLoss : public LossItf {
   /// Get loss value (frame average),
   BaseFloat AvgLoss();
 
+  /// Copy with the configuration and the running averages of the task weighting,
+  LossItf* NewThreadCopy() const;
+  void AddStats(const LossItf &other);
+  /// Averages the running averages of the per-task losses of the copies,
+  void MergeThreadCopies(const std::vector<LossItf*> &copies);
+
+  /// Starting-points of the target index-ranges of the losses (num_losses+1 elements),
+  const std::vector<int32>& LossDimOffset() const { return loss_dim_offset_; }
+
   /// Set target interpolation mode and weight
   void Set_Target_Interp(const std::string tgt_interp_mode="none", const float tgt_interp_wt=1.0) {
 	  tgt_interp_mode_ =   tgt_interp_mode;
@@ -269,16 +357,48 @@ class MultiTaskLoss : public LossItf {
 	  }
   };
 
+  /// Set adaptive weighting of the losses, on top of the fixed weights,
+  /// the weights are re-computed in each mini-batch :
+  ///  'none'   : fixed weights,
+  ///  'frames' : the gradients of the losses are normalized by the number
+  ///             of frames of the task in the mini-batch (all tasks get
+  ///             the same total weight, whatever their share of frames),
+  ///  'loss'   : the gradients are divided by the running average of the
+  ///             per-frame loss of the task, (relative to the mean over tasks),
+  ///             i.e. the tasks with large loss are not dominating,
+  ///  'frames-loss' : both.
+  /// 'smooth' is the constant of the running average of the 'loss' mode.
+  void SetTaskWeighting(const std::string &mode, BaseFloat smooth = 0.9);
+
  private:
+  /// Computes the weights of the losses for the mini-batch, from the
+  /// per-task frame counts and the per-frame losses of the mini-batch,
+  /// (with 'none' only the fixed weights are set, 'task_frames' is empty)
+  void UpdateTaskWeights(const Vector<BaseFloat> &task_frames,
+                         const Vector<BaseFloat> &task_loss);
+
   std::string tgt_interp_mode_;
   float tgt_interp_wt_;
   std::vector<LossItf*>  loss_vec_;
   std::vector<int32>     loss_dim_;
   std::vector<BaseFloat> loss_weights_;
+
+  // adaptive weighting of the losses, (SetTaskWeighting)
+  std::string            task_weighting_;
+  BaseFloat              task_weighting_smooth_;
+  Vector<BaseFloat>      task_weights_;      ///< weights of the current mini-batch,
+  Vector<double>         task_weights_sum_;  ///< for the report (average weights),
+  Vector<double>         task_loss_avg_;     ///< running averages of per-frame losses,
+  int32                  num_minibatches_;
   
   std::vector<int32>     loss_dim_offset_;
 
   CuMatrix<BaseFloat>    tgt_mat_;
+
+  // per-loss masks of frames with defined targets, (num_losses x num_frames)
+  Matrix<BaseFloat>      frmwei_have_tgt_host_;
+  CuMatrix<BaseFloat>    frmwei_have_tgt_;
+  CuVector<BaseFloat>    frame_weights_;
 };
 
 } // namespace nnet1
@@ -215,6 +215,34 @@ class LstmProjectedStreams : public UpdatableComponent {
     return;
   }
 
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    int32 offset = 0, len;
+
+    len = w_gifo_x_.NumRows() * w_gifo_x_.NumCols();
+    w_gifo_x_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = w_gifo_r_.NumRows() * w_gifo_r_.NumCols();
+    w_gifo_r_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    len = bias_.Dim();
+    bias_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = peephole_i_c_.Dim();
+    peephole_i_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = peephole_f_c_.Dim();
+    peephole_f_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = peephole_o_c_.Dim();
+    peephole_o_c_.CopyFromVec(params.Range(offset, len)); offset += len;
+
+    len = w_r_m_.NumRows() * w_r_m_.NumCols();
+    w_r_m_.CopyRowsFromVec(params.Range(offset, len)); offset += len;
+
+    KALDI_ASSERT(offset == NumParams());
+  }
+
   std::string Info() const {
     return std::string("  ") +
       "\n  w_gifo_x_  "   + MomentStatistics(w_gifo_x_) +
@@ -293,6 +321,10 @@ class LstmProjectedStreams : public UpdatableComponent {
     }
   }
 
+  bool IsFeedforwardThreadSafe() const {
+    return false;  // the recurrent state and the buffers are kept in the component,
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     int DEBUG = 0;
 
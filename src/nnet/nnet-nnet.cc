@@ -25,6 +25,7 @@
 #include "nnet/nnet-various.h"
 #include "nnet/nnet-lstm-projected-streams.h"
 #include "nnet/nnet-blstm-projected-streams.h"
+#include "nnet/nnet-profile.h"
 
 namespace kaldi {
 namespace nnet1 {
@@ -40,6 +41,7 @@ Nnet::Nnet(const Nnet& other) {
   backpropagate_buf_.resize(NumComponents()+1);
   // copy train opts
   SetTrainOptions(other.opts_);
+  profile_ = other.profile_;
   Check(); 
 }
 
@@ -54,6 +56,8 @@ Nnet & Nnet::operator = (const Nnet& other) {
   backpropagate_buf_.resize(NumComponents()+1);
   // copy train opts
   SetTrainOptions(other.opts_); 
+  profile_ = other.profile_;
+  ResetProfile();
   Check();
   return *this;
 }
@@ -79,14 +83,40 @@ void Nnet::Propagate(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out
   propagate_buf_[0].CopyFromMat(in);
 
   for(int32 i=0; i<(int32)components_.size(); i++) {
-    components_[i]->Propagate(propagate_buf_[i], &propagate_buf_[i+1]); // propagate_buf_[i]   is the i/p to components_[i]
-    																	// propagate_buf_[i+1] is the o/p of components_[i]
+    PropagateComponent(i, propagate_buf_[i], &propagate_buf_[i+1]); // propagate_buf_[i]   is the i/p to components_[i]
+    																// propagate_buf_[i+1] is the o/p of components_[i]
   }
   
   (*out) = propagate_buf_[components_.size()];
 }
 
 
+void Nnet::PropagateInto(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
+  KALDI_ASSERT(NULL != out);
+  KALDI_ASSERT(out->NumRows() == in.NumRows());
+
+  if (NumComponents() == 0) {
+    out->CopyFromMat(in);
+    return;
+  }
+
+  KALDI_ASSERT((int32)propagate_buf_.size() >= NumComponents()+1);
+
+  propagate_buf_[0].Resize(in.NumRows(), in.NumCols(), kUndefined);
+  propagate_buf_[0].CopyFromMat(in);
+
+  int32 last = NumComponents()-1;
+  for(int32 i=0; i<last; i++) {
+    PropagateComponent(i, propagate_buf_[i], &propagate_buf_[i+1]);
+  }
+  // the last component writes into 'out',
+  Timer tim;
+  components_[last]->PropagateInto(propagate_buf_[last], out);
+  if (profile_) AccuProfile(&time_propagate_, last, tim);
+  propagate_buf_[last+1].Resize(0, 0);
+}
+
+
 void Nnet::Backpropagate(const CuMatrixBase<BaseFloat> &out_diff, CuMatrix<BaseFloat> *in_diff) {
 
   //////////////////////////////////////
@@ -103,12 +133,7 @@ void Nnet::Backpropagate(const CuMatrixBase<BaseFloat> &out_diff, CuMatrix<BaseF
   backpropagate_buf_[NumComponents()] = out_diff;
   // backpropagate using buffers
   for (int32 i = NumComponents()-1; i >= 0; i--) {
-    components_[i]->Backpropagate(propagate_buf_[i], propagate_buf_[i+1],
-                            backpropagate_buf_[i+1], &backpropagate_buf_[i]);
-    if (components_[i]->IsUpdatable()) {
-      UpdatableComponent *uc = dynamic_cast<UpdatableComponent*>(components_[i]);
-      uc->Update(propagate_buf_[i], backpropagate_buf_[i+1]);
-    }
+    BackpropagateComponent(i, &backpropagate_buf_[i]);
   }
   // eventually export the derivative
   if (NULL != in_diff) (*in_diff) = backpropagate_buf_[0];
@@ -119,6 +144,31 @@ void Nnet::Backpropagate(const CuMatrixBase<BaseFloat> &out_diff, CuMatrix<BaseF
 }
 
 
+void Nnet::BackpropagateInto(const CuMatrixBase<BaseFloat> &out,
+                             const CuMatrixBase<BaseFloat> &out_diff,
+                             CuMatrixBase<BaseFloat> *in_diff) {
+  if (NumComponents() == 0) {
+    if (NULL != in_diff) in_diff->CopyFromMat(out_diff);
+    return;
+  }
+
+  KALDI_ASSERT((int32)propagate_buf_.size() == NumComponents()+1);
+  KALDI_ASSERT((int32)backpropagate_buf_.size() == NumComponents()+1);
+
+  // the 1st component gets NULL if the derivative is not exported,
+  // (then only the components with nested nnets backpropagate)
+  int32 first = (NULL == in_diff ? 1 : 0),
+    last = NumComponents()-1;
+  // the last component reads 'out', 'out_diff' directly,
+  BackpropagateComponent(last, out, out_diff,
+                         (last >= first ? &backpropagate_buf_[last] : NULL));
+  for (int32 i = last-1; i >= 0; i--) {
+    BackpropagateComponent(i, (i >= first ? &backpropagate_buf_[i] : NULL));
+  }
+  if (NULL != in_diff) in_diff->CopyFromMat(backpropagate_buf_[0]);
+}
+
+
 void Nnet::Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out) {
   KALDI_ASSERT(NULL != out);
 
@@ -129,7 +179,7 @@ void Nnet::Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *o
   }
 
   if (NumComponents() == 1) {
-    components_[0]->Propagate(in, out);
+    PropagateComponent(0, in, out);
     return;
   }
 
@@ -138,17 +188,177 @@ void Nnet::Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *o
 
   // propagate by using exactly 2 auxiliary buffers
   int32 L = 0;
-  components_[L]->Propagate(in, &propagate_buf_[L%2]);
+  PropagateComponent(L, in, &propagate_buf_[L%2]);
   for(L++; L<=NumComponents()-2; L++) {
-    components_[L]->Propagate(propagate_buf_[(L-1)%2], &propagate_buf_[L%2]);
+    PropagateComponent(L, propagate_buf_[(L-1)%2], &propagate_buf_[L%2]);
   }
-  components_[L]->Propagate(propagate_buf_[(L-1)%2], out);
+  PropagateComponent(L, propagate_buf_[(L-1)%2], out);
   // release the buffers we don't need anymore
   propagate_buf_[0].Resize(0,0);
   propagate_buf_[1].Resize(0,0);
 }
 
 
+void Nnet::Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out,
+                       std::vector<CuMatrix<BaseFloat> > *buffers) const {
+  KALDI_ASSERT(NULL != out && NULL != buffers);
+
+  if (NumComponents() == 0) { 
+    out->Resize(in.NumRows(), in.NumCols());
+    out->CopyFromMat(in); 
+    return; 
+  }
+
+  if (NumComponents() == 1) {
+    components_[0]->Feedforward(in, out);
+    return;
+  }
+
+  // the caller's buffers, kept allocated for the next call,
+  if (buffers->size() < 2) buffers->resize(2);
+
+  // propagate by using exactly 2 auxiliary buffers
+  int32 L = 0;
+  components_[L]->Feedforward(in, &(*buffers)[L%2]);
+  for(L++; L<=NumComponents()-2; L++) {
+    components_[L]->Feedforward((*buffers)[(L-1)%2], &(*buffers)[L%2]);
+  }
+  components_[L]->Feedforward((*buffers)[(L-1)%2], out);
+}
+
+
+bool Nnet::IsFeedforwardThreadSafe() const {
+  for (int32 c = 0; c < NumComponents(); c++) {
+    if (!components_[c]->IsFeedforwardThreadSafe()) return false;
+  }
+  return true;
+}
+
+
+void Nnet::PropagateComponent(int32 c, const CuMatrixBase<BaseFloat> &in,
+                              CuMatrix<BaseFloat> *out) {
+  if (!profile_) {
+    components_[c]->Propagate(in, out);
+    return;
+  }
+  Timer tim;
+  components_[c]->Propagate(in, out);
+  AccuProfile(&time_propagate_, c, tim);
+}
+
+
+void Nnet::BackpropagateComponent(int32 c, CuMatrix<BaseFloat> *in_diff) {
+  BackpropagateComponent(c, propagate_buf_[c+1], backpropagate_buf_[c+1], in_diff);
+}
+
+
+void Nnet::BackpropagateComponent(int32 c, const CuMatrixBase<BaseFloat> &out,
+                                  const CuMatrixBase<BaseFloat> &out_diff,
+                                  CuMatrix<BaseFloat> *in_diff) {
+  Timer tim;
+  components_[c]->Backpropagate(propagate_buf_[c], out, out_diff, in_diff);
+  if (profile_) AccuProfile(&time_backpropagate_, c, tim);
+  if (components_[c]->IsUpdatable()) {
+    UpdatableComponent *uc = dynamic_cast<UpdatableComponent*>(components_[c]);
+    tim.Reset();
+    uc->Update(propagate_buf_[c], out_diff);
+    if (profile_) AccuProfile(&time_update_, c, tim);
+  }
+}
+
+
+void Nnet::AccuProfile(std::vector<double> *time, int32 c, Timer &tim) {
+  if (time->size() < NumComponents()) time->resize(NumComponents(), 0.0);
+  (*time)[c] += NnetProfiler::Elapsed(tim);
+}
+
+
+bool Nnet::GetFrameContext(int32 *left_context, int32 *right_context,
+                           int32 *num_splice) const {
+  *left_context = 0; *right_context = 0; *num_splice = 0;
+  for (int32 c = 0; c < NumComponents(); c++) {
+    const Component& comp = GetComponent(c);
+    switch (comp.GetType()) {
+      case Component::kSplice: {
+        std::vector<int32> offsets;
+        dynamic_cast<const Splice&>(comp).GetFrameOffsets(&offsets);
+        if (!offsets.empty()) {
+          *left_context += std::max(0, -*std::min_element(offsets.begin(), offsets.end()));
+          *right_context += std::max(0, *std::max_element(offsets.begin(), offsets.end()));
+        }
+        (*num_splice)++;
+        break;
+      }
+      case Component::kParallelComponent: {
+        // the widest of the nested networks,
+        const ParallelComponent& parallel = dynamic_cast<const ParallelComponent&>(comp);
+        int32 left = 0, right = 0, splice = 0;
+        for (int32 i = 0; i < parallel.NumNestedNnet(); i++) {
+          int32 l, r, s;
+          if (!parallel.GetNestedNnet(i).GetFrameContext(&l, &r, &s)) return false;
+          left = std::max(left, l); right = std::max(right, r); splice = std::max(splice, s);
+        }
+        *left_context += left; *right_context += right; *num_splice += splice;
+        break;
+      }
+      case Component::kLstmProjectedStreams:
+      case Component::kBLstmProjectedStreams:
+      case Component::kSentenceAveragingComponent:
+        return false;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+
+void Nnet::SetProfiling(bool profile) {
+  profile_ = profile;
+}
+
+
+void Nnet::AddProfile(const Nnet &other) {
+  KALDI_ASSERT(other.NumComponents() == NumComponents());
+  const std::vector<double> *src[3] = { &other.time_propagate_,
+    &other.time_backpropagate_, &other.time_update_ };
+  std::vector<double> *tgt[3] = { &time_propagate_, &time_backpropagate_, &time_update_ };
+  for (int32 k = 0; k < 3; k++) {
+    tgt[k]->resize(NumComponents(), 0.0);
+    for (int32 c = 0; c < src[k]->size(); c++) (*tgt[k])[c] += (*src[k])[c];
+  }
+}
+
+
+void Nnet::ResetProfile() {
+  time_propagate_.clear();
+  time_backpropagate_.clear();
+  time_update_.clear();
+}
+
+
+std::string Nnet::InfoProfile() const {
+  std::ostringstream ostr;
+  for (int32 i = 0; i < NumComponents(); i++) {
+    ostr << "component " << i+1 << " " 
+         << Component::TypeToMarker(components_[i]->GetType())
+         << " propagate " << (i < time_propagate_.size() ? time_propagate_[i] : 0.0)
+         << " backpropagate " << (i < time_backpropagate_.size() ? time_backpropagate_[i] : 0.0)
+         << " update " << (i < time_update_.size() ? time_update_[i] : 0.0) << std::endl;
+  }
+  return ostr.str();
+}
+
+
+void Nnet::GetProfileTotals(double *propagate, double *backpropagate,
+                            double *update) const {
+  *propagate = 0.0; *backpropagate = 0.0; *update = 0.0;
+  for (int32 i = 0; i < time_propagate_.size(); i++) *propagate += time_propagate_[i];
+  for (int32 i = 0; i < time_backpropagate_.size(); i++) *backpropagate += time_backpropagate_[i];
+  for (int32 i = 0; i < time_update_.size(); i++) *update += time_update_[i];
+}
+
+
 int32 Nnet::OutputDim() const {
   KALDI_ASSERT(!components_.empty());
   return components_.back()->OutputDim();
@@ -229,6 +439,21 @@ void Nnet::GetParams(Vector<BaseFloat>* wei_copy) const {
 }
 
 
+void Nnet::SetParams(const VectorBase<BaseFloat>& wei_src) {
+  KALDI_ASSERT(wei_src.Dim() == NumParams());
+  int32 pos = 0;
+  for(int32 i=0; i<components_.size(); i++) {
+    if(components_[i]->IsUpdatable()) {
+      UpdatableComponent& c = dynamic_cast<UpdatableComponent&>(*components_[i]);
+      int32 num_params = c.NumParams();
+      c.SetParams(wei_src.Range(pos, num_params));
+      pos += num_params;
+    }
+  }
+  KALDI_ASSERT(pos == NumParams());
+}
+
+
 void Nnet::GetWeights(Vector<BaseFloat>* wei_copy) const {
   wei_copy->Resize(NumParams());
   int32 pos = 0;
@@ -366,6 +591,164 @@ void Nnet::ResetLstmStreams(const std::vector<int32> &stream_reset_flag) {
 }
 
 
+void Nnet::SetBlockSoftmaxRowOffset(const std::vector<int32> &row_offset) {
+  int32 c = NumComponents()-1;
+  if (c < 0 || GetComponent(c).GetType() != Component::kBlockSoftmax) {
+    KALDI_ERR << "The last component is not <BlockSoftmax>, "
+              << "cannot evaluate the output blocks sparsely.";
+  }
+  BlockSoftmax& softmax = dynamic_cast<BlockSoftmax&>(GetComponent(c));
+  softmax.SetBlockRowOffset(row_offset);
+  // the affine transform feeding the softmax is restricted to same blocks,
+  if (c > 0 && GetComponent(c-1).GetType() == Component::kAffineTransform) {
+    AffineTransform& affine = dynamic_cast<AffineTransform&>(GetComponent(c-1));
+    if (row_offset.empty()) {
+      affine.SetOutputBlocks(std::vector<int32>(), std::vector<int32>());
+    } else {
+      affine.SetOutputBlocks(softmax.block_offset, row_offset);
+    }
+  }
+}
+
+
+void Nnet::SetTaskLearnRateScale(const std::vector<int32> &task_offset,
+                                 const std::vector<BaseFloat> &scale) {
+  int32 num_tasks = scale.size();
+  KALDI_ASSERT(task_offset.size() == num_tasks + 1);
+  KALDI_ASSERT(task_offset.back() == OutputDim());
+  int32 c = NumComponents()-1;
+  if (c < 0) KALDI_ERR << "Empty network, no output layer";
+  if (GetComponent(c).GetType() == Component::kParallelComponent) {
+    // one nested network per task,
+    ParallelComponent& parallel = dynamic_cast<ParallelComponent&>(GetComponent(c));
+    if (parallel.NumNestedNnet() != num_tasks) {
+      KALDI_ERR << "The output <ParallelComponent> has " << parallel.NumNestedNnet()
+                << " nested networks, expected one per task : " << num_tasks;
+    }
+    for (int32 t = 0; t < num_tasks; t++) {
+      Nnet& nested = parallel.GetNestedNnet(t);
+      std::vector<int32> nested_offset(2, 0);
+      nested_offset[1] = nested.OutputDim();
+      if (nested_offset[1] != task_offset[t+1] - task_offset[t]) {
+        KALDI_ERR << "Nested network " << t+1 << " has " << nested_offset[1]
+                  << " outputs, the task has " << task_offset[t+1] - task_offset[t];
+      }
+      nested.SetTaskLearnRateScale(nested_offset, std::vector<BaseFloat>(1, scale[t]));
+    }
+    return;
+  }
+  // the affine transform feeding the softmax,
+  Component::ComponentType type = GetComponent(c).GetType();
+  if (c > 0 && (type == Component::kSoftmax || type == Component::kBlockSoftmax)) {
+    c--;
+  }
+  if (GetComponent(c).GetType() != Component::kAffineTransform) {
+    KALDI_ERR << "The output layer is not <AffineTransform>, but " 
+              << Component::TypeToMarker(GetComponent(c).GetType())
+              << ", cannot set the per-task learning rates";
+  }
+  Vector<BaseFloat> row_scale(OutputDim());
+  for (int32 t = 0; t < num_tasks; t++) {
+    row_scale.Range(task_offset[t], task_offset[t+1] - task_offset[t]).Set(scale[t]);
+  }
+  if (row_scale.Min() == 1.0 && row_scale.Max() == 1.0) {
+    row_scale.Resize(0);  // no scaling,
+  }
+  dynamic_cast<AffineTransform&>(GetComponent(c)).SetOutputLearnRateScale(row_scale);
+}
+
+
+/// Copies the components of a nested network of <ParallelComponent> to 'out',
+/// a <Copy> selecting the input columns of the branch is put in front.
+static void CopyParallelBranch(const ParallelComponent &parallel, int32 branch,
+                               std::vector<Component*> *out) {
+  int32 input_offset = 0;
+  for (int32 i = 0; i < branch; i++) {
+    input_offset += parallel.GetNestedNnet(i).InputDim();
+  }
+  const Nnet &nested = parallel.GetNestedNnet(branch);
+  if (nested.InputDim() != parallel.InputDim()) {
+    std::ostringstream os;
+    os << "<Copy> <InputDim> " << parallel.InputDim()
+       << " <OutputDim> " << nested.InputDim()
+       << " <BuildVector> " << input_offset + 1 << ":" << input_offset + nested.InputDim()
+       << " </BuildVector>\n";
+    out->push_back(Component::Init(os.str()));
+  }
+  for (int32 i = 0; i < nested.NumComponents(); i++) {
+    out->push_back(nested.GetComponent(i).Copy());
+  }
+}
+
+
+void Nnet::SelectTask(int32 task) {
+  int32 c = NumComponents()-1;
+  if (c < 0) KALDI_ERR << "Cannot select task in empty network";
+  // the components replacing the range [c, end),
+  std::vector<Component*> task_components;
+  if (GetComponent(c).GetType() == Component::kBlockSoftmax) {
+    const BlockSoftmax& softmax = dynamic_cast<const BlockSoftmax&>(GetComponent(c));
+    int32 num_blocks = softmax.block_dims.size();
+    if (task < 1 || task > num_blocks) {
+      KALDI_ERR << "Task " << task << " out of range, the <BlockSoftmax> has "
+                << num_blocks << " blocks";
+    }
+    int32 offset = softmax.block_offset[task-1],
+      dim = softmax.block_dims[task-1];
+    c--;
+    if (c >= 0 && GetComponent(c).GetType() == Component::kAffineTransform) {
+      // keep only the rows of the affine transform producing the block,
+      const AffineTransform& affine = dynamic_cast<const AffineTransform&>(GetComponent(c));
+      AffineTransform* affine_task = new AffineTransform(affine.InputDim(), dim);
+      affine_task->SetLinearity(affine.GetLinearity().RowRange(offset, dim));
+      affine_task->SetBias(affine.GetBias().Range(offset, dim));
+      task_components.push_back(affine_task);
+    } else if (c >= 0 && GetComponent(c).GetType() == Component::kParallelComponent) {
+      // the nested networks produce the blocks,
+      const ParallelComponent& parallel = dynamic_cast<const ParallelComponent&>(GetComponent(c));
+      if (parallel.NumNestedNnet() != num_blocks) {
+        KALDI_ERR << "Mismatch of <ParallelComponent> with " << parallel.NumNestedNnet()
+                  << " nested networks and <BlockSoftmax> with " << num_blocks << " blocks";
+      }
+      for (int32 i = 0; i < num_blocks; i++) {
+        if (parallel.GetNestedNnet(i).OutputDim() != softmax.block_dims[i]) {
+          KALDI_ERR << "Output dim of nested network #" << i+1 << " "
+                    << parallel.GetNestedNnet(i).OutputDim()
+                    << " does not match <BlockSoftmax> block " << softmax.block_dims[i];
+        }
+      }
+      CopyParallelBranch(parallel, task-1, &task_components);
+    } else {
+      KALDI_ERR << "Cannot select task, the <BlockSoftmax> is not preceded by "
+                << "<AffineTransform> or <ParallelComponent>";
+    }
+    task_components.push_back(new Softmax(dim, dim));
+  } else if (GetComponent(c).GetType() == Component::kParallelComponent) {
+    const ParallelComponent& parallel = dynamic_cast<const ParallelComponent&>(GetComponent(c));
+    if (task < 1 || task > parallel.NumNestedNnet()) {
+      KALDI_ERR << "Task " << task << " out of range, the <ParallelComponent> has "
+                << parallel.NumNestedNnet() << " nested networks";
+    }
+    CopyParallelBranch(parallel, task-1, &task_components);
+  } else {
+    KALDI_ERR << "Cannot select task, the last component is "
+              << Component::TypeToMarker(GetComponent(c).GetType())
+              << " (expected <BlockSoftmax> or <ParallelComponent>)";
+  }
+  // replace the tail of the network,
+  for (int32 i = c; i < NumComponents(); i++) {
+    delete components_[i];
+  }
+  components_.resize(c);
+  components_.insert(components_.end(), task_components.begin(), task_components.end());
+  // create training buffers,
+  propagate_buf_.resize(NumComponents()+1);
+  backpropagate_buf_.resize(NumComponents()+1);
+  //
+  Check();
+}
+
+
 void Nnet::Init(const std::string &file) {
   Input in(file);
   std::istream &is = in.Stream();
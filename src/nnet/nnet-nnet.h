@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "base/kaldi-common.h"
+#include "base/timer.h"
 #include "util/kaldi-io.h"
 #include "matrix/matrix-lib.h"
 #include "nnet/nnet-trnopts.h"
@@ -35,8 +36,8 @@ namespace nnet1 {
 
 class Nnet {
  public:
-  Nnet() {}
-  Nnet(const Nnet& other); // Copy constructor.
+  Nnet() : profile_(false) {}
+  Nnet(const Nnet& other); // Copy constructor (the profile times are not copied).
   Nnet &operator = (const Nnet& other); // Assignment operator.
 
   ~Nnet(); 
@@ -46,8 +47,23 @@ class Nnet {
   void Propagate(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out); 
   /// Perform backward pass through the network
   void Backpropagate(const CuMatrixBase<BaseFloat> &out_diff, CuMatrix<BaseFloat> *in_diff);
+  /// Perform forward pass, the output is written to pre-allocated 'out' (e.g. a sub-matrix),
+  /// the last component writes straight into 'out', (it is not kept in the buffers)
+  void PropagateInto(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out);
+  /// Perform backward pass after PropagateInto(), 'out' is its unchanged output,
+  /// the derivative is written to pre-allocated 'in_diff' (NULL = don't export)
+  void BackpropagateInto(const CuMatrixBase<BaseFloat> &out,
+                         const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff);
   /// Perform forward pass through the network, don't keep buffers (use it when not training)
   void Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out); 
+  /// Perform forward pass without changing the network, the 2 auxiliary
+  /// buffers are supplied by the caller, so a single network can be shared
+  /// by several threads, each with its own 'buffers' (no profiling)
+  void Feedforward(const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out,
+                   std::vector<CuMatrix<BaseFloat> > *buffers) const; 
+  /// Check if Feedforward(in, out, buffers) can be called concurrently,
+  /// (false if some component keeps state in the forward pass, e.g. LSTM)
+  bool IsFeedforwardThreadSafe() const;
 
   /// Dimensionality on network input (input feature dim.)
   int32 InputDim() const; 
@@ -89,6 +105,8 @@ class Nnet {
   int32 NumParams() const;
   /// Get the network weights in a supervector
   void GetParams(Vector<BaseFloat>* wei_copy) const;
+  /// Set the network weights from a supervector (same layout as GetParams)
+  void SetParams(const VectorBase<BaseFloat>& wei_src);
   /// Get the network weights in a supervector
   void GetWeights(Vector<BaseFloat>* wei_copy) const;
   /// Set the network weights from a supervector
@@ -100,6 +118,40 @@ class Nnet {
   void SetDropoutRetention(BaseFloat r);
   /// Reset streams in LSTM multi-stream training,
   void ResetLstmStreams(const std::vector<int32> &stream_reset_flag);
+  /// Evaluate the output <BlockSoftmax> (and the <AffineTransform> before it)
+  /// only on the rows of each block, the mini-batch has to be grouped by blocks,
+  /// 'row_offset' has (num_blocks+1) elements, the empty vector sets dense mode.
+  void SetBlockSoftmaxRowOffset(const std::vector<int32> &row_offset);
+  /// Reduce a multi-task network to the task 'task' (1-based), the output
+  /// <BlockSoftmax> becomes <Softmax> of the selected block (with the matching
+  /// rows of the <AffineTransform> before it), or the output <ParallelComponent>
+  /// is replaced by the components of the selected nested network.
+  void SelectTask(int32 task);
+  /// Set per-task learning-rate multipliers of the output layer, the tasks are
+  /// the output index-ranges 'task_offset' (num_tasks+1 elements). The rows of
+  /// the <AffineTransform> before the output <Softmax>/<BlockSoftmax> are
+  /// scaled, or the last <AffineTransform> in each nested network of the
+  /// output <ParallelComponent> (one network per task).
+  void SetTaskLearnRateScale(const std::vector<int32> &task_offset,
+                             const std::vector<BaseFloat> &scale);
+  /// Frame-context of the network given by the <Splice> components (also in
+  /// the nested networks), 'num_splice' is the largest number of <Splice>
+  /// components on a path through the network. Returns false if the output
+  /// is not a function of a fixed window of input frames (LSTM, BLSTM,
+  /// sentence-averaging), in which case the utterances cannot be batched.
+  bool GetFrameContext(int32 *left_context, int32 *right_context,
+                       int32 *num_splice) const;
+
+  /// Measure the wall-time of the forward/backward pass and update of each component,
+  void SetProfiling(bool profile);
+  /// Add the component times measured in a copy of this network (e.g. training thread),
+  void AddProfile(const Nnet &other);
+  /// Reset the component times,
+  void ResetProfile();
+  /// Create string with per-component times (seconds), one component per line
+  std::string InfoProfile() const;
+  /// Get the component times summed over the components (seconds),
+  void GetProfileTotals(double *propagate, double *backpropagate, double *update) const;
 
   /// Initialize MLP from config
   void Init(const std::string &config_file);
@@ -133,6 +185,17 @@ class Nnet {
   }
 
  private:
+  /// Propagate through component 'c' (measures the time when profiling),
+  void PropagateComponent(int32 c, const CuMatrixBase<BaseFloat> &in, CuMatrix<BaseFloat> *out);
+  /// Backpropagate through component 'c' and update it, uses the buffers,
+  void BackpropagateComponent(int32 c, CuMatrix<BaseFloat> *in_diff);
+  /// The same, the output and the output derivative of the component are given,
+  void BackpropagateComponent(int32 c, const CuMatrixBase<BaseFloat> &out,
+                              const CuMatrixBase<BaseFloat> &out_diff,
+                              CuMatrix<BaseFloat> *in_diff);
+  /// Add time measured by 'tim' to the time of component 'c',
+  void AccuProfile(std::vector<double> *time, int32 c, Timer &tim);
+
   /// Vector which contains all the components composing the neural network,
   /// the components are for example: AffineTransform, Sigmoid, Softmax
   std::vector<Component*> components_; 
@@ -142,6 +205,10 @@ class Nnet {
 
   /// Option class with hyper-parameters passed to UpdatableComponent(s)
   NnetTrainOptions opts_;
+
+  /// Per-component wall-time (seconds), measured when 'profile_' is set
+  bool profile_;
+  std::vector<double> time_propagate_, time_backpropagate_, time_update_;
 };
   
 
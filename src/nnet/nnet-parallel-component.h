@@ -25,6 +25,8 @@
 #include "nnet/nnet-component.h"
 #include "nnet/nnet-utils.h"
 #include "cudamatrix/cu-math.h"
+#include "cudamatrix/cu-device.h"
+#include "thread/kaldi-task-sequence.h"
 
 #include <sstream>
 
@@ -34,10 +36,16 @@ namespace nnet1 {
 class ParallelComponent : public UpdatableComponent {
  public:
   ParallelComponent(int32 dim_in, int32 dim_out) 
-    : UpdatableComponent(dim_in, dim_out)
+    : UpdatableComponent(dim_in, dim_out), num_threads_(0), pool_(NULL)
   { }
-  ~ParallelComponent()
+  /// The copy gets its own thread pool,
+  ParallelComponent(const ParallelComponent &other)
+    : UpdatableComponent(other), nnet_(other.nnet_),
+      input_offset_(other.input_offset_), output_offset_(other.output_offset_),
+      num_threads_(other.num_threads_), pool_(NULL)
   { }
+  ~ParallelComponent()
+  { delete pool_; }
 
   Component* Copy() const { return new ParallelComponent(*this); }
   ComponentType GetType() const { return kParallelComponent; }
@@ -88,14 +96,7 @@ class ParallelComponent : public UpdatableComponent {
         KALDI_LOG << "Initialized nested <Nnet> from prototype : " << nested_nnet_proto[i];
       }
     }
-    // check dim-sum of nested nnets
-    int32 nnet_input_sum = 0, nnet_output_sum = 0;
-    for (int32 i=0; i<nnet_.size(); i++) {
-      nnet_input_sum += nnet_[i].InputDim();
-      nnet_output_sum += nnet_[i].OutputDim();
-    }
-    KALDI_ASSERT(InputDim() == nnet_input_sum);
-    KALDI_ASSERT(OutputDim() == nnet_output_sum);
+    ComputeOffsets();
   }
 
   void ReadData(std::istream &is, bool binary) {
@@ -113,14 +114,7 @@ class ParallelComponent : public UpdatableComponent {
     }
     ExpectToken(is, binary, "</ParallelComponent>");
 
-    // check dim-sum of nested nnets
-    int32 nnet_input_sum = 0, nnet_output_sum = 0;
-    for (int32 i=0; i<nnet_.size(); i++) {
-      nnet_input_sum += nnet_[i].InputDim();
-      nnet_output_sum += nnet_[i].OutputDim();
-    }
-    KALDI_ASSERT(InputDim() == nnet_input_sum);
-    KALDI_ASSERT(OutputDim() == nnet_output_sum);
+    ComputeOffsets();
   }
 
   void WriteData(std::ostream &os, bool binary) const {
@@ -141,6 +135,8 @@ class ParallelComponent : public UpdatableComponent {
 
   const Nnet& GetNestedNnet(int32 id) const { return nnet_.at(id); }
 
+  int32 NumNestedNnet() const { return nnet_.size(); }
+
   int32 NumParams() const { 
     int32 num_params_sum = 0;
     for (int32 i=0; i<nnet_.size(); i++) 
@@ -159,6 +155,16 @@ class ParallelComponent : public UpdatableComponent {
     }
     KALDI_ASSERT(offset == NumParams());
   }
+
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    int32 offset = 0;
+    for (int32 i=0; i<nnet_.size(); i++) {
+      int32 num_params = nnet_[i].NumParams();
+      nnet_[i].SetParams(params.Range(offset, num_params));
+      offset += num_params;
+    }
+  }
     
   std::string Info() const { 
     std::ostringstream os;
@@ -197,34 +203,32 @@ class ParallelComponent : public UpdatableComponent {
   }
 
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
-    int32 input_offset = 0, output_offset = 0;
+    RunBranches(false, in, in, out);
+  }
+
+  bool IsFeedforwardThreadSafe() const {
     for (int32 i=0; i<nnet_.size(); i++) {
-      CuSubMatrix<BaseFloat> src(in.ColRange(input_offset, nnet_[i].InputDim()));
-      CuSubMatrix<BaseFloat> tgt(out->ColRange(output_offset, nnet_[i].OutputDim()));
-      //
-      CuMatrix<BaseFloat> tgt_aux;
-      nnet_[i].Propagate(src, &tgt_aux);
-      tgt.CopyFromMat(tgt_aux);
-      //
-      input_offset += nnet_[i].InputDim();
-      output_offset += nnet_[i].OutputDim();
+      if (!nnet_[i].IsFeedforwardThreadSafe()) return false;
     }
+    return true;
   }
 
-  void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in, const CuMatrixBase<BaseFloat> &out,
-                        const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff) {
+  void FeedforwardFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) const {
+    // the nested networks run one after another in the calling thread,
+    std::vector<CuMatrix<BaseFloat> > buffers;
+    CuMatrix<BaseFloat> tgt;
     int32 input_offset = 0, output_offset = 0;
     for (int32 i=0; i<nnet_.size(); i++) {
-      CuSubMatrix<BaseFloat> src(out_diff.ColRange(output_offset, nnet_[i].OutputDim()));
-      CuSubMatrix<BaseFloat> tgt(in_diff->ColRange(input_offset, nnet_[i].InputDim()));
-      // 
-      CuMatrix<BaseFloat> tgt_aux;
-      nnet_[i].Backpropagate(src, &tgt_aux);
-      tgt.CopyFromMat(tgt_aux);
-      //
+      nnet_[i].Feedforward(in.ColRange(input_offset, nnet_[i].InputDim()), &tgt, &buffers);
+      out->ColRange(output_offset, nnet_[i].OutputDim()).CopyFromMat(tgt);
       input_offset += nnet_[i].InputDim();
       output_offset += nnet_[i].OutputDim();
     }
+  }
+
+  void BackpropagateFnc(const CuMatrixBase<BaseFloat> &in, const CuMatrixBase<BaseFloat> &out,
+                        const CuMatrixBase<BaseFloat> &out_diff, CuMatrixBase<BaseFloat> *in_diff) {
+    RunBranches(true, out, out_diff, in_diff);
 
     #if 0
 	std::vector<Component*> c;
@@ -319,8 +323,108 @@ class ParallelComponent : public UpdatableComponent {
     }
   }
 
+  /// Caps the number of threads running the nested networks, the calling
+  /// thread included (0 = one per nested network, 1 = all in the calling
+  /// thread). The threads are created once and kept until destruction.
+  /// The multi-threaded trainers set 1, their threads already use the cores.
+  void SetNumThreads(int32 num_threads) {
+    KALDI_ASSERT(num_threads >= 0);
+    if (num_threads != num_threads_) {
+      delete pool_;
+      pool_ = NULL;
+    }
+    num_threads_ = num_threads;
+  }
+
  private:
+  /// Checks the dim-sums of the nested networks and computes their column
+  /// ranges, (once, the forward/backward passes only read them)
+  void ComputeOffsets() {
+    int32 num_nnets = nnet_.size();
+    input_offset_.assign(num_nnets+1, 0);
+    output_offset_.assign(num_nnets+1, 0);
+    for (int32 i=0; i<num_nnets; i++) {
+      input_offset_[i+1] = input_offset_[i] + nnet_[i].InputDim();
+      output_offset_[i+1] = output_offset_[i] + nnet_[i].OutputDim();
+    }
+    KALDI_ASSERT(InputDim() == input_offset_[num_nnets]);
+    KALDI_ASSERT(OutputDim() == output_offset_[num_nnets]);
+  }
+
+  /// Forward or backward pass through the nested networks, each network
+  /// reads/writes its column range of 'src'/'tgt' ('tgt' can be NULL
+  /// in the backward pass, 'out' is the output of the forward pass).
+  /// Without GPU the networks run concurrently, the calling thread runs
+  /// the 1st one and the thread pool the others.
+  void RunBranches(bool backward, const CuMatrixBase<BaseFloat> &out,
+                   const CuMatrixBase<BaseFloat> &src,
+                   CuMatrixBase<BaseFloat> *tgt) {
+    int32 num_nnets = nnet_.size();
+    int32 num_threads = (num_threads_ > 0 ? std::min(num_threads_, num_nnets) : num_nnets);
+#if HAVE_CUDA == 1
+    if (CuDevice::Instantiate().Enabled()) {
+      num_threads = 1; // the CUDA calls stay in the main thread,
+    }
+#endif
+    if (num_threads <= 1) {
+      for (int32 i=0; i<num_nnets; i++) {
+        RunBranch(i, backward, out, src, tgt);
+      }
+      return;
+    }
+    if (pool_ == NULL) {
+      TaskSequencerConfig config;
+      config.num_threads = num_threads - 1;
+      config.num_threads_total = num_nnets;
+      pool_ = new TaskSequencer<BranchTask>(config);
+    }
+    for (int32 i=1; i<num_nnets; i++) {
+      pool_->Run(new BranchTask(this, i, backward, &out, &src, tgt));
+    }
+    RunBranch(0, backward, out, src, tgt);
+    pool_->Wait();
+  }
+
+  void RunBranch(int32 i, bool backward, const CuMatrixBase<BaseFloat> &out,
+                 const CuMatrixBase<BaseFloat> &src, CuMatrixBase<BaseFloat> *tgt) {
+    if (!backward) {
+      CuSubMatrix<BaseFloat> in_i(src.ColRange(input_offset_[i], nnet_[i].InputDim()));
+      CuSubMatrix<BaseFloat> out_i(tgt->ColRange(output_offset_[i], nnet_[i].OutputDim()));
+      nnet_[i].PropagateInto(in_i, &out_i);
+      return;
+    }
+    CuSubMatrix<BaseFloat> out_i(out.ColRange(output_offset_[i], nnet_[i].OutputDim()));
+    CuSubMatrix<BaseFloat> out_diff_i(src.ColRange(output_offset_[i], nnet_[i].OutputDim()));
+    if (tgt == NULL) {
+      nnet_[i].BackpropagateInto(out_i, out_diff_i, NULL);
+    } else {
+      CuSubMatrix<BaseFloat> in_diff_i(tgt->ColRange(input_offset_[i], nnet_[i].InputDim()));
+      nnet_[i].BackpropagateInto(out_i, out_diff_i, &in_diff_i);
+    }
+  }
+
+  /// Runs one nested network in the thread pool,
+  class BranchTask {
+   public:
+    BranchTask(ParallelComponent *pc, int32 i, bool backward,
+               const CuMatrixBase<BaseFloat> *out, const CuMatrixBase<BaseFloat> *src,
+               CuMatrixBase<BaseFloat> *tgt)
+      : pc_(pc), i_(i), backward_(backward), out_(out), src_(src), tgt_(tgt) { }
+    void operator() () { pc_->RunBranch(i_, backward_, *out_, *src_, tgt_); }
+   private:
+    ParallelComponent *pc_;
+    int32 i_;
+    bool backward_;
+    const CuMatrixBase<BaseFloat> *out_, *src_;
+    CuMatrixBase<BaseFloat> *tgt_;
+  };
+
+  ParallelComponent &operator = (const ParallelComponent &other); // disallow
+
   std::vector<Nnet> nnet_;
+  std::vector<int32> input_offset_, output_offset_; ///< column ranges of the nested networks
+  int32 num_threads_; ///< cap on the threads, (0 = one per nested network)
+  TaskSequencer<BranchTask> *pool_; ///< created on first use, (not copied)
 };
 
 } // namespace nnet1
@@ -71,7 +71,7 @@ PdfPrior::PdfPrior(const PdfPriorOptions &opts)
 }
 
 
-void PdfPrior::SubtractOnLogpost(CuMatrixBase<BaseFloat> *llk) {
+void PdfPrior::SubtractOnLogpost(CuMatrixBase<BaseFloat> *llk) const {
   if(log_priors_.Dim() == 0) {
     KALDI_ERR << "--class-frame-counts is empty: Cannot initialize priors "
               << "without the counts.";
@@ -0,0 +1,82 @@
+// nnet/nnet-profile.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet/nnet-profile.h"
+#include "cudamatrix/cu-device.h"
+#include "util/kaldi-io.h"
+
+#include <sstream>
+
+namespace kaldi {
+namespace nnet1 {
+
+
+NnetProfiler::NnetProfiler(const NnetProfileOptions &opts)
+  : opts_(opts), num_minibatches_(0), num_frames_(0) {
+  KALDI_ASSERT(opts_.profile_interval >= 0);
+}
+
+
+double NnetProfiler::Elapsed(Timer &tim) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    // the kernels run asynchronously,
+    cudaThreadSynchronize(); // deprecated, but for legacy not cudaDeviceSynchronize
+  }
+#endif
+  return tim.Elapsed();
+}
+
+
+void NnetProfiler::MinibatchDone(int32 num_frames, const Nnet &nnet) {
+  if (!opts_.profile) return;
+  num_minibatches_++;
+  num_frames_ += num_frames;
+  if (opts_.profile_interval > 0 && num_minibatches_ % opts_.profile_interval == 0) {
+    KALDI_LOG << "Profile after " << num_minibatches_ << " mini-batches :\n"
+              << Summary(nnet);
+  }
+}
+
+
+std::string NnetProfiler::Summary(const Nnet &nnet) const {
+  std::ostringstream os;
+  os << "minibatches " << num_minibatches_ << "\n"
+     << "frames " << num_frames_ << "\n"
+     << "wall_time " << timer_.Elapsed() << "\n";
+  std::map<std::string, double>::const_iterator it;
+  for (it = stage_time_.begin(); it != stage_time_.end(); ++it) {
+    os << "stage " << it->first << " " << it->second << "\n";
+  }
+  os << nnet.InfoProfile();
+  return os.str();
+}
+
+
+void NnetProfiler::Finish(const Nnet &nnet) const {
+  if (!opts_.profile) return;
+  std::string summary = Summary(nnet);
+  KALDI_LOG << "Profile summary :\n" << summary;
+  if (opts_.profile_wxfilename != "") {
+    Output ko(opts_.profile_wxfilename, false);
+    ko.Stream() << summary;
+  }
+}
+
+
+} // namespace nnet1
+} // namespace kaldi
@@ -0,0 +1,102 @@
+// nnet/nnet-profile.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_NNET_NNET_PROFILE_H_
+#define KALDI_NNET_NNET_PROFILE_H_
+
+#include <map>
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "itf/options-itf.h"
+#include "nnet/nnet-nnet.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// Configuration of the time-profiling of the training.
+struct NnetProfileOptions {
+  bool profile; // Measure the time of the training stages and of the components
+  int32 profile_interval; // Print the summary every N mini-batches, 0 = at the end only
+  std::string profile_wxfilename; // Write the final summary also to this file
+
+  NnetProfileOptions()
+   : profile(false), profile_interval(0)
+  { }
+
+  void Register(OptionsItf *po) {
+    po->Register("profile", &profile, "Measure wall-time of the training stages (reading, randomization, forward, loss, backward) and of the individual components (with GPU, the device is synchronized after each measured stage, which slows the training)");
+    po->Register("profile-interval", &profile_interval, "Print the profile summary every N mini-batches (0 = only at the end)");
+    po->Register("profile-wxfilename", &profile_wxfilename, "Write the final profile summary to this file");
+  }
+};
+
+
+/**
+ * Accumulates the wall-time of the named stages of the training
+ * (e.g. 'reader_stall', 'feature_transform', 'randomizer_fill', 'forward'),
+ * and produces a summary together with the per-component times of the network
+ * (see Nnet::SetProfiling). The summary has one 'key value(s)' record per line:
+ *
+ *   minibatches 1200
+ *   frames 307200
+ *   wall_time 61.2
+ *   stage forward 20.1
+ *   component 1 <AffineTransform> propagate 5.2 backpropagate 4.1 update 6.3
+ */
+class NnetProfiler {
+ public:
+  NnetProfiler(const NnetProfileOptions &opts);
+
+  bool Enabled() const { return opts_.profile; }
+
+  /// Add the time measured by 'tim' to the stage, (waits for the GPU first)
+  void Accu(const std::string &stage, Timer &tim) {
+    if (opts_.profile) stage_time_[stage] += Elapsed(tim);
+  }
+  /// Add 'seconds' to the stage,
+  void Accu(const std::string &stage, double seconds) {
+    if (opts_.profile) stage_time_[stage] += seconds;
+  }
+
+  /// Count the mini-batch, prints the summary every 'profile_interval' mini-batches,
+  void MinibatchDone(int32 num_frames, const Nnet &nnet);
+
+  /// The summary of the profile,
+  std::string Summary(const Nnet &nnet) const;
+
+  /// Print the final summary (and write it to 'profile_wxfilename'),
+  void Finish(const Nnet &nnet) const;
+
+  /// Time measured by 'tim', the pending GPU work is finished first,
+  static double Elapsed(Timer &tim);
+
+ private:
+  NnetProfileOptions opts_;
+  mutable Timer timer_; // (Timer::Elapsed() is not const)
+  int64 num_minibatches_;
+  int64 num_frames_;
+  std::map<std::string, double> stage_time_;
+};
+
+
+} // namespace nnet1
+} // namespace kaldi
+
+#endif
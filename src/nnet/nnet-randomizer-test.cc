@@ -121,6 +121,35 @@ void UnitTestMatrixRandomizer() {
   KALDI_ASSERT(i == 22); // 22 minibatches
 }
 
+void UnitTestMatrixRandomizerShuffle() {
+  Matrix<BaseFloat> m(300,10);
+  InitRand(&m);
+  // config
+  NnetDataRandomizerOptions c;
+  c.randomizer_size = 250;
+  c.minibatch_size = 100;
+  // randomizer
+  MatrixRandomizer r;
+  r.Init(c);
+  r.AddData(CuMatrix<BaseFloat>(m.RowRange(0,100)));
+  r.AddData(CuMatrix<BaseFloat>(m.RowRange(100,200))); // longer, buffer grows
+  KALDI_ASSERT(r.IsFull());
+  // reverse the order, drop the first 50 frames,
+  std::vector<int32> mask(250);
+  for(int32 i=0; i<250; i++) { mask[i]=299-i; }
+  r.Randomize(mask);
+  KALDI_ASSERT(r.NumFrames() == 250);
+  int32 i=0;
+  for( ; !r.Done(); r.Next(), i++) {
+    const CuMatrixBase<BaseFloat> &m3 = r.Value();
+    Matrix<BaseFloat> m4(m3.NumRows(),m3.NumCols()); m3.CopyToMat(&m4);
+    for(int32 j=0; j<c.minibatch_size; j++) {
+      AssertEqual(m4.Row(j), m.Row(299-(i*c.minibatch_size+j)));
+    }
+  }
+  KALDI_ASSERT(i == 2); // 2 minibatches, 50 frames left-over
+}
+
 void UnitTestVectorRandomizer() {
   Vector<BaseFloat> v(1111);
   InitRand(&v);
@@ -212,12 +241,113 @@ void UnitTestStdVectorRandomizer() {
   KALDI_ASSERT(i == 22); // 22 minibatches
 }
 
+void UnitTestTaskRandomizerMask() {
+  // targets of 2 tasks, dims 3 and 3 : 700 frames of task 0, 300 of task 1,
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > post(1000);
+  for (int32 t = 0; t < post.size(); t++) {
+    post[t].push_back(std::make_pair(t % 10 < 7 ? t % 3 : 3 + t % 3, 1.0));
+  }
+  std::vector<int32> task_offset;
+  task_offset.push_back(0); task_offset.push_back(3); task_offset.push_back(6);
+  // config
+  NnetDataRandomizerOptions c;
+  c.randomizer_size = 1000;
+  c.minibatch_size = 100;
+  PosteriorRandomizer r;
+  r.Init(c);
+  r.AddData(post);
+
+  // single-task mini-batches, all frames used,
+  c.task_minibatch = "single";
+  TaskRandomizerMask m1(c, task_offset);
+  std::vector<int32> mask1 = m1.Generate(r);
+  KALDI_ASSERT(mask1.size() == 1000);
+  std::vector<int32> sorted(mask1);
+  std::sort(sorted.begin(), sorted.end());
+  for (int32 i = 0; i < sorted.size(); i++) KALDI_ASSERT(sorted[i] == i);
+  for (int32 mb = 0; mb < 10; mb++) {
+    bool task_0 = (post[mask1[mb*100]][0].first < 3);
+    for (int32 i = mb*100; i < (mb+1)*100; i++) {
+      KALDI_ASSERT((post[mask1[i]][0].first < 3) == task_0);
+    }
+  }
+
+  // fixed quotas, 7 mini-batches limited by task 1, surplus of task 0 dropped,
+  c.task_minibatch = "60:40";
+  TaskRandomizerMask m2(c, task_offset);
+  std::vector<int32> mask2 = m2.Generate(r);
+  KALDI_ASSERT(mask2.size() == 700);
+  KALDI_ASSERT(m2.NumDropped() == 300);
+  for (int32 i = 0; i < mask2.size(); i++) {
+    KALDI_ASSERT((post[mask2[i]][0].first < 3) == (i % 100 < 60));
+  }
+  r.Randomize(mask2);
+  KALDI_ASSERT(r.NumFrames() == 700);
+  int32 i = 0;
+  for ( ; !r.Done(); r.Next(), i++) { }
+  KALDI_ASSERT(i == 7); // 7 minibatches
+}
+
+
+void UnitTestCompactPosteriorRandomizer() {
+  // targets of 2 tasks (dims 3 and 5), varying number of entries per frame,
+  Posterior post(1111);
+  for (int32 t = 0; t < post.size(); t++) {
+    int32 n = t % 4;
+    for (int32 j = 0; j < n; j++) {
+      post[t].push_back(std::make_pair(t % 2 == 0 ? j : 3 + j, RandUniform()));
+    }
+  }
+  std::vector<int32> task_offset;
+  task_offset.push_back(0); task_offset.push_back(3); task_offset.push_back(8);
+  CompactPosterior cpost(post, 16, &task_offset);
+  // config
+  NnetDataRandomizerOptions c;
+  c.randomizer_size = 1000;
+  c.minibatch_size = 100;
+  // the compact randomizer must give the same mini-batches as PosteriorRandomizer,
+  PosteriorRandomizer r;
+  CompactPosteriorRandomizer rc;
+  r.Init(c);
+  rc.Init(c);
+  RandomizerMask mask(c);
+  int32 num_minibatches = 0;
+  for (int32 fill = 0; fill < 2; fill++) {
+    r.AddData(post);
+    rc.AddData(cpost);
+    KALDI_ASSERT(rc.IsFull() && rc.NumFrames() == r.NumFrames());
+    for (int32 t = 0; t < rc.NumFrames(); t++) {
+      KALDI_ASSERT(rc.FrameTask(t) == (r.Element(t).empty() ? 0 :
+                                        (r.Element(t)[0].first < 3 ? 0 : 1)));
+    }
+    const std::vector<int32> &m = mask.Generate(r.NumFrames());
+    r.Randomize(m);
+    rc.Randomize(m);
+    for ( ; !r.Done(); r.Next(), rc.Next(), num_minibatches++) {
+      KALDI_ASSERT(!rc.Done());
+      const Posterior &p1 = r.Value(), &p2 = rc.Value();
+      KALDI_ASSERT(p1.size() == p2.size());
+      for (int32 t = 0; t < p1.size(); t++) {
+        KALDI_ASSERT(p1[t].size() == p2[t].size());
+        for (int32 j = 0; j < p1[t].size(); j++) {
+          KALDI_ASSERT(p1[t][j].first == p2[t][j].first);
+          KALDI_ASSERT(fabs(p1[t][j].second - p2[t][j].second) < 1.0e-04);
+        }
+      }
+    }
+    KALDI_ASSERT(rc.Done());
+  }
+  KALDI_ASSERT(num_minibatches == 22);
+}
 
 int main() {
   UnitTestRandomizerMask();
   UnitTestMatrixRandomizer();
+  UnitTestMatrixRandomizerShuffle();
   UnitTestVectorRandomizer();
   UnitTestStdVectorRandomizer();
+  UnitTestTaskRandomizerMask();
+  UnitTestCompactPosteriorRandomizer();
   
   std::cout << "Tests succeeded.\n";
 }
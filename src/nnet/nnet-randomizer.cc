@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include "nnet/nnet-randomizer.h"
+#include "util/text-utils.h"
 
 #include <algorithm>
 #include <vector>
@@ -40,12 +41,172 @@ const std::vector<int32>& RandomizerMask::Generate(int32 mask_size) {
 }
 
 
+/* TaskRandomizerMask:: */
+
+void TaskRandomizerMask::Init(const NnetDataRandomizerOptions& conf,
+                              const std::vector<int32> &task_offset) {
+  conf_ = conf;
+  task_offset_ = task_offset;
+  KALDI_ASSERT(task_offset_.size() >= 2);
+  int32 num_tasks = task_offset_.size() - 1;
+  // parse the mode,
+  task_quota_.clear();
+  if (conf_.task_minibatch != "single") {
+    if (!SplitStringToIntegers(conf_.task_minibatch, ":", false, &task_quota_)) {
+      KALDI_ERR << "Invalid --task-minibatch " << conf_.task_minibatch;
+    }
+    if (task_quota_.size() != num_tasks) {
+      KALDI_ERR << "--task-minibatch has " << task_quota_.size() << " quotas, "
+                << "while there are " << num_tasks << " tasks.";
+    }
+    int32 sum = 0;
+    for (int32 i = 0; i < task_quota_.size(); i++) {
+      KALDI_ASSERT(task_quota_[i] >= 0);
+      sum += task_quota_[i];
+    }
+    if (sum != conf_.minibatch_size) {
+      KALDI_ERR << "Sum of --task-minibatch quotas " << sum 
+                << " differs from --minibatch-size " << conf_.minibatch_size;
+    }
+  }
+  rand_state_.seed = conf.randomizer_seed;
+}
+
+namespace {
+/// Random generator for std::random_shuffle, with its own state,
+struct RandIntGenerator {
+  explicit RandIntGenerator(RandomState *state) : state_(state) { }
+  int32 operator() (int32 n) { return RandInt(0, n-1, state_); }
+  RandomState *state_;
+};
+}
+
+int32 TaskRandomizerMask::IdTask(int32 id) const {
+  int32 task = std::upper_bound(task_offset_.begin(), task_offset_.end(), id)
+               - task_offset_.begin() - 1;
+  if (task < 0 || task+1 >= task_offset_.size()) {
+    KALDI_ERR << "Target index " << id << " out of task ranges "
+              << "(0.." << task_offset_.back()-1 << ")";
+  }
+  return task;
+}
+
+int32 TaskRandomizerMask::FrameTask(const std::vector<std::pair<int32, BaseFloat> > &post) const {
+  if (post.size() == 0) return 0;
+  return IdTask(post[0].first);
+}
+
+const std::vector<int32>& TaskRandomizerMask::Generate(const PosteriorRandomizer &targets) {
+  std::vector<int32> frame_task(targets.NumFrames());
+  for (int32 t = 0; t < frame_task.size(); t++) {
+    frame_task[t] = FrameTask(targets.Element(t));
+  }
+  return GenerateFromTasks(frame_task);
+}
+
+const std::vector<int32>& TaskRandomizerMask::Generate(const CompactPosteriorRandomizer &targets) {
+  std::vector<int32> frame_task(targets.NumFrames());
+  for (int32 t = 0; t < frame_task.size(); t++) {
+    int32 task = targets.FrameTask(t),
+      id = targets.FrameFirstId(t);
+    if (task < 0) { // not tagged, use the 1st target,
+      task = (id < 0 ? 0 : IdTask(id));
+    } else if (task+1 >= task_offset_.size()) {
+      KALDI_ERR << "Task-tag " << task << " of the targets is out of range, "
+                << "there are " << task_offset_.size()-1 << " tasks.";
+    } else if (id >= 0 && IdTask(id) != task) {
+      // the tags come from the task ranges of paste-post, these must be
+      // the index-ranges of the multitask loss,
+      KALDI_ERR << "Task-tag " << task << " does not match the target index "
+                << id << " (task " << IdTask(id) << " of the loss dims), "
+                << "were the targets pasted with other dims?";
+    }
+    frame_task[t] = task;
+  }
+  return GenerateFromTasks(frame_task);
+}
+
+const std::vector<int32>& TaskRandomizerMask::GenerateFromTasks(const std::vector<int32> &frame_task) {
+  int32 num_tasks = task_offset_.size() - 1,
+    num_frames = frame_task.size(),
+    mb = conf_.minibatch_size;
+  // per-task lists of frames, shuffled,
+  std::vector<std::vector<int32> > task_frames(num_tasks);
+  for (int32 t = 0; t < num_frames; t++) {
+    task_frames[frame_task[t]].push_back(t);
+  }
+  RandIntGenerator rand_gen(&rand_state_);
+  for (int32 k = 0; k < num_tasks; k++) {
+    std::random_shuffle(task_frames[k].begin(), task_frames[k].end(), rand_gen);
+  }
+  mask_.clear();
+  mask_.reserve(num_frames);
+  // 'quota' mode : each mini-batch has 'task_quota_[k]' frames of task k,
+  if (task_quota_.size() > 0) {
+    int32 num_mb = -1;
+    for (int32 k = 0; k < num_tasks; k++) {
+      if (task_quota_[k] == 0) continue;
+      int32 n = task_frames[k].size() / task_quota_[k];
+      if (num_mb == -1 || n < num_mb) num_mb = n;
+    }
+    if (num_mb > 0) {
+      for (int32 m = 0; m < num_mb; m++) {
+        for (int32 k = 0; k < num_tasks; k++) {
+          std::vector<int32>::const_iterator it = task_frames[k].begin() + m*task_quota_[k];
+          mask_.insert(mask_.end(), it, it + task_quota_[k]);
+        }
+      }
+      num_dropped_ += num_frames - mask_.size();
+      return mask_;
+    }
+    // some task is missing in the buffer, fall back to single-task mini-batches,
+    KALDI_WARN << "Cannot fill the task quotas " << conf_.task_minibatch 
+               << " from the randomizer buffer, using single-task mini-batches "
+               << "(are the utterances of the tasks interleaved in the feature list?)";
+  }
+  // 'single' mode : shuffled list of single-task mini-batches,
+  std::vector<std::pair<int32, int32> > minibatches; // (task, first-frame)
+  for (int32 k = 0; k < num_tasks; k++) {
+    for (int32 i = 0; i + mb <= task_frames[k].size(); i += mb) {
+      minibatches.push_back(std::make_pair(k, i));
+    }
+  }
+  std::random_shuffle(minibatches.begin(), minibatches.end(), rand_gen);
+  for (int32 m = 0; m < minibatches.size(); m++) {
+    std::vector<int32>::const_iterator it = 
+      task_frames[minibatches[m].first].begin() + minibatches[m].second;
+    mask_.insert(mask_.end(), it, it + mb);
+  }
+  // remaining frames at the end, still grouped by task,
+  for (int32 k = 0; k < num_tasks; k++) {
+    int32 rest = task_frames[k].size() % mb;
+    mask_.insert(mask_.end(), task_frames[k].end() - rest, task_frames[k].end());
+  }
+  KALDI_ASSERT(mask_.size() == num_frames);
+  return mask_;
+}
+
+
 /* MatrixRandomizer:: */
 
+void MatrixRandomizer::Reserve(int32 num_rows, int32 num_cols) {
+  if (data_.NumRows() >= num_rows && data_.NumCols() == num_cols) return;
+  // grow the buffer, copy only the stored frames,
+  CuMatrix<BaseFloat> data_new(num_rows, num_cols, kUndefined);
+  if (data_end_ > 0) {
+    data_new.RowRange(0, data_end_).CopyFromMat(data_.RowRange(0, data_end_));
+  }
+  data_.Swap(&data_new);
+  // the second buffer holds no data,
+  data_aux_.Resize(num_rows, num_cols, kUndefined);
+}
+
 void MatrixRandomizer::AddData(const CuMatrixBase<BaseFloat>& m) {
-  // pre-allocate before 1st use
-  if(data_.NumCols() == 0) {
-    data_.Resize(conf_.randomizer_size,m.NumCols());
+  // pre-allocate before 1st use,
+  // (we get data only when not full, ie. 'data_end_ <= randomizer_size',
+  //  so 'randomizer_size' + utterance length is the upper bound)
+  if (data_.NumCols() == 0) {
+    Reserve(conf_.randomizer_size + m.NumRows(), m.NumCols());
   }
   // optionally put previous left-over to front
   if (data_begin_ > 0) {
@@ -56,13 +217,10 @@ void MatrixRandomizer::AddData(const CuMatrixBase<BaseFloat>& m) {
       data_.RowRange(0,leftover).CopyFromMat(data_.RowRange(data_begin_,leftover));
     }
     data_begin_ = 0; data_end_ = leftover;
-    data_.RowRange(leftover,data_.NumRows()-leftover).SetZero(); // zeroing the rest 
   }
-  // extend the buffer if necessary
+  // extend the buffer if necessary (longer utterance than before)
   if(data_.NumRows() < data_end_ + m.NumRows()) {
-    CuMatrix<BaseFloat> data_aux(data_);
-    data_.Resize(data_end_ + m.NumRows() + 1000, data_.NumCols()); // +1000 row extra
-    data_.RowRange(0,data_aux.NumRows()).CopyFromMat(data_aux);
+    Reserve(std::max(conf_.randomizer_size, data_end_) + m.NumRows(), data_.NumCols());
   }
   // copy the data
   data_.RowRange(data_end_,m.NumRows()).CopyFromMat(m);
@@ -72,29 +230,26 @@ void MatrixRandomizer::AddData(const CuMatrixBase<BaseFloat>& m) {
 void MatrixRandomizer::Randomize(const std::vector<int32>& mask) {
   KALDI_ASSERT(data_begin_ == 0);
   KALDI_ASSERT(data_end_ > 0);
-  KALDI_ASSERT(data_end_ == mask.size());
-  // Copy to auxiliary buffer for unshuffled data
-  data_aux_ = data_;
+  KALDI_ASSERT(data_end_ >= mask.size()); // shorter mask drops frames
   // Put the mask to GPU 
-  CuArray<int32> mask_in_gpu(mask.size());
-  mask_in_gpu.CopyFromVec(mask);
-  // Randomize the data, mask is used to index rows in source matrix:
-  // (Here the vector 'mask_in_gpu' is typically shorter than number of rows in 'data_aux_',
-  //  because the the buffer 'data_aux_' is larger than capacity 'randomizer_size'.
-  //  The extra rows in 'data_aux_' do not contain speech frames and are not copied
-  //  from 'data_aux_', the extra rows in 'data_' are unchanged by cu::Randomize.)
-  cu::Randomize(data_aux_, mask_in_gpu, &data_);
+  mask_in_gpu_.CopyFromVec(mask);
+  // Randomize the data, mask is used to index rows in source matrix,
+  // the shuffled frames go to the second buffer, which becomes 'data_':
+  // (Here the vector 'mask_in_gpu_' can be shorter than 'data_end_',
+  //  the frames not in the mask are dropped.)
+  CuSubMatrix<BaseFloat> data_aux(data_aux_.RowRange(0, data_end_));
+  cu::Randomize(data_.RowRange(0, data_end_), mask_in_gpu_, &data_aux);
+  data_.Swap(&data_aux_);
+  data_end_ = mask.size();
 }
 
 void MatrixRandomizer::Next() {
   data_begin_ += conf_.minibatch_size;
 }
 
-const CuMatrixBase<BaseFloat>& MatrixRandomizer::Value() {
+CuSubMatrix<BaseFloat> MatrixRandomizer::Value() const {
   KALDI_ASSERT(data_end_ - data_begin_ >= conf_.minibatch_size); // have data for minibatch
-  minibatch_.Resize(conf_.minibatch_size, data_.NumCols(),kUndefined);
-  minibatch_.CopyFromMat(data_.RowRange(data_begin_,conf_.minibatch_size));
-  return minibatch_;
+  return data_.RowRange(data_begin_, conf_.minibatch_size);
 }
 
 
@@ -130,13 +285,14 @@ void VectorRandomizer::AddData(const Vector<BaseFloat>& v) {
 void VectorRandomizer::Randomize(const std::vector<int32>& mask) {
   KALDI_ASSERT(data_begin_ == 0);
   KALDI_ASSERT(data_end_ > 0);
-  KALDI_ASSERT(data_end_ == mask.size());
+  KALDI_ASSERT(data_end_ >= mask.size()); // shorter mask drops frames
   // Use auxiliary buffer for unshuffled data
   Vector<BaseFloat> data_aux(data_);
   // randomize the data, mask is used to index elements in source vector
   for(int32 i = 0; i<mask.size(); i++) {
     data_(i) = data_aux(mask.at(i));
   }
+  data_end_ = mask.size();
 }
 
 void VectorRandomizer::Next() {
@@ -184,13 +340,14 @@ template<typename T>
 void StdVectorRandomizer<T>::Randomize(const std::vector<int32>& mask) {
   KALDI_ASSERT(data_begin_ == 0);
   KALDI_ASSERT(data_end_ > 0);
-  KALDI_ASSERT(data_end_ == mask.size());
+  KALDI_ASSERT(data_end_ >= mask.size()); // shorter mask drops frames
   // Use auxiliary buffer for unshuffled data
   std::vector<T> data_aux(data_);
   // randomize the data, mask is used to index elements in source vector
   for(int32 i = 0; i<mask.size(); i++) {
     data_.at(i) = data_aux.at(mask.at(i));
   }
+  data_end_ = mask.size();
 }
 
 template<typename T>
@@ -209,6 +366,86 @@ const std::vector<T>& StdVectorRandomizer<T>::Value() {
   return minibatch_;
 }
 
+/* CompactPosteriorRandomizer */
+
+void CompactPosteriorRandomizer::AddData(const CompactPosterior& post) {
+  // optionally put previous left-over to front, (the entries of the
+  // delivered frames are dropped)
+  if (data_begin_ > 0) {
+    KALDI_ASSERT(data_begin_ <= data_end_); // sanity check
+    int32 leftover = data_end_ - data_begin_,
+      begin = frame_offset_[data_begin_];
+    ids_.erase(ids_.begin(), ids_.begin() + begin);
+    weights_.erase(weights_.begin(), weights_.begin() + begin);
+    for (int32 t = 0; t <= leftover; t++) {
+      frame_offset_[t] = frame_offset_[data_begin_ + t] - begin;
+    }
+    std::copy(frame_task_.begin() + data_begin_, frame_task_.begin() + data_end_,
+              frame_task_.begin());
+    data_begin_ = 0; data_end_ = leftover;
+  }
+  frame_offset_.resize(data_end_ + 1);
+  frame_task_.resize(data_end_);
+  // append the entries, the weights are stored with 16 bits,
+  int32 offset = ids_.size(),
+    scale = (post.WeightBits() == 8 ? 257 : 1); // 255 * 257 = 65535
+  for (int32 i = 0; i < post.NumEntries(); i++) {
+    ids_.push_back(post.Id(i));
+    weights_.push_back(post.QuantizedWeight(i) * scale);
+  }
+  for (int32 t = 0; t < post.NumFrames(); t++) {
+    frame_offset_.push_back(offset + post.FrameEnd(t));
+    frame_task_.push_back(post.FrameTask(t));
+  }
+  data_end_ += post.NumFrames();
+}
+
+void CompactPosteriorRandomizer::Randomize(const std::vector<int32>& mask) {
+  KALDI_ASSERT(data_begin_ == 0);
+  KALDI_ASSERT(data_end_ > 0);
+  KALDI_ASSERT(data_end_ >= mask.size()); // shorter mask drops frames
+  // the entries are copied in the order of the mask,
+  std::vector<int32> ids, offset(mask.size() + 1, 0);
+  std::vector<uint16> weights;
+  std::vector<int16> task(mask.size());
+  ids.reserve(ids_.size());
+  weights.reserve(weights_.size());
+  for (int32 i = 0; i < mask.size(); i++) {
+    int32 f = mask.at(i);
+    KALDI_ASSERT(f >= 0 && f < data_end_);
+    ids.insert(ids.end(), ids_.begin() + frame_offset_[f], ids_.begin() + frame_offset_[f+1]);
+    weights.insert(weights.end(), weights_.begin() + frame_offset_[f],
+                   weights_.begin() + frame_offset_[f+1]);
+    offset[i+1] = ids.size();
+    task[i] = frame_task_[f];
+  }
+  ids_.swap(ids);
+  weights_.swap(weights);
+  frame_offset_.swap(offset);
+  frame_task_.swap(task);
+  data_end_ = mask.size();
+}
+
+void CompactPosteriorRandomizer::Next() {
+  data_begin_ += conf_.minibatch_size;
+}
+
+const Posterior& CompactPosteriorRandomizer::Value() {
+  KALDI_ASSERT(data_end_ - data_begin_ >= conf_.minibatch_size); // have data for minibatch
+  minibatch_.resize(conf_.minibatch_size);
+  for (int32 t = 0; t < conf_.minibatch_size; t++) {
+    int32 begin = frame_offset_[data_begin_ + t],
+      end = frame_offset_[data_begin_ + t + 1];
+    std::vector<std::pair<int32, BaseFloat> > &frame = minibatch_[t];
+    frame.resize(end - begin);
+    for (int32 i = begin; i < end; i++) {
+      frame[i - begin].first = ids_[i];
+      frame[i - begin].second = weights_[i] / 65535.0;
+    }
+  }
+  return minibatch_;
+}
+
 // Instantiate template StdVectorRandomizer with types we expect to operate on
 template class StdVectorRandomizer<int32>;
 template class StdVectorRandomizer<std::vector<std::pair<int32, BaseFloat> > >; //PosteriorRandomizer
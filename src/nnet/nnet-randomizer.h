@@ -25,6 +25,7 @@
 #include "itf/options-itf.h"
 #include "cudamatrix/cu-matrix.h"
 #include "cudamatrix/cu-math.h"
+#include "hmm/posterior.h"
 
 namespace kaldi {
 namespace nnet1 {
@@ -34,15 +35,18 @@ struct NnetDataRandomizerOptions {
   int32 randomizer_size; // Maximum number of samples we want to have in memory at once.
   int32 randomizer_seed;
   int32 minibatch_size;  // Size of a single mini-batch.
+  std::string task_minibatch; // Task-stratified mini-batches ('', 'single', 'N1:N2:...')
 
   NnetDataRandomizerOptions()
-   : randomizer_size(32768), randomizer_seed(777), minibatch_size(256) 
+   : randomizer_size(32768), randomizer_seed(777), minibatch_size(256),
+     task_minibatch("")
   { }
 
   void Register(OptionsItf *po) {
     po->Register("randomizer-size", &randomizer_size, "Capacity of randomizer, length of concatenated utterances which are used for frame-level shuffling (in frames, affects memory consumption, max 8000000).");
     po->Register("randomizer-seed", &randomizer_seed, "Seed value for srand, sets fixed order of frame-level shuffling");
     po->Register("minibatch-size", &minibatch_size, "Size of a minibatch.");
+    po->Register("task-minibatch", &task_minibatch, "Task-stratified shuffling for multi-task training, the task of a frame is given by the index-range of its targets ('' : uniform shuffling, 'single' : single-task mini-batches, 'N1:N2:...' : fixed number of frames per task in each mini-batch, must sum to minibatch-size, surplus frames of a task are dropped).");
   }
 };
 ///
@@ -62,7 +66,10 @@ class RandomizerMask {
 };
 
 
-/// Randomizes rows of a matrix according to a mask
+/// Randomizes rows of a matrix according to a mask,
+/// (double-buffered: the shuffling goes from the fill buffer to the
+///  second buffer and the buffers are swapped, the mini-batches
+///  are returned as views into the buffer without copying)
 class MatrixRandomizer {
  public:
   MatrixRandomizer() : data_begin_(0), data_end_(0) { }
@@ -73,23 +80,31 @@ class MatrixRandomizer {
   /// Add data to randomization buffer
   void AddData(const CuMatrixBase<BaseFloat>& m);
   /// Returns true, when capacity is full
-  bool IsFull() { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
+  bool IsFull() const { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
   /// Number of frames stored inside the Randomizer
-  int32 NumFrames() { return data_end_; }
-  /// Randomize matrix row-order using mask
+  int32 NumFrames() const { return data_end_; }
+  /// Randomize matrix row-order using mask (frames not in the mask are dropped)
   void Randomize(const std::vector<int32>& mask);
 
   /// Returns true, if no more data for another mini-batch (after current one)
-  bool Done() { return (data_end_ - data_begin_ < conf_.minibatch_size); }
+  bool Done() const { return (data_end_ - data_begin_ < conf_.minibatch_size); }
   /// Sets cursor to next mini-batch
   void Next();
-  /// Returns matrix-window with next mini-batch
-  const CuMatrixBase<BaseFloat>& Value();
+  /// Returns matrix-window with next mini-batch, 
+  /// (a view into the buffer, valid until the next AddData() or Randomize())
+  CuSubMatrix<BaseFloat> Value() const;
+  /// The whole buffer and the row offset of the current mini-batch in it,
+  /// (to keep several mini-batches as views, valid as Value())
+  const CuMatrixBase<BaseFloat>& Buffer() const { return data_; }
+  int32 Offset() const { return data_begin_; }
 
  private:
+  /// Makes sure both buffers have 'num_rows' rows (keeps the data),
+  void Reserve(int32 num_rows, int32 num_cols);
+
   CuMatrix<BaseFloat> data_; // can be larger than 'randomizer_size'
-  CuMatrix<BaseFloat> data_aux_; // auxiliary buffer for shuffling
-  CuMatrix<BaseFloat> minibatch_; // buffer for mini-batch
+  CuMatrix<BaseFloat> data_aux_; // second buffer, target of the shuffling
+  CuArray<int32> mask_in_gpu_;
 
   /// Cursor to beginning of data (row index, moves as mini-batches are delivered)
   int32 data_begin_;
@@ -97,6 +112,8 @@ class MatrixRandomizer {
   int32 data_end_;   
 
   NnetDataRandomizerOptions conf_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MatrixRandomizer);
 };
 
 
@@ -111,14 +128,14 @@ class VectorRandomizer {
   /// Add data to randomization buffer
   void AddData(const Vector<BaseFloat>& v);
   /// Returns true, when capacity is full
-  bool IsFull() { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
+  bool IsFull() const { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
   /// Number of frames stored inside the Randomizer
-  int32 NumFrames() { return data_end_; }
-  /// Randomize matrix row-order using mask
+  int32 NumFrames() const { return data_end_; }
+  /// Randomize matrix row-order using mask (frames not in the mask are dropped)
   void Randomize(const std::vector<int32>& mask);
 
   /// Returns true, if no more data for another mini-batch (after current one)
-  bool Done() { return (data_end_ - data_begin_ < conf_.minibatch_size); }
+  bool Done() const { return (data_end_ - data_begin_ < conf_.minibatch_size); }
   /// Sets cursor to next mini-batch
   void Next();
   /// Returns matrix-window with next mini-batch
@@ -149,19 +166,25 @@ class StdVectorRandomizer {
   /// Add data to randomization buffer
   void AddData(const std::vector<T>& v);
   /// Returns true, when capacity is full
-  bool IsFull() { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
+  bool IsFull() const { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
   /// Number of frames stored inside the Randomizer
-  int32 NumFrames() { return data_end_; }
-  /// Randomize matrix row-order using mask
+  int32 NumFrames() const { return data_end_; }
+  /// Randomize matrix row-order using mask (frames not in the mask are dropped)
   void Randomize(const std::vector<int32>& mask);
 
   /// Returns true, if no more data for another mini-batch (after current one)
-  bool Done() { return (data_end_ - data_begin_ < conf_.minibatch_size); }
+  bool Done() const { return (data_end_ - data_begin_ < conf_.minibatch_size); }
   /// Sets cursor to next mini-batch
   void Next();
   /// Returns matrix-window with next mini-batch
   const std::vector<T>& Value();
 
+  /// Access to i'th element in the buffer (0..NumFrames()-1, before Randomize)
+  const T& Element(int32 i) const {
+    KALDI_ASSERT(i >= 0 && i < data_end_);
+    return data_[i];
+  }
+
  private:
   std::vector<T> data_; // can be larger than 'randomizer_size'
   std::vector<T> minibatch_; // buffer for mini-batch
@@ -178,6 +201,102 @@ typedef StdVectorRandomizer<int32> Int32VectorRandomizer;
 typedef StdVectorRandomizer<std::vector<std::pair<int32, BaseFloat> > > PosteriorRandomizer;
 
 
+/// Randomizes the frames of CompactPosterior targets, the entries are kept
+/// in flat arrays (weights quantized to 16 bits) in the order of the frames,
+/// Randomize() re-orders them. Per frame there is only an int32 offset and
+/// an int16 task-tag. The mini-batch is returned de-quantized as Posterior.
+class CompactPosteriorRandomizer {
+ public:
+  CompactPosteriorRandomizer() : frame_offset_(1, 0), data_begin_(0), data_end_(0) { }
+  CompactPosteriorRandomizer(const NnetDataRandomizerOptions &conf)
+    : frame_offset_(1, 0), data_begin_(0), data_end_(0) { Init(conf); }
+  /// Set the randomizer parameters (size)
+  void Init(const NnetDataRandomizerOptions& conf) { conf_ = conf; }
+
+  /// Add data to randomization buffer
+  void AddData(const CompactPosterior& post);
+  /// Returns true, when capacity is full
+  bool IsFull() const { return ((data_begin_ == 0) && (data_end_ > conf_.randomizer_size )); }
+  /// Number of frames stored inside the Randomizer
+  int32 NumFrames() const { return data_end_; }
+  /// Randomize frame-order using mask (frames not in the mask are dropped)
+  void Randomize(const std::vector<int32>& mask);
+
+  /// Returns true, if no more data for another mini-batch (after current one)
+  bool Done() const { return (data_end_ - data_begin_ < conf_.minibatch_size); }
+  /// Sets cursor to next mini-batch
+  void Next();
+  /// Returns the next mini-batch
+  const Posterior& Value();
+
+  /// Task-tag of i'th frame in the buffer (-1 if not tagged, before Randomize),
+  int32 FrameTask(int32 i) const { return frame_task_[i]; }
+  /// Index of the first target of i'th frame (-1 if no targets, before Randomize),
+  int32 FrameFirstId(int32 i) const {
+    return (frame_offset_[i+1] > frame_offset_[i] ? ids_[frame_offset_[i]] : -1);
+  }
+
+ private:
+  // the entries, (in the order of the frames),
+  std::vector<int32> ids_;
+  std::vector<uint16> weights_;
+  // the frames, the entries of frame 't' are frame_offset_[t] .. frame_offset_[t+1]-1,
+  std::vector<int32> frame_offset_;
+  std::vector<int16> frame_task_;
+
+  Posterior minibatch_; // buffer for mini-batch
+
+  /// Cursor to beginning of data (frame index, moves as mini-batches are delivered)
+  int32 data_begin_;
+  /// Cursor past the end of data (frame index)
+  int32 data_end_;
+
+  NnetDataRandomizerOptions conf_;
+};
+
+
+/// Generates index-mask, which groups the frames into task-stratified mini-batches,
+/// (task of a frame is given by the index-range of its targets, ie. the 'dims'
+/// of MultiTaskLoss). The mini-batches are either single-task, or contain 
+/// a fixed number of frames of each task. Within a mini-batch the frames
+/// are grouped by task, so the output blocks can be evaluated sparsely.
+/// A frame belongs to the task of its 1st target entry, (a frame with targets
+/// of several tasks is trained on all of them, but it counts in the quota of
+/// one task only). The shuffling uses its own random state seeded by
+/// 'randomizer_seed', the global rand() generator is not re-seeded.
+class TaskRandomizerMask {
+ public:
+  TaskRandomizerMask() : num_dropped_(0) { }
+  TaskRandomizerMask(const NnetDataRandomizerOptions &conf, 
+                     const std::vector<int32> &task_offset) : num_dropped_(0) { 
+    Init(conf, task_offset); 
+  }
+  /// Init, 'task_offset' are (num_tasks+1) starting-points of target index-ranges,
+  void Init(const NnetDataRandomizerOptions& conf, const std::vector<int32> &task_offset);
+  /// Generate mask from the targets in the randomizer buffer, in the 'quota' mode
+  /// the mask can be shorter than number of frames (surplus frames get dropped).
+  const std::vector<int32>& Generate(const PosteriorRandomizer &targets);
+  /// The same with compact targets, the task-tags are used (if present),
+  const std::vector<int32>& Generate(const CompactPosteriorRandomizer &targets);
+  /// Number of frames dropped so far (surplus frames in the 'quota' mode)
+  int64 NumDropped() const { return num_dropped_; }
+ private:
+  /// Task of the frame by its 1st target, frames without targets go to task 0,
+  int32 FrameTask(const std::vector<std::pair<int32, BaseFloat> > &post) const;
+  /// Task of the target index,
+  int32 IdTask(int32 id) const;
+  /// Generates the mask from the tasks of the frames,
+  const std::vector<int32>& GenerateFromTasks(const std::vector<int32> &frame_task);
+
+  NnetDataRandomizerOptions conf_;
+  std::vector<int32> task_offset_;
+  std::vector<int32> task_quota_; ///< frames per task in a mini-batch (empty = single-task)
+  std::vector<int32> mask_;
+  int64 num_dropped_;
+  RandomState rand_state_;
+};
+
+
 } // namespace nnet1
 } // namespace kaldi
 
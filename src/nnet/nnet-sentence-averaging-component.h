@@ -75,9 +75,14 @@ class SentenceAveragingComponent : public UpdatableComponent {
 
   int32 NumParams() const { return nnet_.NumParams(); }
   void GetParams(Vector<BaseFloat>* wei_copy) const { wei_copy->Resize(NumParams()); nnet_.GetParams(wei_copy); }
+  void SetParams(const VectorBase<BaseFloat> &params) { nnet_.SetParams(params); }
   std::string Info() const { return std::string("nested_network {\n") + nnet_.Info() + "}\n"; }
   std::string InfoGradient() const { return std::string("nested_gradient {\n") + nnet_.InfoGradient() + "}\n"; }
 
+  bool IsFeedforwardThreadSafe() const {
+    return false;  // the nested network keeps its buffers,
+  }
+
   void PropagateFnc(const CuMatrixBase<BaseFloat> &in, CuMatrixBase<BaseFloat> *out) {
     // Get NN output
     CuMatrix<BaseFloat> out_nnet;
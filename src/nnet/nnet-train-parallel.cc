@@ -0,0 +1,174 @@
+// nnet/nnet-train-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet/nnet-train-parallel.h"
+#include "nnet/nnet-parallel-component.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+
+NnetParallelTrainer::NnetParallelTrainer(const NnetParallelOptions &opts,
+                                         bool crossvalidate, bool block_softmax_sparse,
+                                         Nnet *nnet, LossItf *loss)
+  : opts_(opts), crossvalidate_(crossvalidate),
+    block_softmax_sparse_(block_softmax_sparse),
+    nnet_(nnet), loss_(loss), barrier_(opts.num_threads), minibatches_(NULL) {
+  KALDI_ASSERT(opts_.num_threads > 1);
+  KALDI_ASSERT(opts_.sync_minibatches > 0);
+#if HAVE_CUDA == 1
+  // Our GPU code won't work with multithreading,
+  if (CuDevice::Instantiate().Enabled()) {
+    KALDI_ERR << "Multi-threaded training (--num-threads > 1) works only on CPU, "
+              << "use --use-gpu=no";
+  }
+#endif
+  for (int32 t = 0; t < opts_.num_threads; t++) {
+    thread_nnet_.push_back(new Nnet(*nnet_));
+    // the nested networks of the ParallelComponents run in the training
+    // thread, (the training threads already occupy the cores)
+    Nnet &nnet = *thread_nnet_.back();
+    for (int32 c = 0; c < nnet.NumComponents(); c++) {
+      if (nnet.GetComponent(c).GetType() == Component::kParallelComponent) {
+        dynamic_cast<ParallelComponent&>(nnet.GetComponent(c)).SetNumThreads(1);
+      }
+    }
+  }
+  thread_loss_.resize(opts_.num_threads, NULL);
+  thread_out_.resize(opts_.num_threads);
+  thread_diff_.resize(opts_.num_threads);
+  thread_feats_.resize(opts_.num_threads);
+}
+
+
+NnetParallelTrainer::~NnetParallelTrainer() {
+  for (int32 t = 0; t < thread_nnet_.size(); t++) {
+    delete thread_nnet_[t];
+  }
+}
+
+
+void NnetParallelTrainer::Train(const std::vector<NnetMinibatch> &minibatches) {
+  if (minibatches.empty()) return;
+  minibatches_ = &minibatches;
+  for (int32 t = 0; t < thread_loss_.size(); t++) {
+    thread_loss_[t] = loss_->NewThreadCopy();
+  }
+  {
+    // The initialization of the following class spawns the threads,
+    // the destructor re-joins them.
+    MultiThreader<TrainThread> m(opts_.num_threads, TrainThread(this));
+  }
+  minibatches_ = NULL;
+  // the loss statistics of the threads are added to the shared loss,
+  // (and the adaptive state is merged, also in the cross-validation)
+  loss_->MergeThreadCopies(thread_loss_);
+  for (int32 t = 0; t < thread_loss_.size(); t++) {
+    loss_->AddStats(*thread_loss_[t]);
+    delete thread_loss_[t];
+    thread_loss_[t] = NULL;
+  }
+  // the component times of the threads are summed in the master,
+  for (int32 t = 0; t < thread_nnet_.size(); t++) {
+    nnet_->AddProfile(*thread_nnet_[t]);
+    thread_nnet_[t]->ResetProfile();
+  }
+}
+
+
+void NnetParallelTrainer::TrainLoop(int32 thread_id) {
+  const std::vector<NnetMinibatch> &minibatches = *minibatches_;
+
+  int32 num_minibatches = minibatches.size(),
+    num_threads = opts_.num_threads,
+    round_size = num_threads * opts_.sync_minibatches,
+    num_rounds = (num_minibatches + round_size - 1) / round_size;
+
+  for (int32 r = 0; r < num_rounds; r++) {
+    // the mini-batches are assigned round-robin,
+    for (int32 i = r * round_size + thread_id;
+         i < std::min((r + 1) * round_size, num_minibatches); i += num_threads) {
+      const NnetMinibatch &mb = minibatches[i];
+      if (mb.feats_buffer != NULL) {
+        // view into the shared buffer, (no copy)
+        CuSubMatrix<BaseFloat> feats(mb.feats_buffer->RowRange(mb.feats_offset,
+                                                               mb.weights.Dim()));
+        TrainMinibatch(thread_id, feats, mb);
+      } else {
+        TrainMinibatch(thread_id, mb.feats, mb);
+      }
+    }
+    // merge the updates, (the last thread to arrive does it)
+    if (!crossvalidate_) {
+      if (barrier_.Wait() == -1) {
+        MergeUpdates();
+      }
+      barrier_.Wait();
+    }
+  }
+}
+
+
+void NnetParallelTrainer::TrainMinibatch(int32 thread_id,
+                                         const CuMatrixBase<BaseFloat> &feats,
+                                         const NnetMinibatch &mb) {
+  Nnet &nnet = *thread_nnet_[thread_id];
+  CuMatrix<BaseFloat> &nnet_out = thread_out_[thread_id],
+    &obj_diff = thread_diff_[thread_id];
+  const CuMatrixBase<BaseFloat> *nnet_in = &feats;
+  // optionally re-order the frames, (into the buffer of the thread)
+  if (!mb.frame_order.empty()) {
+    CuMatrix<BaseFloat> &feats_reordered = thread_feats_[thread_id];
+    feats_reordered.Resize(feats.NumRows(), feats.NumCols(), kUndefined);
+    feats_reordered.CopyRows(feats, mb.frame_order);
+    nnet_in = &feats_reordered;
+  }
+  if (block_softmax_sparse_) {
+    nnet.SetBlockSoftmaxRowOffset(mb.block_row_offset);
+  }
+  // forward pass
+  nnet.Propagate(*nnet_in, &nnet_out);
+  // evaluate objective function, (private copy of the thread)
+  thread_loss_[thread_id]->Eval(mb.weights, nnet_out, mb.targets, &obj_diff);
+  // backward pass, updates the private copy of the model
+  if (!crossvalidate_) {
+    nnet.Backpropagate(obj_diff, NULL);
+  }
+}
+
+
+void NnetParallelTrainer::MergeUpdates() {
+  // master <- master + 1/N sum_t (thread_t - master) = 1/N sum_t thread_t,
+  // (the updates are averaged, not summed, to keep the effective learning rate)
+  thread_nnet_[0]->GetParams(&master_params_);
+  for (int32 t = 1; t < thread_nnet_.size(); t++) {
+    thread_nnet_[t]->GetParams(&thread_params_);
+    master_params_.AddVec(1.0, thread_params_);
+  }
+  master_params_.Scale(1.0 / thread_nnet_.size());
+  nnet_->SetParams(master_params_);
+  for (int32 t = 0; t < thread_nnet_.size(); t++) {
+    thread_nnet_[t]->SetParams(master_params_);
+  }
+  // the adaptive state of the losses, (e.g. the MultiTaskLoss task weighting)
+  loss_->MergeThreadCopies(thread_loss_);
+}
+
+
+} // namespace nnet1
+} // namespace kaldi
@@ -0,0 +1,139 @@
+// nnet/nnet-train-parallel.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_NNET_NNET_TRAIN_PARALLEL_H_
+#define KALDI_NNET_NNET_TRAIN_PARALLEL_H_
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "hmm/posterior.h"
+#include "thread/kaldi-thread.h"
+#include "thread/kaldi-barrier.h"
+#include "cudamatrix/cu-matrix.h"
+#include "nnet/nnet-nnet.h"
+#include "nnet/nnet-loss.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// Configuration of the multi-threaded CPU training.
+struct NnetParallelOptions {
+  int32 num_threads; // Number of training threads, 1 = no threads
+  int32 sync_minibatches; // Period of merging the updates (mini-batches per thread)
+
+  NnetParallelOptions()
+   : num_threads(1), sync_minibatches(8)
+  { }
+
+  void Register(OptionsItf *po) {
+    po->Register("num-threads", &num_threads, "Number of threads for the CPU training (each thread trains its own copy of the network, the updates are merged periodically; not with GPU)");
+    po->Register("sync-minibatches", &sync_minibatches, "Multi-threaded training: merge the updates of the threads after each thread trained this many mini-batches");
+  }
+};
+
+
+/// Mini-batch for the multi-threaded training,
+struct NnetMinibatch {
+  /// The features are rows [feats_offset, feats_offset + weights.Dim()) of
+  /// 'feats_buffer', which must not change until Train() returns (e.g. the
+  /// buffer of the MatrixRandomizer, so the mini-batches are not copied),
+  /// or the matrix 'feats' if 'feats_buffer' is NULL.
+  const CuMatrixBase<BaseFloat> *feats_buffer;
+  int32 feats_offset;
+  CuMatrix<BaseFloat> feats;
+  /// Optional re-ordering of the features, row t is row frame_order[t],
+  std::vector<int32> frame_order;
+  Posterior targets;
+  Vector<BaseFloat> weights;
+  std::vector<int32> block_row_offset; ///< rows of the <BlockSoftmax> blocks, (empty = dense)
+
+  NnetMinibatch() : feats_buffer(NULL), feats_offset(0) { }
+};
+
+
+/**
+ * Multi-threaded CPU training of nnet1::Nnet.
+ *
+ * Each thread trains a private copy of the network (own buffers, own momentum)
+ * on its share of the mini-batches. After every 'sync_minibatches' mini-batches
+ * per thread, the threads meet at a barrier, the master network is set to the
+ * average of the thread models (i.e. the updates of the threads are averaged,
+ * so the learning rate has the same meaning as in the single-threaded
+ * training, per mini-batch of each thread), and the averaged parameters are
+ * copied back to the threads.
+ *
+ * The objective function is evaluated by a private copy in each thread
+ * (LossItf::NewThreadCopy()), the statistics are added to the shared one
+ * at the end of Train(). The adaptive state of the loss (the running
+ * averages of the MultiTaskLoss task weighting) is merged together with
+ * the models (LossItf::MergeThreadCopies()).
+ *
+ * The mini-batches are assigned to the threads round-robin, so the result
+ * does not depend on the thread scheduling.
+ */
+class NnetParallelTrainer {
+ public:
+  NnetParallelTrainer(const NnetParallelOptions &opts,
+                      bool crossvalidate, bool block_softmax_sparse,
+                      Nnet *nnet, LossItf *loss);
+  ~NnetParallelTrainer();
+
+  /// Train with the mini-batches, 'nnet' contains the merged model afterwards,
+  void Train(const std::vector<NnetMinibatch> &minibatches);
+
+ private:
+  /// The training thread,
+  class TrainThread : public MultiThreadable {
+   public:
+    TrainThread(NnetParallelTrainer *trainer) : trainer_(trainer) { }
+    void operator() () { trainer_->TrainLoop(thread_id_); }
+   private:
+    NnetParallelTrainer *trainer_;
+  };
+
+  /// Runs in the training thread 'thread_id',
+  void TrainLoop(int32 thread_id);
+  /// Trains the model of thread 'thread_id' with one mini-batch,
+  void TrainMinibatch(int32 thread_id, const CuMatrixBase<BaseFloat> &feats,
+                      const NnetMinibatch &mb);
+  /// Averages the thread models into the master, (by single thread)
+  void MergeUpdates();
+
+  NnetParallelOptions opts_;
+  bool crossvalidate_;
+  bool block_softmax_sparse_;
+  Nnet *nnet_; ///< the master model
+  LossItf *loss_;
+  Barrier barrier_;
+
+  std::vector<Nnet*> thread_nnet_; ///< private copies of the model
+  std::vector<LossItf*> thread_loss_; ///< private copies of the loss
+  /// buffers of the threads,
+  std::vector<CuMatrix<BaseFloat> > thread_out_, thread_diff_, thread_feats_;
+  const std::vector<NnetMinibatch> *minibatches_; ///< data of the current Train() call
+
+  Vector<BaseFloat> master_params_, thread_params_; ///< merging buffers
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetParallelTrainer);
+};
+
+
+} // namespace nnet1
+} // namespace kaldi
+
+#endif
@@ -25,6 +25,8 @@
 #include <algorithm>
 
 #include "base/kaldi-common.h"
+#include "matrix/compressed-matrix.h"
+#include "cudamatrix/cu-device.h"
 #include "cudamatrix/cu-matrix.h"
 #include "cudamatrix/cu-array.h"
 #include "hmm/posterior.h"
@@ -201,6 +203,73 @@ void PosteriorToMatrixMapped(const Posterior &post, const TransitionModel &model
 }
 
 
+/**
+ * Decompress CompressedMatrix (e.g. features from 'copy-feats --compress=true')
+ * into CuMatrix, when the CuMatrix is in host memory (no GPU) the values are
+ * decoded straight into it, without an intermediate host-matrix.
+ */
+template <typename Real>
+void CompressedMatrixToCuMatrix(const CompressedMatrix &cmat, CuMatrix<Real> *mat) {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    Matrix<Real> m(cmat);
+    (*mat) = m;
+    return;
+  }
+#endif
+  mat->Resize(cmat.NumRows(), cmat.NumCols(), kUndefined);
+  cmat.CopyToMat(&mat->Mat());
+}
+
+
+/**
+ * Group the frames of a mini-batch by the block (task) of their targets,
+ * the blocks are defined by column offsets 'block_offset' (num_blocks+1 elements).
+ * The 'frame_order' is a stable re-ordering of the frames grouped by blocks,
+ * the 'row_offset' contains the row-ranges of the blocks in the re-ordered data.
+ * Frames without targets go to the 1st block (they have zero weight in the loss).
+ * Returns false if some frame has targets in more than one block.
+ */
+inline bool GroupPosteriorByBlock(const Posterior &post,
+                                  const std::vector<int32> &block_offset,
+                                  std::vector<int32> *frame_order,
+                                  std::vector<int32> *row_offset) {
+  int32 num_blocks = block_offset.size() - 1;
+  KALDI_ASSERT(num_blocks > 0);
+  // find the block of each frame,
+  std::vector<int32> frame_block(post.size(), 0);
+  row_offset->assign(num_blocks+1, 0);
+  for (int32 t = 0; t < post.size(); t++) {
+    int32 block = -1;
+    for (int32 i = 0; i < post[t].size(); i++) {
+      int32 col = post[t][i].first;
+      int32 bl = std::upper_bound(block_offset.begin(), block_offset.end(), col)
+                 - block_offset.begin() - 1;
+      if (bl < 0 || bl >= num_blocks) {
+        KALDI_ERR << "Out-of-bound Posterior element with index " << col 
+                  << ", higher than number of columns " << block_offset.back();
+      }
+      if (block != -1 && block != bl) return false; // targets in 2 blocks,
+      block = bl;
+    }
+    if (block == -1) block = 0; // no targets,
+    frame_block[t] = block;
+    (*row_offset)[block+1]++;
+  }
+  // frame counts -> offsets,
+  for (int32 bl = 0; bl < num_blocks; bl++) {
+    (*row_offset)[bl+1] += (*row_offset)[bl];
+  }
+  // stable counting sort,
+  std::vector<int32> cursor(row_offset->begin(), row_offset->end()-1);
+  frame_order->resize(post.size());
+  for (int32 t = 0; t < post.size(); t++) {
+    (*frame_order)[cursor[frame_block[t]]++] = t;
+  }
+  return true;
+}
+
+
 } // namespace nnet1
 } // namespace kaldi
 
@@ -126,6 +126,12 @@ class Splice: public Component {
     WriteIntegerVector(os, binary, frame_offsets);
   }
   
+  /// The frame offsets of the splicing,
+  void GetFrameOffsets(std::vector<int32> *frame_offsets) const {
+    frame_offsets->resize(frame_offsets_.Dim());
+    frame_offsets_.CopyToVec(frame_offsets);
+  }
+
   std::string Info() const {
     std::ostringstream ostr;
     ostr << "\n  frame_offsets " << frame_offsets_;
@@ -365,6 +371,11 @@ class AddShift : public UpdatableComponent {
     wei_copy->Resize(InputDim());
     shift_data_.CopyToVec(wei_copy);
   }
+
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    shift_data_.CopyFromVec(params);
+  }
    
   std::string Info() const {
     return std::string("\n  shift_data") + MomentStatistics(shift_data_);
@@ -472,6 +483,11 @@ class Rescale : public UpdatableComponent {
     wei_copy->Resize(InputDim());
     scale_data_.CopyToVec(wei_copy);
   }
+
+  void SetParams(const VectorBase<BaseFloat> &params) {
+    KALDI_ASSERT(params.Dim() == NumParams());
+    scale_data_.CopyFromVec(params);
+  }
  
   std::string Info() const {
     return std::string("\n  scale_data") + MomentStatistics(scale_data_);
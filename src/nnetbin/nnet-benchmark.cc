@@ -0,0 +1,335 @@
+// nnetbin/nnet-benchmark.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include <algorithm>
+
+#include "nnet/nnet-nnet.h"
+#include "nnet/nnet-component.h"
+#include "nnet/nnet-parallel-component.h"
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "base/timer.h"
+#include "thread/kaldi-thread.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// Component to be benchmarked, (name for the CSV, config line),
+struct BenchmarkConfig {
+  std::string name;
+  std::string conf;
+  BenchmarkConfig(const std::string &n, const std::string &c) : name(n), conf(c) { }
+};
+
+
+/// <ParallelComponent> with 'num_nnets' nested networks
+/// (each reads 'dim_in' columns : Affine + Sigmoid + Affine),
+std::string ParallelComponentConfig(int32 num_nnets, int32 dim_in,
+                                    int32 dim_hid, int32 dim_out) {
+  std::ostringstream os;
+  os << "<ParallelComponent> " << num_nnets * dim_out << " " << num_nnets * dim_in << "\n"
+     << "<NestedNnetCount> " << num_nnets << "\n";
+  for (int32 i = 0; i < num_nnets; i++) {
+    Nnet nnet;
+    std::ostringstream c1, c2, c3;
+    c1 << "<AffineTransform> <InputDim> " << dim_in << " <OutputDim> " << dim_hid << " <ParamStddev> 0.1\n";
+    c2 << "<Sigmoid> <InputDim> " << dim_hid << " <OutputDim> " << dim_hid << "\n";
+    c3 << "<AffineTransform> <InputDim> " << dim_hid << " <OutputDim> " << dim_out << " <ParamStddev> 0.1\n";
+    nnet.AppendComponent(Component::Init(c1.str()));
+    nnet.AppendComponent(Component::Init(c2.str()));
+    nnet.AppendComponent(Component::Init(c3.str()));
+    os << "<NestedNnet> " << i+1 << "\n";
+    nnet.Write(os, false);
+  }
+  os << "</ParallelComponent>\n";
+  return os.str();
+}
+
+
+/// The default set of the benchmarked components,
+void DefaultBenchmarkConfigs(std::vector<BenchmarkConfig> *configs) {
+  configs->push_back(BenchmarkConfig("AffineTransform_2048x2048",
+    "<AffineTransform> <InputDim> 2048 <OutputDim> 2048 <ParamStddev> 0.1\n"));
+  configs->push_back(BenchmarkConfig("Sigmoid_2048",
+    "<Sigmoid> <InputDim> 2048 <OutputDim> 2048\n"));
+  configs->push_back(BenchmarkConfig("Softmax_6000",
+    "<Softmax> <InputDim> 6000 <OutputDim> 6000\n"));
+  configs->push_back(BenchmarkConfig("BlockSoftmax_2x3000",
+    "<BlockSoftmax> <InputDim> 6000 <OutputDim> 6000 <BlockDims> 3000:3000\n"));
+  configs->push_back(BenchmarkConfig("BlockSoftmax_3x2000",
+    "<BlockSoftmax> <InputDim> 6000 <OutputDim> 6000 <BlockDims> 2000:2000:2000\n"));
+  configs->push_back(BenchmarkConfig("BlockSoftmax_6x1000",
+    "<BlockSoftmax> <InputDim> 6000 <OutputDim> 6000 <BlockDims> 1000:1000:1000:1000:1000:1000\n"));
+  configs->push_back(BenchmarkConfig("BlockSoftmax_4000-1500-500",
+    "<BlockSoftmax> <InputDim> 6000 <OutputDim> 6000 <BlockDims> 4000:1500:500\n"));
+  configs->push_back(BenchmarkConfig("LstmProjectedStreams_512-1024-256",
+    "<LstmProjectedStreams> <InputDim> 512 <OutputDim> 256 <CellDim> 1024 <ParamScale> 0.1\n"));
+  configs->push_back(BenchmarkConfig("Convolutional2DComponent_3x11x40-64x7x32",
+    "<Convolutional2DComponent> <InputDim> 1320 <OutputDim> 14336 <FmapXLen> 11 <FmapYLen> 40 "
+    "<FiltXLen> 5 <FiltYLen> 9 <FiltXStep> 1 <FiltYStep> 1 <ConnectFmap> 0 <ParamStddev> 0.1\n"));
+  configs->push_back(BenchmarkConfig("ParallelComponent_4x(256-1024-1000)",
+    ParallelComponentConfig(4, 256, 1024, 1000)));
+  configs->push_back(BenchmarkConfig("Splice_40x11",
+    "<Splice> <InputDim> 40 <OutputDim> 440 <BuildVector> -5:5 </BuildVector>\n"));
+}
+
+
+/// Creates the component, from config line, or from <ParallelComponent> in text format,
+Component* NewBenchmarkComponent(const BenchmarkConfig &config) {
+  Component *c;
+  if (config.conf.compare(0, 20, "<ParallelComponent> ") == 0) {
+    std::istringstream is(config.conf);
+    c = Component::Read(is, false);
+  } else {
+    c = Component::Init(config.conf);
+  }
+  if (c->IsUpdatable()) {
+    dynamic_cast<UpdatableComponent*>(c)->SetTrainOptions(NnetTrainOptions());
+  }
+  return c;
+}
+
+
+/// Result of one benchmark, times are in seconds (sums over the iterations),
+struct BenchmarkTimes {
+  double propagate, backpropagate, update;
+  std::vector<double> iteration; ///< time of each iteration,
+  BenchmarkTimes() : propagate(0.0), backpropagate(0.0), update(0.0) { }
+};
+
+
+/// Median of the iteration times,
+double MedianIterationTime(const BenchmarkTimes &times) {
+  KALDI_ASSERT(!times.iteration.empty());
+  std::vector<double> t(times.iteration);
+  std::sort(t.begin(), t.end());
+  return t[t.size() / 2];
+}
+
+
+/// Runs the forward pass, backward pass and update of own copy of the component,
+/// (with several threads, the nested networks of a <ParallelComponent> run in
+/// the benchmark thread, as in the multi-threaded training)
+class BenchmarkThread : public MultiThreadable {
+ public:
+  BenchmarkThread(const Component *component, int32 minibatch_size, int32 iterations,
+                  std::vector<BenchmarkTimes> *times)
+    : component_(component), minibatch_size_(minibatch_size),
+      iterations_(iterations), times_(times) { }
+
+  void operator() () {
+    Component *c = component_->Copy();
+    CuMatrix<BaseFloat> in(minibatch_size_, c->InputDim(), kUndefined),
+      out, out_diff(minibatch_size_, c->OutputDim(), kUndefined), in_diff;
+    in.SetRandn();
+    out_diff.SetRandn();
+    out_diff.Scale(0.001);
+    // the nested networks update in the backward pass, they are profiled
+    // to split the backward time,
+    ParallelComponent *pc = NULL;
+    if (c->GetType() == Component::kParallelComponent) {
+      pc = dynamic_cast<ParallelComponent*>(c);
+      if (num_threads_ > 1) pc->SetNumThreads(1);
+      for (int32 n = 0; n < pc->NumNestedNnet(); n++) {
+        pc->GetNestedNnet(n).SetProfiling(true);
+      }
+    }
+    BenchmarkTimes &times = (*times_)[thread_id_];
+    Timer tim, tim_iter;
+    for (int32 i = 0; i < iterations_; i++) {
+      tim_iter.Reset();
+      tim.Reset();
+      c->Propagate(in, &out);
+      times.propagate += tim.Elapsed();
+      tim.Reset();
+      c->Backpropagate(in, out, out_diff, &in_diff);
+      times.backpropagate += tim.Elapsed();
+      if (c->IsUpdatable()) {
+        tim.Reset();
+        dynamic_cast<UpdatableComponent*>(c)->Update(in, out_diff);
+        times.update += tim.Elapsed();
+      }
+      times.iteration.push_back(tim_iter.Elapsed());
+    }
+    if (pc != NULL) {
+      // the nested networks can run concurrently, the backward time
+      // is split by the shares of the summed nested times,
+      double nested_backprop = 0.0, nested_update = 0.0;
+      for (int32 n = 0; n < pc->NumNestedNnet(); n++) {
+        double p, b, u;
+        pc->GetNestedNnet(n).GetProfileTotals(&p, &b, &u);
+        nested_backprop += b;
+        nested_update += u;
+      }
+      if (nested_backprop + nested_update > 0.0) {
+        double update = times.backpropagate * nested_update / (nested_backprop + nested_update);
+        times.backpropagate -= update;
+        times.update += update;
+      }
+    }
+    delete c;
+  }
+
+ private:
+  const Component *component_;
+  int32 minibatch_size_;
+  int32 iterations_;
+  std::vector<BenchmarkTimes> *times_;
+};
+
+} // namespace nnet1
+} // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  using namespace kaldi::nnet1;
+  typedef kaldi::int32 int32;
+  try {
+    const char *usage =
+        "Benchmark the forward pass, backward pass and update of nnet1 components,\n"
+        "for several mini-batch sizes and numbers of threads (each thread runs its\n"
+        "own copy of the component), the results are written as CSV.\n"
+        "The default set of components can be replaced by --components (one component\n"
+        "per line, in the nnet-initialize prototype format).\n"
+        "\n"
+        "Usage:  nnet-benchmark [options] [<csv-wxfilename>]\n"
+        "e.g.: \n"
+        " nnet-benchmark --minibatch-sizes=256,1024 --num-threads=1,4 bench.csv\n";
+
+    ParseOptions po(usage);
+
+    std::string minibatch_sizes_str = "64,256,1024";
+    po.Register("minibatch-sizes", &minibatch_sizes_str, "Comma separated list of mini-batch sizes (frames)");
+    std::string num_threads_str = "1";
+    po.Register("num-threads", &num_threads_str, "Comma separated list of numbers of threads (CPU only)");
+    BaseFloat time_per_test = 1.0;
+    po.Register("time-per-test", &time_per_test, "Approximate time of each single-thread measurement (seconds), sets the number of iterations");
+    int32 num_warmup = 5;
+    po.Register("num-warmup", &num_warmup, "Number of warm-up iterations, the number of iterations is calibrated on the median of their times");
+    int32 min_iterations = 10;
+    po.Register("min-iterations", &min_iterations, "Minimum number of iterations of each measurement");
+    std::string components_rxfilename;
+    po.Register("components", &components_rxfilename, "Components to benchmark, one prototype line per component (default: built-in set)");
+
+    std::string use_gpu="no";
+    po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() > 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (num_warmup < 1 || min_iterations < 1) {
+      KALDI_ERR << "--num-warmup and --min-iterations must be positive";
+    }
+    std::string csv_wxfilename = po.GetOptArg(1);
+    if (csv_wxfilename == "") csv_wxfilename = "-";
+
+    std::vector<int32> minibatch_sizes, num_threads;
+    if (!SplitStringToIntegers(minibatch_sizes_str, ",", false, &minibatch_sizes) ||
+        minibatch_sizes.empty()) {
+      KALDI_ERR << "Invalid --minibatch-sizes " << minibatch_sizes_str;
+    }
+    if (!SplitStringToIntegers(num_threads_str, ",", false, &num_threads) ||
+        num_threads.empty()) {
+      KALDI_ERR << "Invalid --num-threads " << num_threads_str;
+    }
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+    if (CuDevice::Instantiate().Enabled() &&
+        *std::max_element(num_threads.begin(), num_threads.end()) > 1) {
+      KALDI_ERR << "Multiple threads (--num-threads) are for CPU only, use --use-gpu=no";
+    }
+#endif
+
+    std::vector<BenchmarkConfig> configs;
+    if (components_rxfilename == "") {
+      DefaultBenchmarkConfigs(&configs);
+    } else {
+      Input in(components_rxfilename);
+      std::string line;
+      while (std::getline(in.Stream(), line)) {
+        if (line.find_first_not_of(" \t") == std::string::npos) continue;
+        std::istringstream is(line);
+        std::string marker;
+        is >> marker;
+        std::ostringstream name;
+        name << marker.substr(1, marker.size()-2) << "_" << configs.size()+1;
+        configs.push_back(BenchmarkConfig(name.str(), line + "\n"));
+      }
+    }
+
+    Output ko(csv_wxfilename, false);
+    ko.Stream() << "component,input_dim,output_dim,minibatch_size,num_threads,iterations,"
+                << "propagate_ms,backpropagate_ms,update_ms,frames_per_second\n";
+
+    for (int32 i = 0; i < configs.size(); i++) {
+      Component *c = NewBenchmarkComponent(configs[i]);
+      KALDI_LOG << "Benchmarking " << configs[i].name;
+      for (int32 j = 0; j < minibatch_sizes.size(); j++) {
+        int32 mb = minibatch_sizes[j];
+        // warm-up and the number of iterations for 'time_per_test',
+        // (the median is not affected by the cold 1st iteration)
+        std::vector<BenchmarkTimes> times(1);
+        {
+          MultiThreader<BenchmarkThread> m(0, BenchmarkThread(c, mb, num_warmup, &times));
+        }
+        double t1 = MedianIterationTime(times[0]);
+        int32 iterations = std::max<int32>(min_iterations,
+                                           static_cast<int32>(time_per_test / std::max(t1, 1e-06)));
+        for (int32 k = 0; k < num_threads.size(); k++) {
+          int32 nt = num_threads[k];
+          times.clear();
+          times.resize(nt);
+          Timer tim;
+          {
+            // (0 = run in this thread)
+            MultiThreader<BenchmarkThread> m(nt == 1 ? 0 : nt, BenchmarkThread(c, mb, iterations, &times));
+          }
+          double wall_time = tim.Elapsed();
+          BenchmarkTimes sum;
+          for (int32 t = 0; t < nt; t++) {
+            sum.propagate += times[t].propagate;
+            sum.backpropagate += times[t].backpropagate;
+            sum.update += times[t].update;
+          }
+          double num_calls = static_cast<double>(nt) * iterations;
+          ko.Stream() << configs[i].name << "," << c->InputDim() << "," << c->OutputDim()
+                      << "," << mb << "," << nt << "," << iterations
+                      << "," << 1000.0 * sum.propagate / num_calls
+                      << "," << 1000.0 * sum.backpropagate / num_calls
+                      << "," << 1000.0 * sum.update / num_calls
+                      << "," << num_calls * mb / wall_time << "\n";
+        }
+      }
+      delete c;
+    }
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
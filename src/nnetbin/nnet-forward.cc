@@ -24,7 +24,209 @@
 #include "nnet/nnet-pdf-prior.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "feat/feature-pipeline.h"
 #include "base/timer.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// Utterances forwarded through the nnet in a single propagation,
+/// each utterance is padded at the edges by copies of its first/last frame,
+/// so the <Splice> context does not reach into the neighbouring utterances.
+class NnetForwardBatch {
+ public:
+  NnetForwardBatch(int32 left_context, int32 right_context)
+    : left_context_(left_context), right_context_(right_context), num_rows_(0) { }
+
+  /// Adds the utterance, the features are taken over (swapped),
+  void AddUtterance(const std::string &key, CuMatrix<BaseFloat> *feats) {
+    keys_.push_back(key);
+    feats_.resize(feats_.size() + 1);
+    feats_.back().Swap(feats);
+    if (feats_.back().NumRows() > 0) {
+      num_rows_ += left_context_ + feats_.back().NumRows() + right_context_;
+    }
+  }
+
+  int32 NumUtterances() const { return keys_.size(); }
+  /// Number of rows of the batch (including the padding),
+  int32 NumRows() const { return num_rows_; }
+  const std::string& Key(int32 i) const { return keys_[i]; }
+  int32 NumFrames(int32 i) const { return feats_[i].NumRows(); }
+
+  /// Applies the feature transform to each utterance, (the empty ones stay empty)
+  void TransformFeatures(Nnet *nnet_transf, bool shared,
+                         std::vector<CuMatrix<BaseFloat> > *buffers) {
+    CuMatrix<BaseFloat> feats_transf;
+    for (int32 i = 0; i < feats_.size(); i++) {
+      if (feats_[i].NumRows() == 0) continue;
+      if (shared) {
+        nnet_transf->Feedforward(feats_[i], &feats_transf, buffers);
+      } else {
+        nnet_transf->Feedforward(feats_[i], &feats_transf);
+      }
+      if (!KALDI_ISFINITE(feats_transf.Sum())) { // check there's no nan/inf,
+        KALDI_ERR << "NaN or inf found in transformed-features for " << keys_[i];
+      }
+      feats_[i].Swap(&feats_transf);
+    }
+  }
+
+  /// Concatenates the padded utterances,
+  void GetInput(CuMatrix<BaseFloat> *in) const {
+    KALDI_ASSERT(num_rows_ > 0);
+    int32 row = 0;
+    for (int32 i = 0; i < feats_.size(); i++) {
+      if (feats_[i].NumRows() > 0) {
+        in->Resize(num_rows_, feats_[i].NumCols(), kUndefined);
+        break;
+      }
+    }
+    for (int32 i = 0; i < feats_.size(); i++) {
+      const CuMatrix<BaseFloat> &feats = feats_[i];
+      if (feats.NumRows() == 0) continue;
+      for (int32 k = 0; k < left_context_; k++) {
+        in->Row(row++).CopyFromVec(feats.Row(0));
+      }
+      in->RowRange(row, feats.NumRows()).CopyFromMat(feats);
+      row += feats.NumRows();
+      for (int32 k = 0; k < right_context_; k++) {
+        in->Row(row++).CopyFromVec(feats.Row(feats.NumRows()-1));
+      }
+    }
+    KALDI_ASSERT(row == num_rows_);
+  }
+
+  /// Copies the output rows of the utterances (without padding),
+  void SplitOutput(const CuMatrixBase<BaseFloat> &out,
+                   std::vector<Matrix<BaseFloat> > *out_utts) const {
+    KALDI_ASSERT(out.NumRows() == num_rows_);
+    out_utts->resize(feats_.size());
+    int32 row = 0;
+    for (int32 i = 0; i < feats_.size(); i++) {
+      int32 num_frames = feats_[i].NumRows();
+      if (num_frames == 0) { // empty output,
+        (*out_utts)[i].Resize(0, 0);
+        continue;
+      }
+      (*out_utts)[i].Resize(num_frames, out.NumCols(), kUndefined);
+      row += left_context_;
+      out.RowRange(row, num_frames).CopyToMat(&(*out_utts)[i]);
+      row += num_frames + right_context_;
+    }
+  }
+
+  void Clear() { keys_.clear(); feats_.clear(); num_rows_ = 0; }
+
+ private:
+  int32 left_context_, right_context_;
+  std::vector<std::string> keys_;
+  std::vector<CuMatrix<BaseFloat> > feats_;
+  int32 num_rows_;
+};
+
+
+/// Forward pass of one batch, the networks are shared by the tasks running
+/// in parallel ('shared' = const forward pass with the buffers of the task),
+/// the outputs are written in the destructor, (i.e. in the input order).
+class NnetForwardTask {
+ public:
+  // Initializer takes ownership of "batch".
+  NnetForwardTask(Nnet *nnet_transf, Nnet *nnet, bool shared,
+                  const PdfPrior *pdf_prior, bool apply_log, int32 time_shift,
+                  NnetForwardBatch *batch, BaseFloatMatrixWriter *feature_writer):
+      nnet_transf_(nnet_transf), nnet_(nnet), shared_(shared),
+      pdf_prior_(pdf_prior), apply_log_(apply_log), time_shift_(time_shift),
+      batch_(batch), feature_writer_(feature_writer) { }
+
+  void operator () () {
+    std::string name = (batch_->NumUtterances() == 1 ? batch_->Key(0) : 
+                        "batch " + batch_->Key(0) + " .. " + 
+                        batch_->Key(batch_->NumUtterances()-1));
+
+    // only empty utterances, these get empty outputs,
+    if (batch_->NumRows() == 0) {
+      KALDI_WARN << "No frames in " << name;
+      batch_out_.resize(batch_->NumUtterances());
+      return;
+    }
+
+    // fwd-pass, feature transform (per utterance),
+    batch_->TransformFeatures(nnet_transf_, shared_, &buffers_);
+
+    // fwd-pass, nnet,
+    CuMatrix<BaseFloat> nnet_in, nnet_out;
+    batch_->GetInput(&nnet_in);
+    if (shared_) {
+      nnet_->Feedforward(nnet_in, &nnet_out, &buffers_);
+    } else {
+      nnet_->Feedforward(nnet_in, &nnet_out);
+    }
+    if (!KALDI_ISFINITE(nnet_out.Sum())) { // check there's no nan/inf,
+      KALDI_ERR << "NaN or inf found in nn-output for " << name;
+    }
+    
+    // convert posteriors to log-posteriors,
+    if (apply_log_) {
+      if (!(nnet_out.Min() >= 0.0 && nnet_out.Max() <= 1.0)) {
+        KALDI_WARN << name << " "
+                   << "Applying 'log' to data which don't seem to be probabilities "
+                   << "(is there a softmax somwhere?)";
+      }
+      nnet_out.Add(1e-20); // avoid log(0),
+      nnet_out.ApplyLog();
+    }
+   
+    // subtract log-priors from log-posteriors or pre-softmax,
+    if (pdf_prior_ != NULL) {
+      if (nnet_out.Min() >= 0.0 && nnet_out.Max() <= 1.0) {
+        KALDI_WARN << name << " " 
+                   << "Subtracting log-prior on 'probability-like' data in range [0..1] " 
+                   << "(Did you forget --no-softmax=true or --apply-log=true ?)";
+      }
+      pdf_prior_->SubtractOnLogpost(&nnet_out);
+    }
+
+    // download from GPU, split to utterances,
+    batch_->SplitOutput(nnet_out, &batch_out_);
+
+    for (int32 i = 0; i < batch_->NumUtterances(); i++) {
+      Matrix<BaseFloat> &nnet_out_host = batch_out_[i];
+      // time-shift, remove N first frames of LSTM output,
+      if (time_shift_ > 0) {
+        Matrix<BaseFloat> tmp(nnet_out_host);
+        nnet_out_host = tmp.RowRange(time_shift_, tmp.NumRows() - time_shift_);
+      }
+      if (!KALDI_ISFINITE(nnet_out_host.Sum())) { // check there's no nan/inf,
+        KALDI_ERR << "NaN or inf found in final output nn-output for " << batch_->Key(i);
+      }
+    }
+  }
+
+  ~NnetForwardTask() {
+    // write,
+    for (int32 i = 0; i < batch_out_.size(); i++) {
+      feature_writer_->Write(batch_->Key(i), batch_out_[i]);
+    }
+    delete batch_;
+  }
+
+ private:
+  Nnet *nnet_transf_, *nnet_;
+  bool shared_;
+  const PdfPrior *pdf_prior_;
+  bool apply_log_;
+  int32 time_shift_;
+  NnetForwardBatch *batch_;  // The utterances, owned locally.
+  BaseFloatMatrixWriter *feature_writer_;
+
+  std::vector<CuMatrix<BaseFloat> > buffers_;  // The forward pass buffers,
+  std::vector<Matrix<BaseFloat> > batch_out_;  // The outputs.
+};
+
+} // namespace nnet1
+} // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -36,7 +238,13 @@ int main(int argc, char *argv[]) {
         "\n"
         "Usage:  nnet-forward [options] <model-in> <feature-rspecifier> <feature-wspecifier>\n"
         "e.g.: \n"
-        " nnet-forward nnet ark:features.ark ark:mlpoutput.ark\n";
+        " nnet-forward nnet ark:features.ark ark:mlpoutput.ark\n"
+        " nnet-forward --batch-frames=2048 --feature-transform=final.feature_transform \\\n"
+        "   final.nnet scp:feats.scp ark:mlpoutput.ark\n"
+        " nnet-forward --num-threads=8 final.nnet scp:feats.scp ark:mlpoutput.ark\n"
+        "The features can be a feature-pipeline spec (see feat/feature-pipeline.h), e.g.\n"
+        " nnet-forward final.nnet 'pipeline:scp:feats.scp | apply-cmvn --utt2spk=ark:utt2spk \\\n"
+        "   scp:cmvn.scp | add-deltas' ark:mlpoutput.ark\n";
 
     ParseOptions po(usage);
 
@@ -50,6 +258,8 @@ int main(int argc, char *argv[]) {
     po.Register("no-softmax", &no_softmax, "No softmax on MLP output (or remove it if found), the pre-softmax activations will be used as log-likelihoods, log-priors will be subtracted");
     bool apply_log = false;
     po.Register("apply-log", &apply_log, "Transform MLP output to logscale");
+    int32 task = 0;
+    po.Register("task", &task, "Multi-task network : evaluate only the task N (1-based), i.e. the N-th block of output <BlockSoftmax> or N-th network of output <ParallelComponent> (0 = all the tasks)");
 
     std::string use_gpu="no";
     po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA"); 
@@ -61,6 +271,12 @@ int main(int argc, char *argv[]) {
     int32 time_shift = 0;
     po.Register("time-shift", &time_shift, "LSTM : repeat last input frame N-times, discrad N initial output frames."); 
 
+    int32 batch_frames = 0;
+    po.Register("batch-frames", &batch_frames, "Forward several utterances in one propagation, the batches have at least N frames, the utterances are padded at the edges by the frame-context of the <Splice> in the nnet (0 = one utterance at a time, short utterances are faster in batches)");
+
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
@@ -84,6 +300,11 @@ int main(int argc, char *argv[]) {
 
     Nnet nnet;
     nnet.Read(model_filename);
+    // optionally reduce the multi-task network to single task,
+    if (task > 0) {
+      KALDI_LOG << "Selecting task " << task << " from the nnet " << model_filename;
+      nnet.SelectTask(task);
+    }
     // optionally remove softmax,
     Component::ComponentType last_type = nnet.GetComponent(nnet.NumComponents()-1).GetType();
     if (no_softmax) {
@@ -107,23 +328,61 @@ int main(int argc, char *argv[]) {
     nnet_transf.SetDropoutRetention(1.0);
     nnet.SetDropoutRetention(1.0);
 
-    kaldi::int64 tot_t = 0;
+    // the padding of the utterances in the batches (the feature transform is per utterance),
+    int32 left_context = 0, right_context = 0;
+    if (batch_frames > 0) {
+      int32 num_splice = 0;
+      if (!nnet.GetFrameContext(&left_context, &right_context, &num_splice)) {
+        KALDI_ERR << "Cannot use --batch-frames, the nnet has recurrent or sentence-level components";
+      }
+      if (num_splice > 1) {
+        KALDI_ERR << "Cannot use --batch-frames, the nnet has " << num_splice << " <Splice> components "
+                  << "in a row, the padding would not reproduce the edges of the utterances";
+      }
+      if (time_shift > 0) {
+        KALDI_ERR << "Cannot use --batch-frames with --time-shift";
+      }
+      KALDI_LOG << "Forwarding in batches of " << batch_frames << " frames, the utterances "
+                << "are padded by " << left_context << "/" << right_context << " frames";
+    }
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
-    BaseFloatMatrixWriter feature_writer(feature_wspecifier);
+    // the networks are shared by the threads, (CPU only)
+    bool shared = (sequencer_config.num_threads > 1);
+    if (shared) {
+#if HAVE_CUDA==1
+      if (CuDevice::Instantiate().Enabled()) {
+        KALDI_ERR << "Cannot use --num-threads=" << sequencer_config.num_threads
+                  << " with GPU, the threads are for the CPU forward pass";
+      }
+#endif
+      if (!nnet_transf.IsFeedforwardThreadSafe() || !nnet.IsFeedforwardThreadSafe()) {
+        KALDI_WARN << "The nnet has components which keep state in the forward pass "
+                   << "(LSTM, convolutional, ...), ignoring --num-threads="
+                   << sequencer_config.num_threads;
+        shared = false;
+      } else {
+        KALDI_LOG << "Forwarding with " << sequencer_config.num_threads 
+                  << " threads, sharing the nnet";
+      }
+    }
+    const PdfPrior *prior = (prior_opts.class_frame_counts != "" ? &pdf_prior : NULL);
+    NnetForwardBatch *batch = new NnetForwardBatch(left_context, right_context);
 
-    CuMatrix<BaseFloat> feats, feats_transf, nnet_out;
-    Matrix<BaseFloat> nnet_out_host;
+    kaldi::int64 tot_t = 0;
 
+    SequentialFeatureReader feature_reader(feature_rspecifier);
+    BaseFloatMatrixWriter feature_writer(feature_wspecifier);
 
     Timer time;
     double time_now = 0;
     int32 num_done = 0;
+    TaskSequencer<NnetForwardTask> sequencer(sequencer_config);
     // iterate over all feature files
-    for (; !feature_reader.Done(); feature_reader.Next()) {
+    while (!feature_reader.Done()) {
       // read
       Matrix<BaseFloat> mat = feature_reader.Value();
       std::string utt = feature_reader.Key();
+      feature_reader.Next();
       KALDI_VLOG(2) << "Processing utterance " << num_done+1 
                     << ", " << utt
                     << ", " << mat.NumRows() << "frm";
@@ -141,58 +400,6 @@ int main(int argc, char *argv[]) {
           mat.CopyRowFromVec(mat.Row(last_row), r); // copy last row,
         }
       }
-      
-      // push it to gpu,
-      feats = mat;
-
-      // fwd-pass, feature transform,
-      nnet_transf.Feedforward(feats, &feats_transf);
-      if (!KALDI_ISFINITE(feats_transf.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in transformed-features for " << utt;
-      }
-
-      // fwd-pass, nnet,
-      nnet.Feedforward(feats_transf, &nnet_out);
-      if (!KALDI_ISFINITE(nnet_out.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in nn-output for " << utt;
-      }
-      
-      // convert posteriors to log-posteriors,
-      if (apply_log) {
-        if (!(nnet_out.Min() >= 0.0 && nnet_out.Max() <= 1.0)) {
-          KALDI_WARN << utt << " "
-                     << "Applying 'log' to data which don't seem to be probabilities "
-                     << "(is there a softmax somwhere?)";
-        }
-        nnet_out.Add(1e-20); // avoid log(0),
-        nnet_out.ApplyLog();
-      }
-     
-      // subtract log-priors from log-posteriors or pre-softmax,
-      if (prior_opts.class_frame_counts != "") {
-        if (nnet_out.Min() >= 0.0 && nnet_out.Max() <= 1.0) {
-          KALDI_WARN << utt << " " 
-                     << "Subtracting log-prior on 'probability-like' data in range [0..1] " 
-                     << "(Did you forget --no-softmax=true or --apply-log=true ?)";
-        }
-        pdf_prior.SubtractOnLogpost(&nnet_out);
-      }
-
-      // download from GPU,
-      nnet_out_host.Resize(nnet_out.NumRows(), nnet_out.NumCols());
-      nnet_out.CopyToMat(&nnet_out_host);
-
-      // time-shift, remove N first frames of LSTM output,
-      if (time_shift > 0) {
-        Matrix<BaseFloat> tmp(nnet_out_host);
-        nnet_out_host = tmp.RowRange(time_shift, tmp.NumRows() - time_shift);
-      }
-
-      // write,
-      if (!KALDI_ISFINITE(nnet_out_host.Sum())) { // check there's no nan/inf,
-        KALDI_ERR << "NaN or inf found in final output nn-output for " << utt;
-      }
-      feature_writer.Write(feature_reader.Key(), nnet_out_host);
 
       // progress log
       if (num_done % 100 == 0) {
@@ -203,7 +410,28 @@ int main(int argc, char *argv[]) {
       }
       num_done++;
       tot_t += mat.NumRows();
+
+      // push it to gpu, collect the utterances of the batch,
+      // (single utterance without --batch-frames)
+      CuMatrix<BaseFloat> feats(mat);
+      batch->AddUtterance(utt, &feats);
+      if (batch->NumRows() < batch_frames && !feature_reader.Done()) {
+        continue;
+      }
+      // forward the batch, the output is written in the input order,
+      NnetForwardTask *task = new NnetForwardTask(&nnet_transf, &nnet, shared, prior,
+                                                  apply_log, time_shift, 
+                                                  batch, &feature_writer); // takes ownership of "batch".
+      if (shared) {
+        sequencer.Run(task);
+      } else {
+        (*task)();
+        delete task;
+      }
+      batch = new NnetForwardBatch(left_context, right_context);
     }
+    sequencer.Wait();
+    delete batch;
     
     // final message
     KALDI_LOG << "Done " << num_done << " files" 
@@ -19,6 +19,11 @@
 #include "nnet/nnet-nnet.h"
 #include "nnet/nnet-loss.h"
 #include "nnet/nnet-randomizer.h"
+#include "nnet/nnet-activation.h"
+#include "nnet/nnet-utils.h"
+#include "nnet/nnet-data-prefetch.h"
+#include "nnet/nnet-train-parallel.h"
+#include "nnet/nnet-profile.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "base/timer.h"
@@ -33,9 +38,19 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Perform one iteration of Neural Network training by mini-batch Stochastic Gradient Descent.\n"
         "This version use pdf-posterior as targets, prepared typically by ali-to-post.\n"
+        "With --lattice-targets-model the targets are lattices, the pdf-posteriors are computed\n"
+        "on the fly (in the reading thread with --prefetch-utts > 0). The lattices are read by\n"
+        "random access: use 'scp:' or a sorted 'ark,s,cs:' archive (the features sorted too),\n"
+        "other archives are rejected, they would be cached in memory.\n"
         "Usage:  nnet-train-frmshuff [options] <feature-rspecifier> <targets-rspecifier> <model-in> [<model-out>]\n"
         "e.g.: \n"
-        " nnet-train-frmshuff scp:feature.scp ark:posterior.ark nnet.init nnet.iter1\n";
+        " nnet-train-frmshuff scp:feature.scp ark:posterior.ark nnet.init nnet.iter1\n"
+        " nnet-train-frmshuff --lattice-targets-model=final.mdl --lattice-acoustic-scale=0.1 \\\n"
+        "   --posterior-floor=0.01 --prefetch-utts=100 scp:feature.scp scp:lat.scp nnet.init nnet.iter1\n"
+        " nnet-train-frmshuff --compact-targets=true scp:feature.scp ark:compact_post.ark nnet.init nnet.iter1\n"
+        " nnet-train-frmshuff 'pipeline:scp:feature.scp | apply-cmvn scp:cmvn.scp | add-deltas' \\\n"
+        "   ark:posterior.ark nnet.init nnet.iter1\n"
+        "(feature pipelines are documented in feat/feature-pipeline.h)\n";
 
     ParseOptions po(usage);
 
@@ -43,6 +58,12 @@ int main(int argc, char *argv[]) {
     trn_opts.Register(&po);
     NnetDataRandomizerOptions rnd_opts;
     rnd_opts.Register(&po);
+    NnetDataPrefetchOptions prefetch_opts;
+    prefetch_opts.Register(&po);
+    NnetParallelOptions parallel_opts;
+    parallel_opts.Register(&po);
+    NnetProfileOptions profile_opts;
+    profile_opts.Register(&po);
 
     bool binary = true, 
          crossvalidate = false,
@@ -56,9 +77,6 @@ int main(int argc, char *argv[]) {
     std::string objective_function = "xent";
     po.Register("objective-function", &objective_function, "Objective function : xent|mse|xentregmce");
 
-    int32 length_tolerance = 5;
-    po.Register("length-tolerance", &length_tolerance, "Allowed length difference of features/targets (frames)");
-    
     std::string frame_weights;
     po.Register("frame-weights", &frame_weights, "Per-frame weights to scale gradients (frame selection/weighting).");
 
@@ -77,6 +95,18 @@ int main(int argc, char *argv[]) {
 
     double dropout_retention = 0.0;
     po.Register("dropout-retention", &dropout_retention, "number between 0..1, saying how many neurons to preserve (0.0 will keep original value");
+
+    bool block_softmax_sparse = false;
+    po.Register("block-softmax-sparse", &block_softmax_sparse, "Group mini-batch frames by task, evaluate output <BlockSoftmax> and its <AffineTransform> only on the rows of each block");
+    int32 lattice_targets_task = 0;
+    po.Register("lattice-targets-task", &lattice_targets_task, "Multitask : the lattice targets (--lattice-targets-model) belong to this task (0-based), the starting column of the task is added to the pdf-ids");
+
+    std::string task_weighting = "none";
+    po.Register("task-weighting", &task_weighting, "Multitask : adaptive weights of the losses, re-computed in each mini-batch on top of the fixed weights, none|frames|loss|frames-loss (frames = equal weight of the tasks whatever their frame counts, loss = normalize by running average of the per-frame loss)");
+    BaseFloat task_weighting_smooth = 0.9;
+    po.Register("task-weighting-smooth", &task_weighting_smooth, "Multitask : smoothing constant of the running average of the per-frame losses (--task-weighting=loss)");
+    std::string task_learn_rate_coefs;
+    po.Register("task-learn-rate-coefs", &task_learn_rate_coefs, "Multitask : learning-rate multipliers of the output-layer rows of the tasks, colon separated list, e.g. 1.0:0.5 (the <AffineTransform> before the output softmax, or the nested networks of the output <ParallelComponent>)");
      
     
     po.Read(argc, argv);
@@ -112,6 +142,7 @@ int main(int argc, char *argv[]) {
     Nnet nnet;
     nnet.Read(model_filename);
     nnet.SetTrainOptions(trn_opts);
+    nnet.SetProfiling(profile_opts.profile);
 
     if (dropout_retention > 0.0) {
       nnet_transf.SetDropoutRetention(dropout_retention);
@@ -122,18 +153,23 @@ int main(int argc, char *argv[]) {
       nnet.SetDropoutRetention(1.0);
     }
 
-    kaldi::int64 total_frames = 0;
-
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
-    RandomAccessPosteriorReader targets_reader(targets_rspecifier);
-    RandomAccessBaseFloatVectorReader weights_reader;
-    if (frame_weights != "") {
-      weights_reader.Open(frame_weights);
+    // column offsets of the output blocks, for the sparse evaluation,
+    std::vector<int32> block_offset;
+    if (block_softmax_sparse) {
+      const Component& last = nnet.GetComponent(nnet.NumComponents()-1);
+      if (last.GetType() != Component::kBlockSoftmax) {
+        KALDI_ERR << "--block-softmax-sparse requires <BlockSoftmax> as the last component";
+      }
+      block_offset = dynamic_cast<const BlockSoftmax&>(last).block_offset;
     }
 
+    kaldi::int64 total_frames = 0;
+
     RandomizerMask randomizer_mask(rnd_opts);
     MatrixRandomizer feature_randomizer(rnd_opts);
     PosteriorRandomizer targets_randomizer(rnd_opts);
+    CompactPosteriorRandomizer compact_targets_randomizer(rnd_opts);
+    bool compact_targets = prefetch_opts.compact_targets;
     VectorRandomizer weights_randomizer(rnd_opts);
 
     Xent xent;
@@ -149,78 +185,116 @@ int main(int argc, char *argv[]) {
       // 'multitask,<type1>,<dim1>,<weight1>,...,<typeN>,<dimN>,<weightN>'
       multitask.InitFromString(objective_function);
       multitask.Set_Target_Interp(tgt_interp_mode, tgt_interp_wt);
+      multitask.SetTaskWeighting(task_weighting, task_weighting_smooth);
+    } else if (task_weighting != "none" || task_learn_rate_coefs != "" ||
+               lattice_targets_task != 0) {
+      KALDI_ERR << "--task-weighting, --task-learn-rate-coefs and --lattice-targets-task "
+                << "require the 'multitask' objective function";
+    }
+    // the lattice pdf-posteriors are moved to the columns of their task,
+    const std::vector<int32> &task_offset = multitask.LossDimOffset();
+    if (prefetch_opts.lattice_targets_model != "" && task_offset.size() > 0) {
+      if (lattice_targets_task < 0 || lattice_targets_task + 1 >= task_offset.size()) {
+        KALDI_ERR << "Invalid --lattice-targets-task " << lattice_targets_task
+                  << ", there are " << task_offset.size() - 1 << " tasks";
+      }
+      prefetch_opts.lattice_targets_offset = task_offset[lattice_targets_task];
+    }
+
+    // reads the features/targets/weights, (optionally in a background thread),
+    NnetDataPrefetcher data_reader(prefetch_opts, feature_rspecifier, 
+                                   targets_rspecifier, frame_weights, &nnet_transf);
+    if (prefetch_opts.lattice_targets_model != "" && task_offset.size() > 0) {
+      int32 task_dim = task_offset[lattice_targets_task + 1] - task_offset[lattice_targets_task];
+      if (data_reader.NumLatticePdfs() != task_dim) {
+        KALDI_ERR << "The lattice targets have " << data_reader.NumLatticePdfs()
+                  << " pdfs, the task " << lattice_targets_task << " has dim " << task_dim;
+      }
+    }
+    // per-task learning rates of the output layer, (before the training threads copy the nnet)
+    if (task_learn_rate_coefs != "") {
+      std::vector<BaseFloat> coefs;
+      if (!SplitStringToFloats(task_learn_rate_coefs, ":", false, &coefs)) {
+        KALDI_ERR << "Invalid --task-learn-rate-coefs " << task_learn_rate_coefs;
+      }
+      if (coefs.size() + 1 != multitask.LossDimOffset().size()) {
+        KALDI_ERR << "--task-learn-rate-coefs has " << coefs.size() << " values, there are "
+                  << multitask.LossDimOffset().size() - 1 << " tasks";
+      }
+      nnet.SetTaskLearnRateScale(multitask.LossDimOffset(), coefs);
+    }
+
+    // multi-threaded CPU training, (the threads evaluate copies of the objective function)
+    NnetParallelTrainer *parallel_trainer = NULL;
+    std::vector<NnetMinibatch> minibatches;
+    if (parallel_opts.num_threads > 1) {
+      LossItf *loss = NULL;
+      if (objective_function == "xent") {
+        loss = &xent;
+      } else if (objective_function == "mse") {
+        loss = &mse;
+      } else if (0 == objective_function.compare(0,9,"multitask")) {
+        loss = &multitask;
+      } else {
+        KALDI_ERR << "Multi-threaded training does not support objective function : " 
+                  << objective_function;
+      }
+      parallel_trainer = new NnetParallelTrainer(parallel_opts, crossvalidate, 
+                                                 block_softmax_sparse, &nnet, loss);
+    }
+
+    // task-stratified shuffling, the tasks are the index-ranges of multitask loss,
+    TaskRandomizerMask task_randomizer_mask;
+    if (rnd_opts.task_minibatch != "") {
+      if (0 != objective_function.compare(0,9,"multitask")) {
+        KALDI_ERR << "--task-minibatch requires the 'multitask' objective function";
+      }
+      task_randomizer_mask.Init(rnd_opts, multitask.LossDimOffset());
     }
     
-    CuMatrix<BaseFloat> feats_transf, nnet_out, obj_diff;
+    CuMatrix<BaseFloat> nnet_out, obj_diff;
+    // buffers for task-grouped mini-batches (--block-softmax-sparse),
+    CuMatrix<BaseFloat> nnet_in_grouped;
+    Posterior nnet_tgt_grouped;
+    Vector<BaseFloat> frm_weights_grouped;
+    std::vector<int32> frame_order, block_row_offset;
+    int32 num_dense_minibatches = 0;
     KALDI_LOG << "Objective Function = " << objective_function << "\n";
 
     Timer time;
+    NnetProfiler profiler(profile_opts);
+    Timer tim; // measures the stages for the profile,
     KALDI_LOG << (crossvalidate?"CROSS-VALIDATION":"TRAINING") << " STARTED";
 
-    int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
-    while (!feature_reader.Done()) {
+    int32 num_done = 0;
+    while (!data_reader.Done()) {
 #if HAVE_CUDA==1
       // check the GPU is not overheated
       CuDevice::Instantiate().CheckGpuHealth();
 #endif
       // fill the randomizer
-      for ( ; !feature_reader.Done(); feature_reader.Next()) {
+      tim.Reset();
+      for ( ; !data_reader.Done(); data_reader.Next()) {
         if (feature_randomizer.IsFull()) break; // suspend, keep utt for next loop
-        std::string utt = feature_reader.Key();
-        KALDI_VLOG(3) << "Reading " << utt;
-        // check that we have targets
-        if (!targets_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing targets";
-          num_no_tgt_mat++;
-          continue;
-        }
-        // check we have per-frame weights
-        if (frame_weights != "" && !weights_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing per-frame weights";
-          num_other_error++;
-          continue;
-        }
-        // get feature / target pair
-        Matrix<BaseFloat> mat = feature_reader.Value();
-        Posterior targets = targets_reader.Value(utt);
-        // get per-frame weights
-        Vector<BaseFloat> weights;
-        if (frame_weights != "") {
-          weights = weights_reader.Value(utt);
-        } else { // all per-frame weights are 1.0
-          weights.Resize(mat.NumRows());
-          weights.Set(1.0);
-        }
-        // correct small length mismatch ... or drop sentence
-        {
-          // add lengths to vector
-          std::vector<int32> lenght;
-          lenght.push_back(mat.NumRows());
-          lenght.push_back(targets.size());
-          lenght.push_back(weights.Dim());
-          // find min, max
-          int32 min = *std::min_element(lenght.begin(),lenght.end());
-          int32 max = *std::max_element(lenght.begin(),lenght.end());
-          // fix or drop ?
-          if (max - min < length_tolerance) {
-            if(mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
-            if(targets.size() != min) targets.resize(min);
-            if(weights.Dim() != min) weights.Resize(min, kCopyData);
-          } else {
-            KALDI_WARN << utt << ", length mismatch of targets " << targets.size()
-                       << " and features " << mat.NumRows();
-            num_other_error++;
-            continue;
-          }
-        }
-        // apply optional feature transform
-        nnet_transf.Feedforward(CuMatrix<BaseFloat>(mat), &feats_transf);
+        profiler.Accu("reader_stall", tim); // waiting for the data, (in Done())
+        tim.Reset();
+        // get the (transformed) features, targets, per-frame weights,
+        const CuMatrixBase<BaseFloat> &feats_transf = data_reader.Feats();
+        const Vector<BaseFloat> &weights = data_reader.Weights();
+        profiler.Accu("feature_transform", tim);
+        tim.Reset();
 
         // pass data to randomizers
-        KALDI_ASSERT(feats_transf.NumRows() == targets.size());
+        if (compact_targets) {
+          KALDI_ASSERT(feats_transf.NumRows() == data_reader.CompactTargets().NumFrames());
+          compact_targets_randomizer.AddData(data_reader.CompactTargets());
+        } else {
+          KALDI_ASSERT(feats_transf.NumRows() == data_reader.Targets().size());
+          targets_randomizer.AddData(data_reader.Targets());
+        }
         feature_randomizer.AddData(feats_transf);
-        targets_randomizer.AddData(targets);
         weights_randomizer.AddData(weights);
+        profiler.Accu("randomizer_fill", tim);
         num_done++;
       
         // report the speed
@@ -230,30 +304,97 @@ int main(int argc, char *argv[]) {
                         << time_now/60 << " min; processed " << total_frames/time_now
                         << " frames per second.";
         }
+        tim.Reset();
       }
 
       // randomize
       if (!crossvalidate && randomize) {
-        const std::vector<int32>& mask = randomizer_mask.Generate(feature_randomizer.NumFrames());
+        tim.Reset();
+        const std::vector<int32>& mask = (rnd_opts.task_minibatch == "" ? 
+          randomizer_mask.Generate(feature_randomizer.NumFrames()) : 
+          compact_targets ? task_randomizer_mask.Generate(compact_targets_randomizer) :
+          task_randomizer_mask.Generate(targets_randomizer));
         feature_randomizer.Randomize(mask);
-        targets_randomizer.Randomize(mask);
+        if (compact_targets) compact_targets_randomizer.Randomize(mask);
+        else targets_randomizer.Randomize(mask);
         weights_randomizer.Randomize(mask);
+        profiler.Accu("randomizer_shuffle", tim);
       }
 
       // train with data from randomizers (using mini-batches)
       for ( ; !feature_randomizer.Done(); feature_randomizer.Next(),
-                                          targets_randomizer.Next(),
+                                          (compact_targets ? compact_targets_randomizer.Next() :
+                                                             targets_randomizer.Next()),
                                           weights_randomizer.Next()) {
         // get block of feature/target pairs
-        const CuMatrixBase<BaseFloat>& nnet_in = feature_randomizer.Value();
-        const Posterior& nnet_tgt = targets_randomizer.Value();
-        const Vector<BaseFloat>& frm_weights = weights_randomizer.Value();
+        CuSubMatrix<BaseFloat> nnet_in_view(feature_randomizer.Value());
+        const CuMatrixBase<BaseFloat>* nnet_in_ptr = &nnet_in_view;
+        const Posterior* nnet_tgt_ptr = (compact_targets ? &compact_targets_randomizer.Value() :
+                                                           &targets_randomizer.Value());
+        const Vector<BaseFloat>* frm_weights_ptr = &weights_randomizer.Value();
+
+        // optionally group the frames by task (block of targets),
+        bool is_reordered = false;
+        if (block_softmax_sparse) {
+          if (GroupPosteriorByBlock(*nnet_tgt_ptr, block_offset, &frame_order, &block_row_offset)) {
+            bool is_grouped = true;
+            for (int32 t = 0; t < frame_order.size(); t++) {
+              if (frame_order[t] != t) { is_grouped = false; break; }
+            }
+            if (!is_grouped) {
+              // re-order the mini-batch, (the training threads re-order the features)
+              is_reordered = true;
+              if (parallel_trainer == NULL) {
+                nnet_in_grouped.Resize(nnet_in_ptr->NumRows(), nnet_in_ptr->NumCols(), kUndefined);
+                CuArray<int32> frame_order_gpu(frame_order);
+                cu::Randomize(*nnet_in_ptr, frame_order_gpu, &nnet_in_grouped);
+                nnet_in_ptr = &nnet_in_grouped;
+              }
+              nnet_tgt_grouped.resize(frame_order.size());
+              frm_weights_grouped.Resize(frame_order.size(), kUndefined);
+              for (int32 t = 0; t < frame_order.size(); t++) {
+                nnet_tgt_grouped[t] = (*nnet_tgt_ptr)[frame_order[t]];
+                frm_weights_grouped(t) = (*frm_weights_ptr)(frame_order[t]);
+              }
+              nnet_tgt_ptr = &nnet_tgt_grouped;
+              frm_weights_ptr = &frm_weights_grouped;
+            }
+            nnet.SetBlockSoftmaxRowOffset(block_row_offset);
+          } else {
+            // some frame has targets in several blocks, use dense evaluation,
+            block_row_offset.clear();
+            nnet.SetBlockSoftmaxRowOffset(block_row_offset);
+            num_dense_minibatches++;
+          }
+        }
+        const CuMatrixBase<BaseFloat>& nnet_in = *nnet_in_ptr;
+        const Posterior& nnet_tgt = *nnet_tgt_ptr;
+        const Vector<BaseFloat>& frm_weights = *frm_weights_ptr;
+
+        if (parallel_trainer != NULL) {
+          // keep the mini-batch, the threads train at the end of the buffer,
+          // (the features stay in the randomizer, the threads get views)
+          minibatches.resize(minibatches.size() + 1);
+          NnetMinibatch &mb = minibatches.back();
+          mb.feats_buffer = &feature_randomizer.Buffer();
+          mb.feats_offset = feature_randomizer.Offset();
+          if (is_reordered) mb.frame_order = frame_order;
+          mb.targets = nnet_tgt;
+          mb.weights = frm_weights;
+          if (block_softmax_sparse) mb.block_row_offset = block_row_offset;
+          total_frames += nnet_in.NumRows();
+          profiler.MinibatchDone(nnet_in.NumRows(), nnet);
+          continue;
+        }
 
         // forward pass
+        tim.Reset();
         nnet.Propagate(nnet_in, &nnet_out);
+        profiler.Accu("forward", tim);
 
         // evaluate objective function we've chosen
         // obj_diff contains the error matrix. For e.g., in the case of MSE or XENT, obj_diff(t,k) = y(t,k) - d(t,k)
+        tim.Reset();
         if (objective_function == "xent") {
           // gradients re-scaled by weights in Eval,
           xent.Eval(frm_weights, nnet_out, nnet_tgt, &obj_diff); 
@@ -269,11 +410,14 @@ int main(int argc, char *argv[]) {
         } else {		  
           KALDI_ERR << "Unknown objective function code : " << objective_function;
         }
+        profiler.Accu("loss", tim);
 
         // backward pass
         if (!crossvalidate) {
           // backpropagate
+          tim.Reset();
           nnet.Backpropagate(obj_diff, NULL);
+          profiler.Accu("backward", tim);
         }
 
         // 1st minibatch : show what happens in network 
@@ -298,8 +442,18 @@ int main(int argc, char *argv[]) {
         }
         
         total_frames += nnet_in.NumRows();
+        profiler.MinibatchDone(nnet_in.NumRows(), nnet);
+      }
+
+      // multi-threaded training with the mini-batches of the buffer,
+      if (parallel_trainer != NULL) {
+        tim.Reset();
+        parallel_trainer->Train(minibatches);
+        minibatches.clear();
+        profiler.Accu("parallel_train", tim);
       }
     }
+    delete parallel_trainer;
     
     // after last minibatch : show what happens in network 
     if (kaldi::g_kaldi_verbose_level >= 1) { // vlog-1
@@ -311,17 +465,41 @@ int main(int argc, char *argv[]) {
       }
     }
 
+    if (block_softmax_sparse) {
+      // store the model in the dense mode,
+      nnet.SetBlockSoftmaxRowOffset(std::vector<int32>());
+      if (num_dense_minibatches > 0) {
+        KALDI_LOG << num_dense_minibatches << " mini-batches had targets in "
+                  << "several blocks per frame, those were evaluated densely.";
+      }
+    }
+
     if (!crossvalidate) {
       nnet.Write(target_model_filename, binary);
     }
 
-    KALDI_LOG << "Done " << num_done << " files, " << num_no_tgt_mat
-              << " with no tgt_mats, " << num_other_error
+    KALDI_LOG << "Done " << num_done << " files, " << data_reader.NumNoTgtMat()
+              << " with no tgt_mats, " << data_reader.NumOtherError()
               << " with other errors. "
               << "[" << (crossvalidate?"CROSS-VALIDATION":"TRAINING")
               << ", " << (randomize?"RANDOMIZED":"NOT-RANDOMIZED") 
               << ", " << time.Elapsed()/60 << " min, fps" << total_frames/time.Elapsed()
               << "]";  
+    if (prefetch_opts.prefetch_utts > 0) {
+      KALDI_LOG << "Data prefetch: reading thread waited " << data_reader.ProducerStallTime()
+                << " sec for the training, training waited " << data_reader.ConsumerStallTime()
+                << " sec for the data.";
+    }
+    if (prefetch_opts.lattice_targets_model != "") {
+      KALDI_LOG << "Lattice targets: " << data_reader.AvgTargetsPerFrame()
+                << " pdf-posteriors per frame (--posterior-floor="
+                << prefetch_opts.posterior_floor << ")";
+    }
+    profiler.Finish(nnet);
+    if (task_randomizer_mask.NumDropped() > 0) {
+      KALDI_LOG << "Dropped " << task_randomizer_mask.NumDropped() << " surplus frames "
+                << "by the task quotas " << rnd_opts.task_minibatch;
+    }
 
     if (objective_function == "xent") {
       KALDI_LOG << xent.Report();
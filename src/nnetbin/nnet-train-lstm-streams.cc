@@ -26,6 +26,7 @@
 #include "nnet/nnet-randomizer.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "feat/feature-pipeline.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
 
@@ -127,7 +128,7 @@ int main(int argc, char *argv[]) {
 
     kaldi::int64 total_frames = 0;
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    SequentialFeatureReader feature_reader(feature_rspecifier);
     RandomAccessPosteriorReader target_reader(targets_rspecifier);
     
     /*
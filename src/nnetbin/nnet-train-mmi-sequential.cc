@@ -20,6 +20,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "feat/feature-pipeline.h"
 #include "tree/context-dep.h"
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
@@ -183,7 +184,7 @@ int main(int argc, char *argv[]) {
     TransitionModel trans_model;
     ReadKaldiObject(transition_model_filename, &trans_model);
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    SequentialFeatureReader feature_reader(feature_rspecifier);
     RandomAccessLatticeReader den_lat_reader(den_lat_rspecifier);
     RandomAccessInt32VectorReader num_ali_reader(num_ali_rspecifier);
 
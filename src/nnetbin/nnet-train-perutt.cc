@@ -19,8 +19,11 @@
 #include "nnet/nnet-nnet.h"
 #include "nnet/nnet-loss.h"
 #include "nnet/nnet-randomizer.h"
+#include "nnet/nnet-train-parallel.h"
+#include "nnet/nnet-profile.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "feat/feature-pipeline.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
 
@@ -43,6 +46,10 @@ int main(int argc, char *argv[]) {
 
     NnetTrainOptions trn_opts;
     trn_opts.Register(&po);
+    NnetParallelOptions parallel_opts;
+    parallel_opts.Register(&po);
+    NnetProfileOptions profile_opts;
+    profile_opts.Register(&po);
 
     bool binary = true, 
          crossvalidate = false;
@@ -80,6 +87,11 @@ int main(int argc, char *argv[]) {
       targets_rspecifier = po.GetArg(2),
       model_filename = po.GetArg(3);
         
+    if (objective_function != "xent" && objective_function != "mse") {
+      KALDI_ERR << "Unsupported --objective-function=" << objective_function
+                << " (nnet-train-perutt supports xent|mse)";
+    }
+
     std::string target_model_filename;
     if (!crossvalidate) {
       target_model_filename = po.GetArg(4);
@@ -102,10 +114,11 @@ int main(int argc, char *argv[]) {
     Nnet nnet;
     nnet.Read(model_filename);
     nnet.SetTrainOptions(trn_opts);
+    nnet.SetProfiling(profile_opts.profile);
 
     kaldi::int64 total_frames = 0;
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    SequentialFeatureReader feature_reader(feature_rspecifier);
     RandomAccessPosteriorReader targets_reader(targets_rspecifier);
     RandomAccessBaseFloatVectorReader weights_reader;
     if (frame_weights != "") {
@@ -122,7 +135,23 @@ int main(int argc, char *argv[]) {
     
     CuMatrix<BaseFloat> feats, feats_transf, nnet_out, obj_diff;
 
+    // multi-threaded CPU training, (the threads share the objective function)
+    NnetParallelTrainer *parallel_trainer = NULL;
+    std::vector<NnetMinibatch> minibatches;
+    if (parallel_opts.num_threads > 1) {
+      LossItf *loss = NULL;
+      if (objective_function == "xent") {
+        loss = &xent;
+      } else if (objective_function == "mse") {
+        loss = &mse;
+      }
+      parallel_trainer = new NnetParallelTrainer(parallel_opts, crossvalidate, 
+                                                 false, &nnet, loss);
+    }
+
     Timer time;
+    NnetProfiler profiler(profile_opts);
+    Timer tim; // measures the stages for the profile,
     KALDI_LOG << (crossvalidate?"CROSS-VALIDATION":"TRAINING") << " STARTED";
 
     int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
@@ -175,16 +204,44 @@ int main(int argc, char *argv[]) {
           continue;
         }
       }
+      profiler.Accu("reader_stall", tim); // reading since the last utterance,
+      tim.Reset();
       // apply optional feature transform
       nnet_transf.Feedforward(CuMatrix<BaseFloat>(mat), &feats_transf);
+      profiler.Accu("feature_transform", tim);
  
       // get block of feature/target pairs
       //const Vector<BaseFloat>& frm_weights = weights_randomizer.Value();
 
+      if (parallel_trainer != NULL) {
+        // keep the utterance, the threads train when each has a full share,
+        // (the features are moved into the mini-batch, not copied)
+        int32 num_frames = feats_transf.NumRows();
+        minibatches.resize(minibatches.size() + 1);
+        NnetMinibatch &mb = minibatches.back();
+        mb.feats.Swap(&feats_transf);
+        mb.targets = targets;
+        mb.weights = weights;
+        if (minibatches.size() == parallel_opts.num_threads * parallel_opts.sync_minibatches) {
+          tim.Reset();
+          parallel_trainer->Train(minibatches);
+          minibatches.clear();
+          profiler.Accu("parallel_train", tim);
+        }
+        num_done++;
+        total_frames += num_frames;
+        profiler.MinibatchDone(num_frames, nnet);
+        tim.Reset();
+        continue;
+      }
+
       // forward pass
+      tim.Reset();
       nnet.Propagate(feats_transf, &nnet_out);
+      profiler.Accu("forward", tim);
 
       // evaluate objective function we've chosen
+      tim.Reset();
       if (objective_function == "xent") {
         // gradients re-scaled by weights in Eval,
         xent.Eval(weights, nnet_out, targets, &obj_diff);
@@ -194,11 +251,14 @@ int main(int argc, char *argv[]) {
       } else {
         KALDI_ERR << "Unknown objective function code : " << objective_function;
       }
+      profiler.Accu("loss", tim);
 
       // backward pass
       if (!crossvalidate) {
         // backpropagate
+        tim.Reset();
         nnet.Backpropagate(obj_diff, NULL);
+        profiler.Accu("backward", tim);
       }
 
       // 1st minibatch : show what happens in network 
@@ -235,8 +295,18 @@ int main(int argc, char *argv[]) {
         CuDevice::Instantiate().CheckGpuHealth();
 #endif
       }
+      profiler.MinibatchDone(feats_transf.NumRows(), nnet);
+      tim.Reset();
     }
       
+    if (parallel_trainer != NULL) {
+      tim.Reset();
+      parallel_trainer->Train(minibatches); // the rest,
+      minibatches.clear();
+      profiler.Accu("parallel_train", tim);
+      delete parallel_trainer;
+    }
+
     // after last minibatch : show what happens in network 
     if (kaldi::g_kaldi_verbose_level >= 1) { // vlog-1
       KALDI_VLOG(1) << "### After " << total_frames << " frames,";
@@ -258,6 +328,7 @@ int main(int argc, char *argv[]) {
               << ", " << (randomize?"RANDOMIZED":"NOT-RANDOMIZED") 
               << ", " << time.Elapsed()/60 << " min, fps" << total_frames/time.Elapsed()
               << "]";  
+    profiler.Finish(nnet);
 
     if (objective_function == "xent") {
       KALDI_LOG << xent.Report();
@@ -0,0 +1,320 @@
+// nnetbin/nnet1-latgen-faster-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/feature-pipeline.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-matrix.h"
+#include "nnet/nnet-nnet.h"
+#include "nnet/nnet-pdf-prior.h"
+#include "nnet/nnet-decodable.h"
+#include "base/timer.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// The acoustic model of the decoding task, takes ownership of 'feats'.
+/// With 'shared' the network is evaluated lazily in the decoding thread,
+/// otherwise the whole utterance is forwarded here (in the reading thread,
+/// which owns the GPU and the networks with state in the forward pass).
+/// With 'output_layer' (shared only) the 'nnet' is without the output layer.
+DecodableInterface* NnetDecodable(const TransitionModel &trans_model, Nnet *nnet,
+                                  bool shared, const PdfPrior *pdf_prior,
+                                  const DecodableNnetOutputLayer *output_layer,
+                                  const DecodableNnetOptions &opts,
+                                  const Matrix<BaseFloat> *feats) {
+  if (shared) {
+    return new DecodableNnetScaledMapped(trans_model, *nnet, pdf_prior, opts,
+                                         feats, output_layer);
+  }
+  CuMatrix<BaseFloat> nnet_out;
+  nnet->Feedforward(CuMatrix<BaseFloat>(*feats), &nnet_out);
+  delete feats;
+  // convert posteriors to log-posteriors,
+  if (!opts.no_softmax) {
+    nnet_out.Add(1e-20); // avoid log(0),
+    nnet_out.ApplyLog();
+  }
+  // subtract log-priors from log-posteriors or pre-softmax,
+  if (pdf_prior != NULL) {
+    pdf_prior->SubtractOnLogpost(&nnet_out);
+  }
+  Matrix<BaseFloat> *loglikes = new Matrix<BaseFloat>(nnet_out);
+  return new DecodableMatrixScaledMapped(trans_model, opts.acoustic_scale, loglikes);
+}
+
+} // namespace nnet1
+} // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet1;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices with nnet1 hybrid model, using multiple decoding threads.\n"
+        "The network is evaluated in the decoding threads (no log-likelihood archive),\n"
+        "it replaces the pipeline 'nnet-forward | latgen-faster-mapped-parallel'.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage: nnet1-latgen-faster-parallel [options] <nnet-in> <trans-model-in> "
+        "(fst-in|fsts-rspecifier) <feature-rspecifier> <lattice-wspecifier> "
+        "[ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "e.g.: \n"
+        " nnet1-latgen-faster-parallel --num-threads=4 --feature-transform=final.feature_transform \\\n"
+        "   --class-frame-counts=ali_train_pdf.counts final.nnet final.mdl HCLG.fst \\\n"
+        "   scp:feats.scp 'ark:|gzip -c >lat.1.gz'\n"
+        "With --lazy-output-layer the output layer is evaluated only for the pdfs\n"
+        "of the active tokens (useful for large output layers).\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    LatticeFasterDecoderConfig config;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    DecodableNnetOptions decodable_opts; // has --acoustic-scale option
+    PdfPriorOptions prior_opts;
+
+    std::string word_syms_filename, feature_transform, use_gpu = "no";
+    config.Register(&po);
+    sequencer_config.Register(&po);
+    decodable_opts.Register(&po);
+    prior_opts.Register(&po);
+
+    po.Register("feature-transform", &feature_transform, "Feature transform in front of main network (in nnet format)");
+    po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA, the network is evaluated in the main thread");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_filename = po.GetArg(1),
+        model_in_filename = po.GetArg(2),
+        fst_in_str = po.GetArg(3),
+        feature_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    //Select the GPU
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    // the feature transform and the network in one,
+    Nnet nnet;
+    if (feature_transform != "") {
+      nnet.Read(feature_transform);
+    }
+    {
+      Nnet nnet_main;
+      nnet_main.Read(nnet_filename);
+      nnet.AppendNnet(nnet_main);
+    }
+    // optionally remove softmax,
+    Component::ComponentType last_type = nnet.GetComponent(nnet.NumComponents()-1).GetType();
+    if (decodable_opts.no_softmax) {
+      if (last_type == Component::kSoftmax || last_type == Component::kBlockSoftmax) {
+        KALDI_LOG << "Removing " << Component::TypeToMarker(last_type) << " from the nnet " << nnet_filename;
+        nnet.RemoveComponent(nnet.NumComponents()-1);
+      } else {
+        KALDI_WARN << "Cannot remove softmax using --no-softmax=true, as the last component is " << Component::TypeToMarker(last_type);
+      }
+    }
+    // disable dropout,
+    nnet.SetDropoutRetention(1.0);
+
+    // we will subtract log-priors,
+    PdfPrior pdf_prior(prior_opts);
+    const PdfPrior *prior = (prior_opts.class_frame_counts != "" ? &pdf_prior : NULL);
+
+    // the network is shared by the decoding threads, (CPU only)
+    bool shared = nnet.IsFeedforwardThreadSafe();
+#if HAVE_CUDA==1
+    if (CuDevice::Instantiate().Enabled()) shared = false;
+#endif
+    if (!shared) {
+      KALDI_LOG << "The network is evaluated in the main thread (GPU, or components "
+                << "with state in the forward pass), the decoding in "
+                << sequencer_config.num_threads << " threads";
+    }
+
+    // optionally evaluate the output layer lazily, the pdfs of the active tokens,
+    DecodableNnetOutputLayer *output_layer = NULL;
+    if (decodable_opts.lazy_output_layer) {
+      const Component &last = nnet.GetComponent(nnet.NumComponents()-1);
+      if (!decodable_opts.no_softmax) {
+        KALDI_ERR << "--lazy-output-layer requires --no-softmax=true, (the softmax "
+                  << "normalizer needs the whole output layer)";
+      } else if (!shared) {
+        KALDI_WARN << "Ignoring --lazy-output-layer, the network is not evaluated "
+                   << "in the decoding threads";
+      } else if (last.GetType() != Component::kAffineTransform) {
+        KALDI_WARN << "Ignoring --lazy-output-layer, the output layer is "
+                   << Component::TypeToMarker(last.GetType());
+      } else {
+        output_layer = new DecodableNnetOutputLayer(
+            dynamic_cast<const AffineTransform&>(last), prior);
+        nnet.RemoveLastComponent();
+        KALDI_LOG << "The output layer (" << output_layer->NumPdfs() 
+                  << " pdfs) is evaluated lazily";
+      }
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+    VectorFst<StdArc> *decode_fst = NULL; // only used if there is a single
+                                          // decoding graph.
+
+    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
+    if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
+      SequentialFeatureReader feature_reader(feature_rspecifier);
+      // Input FST is just one FST, not a table of FSTs.
+      decode_fst = fst::ReadFstKaldi(fst_in_str);
+
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        Matrix<BaseFloat> *feats = new Matrix<BaseFloat>(feature_reader.Value());
+        feature_reader.FreeCurrent();
+        if (feats->NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          delete feats;
+          continue;
+        }
+        if (!KALDI_ISFINITE(feats->Sum())) { // check there's no nan/inf,
+          KALDI_ERR << "NaN or inf found in features for " << utt;
+        }
+
+        LatticeFasterDecoder *decoder = new LatticeFasterDecoder(*decode_fst,
+                                                                 config);
+        DecodableInterface *decodable = NnetDecodable(trans_model, &nnet, shared, prior,
+                                                      output_layer, decodable_opts, feats);
+        DecodeUtteranceLatticeFasterClass *task =
+            new DecodeUtteranceLatticeFasterClass(
+                decoder, decodable, trans_model, word_syms, utt,
+                decodable_opts.acoustic_scale, determinize, allow_partial,
+                &alignment_writer, &words_writer, &compact_lattice_writer,
+                &lattice_writer, &tot_like, &frame_count, &num_success,
+                &num_fail, NULL);
+
+        sequencer.Run(task); // takes ownership of "task",
+        // and will delete it when done.
+      }
+    } else { // We have different FSTs for different utterances.
+      SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
+      RandomAccessBaseFloatMatrixReader feature_reader(feature_rspecifier);
+      for (; !fst_reader.Done(); fst_reader.Next()) {
+        std::string utt = fst_reader.Key();
+        if (!feature_reader.HasKey(utt)) {
+          KALDI_WARN << "Not decoding utterance " << utt
+                     << " because no features available.";
+          num_fail++;
+          continue;
+        }
+        const Matrix<BaseFloat> *feats =
+          new Matrix<BaseFloat>(feature_reader.Value(utt));
+        if (feats->NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          delete feats;
+          continue;
+        }
+        if (!KALDI_ISFINITE(feats->Sum())) { // check there's no nan/inf,
+          KALDI_ERR << "NaN or inf found in features for " << utt;
+        }
+        // the decoder owns a copy of the FST, the reader frees its FST
+        // on Next() while the task may be still decoding,
+        LatticeFasterDecoder *decoder =
+          new LatticeFasterDecoder(config, new VectorFst<StdArc>(fst_reader.Value()));
+        DecodableInterface *decodable = NnetDecodable(trans_model, &nnet, shared, prior,
+                                                      output_layer, decodable_opts, feats);
+        DecodeUtteranceLatticeFasterClass *task =
+            new DecodeUtteranceLatticeFasterClass(
+                decoder, decodable, trans_model, word_syms, utt,
+                decodable_opts.acoustic_scale, determinize, allow_partial,
+                &alignment_writer, &words_writer, &compact_lattice_writer,
+                &lattice_writer, &tot_like, &frame_count, &num_success,
+                &num_fail, NULL);
+        sequencer.Run(task); // takes ownership of "task",
+        // and will delete it when done.
+      }
+    }
+    sequencer.Wait();
+
+    if (decode_fst != NULL) delete decode_fst;
+    delete output_layer;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Decoded with " << sequencer_config.num_threads << " threads.";
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor per thread assuming 100 frames/sec is "
+              << (sequencer_config.num_threads*elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+#if HAVE_CUDA==1
+    if (kaldi::g_kaldi_verbose_level >= 1) {
+      CuDevice::Instantiate().PrintProfile();
+    }
+#endif
+
+    if (word_syms) delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -44,6 +44,10 @@ int main(int argc, char *argv[]) {
         "With '--allow-partial=true' an utterance-key is not required to be\n"
         "present in all of the input streams.\n"
         "\n"
+        "With '--compact-bits=8|16' the output is in the compact format (weights\n"
+        "quantized to 8|16 bits, frames tagged by stream), read by nnet-train-frmshuff\n"
+        "with '--compact-targets=true'. The weights must be in the range [0, 1].\n"
+        "\n"
         "The lengths of utterances are provided as 1st argument.\n"
         "The dimensions of input stream are set as 2nd in argument.\n"
         "The following arguments are the input and output streams in 'posterior' format.\n"
@@ -58,6 +62,11 @@ int main(int argc, char *argv[]) {
     po.Register("allow-partial", &allow_partial, 
                 "Produce output also when the utterance is not in all input streams.");
 
+    int32 compact_bits = 0;
+    po.Register("compact-bits", &compact_bits,
+                "Write the compact posteriors with weights quantized to 8|16 bits "
+                "(0 = the Posterior format).");
+
     po.Read(argc, argv);
 
     if (po.NumArgs() < 5) {
@@ -94,7 +103,15 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0, num_empty = 0;
     SequentialInt32Reader featlen_reader(featlen_rspecifier);
-    PosteriorWriter posterior_writer(post_wspecifier);
+    PosteriorWriter posterior_writer;
+    CompactPosteriorWriter compact_posterior_writer;
+    if (compact_bits == 0) {
+      posterior_writer.Open(post_wspecifier);
+    } else if (compact_bits == 8 || compact_bits == 16) {
+      compact_posterior_writer.Open(post_wspecifier);
+    } else {
+      KALDI_ERR << "Invalid --compact-bits " << compact_bits;
+    }
 
     // main loop, posterior pasting happens here,
     for (; !featlen_reader.Done(); featlen_reader.Next()) {
@@ -146,7 +163,12 @@ int main(int argc, char *argv[]) {
         num_empty++;
         continue;
       }
-      if (ok) {
+      if (ok && compact_bits != 0) {
+        // the frames are tagged by the stream of their 1st target,
+        compact_posterior_writer.Write(featlen_reader.Key(),
+                                       CompactPosterior(post, compact_bits, &stream_offset));
+        num_done++;
+      } else if (ok) {
         posterior_writer.Write(featlen_reader.Key(), post);
         num_done++;
       } else {
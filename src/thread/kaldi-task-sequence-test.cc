@@ -66,11 +66,36 @@ void TestTaskSequencer() {
     KALDI_ASSERT(task_output[i] == i);
 }
 
+// Wait() in the middle, then more tasks on the same threads.
+void TestTaskSequencerWait() {
+  TaskSequencerConfig config;
+  config.num_threads = 1 + Rand() % 8;
+  config.num_threads_total = config.num_threads + Rand() % 4;
+
+  std::vector<int32> task_output;
+  TaskSequencer<MyTaskClass> sequencer(config);
+  int32 num_tasks = 0;
+  for (int32 n = 0; n < 3; n++) {
+    int32 num_new = Rand() % 50;
+    for (int32 i = 0; i < num_new; i++)
+      sequencer.Run(new MyTaskClass(num_tasks++, &task_output));
+    sequencer.Wait();
+    KALDI_ASSERT(task_output.size() == static_cast<size_t>(num_tasks));
+    KALDI_ASSERT(sequencer.QueueDepth() == 0);
+  }
+  for (size_t i = 0; i < task_output.size(); i++)
+    KALDI_ASSERT(task_output[i] == static_cast<int32>(i));
+  KALDI_ASSERT(sequencer.MaxQueueDepth() <= config.num_threads_total);
+  KALDI_ASSERT(sequencer.IdleTime() >= 0.0 && sequencer.WaitTime() >= 0.0);
+}
+
 }  // end namespace kaldi.
 
 int main() {
   using namespace kaldi;
   for (int32 i = 0; i < 1000; i++)
     TestTaskSequencer();
+  for (int32 i = 0; i < 100; i++)
+    TestTaskSequencerWait();
 }
 
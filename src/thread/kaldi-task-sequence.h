@@ -21,6 +21,10 @@
 #define KALDI_THREAD_KALDI_TASK_SEQUENCE_H_ 1
 
 #include <pthread.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "base/timer.h"
 #include "thread/kaldi-thread.h"
 #include "itf/options-itf.h"
 #include "thread/kaldi-semaphore.h"
@@ -45,13 +49,16 @@ namespace kaldi {
    something (typically the constructor just sets variables, and the destructor
    does some kind of output).  We have a templated class TaskSequencer<C> which
    is responsible for running the jobs in parallel.  It has a function Run()
-   that will accept a new object of class C; this will block until a thread is
-   free, at which time it will spawn a thread that starts running the operator
-   () of the class.  When classes are finished running, the objects will be
-   deleted.  Class TaskSequencer guarantees that the destructors will be called
-   sequentially (not in parallel) and in the same order the objects were given
-   to the Run() function, so that it is safe for the destructor to have side
-   effects such as outputting data.
+   that will accept a new object of class C and put it in a queue; a fixed
+   pool of --num-threads worker threads, created on the first call and kept
+   until the TaskSequencer is destroyed, takes the objects from the queue and
+   runs their operator ().  When classes are finished running, the objects will
+   be deleted.  Class TaskSequencer guarantees that the destructors will be
+   called sequentially (not in parallel) and in the same order the objects were
+   given to the Run() function, so that it is safe for the destructor to have
+   side effects such as outputting data.  Run() blocks if there are already
+   --num-threads-total objects alive (queued, running, or finished and waiting
+   for the output of the earlier ones), this bounds the memory use.
 
    Note: the destructor of TaskSequencer will wait for any remaining jobs that
    are still running and will call the destructors.   
@@ -65,131 +72,205 @@ struct TaskSequencerConfig {
     po->Register("num-threads", &num_threads, "Number of actively processing "
                  "threads to run in parallel");
     po->Register("num-threads-total", &num_threads_total, "Total number of "
-                 "threads, including those that are waiting on other threads "
-                 "to produce their output.  Controls memory use.  If <= 0, "
+                 "tasks, including those that are queued or waiting on other "
+                 "tasks to produce their output.  Controls memory use.  If <= 0, "
                  "defaults to --num-threads plus 20.  Otherwise, must "
                  "be >= num-threads.");
   }
 };
 
-// C should have an operator () taking no arguments, that does some kind
-// of computation, and a destructor that produces some kind of output (the
-// destructors will be run sequentially in the same order Run as called.
 template<class C>
 class TaskSequencer {
  public:
   TaskSequencer(const TaskSequencerConfig &config):
-      threads_avail_(config.num_threads),
-      tot_threads_avail_(config.num_threads_total > 0 ? config.num_threads_total :
-                         config.num_threads + 20),
-      thread_list_(NULL) {
+      num_threads_(config.num_threads),
+      tasks_avail_(config.num_threads_total > 0 ? config.num_threads_total :
+                   config.num_threads + 20),
+      draining_(false), shutdown_(false), num_tasks_(0), max_queue_depth_(0),
+      idle_time_(0.0), wait_time_(0.0) {
     KALDI_ASSERT((config.num_threads_total <= 0 ||
                   config.num_threads_total >= config.num_threads) &&
                  "num-threads-total, if specified, must be >= num-threads");
+    KALDI_ASSERT(num_threads_ > 0);
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&work_cond_, NULL);
+    pthread_cond_init(&done_cond_, NULL);
   }
 
   /// This function takes ownership of the pointer "c", and will delete it
   /// in the same sequence as Run was called on the jobs.
   void Run(C *c) {
-    threads_avail_.Wait(); // wait till we have a thread for computation free.
-    tot_threads_avail_.Wait(); // this ensures we don't have too many threads
+    Timer timer;
+    tasks_avail_.Wait(); // this ensures we don't have too many tasks
     // waiting on I/O, and consume too much memory.
-    
-    // put the new RunTaskArgsList object at head of the singly
-    // linked list thread_list_.
-    thread_list_ = new RunTaskArgsList(this, c, thread_list_);
-    int32 ret;
-    if ((ret=pthread_create(&(thread_list_->thread),
-                            NULL, // default attributes
-                            TaskSequencer<C>::RunTask,
-                            static_cast<void*>(thread_list_)))) {
-      const char *c = strerror(ret);
-      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
-    }
+    double wait_time = timer.Elapsed();
+    if (threads_.empty()) StartThreads();
+
+    Task *task = new Task(c);
+    pthread_mutex_lock(&mutex_);
+    wait_time_ += wait_time;
+    num_tasks_++;
+    pending_.push_back(task);
+    queue_.push_back(task);
+    max_queue_depth_ = std::max(max_queue_depth_,
+                                static_cast<int32>(queue_.size()));
+    pthread_cond_signal(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
   }
 
   void Wait() { // You call this at the end if it's more convenient
-    // than waiting for the destructor.  It waits for all tasks to finish.
-    if (thread_list_ != NULL) {
-      int ret = pthread_join(thread_list_->thread, NULL);
+    // than waiting for the destructor.  It waits for all tasks to finish,
+    // the threads are kept for further calls to Run().
+    pthread_mutex_lock(&mutex_);
+    while (!pending_.empty() || draining_)
+      pthread_cond_wait(&done_cond_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /// The number of tasks waiting for a free thread.
+  int32 QueueDepth() {
+    pthread_mutex_lock(&mutex_);
+    int32 ans = queue_.size();
+    pthread_mutex_unlock(&mutex_);
+    return ans;
+  }
+
+  /// The largest queue depth so far; if it stays near zero, the reading
+  /// of the input is the bottleneck, not the computation.
+  int32 MaxQueueDepth() {
+    pthread_mutex_lock(&mutex_);
+    int32 ans = max_queue_depth_;
+    pthread_mutex_unlock(&mutex_);
+    return ans;
+  }
+
+  /// The total time (in seconds, summed over the threads) the threads
+  /// spent waiting for tasks.
+  double IdleTime() {
+    pthread_mutex_lock(&mutex_);
+    double ans = idle_time_;
+    pthread_mutex_unlock(&mutex_);
+    return ans;
+  }
+
+  /// The total time (in seconds) Run() was blocked because too many
+  /// tasks were alive (see --num-threads-total).
+  double WaitTime() {
+    pthread_mutex_lock(&mutex_);
+    double ans = wait_time_;
+    pthread_mutex_unlock(&mutex_);
+    return ans;
+  }
+  
+  /// The destructor waits for the last task and stops the threads.
+  ~TaskSequencer() {
+    Wait();
+    pthread_mutex_lock(&mutex_);
+    shutdown_ = true;
+    pthread_cond_broadcast(&work_cond_);
+    pthread_mutex_unlock(&mutex_);
+    for (size_t i = 0; i < threads_.size(); i++) {
+      int ret = pthread_join(threads_[i], NULL);
       if (ret != 0) {
         const char *c = strerror(ret);
-        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
+        KALDI_WARN << "Error joining thread, errno was: " << (c ? c : "[NULL]");
       }
-      KALDI_ASSERT(thread_list_->tail == NULL); // thread would not
-      // have exited without setting tail to NULL.
-      delete thread_list_;
-      thread_list_ = NULL;
     }
-  }
-  
-  /// The destructor waits for the last thread to exit.
-  ~TaskSequencer() {
-    Wait();      
+    if (num_tasks_ > 0)
+      KALDI_VLOG(1) << "TaskSequencer: " << num_tasks_ << " tasks on "
+                    << threads_.size() << " threads, max queue depth "
+                    << max_queue_depth_ << ", threads idle for " << idle_time_
+                    << " sec, Run() blocked for " << wait_time_ << " sec.";
+    pthread_cond_destroy(&done_cond_);
+    pthread_cond_destroy(&work_cond_);
+    pthread_mutex_destroy(&mutex_);
   }
  private:
-  struct RunTaskArgsList {
-    TaskSequencer *me; // Think of this as a "this" pointer.
-    C *c; // Clist element of the task we're expected
-    pthread_t thread;
-    RunTaskArgsList *tail;
-    RunTaskArgsList(TaskSequencer *me, C *c, RunTaskArgsList *tail):
-        me(me), c(c), tail(tail) {}
+  struct Task {
+    C *c;
+    bool done; // operator () has finished.
+    explicit Task(C *c): c(c), done(false) { }
   };
-  // This static function gets run in the threads that we create.
-  static void* RunTask(void *input) {
-    RunTaskArgsList *args = static_cast<RunTaskArgsList*>(input);
-    
-    // (1) run the job.
-    (*(args->c))(); // call operator () on args->c, which does the computation.
-    args->me->threads_avail_.Signal(); // Signal that the compute-intensive
-    // part of the thread is done (we want to run no more than
-    // config_.num_threads of these.)
-    
-    // (2) we want to destroy the object "c" now, by deleting it.  But for
-    //     correct sequencing (this is the whole point of this class, it
-    //     is intended to ensure the output of the program is in correct order),
-    //     we first wait till the previous thread, whose details will be in "tail",
-    //     is finished.
-    if (args->tail != NULL) {
-      int ret = pthread_join(args->tail->thread, NULL);
-      if (ret != 0) {
+
+  void StartThreads() {
+    threads_.resize(num_threads_);
+    for (int32 i = 0; i < num_threads_; i++) {
+      int32 ret;
+      if ((ret=pthread_create(&(threads_[i]),
+                              NULL, // default attributes
+                              TaskSequencer<C>::RunThread,
+                              static_cast<void*>(this)))) {
         const char *c = strerror(ret);
-        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
+        KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
       }
     }
+  }
 
-    delete args->c; // delete the object "c".  This may cause some output,
-    // e.g. to a stream.  We don't need to worry about concurrent access to
-    // the output stream, because each thread waits for the previous thread
-    // to be done, before doing this.  So there is no risk of concurrent
-    // access.
-    args->c = NULL;
-    
-    if (args->tail != NULL) {
-      KALDI_ASSERT(args->tail->tail == NULL); // Because we already
-      // did pthread_join on args->tail->thread, which means that
-      // thread was done, and before it exited, it would have
-      // deleted and set to NULL its tail (which is the next line of code).
-      delete args->tail;
-      args->tail = NULL;
+  // This static function gets run in the threads that we create.
+  static void* RunThread(void *input) {
+    TaskSequencer *me = static_cast<TaskSequencer*>(input);
+    Timer timer;
+    pthread_mutex_lock(&me->mutex_);
+    while (true) {
+      timer.Reset();
+      while (me->queue_.empty() && !me->shutdown_)
+        pthread_cond_wait(&me->work_cond_, &me->mutex_);
+      if (me->queue_.empty()) break;  // shutdown,
+      me->idle_time_ += timer.Elapsed();
+      Task *task = me->queue_.front();
+      me->queue_.pop_front();
+      pthread_mutex_unlock(&me->mutex_);
+
+      // (1) run the job.
+      (*(task->c))(); // call operator () on task->c, which does the computation.
+
+      // (2) we want to destroy the finished objects in the order of Run(),
+      //     the thread which finds the oldest object done deletes the objects
+      //     until it reaches one that is not done; the others just mark their
+      //     object as done.  The flag 'draining_' makes sure there is a
+      //     single thread deleting, so there is no concurrent access to the
+      //     output streams.
+      pthread_mutex_lock(&me->mutex_);
+      task->done = true;
+      if (!me->draining_) {
+        me->draining_ = true;
+        while (!me->pending_.empty() && me->pending_.front()->done) {
+          Task *oldest = me->pending_.front();
+          me->pending_.pop_front();
+          pthread_mutex_unlock(&me->mutex_);
+          delete oldest->c; // delete the object "c".  This may cause some
+          // output, e.g. to a stream.
+          delete oldest;
+          me->tasks_avail_.Signal();
+          pthread_mutex_lock(&me->mutex_);
+        }
+        me->draining_ = false;
+        if (me->pending_.empty())
+          pthread_cond_broadcast(&me->done_cond_);
+      }
     }
-    // At this point we are exiting from the thread.  Signal the
-    // "tot_threads_avail_" semaphore which is used to limit the total number of threads that are alive, including
-    // not onlhy those that are in active computation in c->operator (), but those
-    // that are waiting on I/O or other threads.
-    args->me->tot_threads_avail_.Signal();
-    // .. and exit the thread, by returning. 
+    pthread_mutex_unlock(&me->mutex_);
     return NULL;
   }
 
-  Semaphore threads_avail_; // Initialized to the number of threads we are
-  // supposed to run with; the function Run() waits on this.
+  int32 num_threads_;
+  std::vector<pthread_t> threads_;
 
-  Semaphore tot_threads_avail_; // We use this semaphore to ensure we don't
-  // consume too much memory...
-  RunTaskArgsList *thread_list_; 
-  
+  Semaphore tasks_avail_; // Initialized to the number of tasks we can have
+  // alive; the function Run() waits on this, so we don't consume too much
+  // memory...
+
+  pthread_mutex_t mutex_; // guards the members below,
+  pthread_cond_t work_cond_; // signaled when a task is queued (or shutdown),
+  pthread_cond_t done_cond_; // signaled when all the tasks are deleted.
+  std::deque<Task*> queue_; // the tasks waiting for a thread,
+  std::deque<Task*> pending_; // all the tasks alive, in the order of Run(),
+  bool draining_; // a thread is deleting the finished tasks,
+  bool shutdown_;
+
+  int64 num_tasks_;
+  int32 max_queue_depth_;
+  double idle_time_, wait_time_;
 };
 
 } // namespace kaldi
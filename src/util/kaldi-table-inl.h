@@ -24,6 +24,7 @@
 
 #include <algorithm>
 #include "util/kaldi-io.h"
+#include "util/mapped-archive.h"
 #include "util/text-utils.h"
 #include "util/stl-utils.h" // for StringHasher.
 
@@ -2080,6 +2081,156 @@ template<class Holder>  class RandomAccessTableReaderUnsortedArchiveImpl:
 
 
 
+// RandomAccessTableReaderMmapArchiveImpl is used for the "mmap" option, for
+// archives of binary objects on local files.  The archive is memory-mapped and
+// indexed by key (see class MappedArchive), so HasKey() is a binary search and
+// Value() parses just the object asked for, straight from the mapping; only
+// the last object read is kept in memory.  The index is built by scanning the
+// archive once, and cached in "<archive>.idx" for later programs; the archive
+// need not be sorted.
+template<class Holder>  class RandomAccessTableReaderMmapArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderMmapArchiveImpl(): holder_(NULL), error_(false) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (archive_.IsOpen()) {
+      if (!Close())  // call Close() yourself to suppress this exception.
+        KALDI_ERR << "TableReader::Open, error closing previous input.";
+    }
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier &&
+                 ClassifyRxfilename(archive_rxfilename_) == kFileInput);
+    if (!archive_.Open(archive_rxfilename_)) {
+      KALDI_WARN << "TableReader: failed to open stream "
+                 << PrintableRxfilename(archive_rxfilename_);
+      return false;
+    }
+    if (!archive_.ReadIndex()) {
+      BuildIndex();
+      std::string duplicate;
+      if (!archive_.SortIndex(&duplicate))
+        KALDI_ERR << "Error in RandomAccessTableReader: duplicate key "
+                  << duplicate << " in archive " << archive_rxfilename_;
+      // Only written if the archive could be read to the end; failing to
+      // write it (e.g. read-only directory) is not an error.
+      if (!error_ && !archive_.WriteIndex())
+        KALDI_VLOG(1) << "Could not write the index of archive "
+                      << archive_rxfilename_;
+    }
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    size_t begin, end;
+    return archive_.Find(key, &begin, &end);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (holder_ != NULL && cur_key_ == key)
+      return holder_->Value();
+    size_t begin, end;
+    if (!archive_.Find(key, &begin, &end))
+      KALDI_ERR << "Value() called but no such key " << key
+                << " in archive " << PrintableRxfilename(archive_rxfilename_);
+    delete holder_;
+    holder_ = NULL;
+    MemoryStreambuf buf(archive_.Data() + begin, end - begin);
+    std::istream is(&buf);
+    if (is.peek() != '\n') is.get();  // Consume the space or tab.
+    Holder *holder = new Holder;
+    if (!holder->Read(is)) {
+      delete holder;
+      KALDI_ERR << "Object read failed, reading key " << key << " of archive "
+                << PrintableRxfilename(archive_rxfilename_);
+    }
+    holder_ = holder;
+    cur_key_ = key;
+    return holder_->Value();
+  }
+
+  virtual bool Close() {
+    if (!archive_.IsOpen())
+      KALDI_ERR << "Close() called on TableReader twice or otherwise wrongly.";
+    archive_.Close();
+    delete holder_;
+    holder_ = NULL;
+    bool ans = !error_;
+    error_ = false;
+    if (!ans && opts_.permissive) {
+      KALDI_WARN << "Error state detected closing reader.  "
+                 << "Ignoring it because you specified permissive mode.";
+      return true;
+    }
+    return ans;
+  }
+
+  virtual ~RandomAccessTableReaderMmapArchiveImpl() {
+    if (archive_.IsOpen())
+      if (!Close())  // more specific warning will already have been printed.
+        KALDI_ERR << "Error closing RandomAccessTableReader: rspecifier is "
+                  << rspecifier_;
+  }
+
+ private:
+  // Reads through the archive (as ReadNextObject() of the archive readers
+  // does) and adds every object to the index of archive_.  On a read error it
+  // sets error_ and the index has the objects before the error.
+  void BuildIndex() {
+    MemoryStreambuf buf(archive_.Data(), archive_.Size());
+    std::istream is(&buf);
+    std::string key;
+    while (true) {
+      is >> key;
+      if (is.eof()) break;
+      if (is.fail()) {
+        KALDI_WARN << "Error reading archive: rspecifier is " << rspecifier_;
+        error_ = true;
+        break;
+      }
+      size_t begin = static_cast<size_t>(is.tellg());
+      int c = is.peek();
+      if (c != ' ' && c != '\t' && c != '\n') {
+        KALDI_WARN << "Invalid archive file format: expected space after key "
+                   << key << ", got character "
+                   << CharToString(static_cast<char>(c))
+                   << ", reading archive "
+                   << PrintableRxfilename(archive_rxfilename_);
+        error_ = true;
+        break;
+      }
+      if (c != '\n') is.get();  // Consume the space or tab.
+      Holder holder;
+      if (!holder.Read(is)) {
+        KALDI_WARN << "Object read failed, reading archive "
+                   << PrintableRxfilename(archive_rxfilename_);
+        error_ = true;
+        break;
+      }
+      is.clear();  // (a Read() at the end of the archive may set eof).
+      archive_.AddEntry(key, begin, static_cast<size_t>(is.tellg()));
+    }
+    KALDI_VLOG(1) << "Indexed " << archive_.NumEntries() << " objects in archive "
+                  << archive_rxfilename_;
+  }
+
+  MappedArchive archive_;
+  Holder *holder_;  // the object of cur_key_ (the last Value()), or NULL.
+  std::string cur_key_;
+  bool error_;  // true if the archive could not be read to the end.
+
+  std::string rspecifier_;
+  std::string archive_rxfilename_;
+  RspecifierOptions opts_;
+};
+
+
+
+
 template<class Holder>
 RandomAccessTableReader<Holder>::RandomAccessTableReader(const std::string &rspecifier):
     impl_(NULL) {
@@ -2099,6 +2250,17 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
+      if (opts.mmap) {
+        std::string rxfilename;
+        ClassifyRspecifier(rspecifier, &rxfilename, NULL);
+        if (Holder::IsReadInBinary() &&
+            ClassifyRxfilename(rxfilename) == kFileInput) {
+          impl_ = new RandomAccessTableReaderMmapArchiveImpl<Holder>();
+          break;
+        }
+        KALDI_WARN << "Ignoring the mmap option, which needs binary objects "
+                   << "in a local file: rspecifier is " << rspecifier;
+      }
       if (opts.sorted) {
         if (opts.called_sorted) // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
@@ -181,6 +181,15 @@ void UnitTestClassifyRspecifier() {
     KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo|");
   }
 
+  {
+    std::string a = "s,mmap,ark:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo" && opts.mmap &&
+                 opts.sorted);
+  }
+
 
   {
     std::string a = "b,ark:foo|";  // b, is ignored.
@@ -773,6 +782,7 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
   else if (Rand()%2 == 0) name += "ncs,";
   if (once) name += "o,";
   else if (Rand()%2 == 0) name += "no,";
+  if (!read_scp && Rand()%2 == 0) name += "mmap,";
   name += std::string(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
 
   RandomAccessDoubleReader sbr(name);
@@ -804,6 +814,7 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
       }
     }
   }
+  unlink("tmpf.idx");
 }
 
 
@@ -846,6 +857,7 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
   else if (Rand()%2 == 0) name += "ncs,";
   if (once) name += "o,";
   else if (Rand()%2 == 0) name += "no,";
+  if (!read_scp && Rand()%2 == 0) name += "mmap,";
   name += std::string(read_scp ? "scp:tmpf.scp" : "ark:tmpf");
   
   RandomAccessDoubleMatrixReader sbr(name);
@@ -879,9 +891,46 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
   }
   unlink("tmpf");
   unlink("tmpf.scp");
+  unlink("tmpf.idx");
 }
 
 
+// The "mmap" option: the index is written by the first reader and reused
+// by the second.
+void UnitTestTableRandomMmap() {
+  int32 sz = 1 + Rand() % 20;
+  std::vector<std::string> k;
+  std::vector<Vector<BaseFloat> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "utt" << (Rand() % 1000) << '_' << i;
+    k.push_back(os.str());
+    v[i].Resize(Rand() % 10);
+    v[i].SetRandn();
+  }
+  unlink("tmpf.idx");
+  {
+    BaseFloatVectorWriter bw("ark:tmpf");
+    for (int32 i = 0; i < sz; i++)
+      bw.Write(k[i], v[i]);
+  }
+  for (int32 pass = 0; pass < 2; pass++) {
+    RandomAccessBaseFloatVectorReader reader("mmap,ark:tmpf");
+    KALDI_ASSERT(!reader.HasKey("utt_missing"));
+    for (int32 n = 0; n < 2 * sz; n++) {
+      int32 i = Rand() % sz;
+      KALDI_ASSERT(reader.HasKey(k[i]));
+      const Vector<BaseFloat> &value = reader.Value(k[i]);
+      KALDI_ASSERT(value.Dim() == v[i].Dim() && value.ApproxEqual(v[i], 1.0e-06));
+    }
+    KALDI_ASSERT(reader.Close());
+    std::ifstream is("tmpf.idx");
+    KALDI_ASSERT(is.good());  // written by the first pass.
+  }
+  unlink("tmpf");
+  unlink("tmpf.idx");
+}
+
 
 }  // end namespace kaldi.
 
@@ -890,6 +939,7 @@ int main() {
   UnitTestReadScriptFile();
   UnitTestClassifyWspecifier();
   UnitTestClassifyRspecifier();
+  UnitTestTableRandomMmap();
   for (int i = 0; i < 10; i++) {
     bool b = (i == 0);
     UnitTestTableSequentialBool(b);
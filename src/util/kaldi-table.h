@@ -176,6 +176,11 @@ bool WriteScriptFile(std::ostream &os,
 //       We allow the negation of the options above, as in no, ns, np,
 //       but these aren't currently very useful (just equivalent to omitting the
 //       corresponding option).
+//   mmap  means that an archive on a local file is memory-mapped and accessed
+//       through an index of the keys (built on first use and cached in
+//       "<archive>.idx"), so random access does not read through the archive.
+//       It applies to binary objects only, and is ignored (with a warning) for
+//       scp files, pipes and text objects.
 //      [any of the above options can be prefixed by n to negate them, e.g. no, ns,
 //       ncs, np; but these aren't currently useful as you could just omit the option].
 //
@@ -198,9 +203,10 @@ struct  RspecifierOptions {
   // For archive files it will suppress errors getting thrown if the archive
   
   // is corrupted and can't be read to the end.
+  bool mmap;  // memory-map the archive and index it (see "mmap" above).
 
   RspecifierOptions(): once(false), sorted(false),
-                       called_sorted(false), permissive(false) { }
+                       called_sorted(false), permissive(false), mmap(false) { }
 };
 
 enum RspecifierType  {
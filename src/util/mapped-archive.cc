@@ -0,0 +1,181 @@
+// util/mapped-archive.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/mapped-archive.h"
+
+namespace kaldi {
+
+bool MappedArchive::Open(const std::string &filename) {
+  Close();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    KALDI_WARN << "Failed to open " << filename << ": " << strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    KALDI_WARN << "Failed to stat " << filename << ": " << strerror(errno);
+    close(fd);
+    return false;
+  }
+  filename_ = filename;
+  size_ = st.st_size;
+  mtime_ = static_cast<int64>(st.st_mtime) * 1000000000;
+#ifdef __linux__
+  mtime_ += st.st_mtim.tv_nsec;  // (rewrites within a second are common)
+#endif
+  if (size_ == 0) {  // mmap() refuses empty files; an empty archive is valid.
+    close(fd);
+    data_ = const_cast<char*>("");
+    return true;
+  }
+  void *data = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);  // (the mapping keeps the file)
+  if (data == MAP_FAILED) {
+    KALDI_WARN << "Failed to mmap " << filename << ": " << strerror(errno);
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  return true;
+}
+
+void MappedArchive::Close() {
+  if (data_ != NULL && size_ > 0)
+    munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+  index_.clear();
+}
+
+bool MappedArchive::ReadIndex() {
+  KALDI_ASSERT(IsOpen());
+  std::ifstream is(IndexFilename().c_str(), std::ios::binary);
+  if (!is.good()) return false;
+  index_.clear();
+  try {
+    bool binary = true;
+    ExpectToken(is, binary, "<ArchiveIndex>");
+    uint64 size;
+    int64 mtime;
+    int32 num_entries;
+    ReadBasicType(is, binary, &size);
+    ReadBasicType(is, binary, &mtime);
+    if (size != size_ || mtime != mtime_) {
+      KALDI_VLOG(1) << "Ignoring the index " << IndexFilename()
+                    << ", the archive was modified.";
+      return false;
+    }
+    ReadBasicType(is, binary, &num_entries);
+    index_.resize(num_entries);
+    for (int32 i = 0; i < num_entries; i++) {
+      ReadToken(is, binary, &index_[i].key);
+      ReadBasicType(is, binary, &index_[i].begin);
+      ReadBasicType(is, binary, &index_[i].end);
+      if (index_[i].end > size_ || index_[i].begin > index_[i].end ||
+          (i > 0 && !(index_[i - 1] < index_[i])))
+        KALDI_ERR << "invalid entry " << index_[i].key;
+    }
+    ExpectToken(is, binary, "</ArchiveIndex>");
+  } catch (const std::exception &) {
+    KALDI_WARN << "Ignoring the corrupted index " << IndexFilename();
+    index_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool MappedArchive::WriteIndex() const {
+  std::ostringstream tmp;
+  tmp << IndexFilename() << ".tmp." << getpid();
+  std::string tmp_filename = tmp.str();
+  {
+    std::ofstream os(tmp_filename.c_str(), std::ios::binary);
+    if (!os.good()) return false;
+    bool binary = true;
+    WriteToken(os, binary, "<ArchiveIndex>");
+    WriteBasicType(os, binary, static_cast<uint64>(size_));
+    WriteBasicType(os, binary, mtime_);
+    WriteBasicType(os, binary, static_cast<int32>(index_.size()));
+    for (size_t i = 0; i < index_.size(); i++) {
+      WriteToken(os, binary, index_[i].key);
+      WriteBasicType(os, binary, index_[i].begin);
+      WriteBasicType(os, binary, index_[i].end);
+    }
+    WriteToken(os, binary, "</ArchiveIndex>");
+    if (!os.good()) {
+      os.close();
+      unlink(tmp_filename.c_str());
+      return false;
+    }
+  }
+  if (rename(tmp_filename.c_str(), IndexFilename().c_str()) != 0) {
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+void MappedArchive::AddEntry(const std::string &key, size_t begin, size_t end) {
+  KALDI_ASSERT(begin <= end && end <= size_);
+  index_.resize(index_.size() + 1);
+  index_.back().key = key;
+  index_.back().begin = begin;
+  index_.back().end = end;
+}
+
+bool MappedArchive::SortIndex(std::string *duplicate) {
+  std::stable_sort(index_.begin(), index_.end());
+  for (size_t i = 1; i < index_.size(); i++) {
+    if (index_[i].key == index_[i - 1].key) {
+      *duplicate = index_[i].key;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MappedArchive::Find(const std::string &key, size_t *begin,
+                         size_t *end) const {
+  Entry entry;
+  entry.key = key;
+  std::vector<Entry>::const_iterator iter =
+      std::lower_bound(index_.begin(), index_.end(), entry);
+  if (iter == index_.end() || iter->key != key) return false;
+  // the entry starts just after the key in the archive, unless the index is
+  // stale (e.g. the archive was rewritten within the same second),
+  if (iter->begin < key.size() ||
+      memcmp(data_ + iter->begin - key.size(), key.c_str(), key.size()) != 0)
+    KALDI_ERR << "The index " << IndexFilename() << " does not match the "
+              << "archive (key " << key << "), please delete it.";
+  *begin = iter->begin;
+  *end = iter->end;
+  return true;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,119 @@
+// util/mapped-archive.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_MAPPED_ARCHIVE_H_
+#define KALDI_UTIL_MAPPED_ARCHIVE_H_
+
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// A read-only std::streambuf on a block of memory (e.g. a part of a
+/// memory-mapped file), so the Holder classes can read objects from it
+/// with no system calls and no copy into a stream buffer.
+class MemoryStreambuf: public std::streambuf {
+ public:
+  MemoryStreambuf(const char *data, size_t size) {
+    char *begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+
+ protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which = std::ios_base::in) {
+    char *pos = (dir == std::ios_base::beg ? eback() :
+                 (dir == std::ios_base::cur ? gptr() : egptr())) + off;
+    if (pos < eback() || pos > egptr())
+      return pos_type(off_type(-1));
+    setg(eback(), pos, egptr());
+    return pos_type(off_type(pos - eback()));
+  }
+  virtual pos_type seekpos(pos_type pos,
+                           std::ios_base::openmode which = std::ios_base::in) {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+
+
+/// A binary archive on a local file, memory-mapped, with an index of the
+/// objects sorted by key, used by the "mmap" rspecifier option (see
+/// RandomAccessTableReaderMmapArchiveImpl in kaldi-table-inl.h).  The index
+/// is built by the caller (which knows how to parse the objects) on the first
+/// use and cached in the file "<archive>.idx"; the cached index is reused if
+/// the size and the modification time of the archive did not change.
+class MappedArchive {
+ public:
+  MappedArchive(): data_(NULL), size_(0), mtime_(0) { }
+
+  /// Maps the file; returns false (with a warning) on failure.
+  bool Open(const std::string &filename);
+
+  void Close();
+
+  bool IsOpen() const { return data_ != NULL; }
+
+  const char *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+  /// Reads the index from "<archive>.idx", returns false if there is no
+  /// index or it is not the index of this archive.
+  bool ReadIndex();
+
+  /// Writes the index to "<archive>.idx" (through a temporary file and a
+  /// rename, so concurrent jobs don't see a partial index).  Returns false
+  /// on failure, e.g. if the directory is not writable.
+  bool WriteIndex() const;
+
+  /// Adds the entry of 'key' at [begin, end) of the file, while building the
+  /// index; 'begin' is just after the key (the separator is not consumed).
+  void AddEntry(const std::string &key, size_t begin, size_t end);
+
+  /// Sorts the index after the AddEntry() calls; returns false and sets
+  /// 'duplicate' if a key appears twice.
+  bool SortIndex(std::string *duplicate);
+
+  /// Looks up 'key' (binary search); outputs the byte range of the object.
+  /// Dies if the file does not have the key at that place (stale index).
+  bool Find(const std::string &key, size_t *begin, size_t *end) const;
+
+  size_t NumEntries() const { return index_.size(); }
+
+  ~MappedArchive() { Close(); }
+
+ private:
+  struct Entry {
+    std::string key;
+    uint64 begin, end;
+    bool operator < (const Entry &other) const { return key < other.key; }
+  };
+  std::string IndexFilename() const { return filename_ + ".idx"; }
+
+  std::string filename_;
+  char *data_;
+  size_t size_;
+  int64 mtime_;  // modification time of the archive in ns, (for the index).
+  std::vector<Entry> index_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedArchive);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_MAPPED_ARCHIVE_H_